@@ -0,0 +1,41 @@
+#include <stdio.h>
+#include "aruvi_rt.h"
+
+/*
+ * Runtime shim for AOT-translated code. Deliberately small and plain C99
+ * so it builds with the same compiler as the generated code.
+ */
+
+jmp_buf aruvi_exit_point;
+int32_t aruvi_exit_value;
+
+int32_t aruvi_idiv(int32_t a, int32_t b) {
+    if (b == 0) {
+        aruvi_fail("Division by zero!");
+    }
+    if (b == -1) {
+        return ARUVI_INEG(a);       /* INT_MIN / -1 overflows in C */
+    }
+    return a / b;
+}
+
+int32_t aruvi_irem(int32_t a, int32_t b) {
+    if (b == 0) {
+        aruvi_fail("Division by zero!");
+    }
+    if (b == -1) {
+        return 0;
+    }
+    return a % b;
+}
+
+void aruvi_halt(void) {
+    aruvi_exit_value = 0;
+    longjmp(aruvi_exit_point, 1);
+}
+
+void aruvi_fail(const char* message) {
+    printf("%s\n", message);
+    aruvi_exit_value = -1;
+    longjmp(aruvi_exit_point, 1);
+}
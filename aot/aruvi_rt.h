@@ -0,0 +1,46 @@
+#ifndef ARUVI_RT_H
+#define ARUVI_RT_H
+
+/*
+ * Runtime shim for C code generated by the AruviJVM AOT translator
+ * (src/aot.c). Generated functions include this header and link against
+ * aruvi_rt.c; nothing here depends on the interpreter.
+ */
+#include <stdint.h>
+#include <setjmp.h>
+
+/* Java int arithmetic wraps on overflow, which signed C arithmetic doesn't */
+#define ARUVI_IADD(a, b) ((int32_t)((uint32_t)(a) + (uint32_t)(b)))
+#define ARUVI_ISUB(a, b) ((int32_t)((uint32_t)(a) - (uint32_t)(b)))
+#define ARUVI_IMUL(a, b) ((int32_t)((uint32_t)(a) * (uint32_t)(b)))
+#define ARUVI_INEG(a)    ((int32_t)(0u - (uint32_t)(a)))
+
+/* Shifts use the low five bits of the count, as in Java */
+#define ARUVI_ISHL(a, b)  ((int32_t)((uint32_t)(a) << ((b) & 0x1f)))
+#define ARUVI_ISHR(a, b)  ((int32_t)(a) >> ((b) & 0x1f))
+#define ARUVI_IUSHR(a, b) ((int32_t)((uint32_t)(a) >> ((b) & 0x1f)))
+
+/* Division and remainder; division by zero is reported through aruvi_fail() */
+int32_t aruvi_idiv(int32_t a, int32_t b);
+int32_t aruvi_irem(int32_t a, int32_t b);
+
+/* Leave the running program: halt returns 0, fail prints and returns -1 */
+void aruvi_halt(void);
+void aruvi_fail(const char* message);
+
+extern jmp_buf aruvi_exit_point;
+extern int32_t aruvi_exit_value;
+
+/* Call a generated function and store its result, or the halt/error value
+ * if it left through aruvi_halt() or aruvi_fail(); this matches what
+ * jvm_execute() returns in the same situations. */
+#define ARUVI_RUN(result, call)                                 \
+    do {                                                        \
+        if (setjmp(aruvi_exit_point) == 0) {                    \
+            (result) = (call);                                  \
+        } else {                                                \
+            (result) = aruvi_exit_value;                        \
+        }                                                       \
+    } while (0)
+
+#endif
@@ -0,0 +1,1201 @@
+/*
+ * AruviJVM benchmark suite
+ *
+ * Runs a set of workloads written in bytecode, each a static method of
+ * class Bench (or of the Recursion test class, for the call-heavy ones),
+ * with untimed warmup runs followed by timed repetitions. For every
+ * workload it reports the median time per bytecode, the bytecode rate and
+ * the peak heap the run needed, and checks the result. The test_* rows
+ * run the interpreter's own small test programs as top-level code, many
+ * times per repetition since one run is too short to time, and show the
+ * dispatch cost of very short programs. The Makefile builds
+ * this file once per dispatch mode and once more with the JIT, so
+ * `make bench` prints them side by side.
+ *
+ *   bench [--results <file>] [--baseline <file>] [--threshold <percent>]
+ *         [--reps <n>]
+ *   bench --compare <file> --baseline <file> [--threshold <percent>]
+ *
+ * --results appends one CSV row per workload to file. --baseline reads
+ * such a file from an earlier run and flags every workload of the same
+ * dispatch mode that got more than the threshold (default 10%) slower, or
+ * whose result changed; the exit status is then 1. Slowdowns compare the
+ * fastest repetitions, which are far less noisy than the medians, and a
+ * file holding several runs of a workload counts its fastest one.
+ * --compare runs nothing: it checks a results file against the baseline
+ * the same way, for every dispatch mode in it. make bench uses it after
+ * alternating runs of two builds on one host, which cancels out most of
+ * the drift between runs that lie minutes apart.
+ *
+ * Built with -DJVM_STACK_TRAFFIC (make bench-traffic), it also reports the
+ * operand stack slots the interpreter loaded and stored per bytecode, the
+ * memory traffic that top-of-stack caching saves.
+ *
+ * Last, it times a short program run start to finish on a new JVM and on
+ * one checked out of a JVMPool, which is the instance set-up cost a host
+ * running many small programs saves, times starting a program of many
+ * methods from a container file and from a startup snapshot, times the
+ * recursive fib with and without the sampling profiler, and runs
+ * SCALING_THREADS green
+ * threads on 1, 2, 4, ... worker OS threads up to one per core, once
+ * computing and once allocating, to show how the M:N scheduler scales.
+ */
+#define _XOPEN_SOURCE 600
+
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+#include "jvm.h"
+#include "bytecode_loader.h"
+#include "test_programs.h"
+
+#define WARMUP_RUNS 2
+#define DEFAULT_REPS 5
+#define MAX_REPS 100
+#define MAX_BASELINE 512
+#define TEST_PROGRAM_RUNS 10000
+
+/* static int nested(int n): count++ n * n times */
+static uint8_t bench_nested[] = {
+    OP_ICONST_0,                /* 0: count = 0 */
+    OP_ISTORE_1,
+    OP_ICONST_0,                /* 2: i = 0 */
+    OP_ISTORE_2,
+    OP_ILOAD_2,                 /* 4: while (i < n) { */
+    OP_ILOAD_0,
+    OP_IF_ICMPGE, 0, 28,
+    OP_ICONST_0,                /* 9: j = 0 */
+    OP_ISTORE_3,
+    OP_ILOAD_3,                 /* 11: while (j < n) { */
+    OP_ILOAD_0,
+    OP_IF_ICMPGE, 0, 14,
+    OP_ILOAD_1,                 /* 16: count++ */
+    OP_ICONST_1,
+    OP_IADD,
+    OP_ISTORE_1,
+    OP_ILOAD_3,                 /* 20: j++ } */
+    OP_ICONST_1,
+    OP_IADD,
+    OP_ISTORE_3,
+    OP_GOTO, 0xff, 0xf3,
+    OP_ILOAD_2,                 /* 27: i++ } */
+    OP_ICONST_1,
+    OP_IADD,
+    OP_ISTORE_2,
+    OP_GOTO, 0xff, 0xe5,
+    OP_ILOAD_1,                 /* 34: return count */
+    OP_IRETURN
+};
+
+/* static int sieve(int n, int times): sieve of Eratosthenes over a new
+ * int[n] each time; the number of primes below n */
+static uint8_t bench_sieve[] = {
+    OP_ICONST_0,                /* 0: count = 0 */
+    OP_ISTORE_3,
+    OP_ICONST_0,                /* 2: t = 0 */
+    OP_ISTORE_2,
+    OP_ILOAD_2,                 /* 4: while (t < times) { */
+    OP_ILOAD_1,
+    OP_IF_ICMPGE, 0, 77,
+    OP_ILOAD_0,                 /* 9: composite = new int[n] */
+    OP_NEWARRAY, 10,
+    OP_ASTORE, 4,
+    OP_ICONST_0,                /* 14: count = 0 */
+    OP_ISTORE_3,
+    OP_ICONST_2,                /* 16: i = 2 */
+    OP_ISTORE, 5,
+    OP_ILOAD, 5,                /* 19: while (i < n) { */
+    OP_ILOAD_0,
+    OP_IF_ICMPGE, 0, 54,
+    OP_ALOAD, 4,                /* 25: if (composite[i] == 0) { */
+    OP_ILOAD, 5,
+    OP_IALOAD,
+    OP_ICONST_0,
+    OP_IF_ICMPNE, 0, 36,
+    OP_ILOAD_3,                 /* 34: count++ */
+    OP_ICONST_1,
+    OP_IADD,
+    OP_ISTORE_3,
+    OP_ILOAD, 5,                /* 38: j = i + i */
+    OP_ILOAD, 5,
+    OP_IADD,
+    OP_ISTORE, 6,
+    OP_ILOAD, 6,                /* 45: while (j < n) { */
+    OP_ILOAD_0,
+    OP_IF_ICMPGE, 0, 19,
+    OP_ALOAD, 4,                /* 51: composite[j] = 1 */
+    OP_ILOAD, 6,
+    OP_ICONST_1,
+    OP_IASTORE,
+    OP_ILOAD, 6,                /* 57: j += i } } */
+    OP_ILOAD, 5,
+    OP_IADD,
+    OP_ISTORE, 6,
+    OP_GOTO, 0xff, 0xed,
+    OP_ILOAD, 5,                /* 67: i++ } */
+    OP_ICONST_1,
+    OP_IADD,
+    OP_ISTORE, 5,
+    OP_GOTO, 0xff, 0xca,
+    OP_ILOAD_2,                 /* 76: t++ } */
+    OP_ICONST_1,
+    OP_IADD,
+    OP_ISTORE_2,
+    OP_GOTO, 0xff, 0xb4,
+    OP_ILOAD_3,                 /* 83: return count */
+    OP_IRETURN
+};
+
+/* static int bubble(int n): bubble sort of a[i] = i * 7919 % 1000; the
+ * number of elements in order, n once sorted */
+static uint8_t bench_bubble[] = {
+    OP_ILOAD_0,                 /* 0: a = new int[n] */
+    OP_NEWARRAY, 10,
+    OP_ASTORE_1,
+    OP_ICONST_0,                /* 4: i = 0 */
+    OP_ISTORE_2,
+    OP_ILOAD_2,                 /* 6: while (i < n) { */
+    OP_ILOAD_0,
+    OP_IF_ICMPGE, 0, 22,
+    OP_ALOAD_1,                 /* 11: a[i] = i * 7919 % 1000 */
+    OP_ILOAD_2,
+    OP_ILOAD_2,
+    OP_SIPUSH, 0x1e, 0xef,
+    OP_IMUL,
+    OP_SIPUSH, 0x03, 0xe8,
+    OP_IREM,
+    OP_IASTORE,
+    OP_ILOAD_2,                 /* 23: i++ } */
+    OP_ICONST_1,
+    OP_IADD,
+    OP_ISTORE_2,
+    OP_GOTO, 0xff, 0xeb,
+    OP_ICONST_0,                /* 30: i = 0 */
+    OP_ISTORE_2,
+    OP_ILOAD_2,                 /* 32: while (i < n - 1) { */
+    OP_ILOAD_0,
+    OP_ICONST_1,
+    OP_ISUB,
+    OP_IF_ICMPGE, 0, 59,
+    OP_ICONST_0,                /* 39: j = 0 */
+    OP_ISTORE_3,
+    OP_ILOAD_3,                 /* 41: while (j < n - 1 - i) { */
+    OP_ILOAD_0,
+    OP_ICONST_1,
+    OP_ISUB,
+    OP_ILOAD_2,
+    OP_ISUB,
+    OP_IF_ICMPGE, 0, 41,
+    OP_ALOAD_1,                 /* 50: if (a[j] > a[j + 1]) { */
+    OP_ILOAD_3,
+    OP_IALOAD,
+    OP_ALOAD_1,
+    OP_ILOAD_3,
+    OP_ICONST_1,
+    OP_IADD,
+    OP_IALOAD,
+    OP_IF_ICMPLE, 0, 23,
+    OP_ALOAD_1,                 /* 61: t = a[j] */
+    OP_ILOAD_3,
+    OP_IALOAD,
+    OP_ISTORE, 4,
+    OP_ALOAD_1,                 /* 66: a[j] = a[j + 1] */
+    OP_ILOAD_3,
+    OP_ALOAD_1,
+    OP_ILOAD_3,
+    OP_ICONST_1,
+    OP_IADD,
+    OP_IALOAD,
+    OP_IASTORE,
+    OP_ALOAD_1,                 /* 74: a[j + 1] = t } */
+    OP_ILOAD_3,
+    OP_ICONST_1,
+    OP_IADD,
+    OP_ILOAD, 4,
+    OP_IASTORE,
+    OP_ILOAD_3,                 /* 81: j++ } */
+    OP_ICONST_1,
+    OP_IADD,
+    OP_ISTORE_3,
+    OP_GOTO, 0xff, 0xd4,
+    OP_ILOAD_2,                 /* 88: i++ } */
+    OP_ICONST_1,
+    OP_IADD,
+    OP_ISTORE_2,
+    OP_GOTO, 0xff, 0xc4,
+    OP_ICONST_1,                /* 95: ordered = 1 */
+    OP_ISTORE, 5,
+    OP_ICONST_1,                /* 98: i = 1 */
+    OP_ISTORE_2,
+    OP_ILOAD_2,                 /* 100: while (i < n) { */
+    OP_ILOAD_0,
+    OP_IF_ICMPGE, 0, 27,
+    OP_ALOAD_1,                 /* 105: if (a[i - 1] <= a[i]) ordered++ */
+    OP_ILOAD_2,
+    OP_ICONST_1,
+    OP_ISUB,
+    OP_IALOAD,
+    OP_ALOAD_1,
+    OP_ILOAD_2,
+    OP_IALOAD,
+    OP_IF_ICMPGT, 0, 9,
+    OP_ILOAD, 5,
+    OP_ICONST_1,
+    OP_IADD,
+    OP_ISTORE, 5,
+    OP_ILOAD_2,                 /* 122: i++ } */
+    OP_ICONST_1,
+    OP_IADD,
+    OP_ISTORE_2,
+    OP_GOTO, 0xff, 0xe6,
+    OP_ILOAD, 5,                /* 129: return ordered */
+    OP_IRETURN
+};
+
+/* static int fibIter(int n, int times): fib(n), computed times times */
+static uint8_t bench_fib_iter[] = {
+    OP_ICONST_0,                /* 0: a = 0 */
+    OP_ISTORE_3,
+    OP_ICONST_0,                /* 2: t = 0 */
+    OP_ISTORE_2,
+    OP_ILOAD_2,                 /* 4: while (t < times) { */
+    OP_ILOAD_1,
+    OP_IF_ICMPGE, 0, 46,
+    OP_ICONST_0,                /* 9: a = 0 */
+    OP_ISTORE_3,
+    OP_ICONST_1,                /* 11: b = 1 */
+    OP_ISTORE, 4,
+    OP_ICONST_0,                /* 14: i = 0 */
+    OP_ISTORE, 6,
+    OP_ILOAD, 6,                /* 17: while (i < n) { */
+    OP_ILOAD_0,
+    OP_IF_ICMPGE, 0, 25,
+    OP_ILOAD_3,                 /* 23: c = a + b */
+    OP_ILOAD, 4,
+    OP_IADD,
+    OP_ISTORE, 5,
+    OP_ILOAD, 4,                /* 29: a = b */
+    OP_ISTORE_3,
+    OP_ILOAD, 5,                /* 32: b = c */
+    OP_ISTORE, 4,
+    OP_ILOAD, 6,                /* 36: i++ } */
+    OP_ICONST_1,
+    OP_IADD,
+    OP_ISTORE, 6,
+    OP_GOTO, 0xff, 0xe7,
+    OP_ILOAD_2,                 /* 45: t++ } */
+    OP_ICONST_1,
+    OP_IADD,
+    OP_ISTORE_2,
+    OP_GOTO, 0xff, 0xd3,
+    OP_ILOAD_3,                 /* 52: return a */
+    OP_IRETURN
+};
+
+/* static int gcd(int n): sum of gcd(i, j) for 1 <= i, j <= n, by Euclid */
+static uint8_t bench_gcd[] = {
+    OP_ICONST_0,                /* 0: sum = 0 */
+    OP_ISTORE_1,
+    OP_ICONST_1,                /* 2: i = 1 */
+    OP_ISTORE_2,
+    OP_ILOAD_2,                 /* 4: while (i <= n) { */
+    OP_ILOAD_0,
+    OP_IF_ICMPGT, 0, 59,
+    OP_ICONST_1,                /* 9: j = 1 */
+    OP_ISTORE_3,
+    OP_ILOAD_3,                 /* 11: while (j <= n) { */
+    OP_ILOAD_0,
+    OP_IF_ICMPGT, 0, 45,
+    OP_ILOAD_2,                 /* 16: a = i */
+    OP_ISTORE, 4,
+    OP_ILOAD_3,                 /* 19: b = j */
+    OP_ISTORE, 5,
+    OP_ILOAD, 5,                /* 22: while (b != 0) { */
+    OP_ICONST_0,
+    OP_IF_ICMPEQ, 0, 21,
+    OP_ILOAD, 4,                /* 28: t = a % b */
+    OP_ILOAD, 5,
+    OP_IREM,
+    OP_ISTORE, 6,
+    OP_ILOAD, 5,                /* 35: a = b */
+    OP_ISTORE, 4,
+    OP_ILOAD, 6,                /* 39: b = t } */
+    OP_ISTORE, 5,
+    OP_GOTO, 0xff, 0xeb,
+    OP_ILOAD_1,                 /* 46: sum += a */
+    OP_ILOAD, 4,
+    OP_IADD,
+    OP_ISTORE_1,
+    OP_ILOAD_3,                 /* 51: j++ } */
+    OP_ICONST_1,
+    OP_IADD,
+    OP_ISTORE_3,
+    OP_GOTO, 0xff, 0xd4,
+    OP_ILOAD_2,                 /* 58: i++ } */
+    OP_ICONST_1,
+    OP_IADD,
+    OP_ISTORE_2,
+    OP_GOTO, 0xff, 0xc6,
+    OP_ILOAD_1,                 /* 65: return sum */
+    OP_IRETURN
+};
+
+/* static int primes(int n): primes below n, by trial division */
+static uint8_t bench_primes[] = {
+    OP_ICONST_0,                /* 0: count = 0 */
+    OP_ISTORE_1,
+    OP_ICONST_2,                /* 2: i = 2 */
+    OP_ISTORE_2,
+    OP_ILOAD_2,                 /* 4: while (i < n) { */
+    OP_ILOAD_0,
+    OP_IF_ICMPGE, 0, 37,
+    OP_ICONST_2,                /* 9: d = 2 */
+    OP_ISTORE_3,
+    OP_ILOAD_3,                 /* 11: while (d * d <= i) { */
+    OP_ILOAD_3,
+    OP_IMUL,
+    OP_ILOAD_2,
+    OP_IF_ICMPGT, 0, 17,
+    OP_ILOAD_2,                 /* 18: if (i % d == 0) goto next */
+    OP_ILOAD_3,
+    OP_IREM,
+    OP_ICONST_0,
+    OP_IF_ICMPEQ, 0, 14,
+    OP_ILOAD_3,                 /* 25: d++ } */
+    OP_ICONST_1,
+    OP_IADD,
+    OP_ISTORE_3,
+    OP_GOTO, 0xff, 0xee,
+    OP_ILOAD_1,                 /* 32: count++ */
+    OP_ICONST_1,
+    OP_IADD,
+    OP_ISTORE_1,
+    OP_ILOAD_2,                 /* 36: next: i++ } */
+    OP_ICONST_1,
+    OP_IADD,
+    OP_ISTORE_2,
+    OP_GOTO, 0xff, 0xdc,
+    OP_ILOAD_1,                 /* 43: return count */
+    OP_IRETURN
+};
+
+/* static int collatz(int n): total Collatz steps to 1 from 1..n */
+static uint8_t bench_collatz[] = {
+    OP_ICONST_0,                /* 0: steps = 0 */
+    OP_ISTORE_1,
+    OP_ICONST_1,                /* 2: i = 1 */
+    OP_ISTORE_2,
+    OP_ILOAD_2,                 /* 4: while (i <= n) { */
+    OP_ILOAD_0,
+    OP_IF_ICMPGT, 0, 44,
+    OP_ILOAD_2,                 /* 9: x = i */
+    OP_ISTORE_3,
+    OP_ILOAD_3,                 /* 11: while (x != 1) { */
+    OP_ICONST_1,
+    OP_IF_ICMPEQ, 0, 30,
+    OP_ILOAD_3,                 /* 16: if (x % 2 == 0) */
+    OP_ICONST_2,
+    OP_IREM,
+    OP_ICONST_0,
+    OP_IF_ICMPNE, 0, 10,
+    OP_ILOAD_3,                 /* 23: x = x / 2 */
+    OP_ICONST_2,
+    OP_IDIV,
+    OP_ISTORE_3,
+    OP_GOTO, 0, 9,
+    OP_ICONST_3,                /* 30: else x = 3 * x + 1 */
+    OP_ILOAD_3,
+    OP_IMUL,
+    OP_ICONST_1,
+    OP_IADD,
+    OP_ISTORE_3,
+    OP_ILOAD_1,                 /* 36: steps++ } */
+    OP_ICONST_1,
+    OP_IADD,
+    OP_ISTORE_1,
+    OP_GOTO, 0xff, 0xe3,
+    OP_ILOAD_2,                 /* 43: i++ } */
+    OP_ICONST_1,
+    OP_IADD,
+    OP_ISTORE_2,
+    OP_GOTO, 0xff, 0xd5,
+    OP_ILOAD_1,                 /* 50: return steps */
+    OP_IRETURN
+};
+
+
+/* Build class Bench with the workloads as its static methods */
+static Class* bench_class(void) {
+    Class* cls = class_create("Bench");
+    if (!cls) {
+        return NULL;
+    }
+    if (!class_add_method(cls, "nested", "(I)I", bench_nested, sizeof(bench_nested)) ||
+        !class_add_method(cls, "sieve", "(II)I", bench_sieve, sizeof(bench_sieve)) ||
+        !class_add_method(cls, "bubble", "(I)I", bench_bubble, sizeof(bench_bubble)) ||
+        !class_add_method(cls, "fibIter", "(II)I", bench_fib_iter, sizeof(bench_fib_iter)) ||
+        !class_add_method(cls, "gcd", "(I)I", bench_gcd, sizeof(bench_gcd)) ||
+        !class_add_method(cls, "primes", "(I)I", bench_primes, sizeof(bench_primes)) ||
+        !class_add_method(cls, "collatz", "(I)I", bench_collatz, sizeof(bench_collatz))) {
+        class_destroy(cls);
+        return NULL;
+    }
+    return cls;
+}
+
+typedef struct {
+    const char* name;
+    int recursion;          /* A method of the Recursion class, not Bench */
+    const char* method;
+    int args[2];
+    int arg_count;
+    int expected;
+    uint8_t* code;          /* Top-level code to run instead of a method */
+    int length;
+    int runs;               /* Runs per timed repetition; 0 is 1 */
+} Workload;
+
+/* What one workload measured */
+typedef struct {
+    int reps;
+    uint64_t bytecodes;     /* Per run */
+    uint64_t calls;         /* Per run */
+    double ns_per_bytecode; /* Median run */
+    double best_ns_per_bytecode;    /* Fastest run, compared with the baseline */
+    double bytecodes_per_sec;
+    int peak_heap;          /* Bytes */
+    int result;
+#ifdef JVM_STACK_TRAFFIC
+    double loads_per_bytecode;
+    double stores_per_bytecode;
+#endif
+} Measurement;
+
+/* A row of an earlier results file */
+typedef struct {
+    char mode[32];
+    char name[64];
+    double best_ns_per_bytecode;
+    int result;
+} BaselineRow;
+
+#ifdef JVM_TOS_CACHE
+#define TOS_LABEL ", top of stack cached"
+#else
+#define TOS_LABEL ""
+#endif
+
+static const char* dispatch_mode(void) {
+#if defined(JVM_JIT)
+    return "threaded+jit";
+#elif defined(JVM_THREADED_DISPATCH)
+    return "threaded";
+#else
+    return "switch";
+#endif
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+static int run_once(JVM* jvm, Method* method, const Workload* w) {
+    jvm->sp = 0;
+    for (int i = 0; i < w->arg_count; i++) {
+        Value v = {w->args[i]};
+        jvm_push(jvm, v);
+    }
+    return jvm_execute_method(jvm, method);
+}
+
+/* Warm up, then time reps repetitions of a workload on a fresh JVM */
+static int measure(Method* method, const Workload* w, int reps, Measurement* m) {
+    double times[MAX_REPS];
+    int runs = w->runs > 0 ? w->runs : 1;
+    JVM* jvm = jvm_create();
+    uint64_t start_count, start_calls;
+#ifdef JVM_STACK_TRAFFIC
+    uint64_t start_loads, start_stores;
+#endif
+
+    if (!jvm) {
+        printf("Failed to create JVM\n");
+        return -1;
+    }
+    jvm_set_verbose(jvm, 0);
+
+    for (int i = 0; i < WARMUP_RUNS; i++) {
+        run_once(jvm, method, w);
+    }
+    start_count = jvm->instructions;
+    start_calls = jvm->calls;
+#ifdef JVM_STACK_TRAFFIC
+    start_loads = jvm->stack_loads;
+    start_stores = jvm->stack_stores;
+#endif
+    for (int i = 0; i < reps; i++) {
+        double start = now_ns();
+        for (int j = 0; j < runs; j++) {
+            m->result = run_once(jvm, method, w);
+        }
+        times[i] = (now_ns() - start) / runs;
+    }
+    qsort(times, reps, sizeof(double), compare_doubles);
+
+    m->reps = reps;
+    m->bytecodes = (jvm->instructions - start_count) / ((uint64_t)reps * (uint64_t)runs);
+    m->calls = (jvm->calls - start_calls) / ((uint64_t)reps * (uint64_t)runs);
+    m->ns_per_bytecode = m->bytecodes ? times[reps / 2] / (double)m->bytecodes : 0.0;
+    m->best_ns_per_bytecode = m->bytecodes ? times[0] / (double)m->bytecodes : 0.0;
+    m->bytecodes_per_sec = times[reps / 2] > 0 ? (double)m->bytecodes / times[reps / 2] * 1e9 : 0.0;
+    m->peak_heap = jvm->heap_peak - HEAP_BASE;
+#ifdef JVM_STACK_TRAFFIC
+    m->loads_per_bytecode = (double)(jvm->stack_loads - start_loads) /
+                            (double)(jvm->instructions - start_count);
+    m->stores_per_bytecode = (double)(jvm->stack_stores - start_stores) /
+                             (double)(jvm->instructions - start_count);
+#endif
+    jvm_destroy(jvm);
+    return 0;
+}
+
+/*
+ * Time complete short executions of fib(n): a JVM from jvm_create() that
+ * jvm_destroy() frees afterwards, against one checked out of a pool and
+ * returned to it. Reports the median ns per execution of each.
+ */
+#define SETUP_RUNS 2001
+#define SETUP_FIB 5
+
+static int measure_setup(Method* fib, int n, double* fresh_ns, double* pooled_ns) {
+    static double times[SETUP_RUNS];
+    Workload w = {"setup", 1, "fib", {n}, 1, 0, NULL, 0, 0};
+    JVMPool* pool = jvm_pool_create(1);
+
+    if (!pool) {
+        printf("Failed to create JVM pool\n");
+        return -1;
+    }
+    for (int i = 0; i < SETUP_RUNS; i++) {
+        double start = now_ns();
+        JVM* jvm = jvm_create();
+        if (!jvm) {
+            jvm_pool_destroy(pool);
+            return -1;
+        }
+        jvm_set_verbose(jvm, 0);
+        run_once(jvm, fib, &w);
+        jvm_destroy(jvm);
+        times[i] = now_ns() - start;
+    }
+    qsort(times, SETUP_RUNS, sizeof(double), compare_doubles);
+    *fresh_ns = times[SETUP_RUNS / 2];
+
+    for (int i = 0; i < SETUP_RUNS; i++) {
+        double start = now_ns();
+        JVM* jvm = jvm_pool_acquire(pool);
+        if (!jvm) {
+            jvm_pool_destroy(pool);
+            return -1;
+        }
+        jvm_set_verbose(jvm, 0);
+        run_once(jvm, fib, &w);
+        jvm_pool_release(pool, jvm);
+        times[i] = now_ns() - start;
+    }
+    qsort(times, SETUP_RUNS, sizeof(double), compare_doubles);
+    *pooled_ns = times[SETUP_RUNS / 2];
+
+    jvm_pool_destroy(pool);
+    return 0;
+}
+
+#ifdef JVM_PROFILER
+/*
+ * Time fib(n) on one JVM, alternating runs without and with the sampling
+ * profiler at SAMPLING_HZ, which is the price of leaving it on. Reports
+ * the median ns of each and the samples taken; they are dropped unread.
+ */
+#define SAMPLING_RUNS 11
+#define SAMPLING_FIB 27
+#define SAMPLING_HZ 1000
+
+static int measure_sampling(Method* fib, int n, double* plain_ns, double* sampled_ns,
+                            uint64_t* samples) {
+    double plain[SAMPLING_RUNS], sampled[SAMPLING_RUNS];
+    Workload w = {"sampling", 1, "fib", {n}, 1, 0, NULL, 0, 0};
+    JVM* jvm = jvm_create();
+
+    if (!jvm) {
+        printf("Failed to create JVM\n");
+        return -1;
+    }
+    jvm_set_verbose(jvm, 0);
+    for (int i = 0; i < WARMUP_RUNS; i++) {
+        run_once(jvm, fib, &w);
+    }
+    for (int i = 0; i < SAMPLING_RUNS; i++) {
+        double start = now_ns();
+        run_once(jvm, fib, &w);
+        plain[i] = now_ns() - start;
+
+        if (jvm_set_sampling(jvm, SAMPLING_HZ) != 0) {
+            jvm_destroy(jvm);
+            return -1;
+        }
+        start = now_ns();
+        run_once(jvm, fib, &w);
+        sampled[i] = now_ns() - start;
+        *samples = jvm_sample_count(jvm);
+    }
+    jvm_set_sampling(jvm, 0);
+    jvm_destroy(jvm);
+
+    qsort(plain, SAMPLING_RUNS, sizeof(double), compare_doubles);
+    qsort(sampled, SAMPLING_RUNS, sizeof(double), compare_doubles);
+    *plain_ns = plain[SAMPLING_RUNS / 2];
+    *sampled_ns = sampled[SAMPLING_RUNS / 2];
+    return 0;
+}
+#endif
+
+/*
+ * Time starting test_startup_registry()'s program from a file until it
+ * has run once: from a container, whose classes are read and whose
+ * methods are loaded, decoded and verified as they are first called, and
+ * from a snapshot, mapped with all of that done. Both files are in the
+ * page cache after the first run. Reports the median ns of each and the
+ * file sizes.
+ */
+#define STARTUP_RUNS 21
+#define STARTUP_ARG 3
+
+static long file_size(const char* path) {
+    FILE* file = fopen(path, "rb");
+    long size = -1;
+    if (file) {
+        fseek(file, 0, SEEK_END);
+        size = ftell(file);
+        fclose(file);
+    }
+    return size;
+}
+
+/* Run m0 of every class; the sum of the results, or -1 */
+static int run_startup(JVM* jvm, ClassRegistry* registry) {
+    int sum = 0;
+
+    for (int c = 0; c < registry->count; c++) {
+        Method* m0 = class_find_method(registry->classes[c], "m0", "(I)I");
+        Value v = {STARTUP_ARG};
+        int result;
+        if (!m0 || method_prepare(m0) != 0) {
+            return -1;
+        }
+        jvm->sp = 0;
+        jvm_push(jvm, v);
+        result = jvm_execute_method(jvm, m0);
+        if (result < 0) {
+            return -1;
+        }
+        sum += result;
+    }
+    return sum;
+}
+
+/* Start from the container once: open it, load every class, run */
+static int start_from_container(JVM* jvm, const char* path) {
+    Container container;
+    ClassRegistry* registry;
+    int result = -1;
+
+    if (container_open(path, &container) != 0) {
+        return -1;
+    }
+    registry = class_registry_create();
+    for (int c = 0; registry && c < STARTUP_CLASSES; c++) {
+        char name[32];
+        Class* cls;
+        snprintf(name, sizeof(name), "Startup%d", c);
+        cls = container_load_class(&container, name);
+        if (!cls || class_registry_add(registry, cls) != 0) {
+            class_destroy(cls);
+            class_registry_destroy(registry);
+            registry = NULL;
+        }
+    }
+    if (registry) {
+        result = run_startup(jvm, registry);
+    }
+    class_registry_destroy(registry);
+    container_close(&container);
+    return result;
+}
+
+static int start_from_snapshot(JVM* jvm, const char* path) {
+    ClassRegistry* registry = snapshot_load(path);
+    int result = registry ? run_startup(jvm, registry) : -1;
+    class_registry_destroy(registry);
+    return result;
+}
+
+static int measure_startup(double* container_ns, double* snapshot_ns, long* container_bytes,
+                           long* snapshot_bytes) {
+    const char* container_path = "startup.aruvi";
+    const char* snapshot_path = "startup.snapshot";
+    double times[STARTUP_RUNS];
+    ClassRegistry* registry = test_startup_registry();
+    JVM* jvm = jvm_create();
+    int expected, status = -1;
+
+    if (!registry || !jvm) {
+        goto out;
+    }
+    jvm_set_verbose(jvm, 0);
+    expected = run_startup(jvm, registry);
+    if (expected < 0 || container_write(container_path, registry->classes, registry->count) != 0 ||
+        snapshot_write(snapshot_path, registry) != 0) {
+        goto out;
+    }
+    *container_bytes = file_size(container_path);
+    *snapshot_bytes = file_size(snapshot_path);
+
+    for (int i = 0; i < STARTUP_RUNS; i++) {
+        double start = now_ns();
+        if (start_from_container(jvm, container_path) != expected) {
+            printf("Wrong result starting from %s\n", container_path);
+            goto out;
+        }
+        times[i] = now_ns() - start;
+    }
+    qsort(times, STARTUP_RUNS, sizeof(double), compare_doubles);
+    *container_ns = times[STARTUP_RUNS / 2];
+
+    for (int i = 0; i < STARTUP_RUNS; i++) {
+        double start = now_ns();
+        if (start_from_snapshot(jvm, snapshot_path) != expected) {
+            printf("Wrong result starting from %s\n", snapshot_path);
+            goto out;
+        }
+        times[i] = now_ns() - start;
+    }
+    qsort(times, STARTUP_RUNS, sizeof(double), compare_doubles);
+    *snapshot_ns = times[STARTUP_RUNS / 2];
+    status = 0;
+
+out:
+    remove(container_path);
+    remove(snapshot_path);
+    if (jvm) jvm_destroy(jvm);
+    class_registry_destroy(registry);
+    return status;
+}
+
+#ifdef JVM_GREEN_THREADS
+/*
+ * Run SCALING_THREADS green threads of method(args) M:N on 1, 2, 4, ...
+ * workers, up to one per core, and print the wall time, bytecode rate and
+ * speedup over one worker of each. Every thread must return expected.
+ */
+#define SCALING_THREADS 16
+#define SCALING_BUDGET 10000
+
+/* Double the workers, ending at exactly one per core */
+static int next_worker_count(int workers, int cores) {
+    if (workers < cores && workers * 2 > cores) {
+        return cores;
+    }
+    return workers * 2;
+}
+
+static int measure_scaling(const char* name, Method* method, const int* args, int arg_count,
+                           int expected) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    double one_worker_ns = 0;
+
+    if (cores < 1) {
+        cores = 1;
+    }
+    if (cores > MAX_WORKERS) {
+        cores = MAX_WORKERS;
+    }
+    printf("%-10s %7s %10s %12s %8s %8s %12s\n", name, "workers", "ms", "Mbytecodes/s",
+           "speedup", "steals", "collections");
+    for (int workers = 1; workers <= cores; workers = next_worker_count(workers, (int)cores)) {
+        JVM* jvm = jvm_create();
+        Scheduler* scheduler = jvm ? scheduler_create(jvm, SCALING_BUDGET) : NULL;
+        int status = scheduler ? 0 : -1;
+        double wall_ns;
+
+        if (scheduler) {
+            jvm_set_verbose(jvm, 0);
+        }
+        for (int i = 0; i < SCALING_THREADS && status == 0; i++) {
+            if (!scheduler_spawn(scheduler, name, method, args, arg_count,
+                                 STACK_SIZE / SCALING_THREADS, MAX_FRAMES / SCALING_THREADS)) {
+                status = -1;
+            }
+        }
+        if (status == 0 && scheduler_run_parallel(scheduler, workers) != 0) {
+            status = -1;
+        }
+        for (int i = 0; i < SCALING_THREADS && status == 0; i++) {
+            if (scheduler->threads[i].result != expected) {
+                printf("%-10s thread %d returned %d, expected %d\n", name, i,
+                       scheduler->threads[i].result, expected);
+                status = -1;
+            }
+        }
+        if (status != 0) {
+            scheduler_destroy(scheduler);
+            jvm_destroy(jvm);
+            return -1;
+        }
+        wall_ns = (double)scheduler->wall_ns;
+        if (workers == 1) {
+            one_worker_ns = wall_ns;
+        }
+        printf("%-10s %7d %10.2f %12.1f %7.2fx %8llu %12llu\n", "", workers, wall_ns / 1e6,
+               (double)jvm->instructions / wall_ns * 1e3, one_worker_ns / wall_ns,
+               (unsigned long long)scheduler->steals, (unsigned long long)jvm->gc_count);
+        scheduler_destroy(scheduler);
+        jvm_destroy(jvm);
+    }
+    return 0;
+}
+#endif
+
+/* Read the rows of an earlier results file. Returns the row count, or -1
+ * if the file can't be opened. */
+static int load_baseline(const char* path, BaselineRow* rows, int max) {
+    FILE* in = fopen(path, "r");
+    char line[256];
+    int count = 0;
+
+    if (!in) {
+        return -1;
+    }
+    while (count < max && fgets(line, sizeof(line), in)) {
+        BaselineRow* row = &rows[count];
+        if (sscanf(line, "%31[^,],%63[^,],%*d,%*u,%*f,%lf,%*f,%*d,%d", row->mode, row->name,
+                   &row->best_ns_per_bytecode, &row->result) == 4) {
+            count++;
+        }
+    }
+    fclose(in);
+    return count;
+}
+
+/* The fastest baseline row for mode and workload, or NULL */
+static const BaselineRow* find_baseline(const BaselineRow* rows, int count, const char* mode,
+                                        const char* name) {
+    const BaselineRow* fastest = NULL;
+
+    for (int i = 0; i < count; i++) {
+        if (strcmp(rows[i].mode, mode) == 0 && strcmp(rows[i].name, name) == 0 &&
+            (!fastest || rows[i].best_ns_per_bytecode < fastest->best_ns_per_bytecode)) {
+            fastest = &rows[i];
+        }
+    }
+    return fastest;
+}
+
+/* How much slower, in percent, the slowest baseline row for mode and
+ * workload was than the fastest: the noise between runs of one build */
+static double baseline_spread(const BaselineRow* rows, int count, const char* mode,
+                              const char* name) {
+    const BaselineRow* fastest = find_baseline(rows, count, mode, name);
+    double slowest = 0.0;
+
+    for (int i = 0; i < count; i++) {
+        if (strcmp(rows[i].mode, mode) == 0 && strcmp(rows[i].name, name) == 0 &&
+            rows[i].best_ns_per_bytecode > slowest) {
+            slowest = rows[i].best_ns_per_bytecode;
+        }
+    }
+    return fastest && fastest->best_ns_per_bytecode > 0
+               ? (slowest / fastest->best_ns_per_bytecode - 1.0) * 100.0
+               : 0.0;
+}
+
+/* Check the fastest run of every workload in the results file at path
+ * against the fastest in the baseline read from baseline_path. A workload
+ * regressed if it got slower by more than the threshold plus the spread
+ * of its baseline runs, so a noisy host widens the margin rather than
+ * failing a clean tree. Returns the number of regressions, or -1 if the
+ * file can't be read. */
+static int compare_results(const char* path, const char* baseline_path,
+                           const BaselineRow* baseline, int baseline_count, double threshold) {
+    BaselineRow rows[MAX_BASELINE];
+    int count = load_baseline(path, rows, MAX_BASELINE);
+    int regressions = 0;
+
+    if (count < 0) {
+        printf("Error: Cannot read %s\n", path);
+        return -1;
+    }
+    printf("\n%-13s %-15s %12s %11s %7s  %s\n", "mode", "workload", "baseline ns",
+           "ns/bytecode", "noise", "change");
+    for (int i = 0; i < count; i++) {
+        const BaselineRow* row = find_baseline(rows, count, rows[i].mode, rows[i].name);
+        const BaselineRow* base;
+        double change, noise;
+
+        /* Each workload once, at its fastest run */
+        if (find_baseline(rows, i, rows[i].mode, rows[i].name)) {
+            continue;
+        }
+        printf("%-13s %-15s ", row->mode, row->name);
+        base = find_baseline(baseline, baseline_count, row->mode, row->name);
+        if (!base || base->best_ns_per_bytecode <= 0) {
+            printf("%12s %11.2f\n", "-", row->best_ns_per_bytecode);
+            continue;
+        }
+        change = (row->best_ns_per_bytecode / base->best_ns_per_bytecode - 1.0) * 100.0;
+        noise = baseline_spread(baseline, baseline_count, row->mode, row->name);
+        printf("%12.2f %11.2f %6.1f%% %+6.1f%%", base->best_ns_per_bytecode,
+               row->best_ns_per_bytecode, noise, change);
+        if (change > threshold + noise) {
+            printf(" REGRESSION");
+            regressions++;
+        }
+        if (base->result != row->result) {
+            printf(" result was %d", base->result);
+            regressions++;
+        }
+        printf("\n");
+    }
+    printf("%d regression%s against %s (threshold %.0f%% plus noise)\n", regressions,
+           regressions == 1 ? "" : "s", baseline_path, threshold);
+    return regressions;
+}
+
+int main(int argc, char** argv) {
+    const Workload workloads[] = {
+        {"nested_loops", 0, "nested", {1000}, 1, 1000000, NULL, 0, 0},
+        {"sieve", 0, "sieve", {2000, 100}, 2, 303, NULL, 0, 0},
+        {"bubble_sort", 0, "bubble", {600}, 1, 600, NULL, 0, 0},
+        {"fib_iterative", 0, "fibIter", {40, 20000}, 2, 102334155, NULL, 0, 0},
+        {"gcd", 0, "gcd", {300}, 1, 336784, NULL, 0, 0},
+        {"prime_count", 0, "primes", {50000}, 1, 5133, NULL, 0, 0},
+        {"collatz", 0, "collatz", {10000}, 1, 849666, NULL, 0, 0},
+        {"fib_recursive", 1, "fib", {30}, 1, 832040, NULL, 0, 0},
+        {"ackermann", 1, "ack", {3, 4}, 2, 125, NULL, 0, 0},
+        {"test_arithmetic", 0, NULL, {0}, 0, 11, test_arithmetic, test_arithmetic_length,
+         TEST_PROGRAM_RUNS},
+        {"test_locals", 0, NULL, {0}, 0, 52, test_locals, test_locals_length, TEST_PROGRAM_RUNS},
+        {"test_branch", 0, NULL, {0}, 0, 1, test_branch, test_branch_length, TEST_PROGRAM_RUNS},
+        {"test_loop", 0, NULL, {0}, 0, 3, test_loop, test_loop_length, TEST_PROGRAM_RUNS}
+    };
+    int count = (int)(sizeof(workloads) / sizeof(workloads[0]));
+    const char* results_path = NULL;
+    const char* baseline_path = NULL;
+    const char* compare_path = NULL;
+    double threshold = 10.0;
+    int reps = DEFAULT_REPS;
+    BaselineRow baseline[MAX_BASELINE];
+    int baseline_count = 0;
+    int regressions = 0, failures = 0;
+    FILE* results = NULL;
+    Class* bench;
+    Class* recursion;
+    Method top_level;
+    struct rusage usage;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 < argc && strcmp(argv[i], "--results") == 0) {
+            results_path = argv[++i];
+        } else if (i + 1 < argc && strcmp(argv[i], "--baseline") == 0) {
+            baseline_path = argv[++i];
+        } else if (i + 1 < argc && strcmp(argv[i], "--threshold") == 0) {
+            threshold = atof(argv[++i]);
+        } else if (i + 1 < argc && strcmp(argv[i], "--reps") == 0) {
+            reps = atoi(argv[++i]);
+        } else if (i + 1 < argc && strcmp(argv[i], "--compare") == 0) {
+            compare_path = argv[++i];
+        } else {
+            printf("Usage: %s [--results <file>] [--baseline <file>] "
+                   "[--threshold <percent>] [--reps <n>]\n"
+                   "       %s --compare <file> --baseline <file> [--threshold <percent>]\n",
+                   argv[0], argv[0]);
+            return 2;
+        }
+    }
+    if (reps < 1 || reps > MAX_REPS) {
+        printf("Error: --reps must be between 1 and %d\n", MAX_REPS);
+        return 2;
+    }
+    if (baseline_path) {
+        baseline_count = load_baseline(baseline_path, baseline, MAX_BASELINE);
+        if (baseline_count < 0) {
+            printf("No baseline at %s; `make bench-baseline` stores one\n", baseline_path);
+            baseline_count = 0;
+        }
+    }
+    if (compare_path) {
+        if (!baseline_path) {
+            printf("Error: --compare needs a --baseline\n");
+            return 2;
+        }
+        regressions = compare_results(compare_path, baseline_path, baseline, baseline_count,
+                                      threshold);
+        return regressions < 0 ? 2 : regressions > 0;
+    }
+    if (results_path) {
+        results = fopen(results_path, "a");
+        if (!results) {
+            printf("Error: Cannot create file %s\n", results_path);
+            return 2;
+        }
+        fseek(results, 0, SEEK_END);
+        if (ftell(results) == 0) {
+            fprintf(results, "mode,workload,reps,bytecodes,ns_per_bytecode,best_ns_per_bytecode,"
+                             "bytecodes_per_sec,peak_heap_bytes,result\n");
+        }
+    }
+
+    bench = bench_class();
+    recursion = test_recursion_class();
+    if (!bench || !recursion) {
+        printf("Failed to build the workload classes\n");
+        return 2;
+    }
+
+    printf("\nDispatch mode: %s%s, %d warmup runs, median of %d\n",
+           dispatch_mode(), TOS_LABEL, WARMUP_RUNS, reps);
+    printf("%-15s %13s %11s %12s %10s %9s %10s ", "workload", "bytecodes/run",
+           "ns/bytecode", "Mbytecodes/s", "calls/run", "peak heap", "result");
+#ifdef JVM_STACK_TRAFFIC
+    printf("%10s %10s ", "loads/bc", "stores/bc");
+#endif
+    printf(" %s\n", "vs baseline");
+    for (int i = 0; i < count; i++) {
+        const Workload* w = &workloads[i];
+        Method* method = &top_level;
+        const BaselineRow* base;
+        Measurement m;
+        int status;
+
+        /* Top-level code runs as a method of no class, as jvm_execute() does */
+        memset(&top_level, 0, sizeof(top_level));
+        if (w->code) {
+            top_level.name = "<main>";
+            top_level.code = w->code;
+            top_level.code_length = w->length;
+        } else {
+            method = class_find_method(w->recursion ? recursion : bench, w->method, NULL);
+        }
+        status = method && method_prepare(method) == 0 ? measure(method, w, reps, &m) : -1;
+        method_release(&top_level);
+        if (status != 0) {
+            printf("%-15s cannot run\n", w->name);
+            failures++;
+            continue;
+        }
+        printf("%-15s %13llu %11.2f %12.1f %10llu %9d %10d ", w->name,
+               (unsigned long long)m.bytecodes, m.ns_per_bytecode, m.bytecodes_per_sec / 1e6,
+               (unsigned long long)m.calls, m.peak_heap, m.result);
+#ifdef JVM_STACK_TRAFFIC
+        printf("%10.2f %10.2f ", m.loads_per_bytecode, m.stores_per_bytecode);
+#endif
+        if (m.result != w->expected) {
+            printf(" WRONG RESULT, expected %d", w->expected);
+            failures++;
+        }
+        base = find_baseline(baseline, baseline_count, dispatch_mode(), w->name);
+        if (base && base->best_ns_per_bytecode > 0) {
+            double change = (m.best_ns_per_bytecode / base->best_ns_per_bytecode - 1.0) * 100.0;
+            printf(" %+6.1f%%", change);
+            if (change > threshold) {
+                printf(" REGRESSION");
+                regressions++;
+            }
+            if (base->result != m.result) {
+                printf(" result was %d", base->result);
+                regressions++;
+            }
+        }
+        printf("\n");
+        if (results) {
+            fprintf(results, "%s,%s,%d,%llu,%.4f,%.4f,%.0f,%d,%d\n", dispatch_mode(), w->name,
+                    m.reps, (unsigned long long)m.bytecodes, m.ns_per_bytecode,
+                    m.best_ns_per_bytecode, m.bytecodes_per_sec, m.peak_heap, m.result);
+        }
+    }
+
+    {
+        Method* fib = class_find_method(recursion, "fib", "(I)I");
+        double fresh_ns, pooled_ns;
+        if (fib && method_prepare(fib) == 0 &&
+            measure_setup(fib, SETUP_FIB, &fresh_ns, &pooled_ns) == 0) {
+            printf("Short run fib(%d): %.0f ns with a new JVM, %.0f ns with a pooled one\n",
+                   SETUP_FIB, fresh_ns, pooled_ns);
+        }
+    }
+    {
+        double container_ns, snapshot_ns;
+        long container_bytes, snapshot_bytes;
+        if (measure_startup(&container_ns, &snapshot_ns, &container_bytes, &snapshot_bytes) == 0) {
+            printf("Startup of %d methods to a first result: %.0f us from a container "
+                   "(%ld KB), %.0f us from a snapshot (%ld KB)\n",
+                   STARTUP_CLASSES * STARTUP_METHODS, container_ns / 1e3,
+                   container_bytes / 1024, snapshot_ns / 1e3, snapshot_bytes / 1024);
+        } else {
+            printf("Startup runs failed\n");
+            failures++;
+        }
+    }
+#ifdef JVM_PROFILER
+    {
+        Method* fib = class_find_method(recursion, "fib", "(I)I");
+        double plain_ns, sampled_ns;
+        uint64_t samples = 0;
+        if (fib && measure_sampling(fib, SAMPLING_FIB, &plain_ns, &sampled_ns, &samples) == 0) {
+            printf("Sampling fib(%d) at %d Hz: %.2f ms, %.2f ms sampled (%+.1f%%, %llu samples)\n",
+                   SAMPLING_FIB, SAMPLING_HZ, plain_ns / 1e6, sampled_ns / 1e6,
+                   (sampled_ns / plain_ns - 1.0) * 100.0, (unsigned long long)samples);
+        } else {
+            printf("Sampling runs failed\n");
+            failures++;
+        }
+    }
+#endif
+#ifdef JVM_GREEN_THREADS
+    {
+        const int primes_args[] = {20000};
+        const int churn_args[] = {10, 5000};
+        Class* node = test_node_class();
+        Method* primes = class_find_method(bench, "primes", NULL);
+        Method* churn = node ? class_find_method(node, "churn", NULL) : NULL;
+
+        printf("M:N scaling, %d green threads, budget %d:\n", SCALING_THREADS, SCALING_BUDGET);
+        if (!primes || !churn ||
+            measure_scaling("primes", primes, primes_args, 1, 2262) != 0 ||
+            measure_scaling("churn", churn, churn_args, 2, 10 * 9 / 2 + 5000) != 0) {
+            printf("Scaling runs failed\n");
+            failures++;
+        }
+        class_destroy(node);
+    }
+#endif
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        printf("Peak resident set: %ld KB; JVM struct: %zu KB\n", usage.ru_maxrss,
+               sizeof(JVM) / 1024);
+    }
+    if (baseline_count > 0) {
+        printf("%d regression%s against %s (threshold %.0f%%)\n", regressions,
+               regressions == 1 ? "" : "s", baseline_path, threshold);
+    }
+
+    if (results) fclose(results);
+    class_destroy(bench);
+    class_destroy(recursion);
+    return regressions > 0 || failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,328 @@
+#include "jvm.h"
+
+/*
+ * Ahead-of-time translation to C
+ *
+ * Emits one plain C99 function per method, for targets where a JIT is not
+ * an option. The translation starts from the verified pre-decoded form:
+ * since every instruction has a known stack depth, operand stack slot n
+ * becomes the C local s<n> and local variable n becomes l<n>, so the
+ * generated code has no stack pointer and no dispatch. Branches become
+ * gotos to per-instruction labels, and invokestatic a direct C call.
+ *
+ * The output includes "aruvi_rt.h" and links against aot/aruvi_rt.c, which
+ * provides division with Java semantics and the halt/error exits. It has
+ * no object heap, so methods that allocate or touch objects and arrays
+ * are not translated, and neither are those that use long, float or
+ * double, whose values take two int32_t slots, or that throw or catch
+ * exceptions. Abstract and native methods have no code and get no
+ * function.
+ */
+
+/* C identifier for a method: aruvi_<class>_<method>, or aruvi_<method> */
+int aot_function_name(const Method* method, char* buffer, int size) {
+    int n;
+    if (method->owner) {
+        n = snprintf(buffer, size, "aruvi_%s_%s", method->owner->name, method->name);
+    } else {
+        n = snprintf(buffer, size, "aruvi_%s", method->name);
+    }
+    if (n < 0 || n >= size) {
+        return -1;
+    }
+    for (char* p = buffer; *p; p++) {
+        if (!((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') ||
+              (*p >= '0' && *p <= '9') || *p == '_')) {
+            *p = '_';
+        }
+    }
+    return 0;
+}
+
+/* Top-level code (no descriptor) returns int like jvm_execute() does */
+static int returns_int(const Method* method) {
+    return !method->descriptor || method->return_slots == 1;
+}
+
+/* Function signature, without the trailing ';' or body */
+static int emit_signature(FILE* out, const Method* method) {
+    char name[128];
+    if (aot_function_name(method, name, sizeof(name)) != 0) {
+        printf("AOT error: method name too long: %s\n", method->name);
+        return -1;
+    }
+    fprintf(out, "%s %s(", returns_int(method) ? "int32_t" : "void", name);
+    if (method->arg_slots == 0) {
+        fprintf(out, "void");
+    }
+    for (int i = 0; i < method->arg_slots; i++) {
+        fprintf(out, "%sint32_t l%d", i > 0 ? ", " : "", i);
+    }
+    fprintf(out, ")");
+    return 0;
+}
+
+/* Emit the statement for one instruction entered with stack depth d */
+static int emit_insn(FILE* out, Method* method, int index, int d) {
+    const Insn* insn = &method->decoded.insns[index];
+
+    /* A superinstruction translates as its first instruction; the rest of
+     * the sequence follows it unchanged */
+    switch (insn_base_op(insn->op)) {
+        case INSN_ICONST:
+            fprintf(out, "    s%d = %d;\n", d, insn->k);
+            break;
+        case INSN_ILOAD:
+            fprintf(out, "    s%d = l%d;\n", d, insn->a);
+            break;
+        case INSN_ISTORE:
+            fprintf(out, "    l%d = s%d;\n", insn->a, d - 1);
+            break;
+        case INSN_IINC:
+            fprintf(out, "    l%d = ARUVI_IADD(l%d, %d);\n", insn->a, insn->a, insn->k);
+            break;
+        case INSN_IADD:
+            fprintf(out, "    s%d = ARUVI_IADD(s%d, s%d);\n", d - 2, d - 2, d - 1);
+            break;
+        case INSN_ISUB:
+            fprintf(out, "    s%d = ARUVI_ISUB(s%d, s%d);\n", d - 2, d - 2, d - 1);
+            break;
+        case INSN_IMUL:
+            fprintf(out, "    s%d = ARUVI_IMUL(s%d, s%d);\n", d - 2, d - 2, d - 1);
+            break;
+        case INSN_IDIV:
+            fprintf(out, "    s%d = aruvi_idiv(s%d, s%d);\n", d - 2, d - 2, d - 1);
+            break;
+        case INSN_IREM:
+            fprintf(out, "    s%d = aruvi_irem(s%d, s%d);\n", d - 2, d - 2, d - 1);
+            break;
+        case INSN_INEG:
+            fprintf(out, "    s%d = ARUVI_INEG(s%d);\n", d - 1, d - 1);
+            break;
+        case INSN_ISHL:
+        case INSN_ISHR:
+        case INSN_IUSHR: {
+            static const char* const shift[] = {"ARUVI_ISHL", "ARUVI_ISHR", "ARUVI_IUSHR"};
+            fprintf(out, "    s%d = %s(s%d, s%d);\n", d - 2, shift[insn->op - INSN_ISHL],
+                    d - 2, d - 1);
+            break;
+        }
+        case INSN_IAND:
+        case INSN_IOR:
+        case INSN_IXOR: {
+            static const char* const bitwise[] = {"&", "|", "^"};
+            fprintf(out, "    s%d = s%d %s s%d;\n", d - 2, d - 2, bitwise[insn->op - INSN_IAND],
+                    d - 1);
+            break;
+        }
+        case INSN_IF_ICMPEQ:
+        case INSN_IF_ICMPNE:
+        case INSN_IF_ICMPLT:
+        case INSN_IF_ICMPGE:
+        case INSN_IF_ICMPGT:
+        case INSN_IF_ICMPLE: {
+            static const char* const compare[] = {"==", "!=", "<", ">=", ">", "<="};
+            fprintf(out, "    if (s%d %s s%d) goto L%d;\n", d - 2,
+                    compare[insn->op - INSN_IF_ICMPEQ], d - 1, insn->k);
+            break;
+        }
+        case INSN_IFEQ:
+        case INSN_IFNE:
+        case INSN_IFLT:
+        case INSN_IFGE:
+        case INSN_IFGT:
+        case INSN_IFLE: {
+            static const char* const compare[] = {"==", "!=", "<", ">=", ">", "<="};
+            fprintf(out, "    if (s%d %s 0) goto L%d;\n", d - 1, compare[insn->op - INSN_IFEQ],
+                    insn->k);
+            break;
+        }
+        case INSN_IFNULL:
+        case INSN_IFNONNULL:
+            fprintf(out, "    if (s%d %s 0) goto L%d;\n", d - 1,
+                    insn->op == INSN_IFNULL ? "==" : "!=", insn->k);
+            break;
+        case INSN_GOTO:
+            fprintf(out, "    goto L%d;\n", insn->k);
+            break;
+        case INSN_TABLESWITCH:
+        case INSN_LOOKUPSWITCH: {
+            /* The C compiler picks its own jump table or compare tree */
+            const SwitchTable* table = &method->decoded.switches[insn->a];
+            fprintf(out, "    switch (s%d) {\n", d - 1);
+            for (int i = 0; i < table->count; i++) {
+                if (table->keys) {
+                    fprintf(out, "    case %ld: goto L%d;\n", (long)table->keys[i], table->targets[i]);
+                } else {
+                    fprintf(out, "    case %ld: goto L%d;\n", (long)table->low + i, table->targets[i]);
+                }
+            }
+            fprintf(out, "    default: goto L%d;\n    }\n", table->default_target);
+            break;
+        }
+        case INSN_POP:
+        case INSN_YIELD:
+        case INSN_SLEEP:
+            /* Translated code runs alone, so there is no one to yield to */
+            break;
+        case INSN_DUP:
+            fprintf(out, "    s%d = s%d;\n", d, d - 1);
+            break;
+        case INSN_INVOKESTATIC:
+        case INSN_INVOKESPECIAL: {
+            /* The verifier resolved calls into other classes; those to this
+             * class's own methods resolve when they first run */
+            const Constant* constant = &method->owner->constants[insn->k];
+            Method* target = constant->method;
+            char name[128];
+            int base;
+
+            if (!target && (!constant->class_name ||
+                            strcmp(constant->class_name, method->owner->name) == 0)) {
+                target = class_find_method(method->owner, constant->name, constant->descriptor);
+            }
+            if (!target || method_prepare(target) != 0 ||
+                aot_function_name(target, name, sizeof(name)) != 0) {
+                printf("AOT error: cannot call %s%s from %s\n", constant->name,
+                       constant->descriptor, method->name);
+                return -1;
+            }
+            base = d - target->arg_slots;
+            fprintf(out, "    ");
+            if (target->return_slots == 1) {
+                fprintf(out, "s%d = ", base);
+            }
+            fprintf(out, "%s(", name);
+            for (int i = 0; i < target->arg_slots; i++) {
+                fprintf(out, "%ss%d", i > 0 ? ", " : "", base + i);
+            }
+            fprintf(out, ");\n");
+            break;
+        }
+        case INSN_IRETURN:
+            fprintf(out, "    return s%d;\n", d - 1);
+            break;
+        case INSN_RETURN:
+        case INSN_END:
+            fprintf(out, returns_int(method) ? "    return 0;\n" : "    return;\n");
+            break;
+        case INSN_HALT:
+            fprintf(out, returns_int(method) ? "    aruvi_halt();\n    return 0;\n"
+                                             : "    aruvi_halt();\n    return;\n");
+            break;
+        default:
+            printf("AOT error: cannot translate instruction %d of %s\n", index, method->name);
+            return -1;
+    }
+    return 0;
+}
+
+/* Emit a method as a C function. Returns 0 on success, -1 on error. */
+int aot_translate_method(FILE* out, Method* method) {
+    DecodedCode* decoded;
+    char* is_target;
+    int status = 0;
+
+    if (method_prepare(method) != 0) {
+        return -1;
+    }
+    decoded = &method->decoded;
+    if (decoded->handler_count > 0) {
+        printf("AOT error: cannot translate the exception handlers of %s\n", method->name);
+        return -1;
+    }
+
+    is_target = (char*)calloc(decoded->count, 1);
+    if (!is_target) {
+        printf("AOT error: out of memory\n");
+        return -1;
+    }
+    for (int i = 0; i < decoded->count; i++) {
+        const Insn* insn = &decoded->insns[i];
+        if (decoded->stack_depth[i] < 0) {
+            continue;
+        }
+        if (insn->op >= INSN_IF_ICMPEQ && insn->op <= INSN_GOTO) {
+            is_target[insn->k] = 1;
+        } else if (insn->op == INSN_TABLESWITCH || insn->op == INSN_LOOKUPSWITCH) {
+            const SwitchTable* table = &decoded->switches[insn->a];
+            for (int j = 0; j < table->count; j++) {
+                is_target[table->targets[j]] = 1;
+            }
+            is_target[table->default_target] = 1;
+        }
+    }
+
+    fprintf(out, "\n/* %s%s */\n", method->name, method->descriptor ? method->descriptor : "");
+    if (emit_signature(out, method) != 0) {
+        free(is_target);
+        return -1;
+    }
+    fprintf(out, " {\n");
+    for (int i = 0; i < method->max_stack; i++) {
+        fprintf(out, "    int32_t s%d;\n", i);
+    }
+    /* The interpreter's scratch local has no use in C */
+    for (int i = method->arg_slots; i < method->locals_count - TOS_SCRATCH_LOCALS; i++) {
+        fprintf(out, "    int32_t l%d = 0;\n", i);
+    }
+    fprintf(out, "\n");
+
+    /* Instructions the verifier never reached have no depth; skip them */
+    for (int i = 0; i < decoded->count && status == 0; i++) {
+        if (decoded->stack_depth[i] < 0) {
+            continue;
+        }
+        if (is_target[i]) {
+            fprintf(out, "L%d:\n", i);
+        }
+        status = emit_insn(out, method, i, decoded->stack_depth[i]);
+    }
+    fprintf(out, "}\n");
+
+    free(is_target);
+    return status;
+}
+
+/* Emit the file prologue shared by all translation units */
+void aot_begin(FILE* out, const char* source) {
+    fprintf(out, "/* Generated by AruviJVM from %s. Do not edit. */\n", source);
+    fprintf(out, "#include \"aruvi_rt.h\"\n");
+}
+
+/* Emit every method of a class, prototypes first so calls can go anywhere */
+int aot_translate_class(FILE* out, Class* cls) {
+    fprintf(out, "\n");
+    for (int i = 0; i < cls->method_count; i++) {
+        if (cls->methods[i].access_flags & (ACC_ABSTRACT | ACC_NATIVE)) {
+            continue;
+        }
+        if (emit_signature(out, &cls->methods[i]) != 0) {
+            return -1;
+        }
+        fprintf(out, ";\n");
+    }
+    for (int i = 0; i < cls->method_count; i++) {
+        if (cls->methods[i].access_flags & (ACC_ABSTRACT | ACC_NATIVE)) {
+            continue;
+        }
+        if (aot_translate_method(out, &cls->methods[i]) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Emit top-level bytecode, such as a .aruvi file, as int32_t aruvi_<name>(void) */
+int aot_translate_code(FILE* out, const char* name, uint8_t* code, int length) {
+    Method method;
+    int status;
+
+    memset(&method, 0, sizeof(method));
+    method.name = (char*)name;
+    method.code = code;
+    method.code_length = length;
+    status = aot_translate_method(out, &method);
+    method_release(&method);
+    return status;
+}
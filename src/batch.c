@@ -0,0 +1,447 @@
+#define _POSIX_C_SOURCE 200112L
+#include "jvm.h"
+#include "bytecode_loader.h"
+#include <ctype.h>
+#include <pthread.h>
+#include <time.h>
+
+/*
+ * Parallel batch execution
+ *
+ * Runs a list of independent jobs, each a program and its int arguments,
+ * on a fixed set of worker threads. A worker owns everything it runs on:
+ * its JVM, reset between jobs, and its own copy of every program it has
+ * loaded, since methods keep call counters, call-site caches and JIT code
+ * that threads must not share. Nothing else is shared but the job list,
+ * which is read-only, and the result array, where each job has its own
+ * slot, so results come back in input order whoever ran them.
+ *
+ * Jobs are handed out by work stealing. Each worker starts with an equal
+ * contiguous range of job indexes and takes jobs from the front of it.
+ * When its range runs out it steals the back half of another worker's
+ * range, so a worker that drew long jobs sheds work to the others. A
+ * range is two indexes under a mutex of its own, which is only held for
+ * as long as it takes to move one of them.
+ */
+
+/* One program as a worker loaded it */
+typedef struct {
+    const char* path;
+    Class* cls;             /* A .class file, or NULL */
+    uint8_t* code;          /* A bytecode file, run as top-level code */
+    Method top;             /* code as a prepared method */
+    int failed;             /* Couldn't be loaded; don't try again */
+} Program;
+
+typedef struct Worker {
+    struct Batch* batch;
+    int id;
+    pthread_t thread;
+    pthread_mutex_t lock;   /* Guards head and tail */
+    int head, tail;         /* Job indexes [head, tail) still to run */
+    JVM* jvm;
+    Program* programs;
+    int program_count;
+    uint64_t steals;
+} Worker;
+
+typedef struct Batch {
+    const BatchJob* jobs;
+    BatchResult* results;
+    Worker* workers;
+    int threads;
+} Batch;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/* A .class file is run by method name; anything else is a bytecode file */
+static int is_class_file(const char* path) {
+    size_t n = strlen(path);
+    return n > 6 && strcmp(path + n - 6, ".class") == 0;
+}
+
+/* Take the next job of the worker's own range */
+static int take_job(Worker* w, int* job) {
+    int found = 0;
+
+    pthread_mutex_lock(&w->lock);
+    if (w->head < w->tail) {
+        *job = w->head++;
+        found = 1;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return found;
+}
+
+/* Move the back half of another worker's range into this worker's empty
+ * range, then take a job from it */
+static int steal_job(Worker* w, int* job) {
+    Batch* batch = w->batch;
+
+    for (int i = 1; i < batch->threads; i++) {
+        Worker* victim = &batch->workers[(w->id + i) % batch->threads];
+        int head = 0, tail = 0;
+
+        pthread_mutex_lock(&victim->lock);
+        if (victim->head < victim->tail) {
+            tail = victim->tail;
+            victim->tail -= (victim->tail - victim->head + 1) / 2;
+            head = victim->tail;
+        }
+        pthread_mutex_unlock(&victim->lock);
+
+        if (head < tail) {
+            pthread_mutex_lock(&w->lock);
+            w->head = head;
+            w->tail = tail;
+            pthread_mutex_unlock(&w->lock);
+            w->steals++;
+            return take_job(w, job);
+        }
+    }
+    return 0;
+}
+
+/* The worker's copy of a program, loading it on first use. NULL if it
+ * can't be loaded. */
+static Program* worker_program(Worker* w, const char* path) {
+    Program* program;
+    int length;
+
+    for (int i = 0; i < w->program_count; i++) {
+        if (strcmp(w->programs[i].path, path) == 0) {
+            return w->programs[i].failed ? NULL : &w->programs[i];
+        }
+    }
+    program = (Program*)realloc(w->programs, sizeof(Program) * (size_t)(w->program_count + 1));
+    if (!program) {
+        printf("Batch error: out of memory\n");
+        return NULL;
+    }
+    w->programs = program;
+    program = &w->programs[w->program_count++];
+    memset(program, 0, sizeof(Program));
+    program->path = path;
+
+    if (is_class_file(path)) {
+        program->cls = class_load_file(path);
+        program->failed = !program->cls;
+    } else if (load_bytecode_file(path, &program->code, &length) == 0) {
+        program->top.name = "<main>";
+        program->top.code = program->code;
+        program->top.code_length = length;
+        program->failed = method_prepare(&program->top) != 0;
+    } else {
+        program->failed = 1;
+    }
+    return program->failed ? NULL : program;
+}
+
+/* Run one job on the worker's JVM and leave the JVM reset */
+static void run_job(Worker* w, int index) {
+    const BatchJob* job = &w->batch->jobs[index];
+    BatchResult* r = &w->batch->results[index];
+    uint64_t start = now_ns();
+    Program* program = worker_program(w, job->path);
+    Method* method = NULL;
+
+    r->worker = w->id;
+    r->status = -1;
+    if (program && program->cls) {
+        method = class_find_method(program->cls, job->method, NULL);
+        if (!method || method_prepare(method) != 0 || method->arg_slots != job->arg_count) {
+            printf("Batch error: cannot run %s %s with %d arguments\n", job->path,
+                   job->method, job->arg_count);
+            method = NULL;
+        }
+    } else if (program) {
+        method = &program->top;
+    }
+
+    if (method) {
+        jvm_set_verbose(w->jvm, 0);
+        for (int i = 0; i < job->arg_count; i++) {
+            Value v = {job->args[i]};
+            jvm_push(w->jvm, v);
+        }
+        r->result = jvm_execute_method(w->jvm, method);
+        r->instructions = w->jvm->instructions;
+        r->status = w->jvm->failed ? -1 : 0;
+        jvm_reset(w->jvm);
+    }
+    r->latency_ns = now_ns() - start;
+}
+
+static void* worker_main(void* arg) {
+    Worker* w = (Worker*)arg;
+    int job;
+
+    while (take_job(w, &job) || steal_job(w, &job)) {
+        run_job(w, job);
+    }
+    return NULL;
+}
+
+static void worker_free(Worker* w) {
+    for (int i = 0; i < w->program_count; i++) {
+        Program* program = &w->programs[i];
+        if (program->cls) {
+            class_destroy(program->cls);
+        }
+        if (program->code) {
+            method_release(&program->top);
+            free_bytecode(program->code);
+        }
+    }
+    free(w->programs);
+    jvm_destroy(w->jvm);
+    pthread_mutex_destroy(&w->lock);
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+/* Nearest-rank percentile of sorted values */
+static uint64_t percentile(const uint64_t* sorted, int count, int p) {
+    int rank = (p * count + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+/* Fill in the totals and latency percentiles of a finished batch */
+static void batch_summarize(const BatchResult* results, int count, BatchStats* stats) {
+    uint64_t* latencies = (uint64_t*)malloc(sizeof(uint64_t) * (size_t)count);
+
+    for (int i = 0; i < count; i++) {
+        stats->failed += results[i].status != 0;
+        stats->instructions += results[i].instructions;
+        if (latencies) {
+            latencies[i] = results[i].latency_ns;
+        }
+    }
+    if (latencies) {
+        qsort(latencies, (size_t)count, sizeof(uint64_t), compare_u64);
+        stats->latency_p50_ns = percentile(latencies, count, 50);
+        stats->latency_p90_ns = percentile(latencies, count, 90);
+        stats->latency_p99_ns = percentile(latencies, count, 99);
+        stats->latency_max_ns = latencies[count - 1];
+        free(latencies);
+    }
+}
+
+/*
+ * Run count jobs on up to threads workers and store the outcome of job i
+ * in results[i]. stats, if not NULL, receives the totals. Returns 0, or
+ * -1 if the workers couldn't be set up.
+ */
+int batch_run(const BatchJob* jobs, int count, int threads, BatchResult* results,
+              BatchStats* stats) {
+    Batch batch;
+    uint64_t start;
+    int started = 0;
+
+    if (threads < 1 || threads > BATCH_MAX_THREADS) {
+        printf("Error: thread count must be between 1 and %d\n", BATCH_MAX_THREADS);
+        return -1;
+    }
+    if (count < 1) {
+        printf("Error: the batch has no jobs\n");
+        return -1;
+    }
+    if (threads > count) {
+        threads = count;
+    }
+    memset(results, 0, sizeof(BatchResult) * (size_t)count);
+    batch.jobs = jobs;
+    batch.results = results;
+    batch.threads = threads;
+    batch.workers = (Worker*)calloc((size_t)threads, sizeof(Worker));
+    if (!batch.workers) {
+        printf("Batch error: out of memory\n");
+        return -1;
+    }
+
+    /* Every worker gets its JVM and its share of the jobs before any starts */
+    for (int i = 0; i < threads; i++) {
+        Worker* w = &batch.workers[i];
+        w->batch = &batch;
+        w->id = i;
+        w->head = (int)((int64_t)count * i / threads);
+        w->tail = (int)((int64_t)count * (i + 1) / threads);
+        w->jvm = jvm_create();
+        if (!w->jvm || pthread_mutex_init(&w->lock, NULL) != 0) {
+            printf("Batch error: cannot set up worker %d\n", i);
+            jvm_destroy(w->jvm);
+            w->jvm = NULL;
+            for (int j = 0; j < i; j++) {
+                worker_free(&batch.workers[j]);
+            }
+            free(batch.workers);
+            return -1;
+        }
+    }
+
+    /* A worker whose thread doesn't start still has its jobs stolen by the
+     * others; if none starts, this thread does all the work */
+    start = now_ns();
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&batch.workers[i].thread, NULL, worker_main, &batch.workers[i]) != 0) {
+            break;
+        }
+        started++;
+    }
+    if (started == 0) {
+        worker_main(&batch.workers[0]);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(batch.workers[i].thread, NULL);
+    }
+
+    if (stats) {
+        memset(stats, 0, sizeof(BatchStats));
+        stats->jobs = count;
+        stats->threads = started > 0 ? started : 1;
+        stats->wall_ns = now_ns() - start;
+        for (int i = 0; i < threads; i++) {
+            stats->steals += batch.workers[i].steals;
+        }
+        batch_summarize(results, count, stats);
+    }
+    for (int i = 0; i < threads; i++) {
+        worker_free(&batch.workers[i]);
+    }
+    free(batch.workers);
+    return 0;
+}
+
+/* Print throughput and latency percentiles */
+void batch_print_stats(const BatchStats* stats) {
+    double seconds = (double)stats->wall_ns / 1e9;
+
+    printf("Batch: %d jobs (%d failed) on %d threads in %.3f ms, %d steals\n", stats->jobs,
+           stats->failed, stats->threads, (double)stats->wall_ns / 1e6, (int)stats->steals);
+    if (seconds > 0) {
+        printf("Throughput: %.0f jobs/s, %.1f Mbytecodes/s\n", stats->jobs / seconds,
+               (double)stats->instructions / seconds / 1e6);
+    }
+    printf("Latency: p50 %.1f us, p90 %.1f us, p99 %.1f us, max %.1f us\n",
+           (double)stats->latency_p50_ns / 1e3, (double)stats->latency_p90_ns / 1e3,
+           (double)stats->latency_p99_ns / 1e3, (double)stats->latency_max_ns / 1e3);
+}
+
+/*
+ * Read a job file: one job per line, "<file.class> <method> [int args...]"
+ * or "<bytecode file>"; blank lines and lines starting with '#' are
+ * skipped. Returns 0 and the jobs, to be freed with batch_free_jobs(), or
+ * -1 on error.
+ */
+int batch_read_jobs(const char* path, BatchJob** jobs, int* count) {
+    FILE* in = fopen(path, "r");
+    char line[512];
+    int capacity = 0, line_number = 0;
+
+    *jobs = NULL;
+    *count = 0;
+    if (!in) {
+        printf("Error: Cannot open file %s\n", path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), in)) {
+        char* words[2 + BATCH_MAX_ARGS + 1];
+        int word_count = 0;
+        BatchJob* job;
+        char* p = line;
+
+        line_number++;
+        while (word_count < (int)(sizeof(words) / sizeof(words[0]))) {
+            while (isspace((unsigned char)*p)) {
+                *p++ = '\0';
+            }
+            if (!*p || *p == '#') {
+                break;
+            }
+            words[word_count++] = p;
+            while (*p && !isspace((unsigned char)*p)) {
+                p++;
+            }
+        }
+        *p = '\0';
+        if (word_count == 0) {
+            continue;
+        }
+
+        if (*count == capacity) {
+            BatchJob* grown;
+            capacity = capacity ? capacity * 2 : 16;
+            grown = (BatchJob*)realloc(*jobs, sizeof(BatchJob) * (size_t)capacity);
+            if (!grown) {
+                printf("Batch error: out of memory\n");
+                goto fail;
+            }
+            *jobs = grown;
+        }
+        job = &(*jobs)[*count];
+        memset(job, 0, sizeof(BatchJob));
+        job->path = (char*)malloc(strlen(words[0]) + 1);
+        if (!job->path) {
+            printf("Batch error: out of memory\n");
+            goto fail;
+        }
+        strcpy(job->path, words[0]);
+        (*count)++;
+
+        if (is_class_file(words[0])) {
+            if (word_count < 2 || word_count > 2 + BATCH_MAX_ARGS) {
+                printf("Batch error: %s line %d: expected <file.class> <method> "
+                       "and up to %d int arguments\n", path, line_number, BATCH_MAX_ARGS);
+                goto fail;
+            }
+            job->method = (char*)malloc(strlen(words[1]) + 1);
+            if (!job->method) {
+                printf("Batch error: out of memory\n");
+                goto fail;
+            }
+            strcpy(job->method, words[1]);
+            for (int i = 2; i < word_count; i++) {
+                char* end;
+                long value = strtol(words[i], &end, 10);
+                if (*end || value < INT32_MIN || value > INT32_MAX) {
+                    printf("Batch error: %s line %d: bad int argument %s\n", path,
+                           line_number, words[i]);
+                    goto fail;
+                }
+                job->args[job->arg_count++] = (int)value;
+            }
+        } else if (word_count > 1) {
+            printf("Batch error: %s line %d: a bytecode file takes no method or arguments\n",
+                   path, line_number);
+            goto fail;
+        }
+    }
+    fclose(in);
+    if (*count == 0) {
+        printf("Batch error: no jobs in %s\n", path);
+        return -1;
+    }
+    return 0;
+
+fail:
+    fclose(in);
+    batch_free_jobs(*jobs, *count);
+    *jobs = NULL;
+    *count = 0;
+    return -1;
+}
+
+void batch_free_jobs(BatchJob* jobs, int count) {
+    for (int i = 0; i < count; i++) {
+        free(jobs[i].path);
+        free(jobs[i].method);
+    }
+    free(jobs);
+}
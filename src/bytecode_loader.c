@@ -1,5 +1,14 @@
+#define _POSIX_C_SOURCE 200112L
+
 #include "bytecode_loader.h"
 
+#ifndef JVM_NO_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #define ARUVIJVM_MAGIC 0xCAFEBABE
 #define ARUVIJVM_VERSION 1
 
@@ -101,3 +110,482 @@ void free_bytecode(uint8_t* bytecode) {
         free(bytecode);
     }
 }
+
+/*
+ * Container files (see bytecode_loader.h for the layout)
+ */
+
+/* Big-endian field access */
+static uint32_t get_u4(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint16_t get_u2(const uint8_t* p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static void put_u4(uint8_t* p, uint32_t value) {
+    p[0] = (uint8_t)(value >> 24);
+    p[1] = (uint8_t)(value >> 16);
+    p[2] = (uint8_t)(value >> 8);
+    p[3] = (uint8_t)value;
+}
+
+static void put_u2(uint8_t* p, uint16_t value) {
+    p[0] = (uint8_t)(value >> 8);
+    p[1] = (uint8_t)value;
+}
+
+/* Do count entries of size bytes at offset lie inside the file? */
+static int in_file(const Container* container, uint32_t offset, uint32_t count, uint32_t size) {
+    return offset <= container->size &&
+           (uint64_t)count * size <= (uint64_t)(container->size - offset);
+}
+
+/* NUL-terminated string at offset, or NULL if it runs off the end */
+static const char* container_string(const Container* container, uint32_t offset) {
+    if (offset >= container->size ||
+        !memchr(container->data + offset, '\0', container->size - offset)) {
+        return NULL;
+    }
+    return (const char*)(container->data + offset);
+}
+
+/* Map a container file and check its header and index bounds. Nothing
+ * else is read until a class or method is looked up. */
+int container_open(const char* filename, Container* container) {
+    const uint8_t* header;
+
+    memset(container, 0, sizeof(Container));
+
+#ifndef JVM_NO_MMAP
+    {
+        struct stat st;
+        void* data;
+        int fd = open(filename, O_RDONLY);
+        if (fd < 0) {
+            printf("Error: Cannot open file %s\n", filename);
+            return -1;
+        }
+        if (fstat(fd, &st) != 0 || st.st_size < CONTAINER_HEADER_SIZE) {
+            printf("Error: %s is not a container file\n", filename);
+            close(fd);
+            return -1;
+        }
+        data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            printf("Error: Cannot map file %s\n", filename);
+            return -1;
+        }
+        container->data = (const uint8_t*)data;
+        container->size = (size_t)st.st_size;
+        container->mapped = 1;
+    }
+#else
+    {
+        /* No mmap on this target: read the whole file instead */
+        FILE* file = fopen(filename, "rb");
+        long size;
+        uint8_t* data;
+        if (!file) {
+            printf("Error: Cannot open file %s\n", filename);
+            return -1;
+        }
+        fseek(file, 0, SEEK_END);
+        size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        data = size >= CONTAINER_HEADER_SIZE ? (uint8_t*)malloc((size_t)size) : NULL;
+        if (!data || fread(data, 1, (size_t)size, file) != (size_t)size) {
+            printf("Error: %s is not a container file\n", filename);
+            free(data);
+            fclose(file);
+            return -1;
+        }
+        fclose(file);
+        container->data = data;
+        container->size = (size_t)size;
+    }
+#endif
+
+    header = container->data;
+    if (get_u4(header) != CONTAINER_MAGIC) {
+        printf("Error: Invalid magic number. Expected 0x%08x, got 0x%08x\n",
+               CONTAINER_MAGIC, get_u4(header));
+        container_close(container);
+        return -1;
+    }
+    if (get_u2(header + 4) != CONTAINER_VERSION) {
+        printf("Error: Unsupported container version %d (expected %d)\n",
+               get_u2(header + 4), CONTAINER_VERSION);
+        container_close(container);
+        return -1;
+    }
+    container->class_count = get_u4(header + 12);
+    container->method_count = get_u4(header + 20);
+    if (get_u4(header + 8) != container->size ||
+        !in_file(container, get_u4(header + 16), container->class_count, CONTAINER_CLASS_SIZE) ||
+        !in_file(container, get_u4(header + 24), container->method_count, CONTAINER_METHOD_SIZE)) {
+        printf("Error: %s is truncated or corrupt\n", filename);
+        container_close(container);
+        return -1;
+    }
+    container->classes = container->data + get_u4(header + 16);
+    container->methods = container->data + get_u4(header + 24);
+    return 0;
+}
+
+/* Unmap a container. Classes loaded from it must be destroyed first. */
+void container_close(Container* container) {
+#ifndef JVM_NO_MMAP
+    if (container->mapped) {
+        munmap((void*)container->data, container->size);
+    }
+#else
+    free((void*)container->data);
+#endif
+    memset(container, 0, sizeof(Container));
+}
+
+/* Binary search of the class index; returns the entry index or -1 */
+static int find_class_entry(const Container* container, const char* name) {
+    int low = 0;
+    int high = (int)container->class_count - 1;
+    while (low <= high) {
+        int mid = low + (high - low) / 2;
+        const char* entry = container_string(container,
+                                             get_u4(container->classes + mid * CONTAINER_CLASS_SIZE));
+        int cmp;
+        if (!entry) {
+            return -1;
+        }
+        cmp = strcmp(name, entry);
+        if (cmp == 0) {
+            return mid;
+        }
+        if (cmp < 0) {
+            high = mid - 1;
+        } else {
+            low = mid + 1;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Create a Class for a container class: name and constant pool only.
+ * Methods are added by class_find_method() as they are first looked up.
+ */
+Class* container_load_class(Container* container, const char* name) {
+    int index = find_class_entry(container, name);
+    const uint8_t* entry;
+    uint32_t constant_offset, constant_count;
+    Class* cls;
+
+    if (index < 0) {
+        printf("Error: no class %s in container\n", name);
+        return NULL;
+    }
+    entry = container->classes + index * CONTAINER_CLASS_SIZE;
+    constant_offset = get_u4(entry + 12);
+    constant_count = get_u4(entry + 16);
+    if (!in_file(container, constant_offset, constant_count, CONTAINER_CONSTANT_SIZE) ||
+        constant_count >= MAX_CONSTANTS) {
+        printf("Error: bad constant pool for class %s\n", name);
+        return NULL;
+    }
+
+    cls = class_create(name);
+    if (!cls) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < constant_count; i++) {
+        const uint8_t* constant = container->data + constant_offset + i * CONTAINER_CONSTANT_SIZE;
+        const char* ref_name = container_string(container, get_u4(constant + 4));
+        const char* ref_descriptor = container_string(container, get_u4(constant + 8));
+        if (get_u4(constant) != CONSTANT_Methodref || !ref_name || !ref_descriptor ||
+            class_add_method_ref(cls, ref_name, ref_descriptor) < 0) {
+            printf("Error: bad constant #%u in class %s\n", i + 1, name);
+            class_destroy(cls);
+            return NULL;
+        }
+    }
+    cls->container = container;
+    cls->container_class = index;
+    return cls;
+}
+
+/* Read method entry index into method. Returns 0, or -1 if it is corrupt. */
+static int read_method_entry(const Container* container, uint32_t index, ContainerMethod* method) {
+    const uint8_t* entry = container->methods + index * CONTAINER_METHOD_SIZE;
+    uint32_t code_offset = get_u4(entry + 8);
+
+    method->name = container_string(container, get_u4(entry));
+    method->descriptor = container_string(container, get_u4(entry + 4));
+    method->code_length = get_u4(entry + 12);
+    method->max_stack = get_u2(entry + 16);
+    method->max_locals = get_u2(entry + 18);
+    if (!method->name || !method->descriptor ||
+        !in_file(container, code_offset, method->code_length, 1) ||
+        method->code_length > INT32_MAX) {
+        return -1;
+    }
+    method->code = container->data + code_offset;
+    return 0;
+}
+
+/*
+ * Look a method of class entry class_index up in the index, by name and by
+ * descriptor unless that is NULL. Returns 0 and fills in method if found.
+ */
+int container_find_method(const Container* container, int class_index,
+                          const char* name, const char* descriptor,
+                          ContainerMethod* method) {
+    const uint8_t* entry;
+    uint32_t first, count;
+    int low, high, found = -1;
+
+    if (class_index < 0 || (uint32_t)class_index >= container->class_count) {
+        return -1;
+    }
+    entry = container->classes + class_index * CONTAINER_CLASS_SIZE;
+    first = get_u4(entry + 4);
+    count = get_u4(entry + 8);
+    if (first > container->method_count || count > container->method_count - first) {
+        return -1;
+    }
+
+    /* Binary search for the first entry with this name */
+    low = 0;
+    high = (int)count - 1;
+    while (low <= high) {
+        int mid = low + (high - low) / 2;
+        int cmp;
+        if (read_method_entry(container, first + mid, method) != 0) {
+            return -1;
+        }
+        cmp = strcmp(name, method->name);
+        if (cmp <= 0) {
+            if (cmp == 0) {
+                found = mid;
+            }
+            high = mid - 1;
+        } else {
+            low = mid + 1;
+        }
+    }
+
+    /* Overloads sit next to each other, ordered by descriptor */
+    for (int i = found; i >= 0 && (uint32_t)i < count; i++) {
+        if (read_method_entry(container, first + i, method) != 0 ||
+            strcmp(method->name, name) != 0) {
+            break;
+        }
+        if (!descriptor || strcmp(method->descriptor, descriptor) == 0) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Add a method of a container class to it on first use */
+Method* container_load_method(Class* cls, const char* name, const char* descriptor) {
+    ContainerMethod found;
+    Method* method;
+
+    if (container_find_method(cls->container, cls->container_class, name, descriptor, &found) != 0) {
+        return NULL;
+    }
+    /* The code stays in the mapping; the class only points at it */
+    method = class_add_method(cls, found.name, found.descriptor,
+                              (uint8_t*)found.code, (int)found.code_length);
+    if (method) {
+        method->max_stack = found.max_stack;
+        if (found.max_locals > method->locals_count) {
+            method->locals_count = found.max_locals;
+        }
+        method->limits_declared = 1;
+    }
+    return method;
+}
+
+/* qsort helpers for the writer: sort classes by name, methods by name and descriptor */
+static int compare_classes(const void* a, const void* b) {
+    return strcmp((*(Class* const*)a)->name, (*(Class* const*)b)->name);
+}
+
+static int compare_methods(const void* a, const void* b) {
+    const Method* x = *(Method* const*)a;
+    const Method* y = *(Method* const*)b;
+    int cmp = strcmp(x->name, y->name);
+    return cmp != 0 ? cmp : strcmp(x->descriptor, y->descriptor);
+}
+
+/* Append a NUL-terminated string at *end and return its offset */
+static uint32_t write_string(uint8_t* buffer, uint32_t* end, const char* s) {
+    uint32_t offset = *end;
+    size_t length = strlen(s) + 1;
+    memcpy(buffer + offset, s, length);
+    *end += (uint32_t)length;
+    return offset;
+}
+
+/*
+ * Check that a class can be written to a container: its methods must be
+ * static, have code that verifies and no exception handlers, and its
+ * constants must all be Methodrefs to its own methods. Returns 0, or -1
+ * with the reason in reason. Verifies every method as a side effect.
+ */
+int container_check(Class* cls, char* reason, size_t size) {
+    for (int i = 0; i < cls->method_count; i++) {
+        Method* method = &cls->methods[i];
+        if ((method->access_flags & (ACC_STATIC | ACC_ABSTRACT | ACC_NATIVE)) != ACC_STATIC) {
+            /* Method entries have no access flags; they all load as static */
+            snprintf(reason, size, "cannot write %s.%s, which is not a static method with code",
+                     cls->name, method->name);
+            return -1;
+        }
+        if (method_prepare(method) != 0) {
+            snprintf(reason, size, "cannot write unverifiable method %s.%s", cls->name,
+                     method->name);
+            return -1;
+        }
+        if (method->handler_count > 0) {
+            /* The container format has no exception tables */
+            snprintf(reason, size, "cannot write exception handlers of %s.%s", cls->name,
+                     method->name);
+            return -1;
+        }
+    }
+    for (int i = 1; i < cls->constant_count; i++) {
+        const Constant* constant = &cls->constants[i];
+        if (constant->tag != CONSTANT_Methodref || constant->class_name) {
+            /* The container format holds only Methodrefs to the class's own methods */
+            snprintf(reason, size, "cannot write constant #%d of %s, which is not a Methodref "
+                     "to its own methods", i, cls->name);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Write classes, with all their methods, to a container file. Every method
+ * is verified first so the index can record its max_stack and max_locals.
+ * Classes that container_check() refuses are reported and nothing is
+ * written.
+ */
+int container_write(const char* filename, Class** classes, int class_count) {
+    Class** sorted = (Class**)malloc(sizeof(Class*) * (class_count > 0 ? class_count : 1));
+    Method* methods[MAX_METHODS];
+    uint32_t method_total = 0, constant_total = 0, size;
+    uint32_t class_index, method_index, constant_area, end;
+    uint8_t* buffer = NULL;
+    uint32_t next_method = 0, next_constant = 0;
+    FILE* file;
+    int status = -1;
+
+    if (!sorted) {
+        printf("Error: out of memory\n");
+        return -1;
+    }
+    memcpy(sorted, classes, sizeof(Class*) * class_count);
+    qsort(sorted, class_count, sizeof(Class*), compare_classes);
+
+    /* Size everything up front */
+    size = CONTAINER_HEADER_SIZE;
+    for (int c = 0; c < class_count; c++) {
+        Class* cls = sorted[c];
+        char reason[160];
+        if (container_check(cls, reason, sizeof(reason)) != 0) {
+            printf("Error: %s\n", reason);
+            goto out;
+        }
+        size += CONTAINER_CLASS_SIZE + (uint32_t)strlen(cls->name) + 1;
+        for (int i = 0; i < cls->method_count; i++) {
+            const Method* method = &cls->methods[i];
+            size += CONTAINER_METHOD_SIZE + (uint32_t)strlen(method->name) + 1 +
+                    (uint32_t)strlen(method->descriptor) + 1 + (uint32_t)method->code_length;
+        }
+        for (int i = 1; i < cls->constant_count; i++) {
+            const Constant* constant = &cls->constants[i];
+            size += CONTAINER_CONSTANT_SIZE + (uint32_t)strlen(constant->name) + 1 +
+                    (uint32_t)strlen(constant->descriptor) + 1;
+        }
+        method_total += (uint32_t)cls->method_count;
+        constant_total += (uint32_t)(cls->constant_count - 1);
+    }
+
+    buffer = (uint8_t*)calloc(size, 1);
+    if (!buffer) {
+        printf("Error: out of memory\n");
+        goto out;
+    }
+    class_index = CONTAINER_HEADER_SIZE;
+    method_index = class_index + (uint32_t)class_count * CONTAINER_CLASS_SIZE;
+    constant_area = method_index + method_total * CONTAINER_METHOD_SIZE;
+    end = constant_area + constant_total * CONTAINER_CONSTANT_SIZE;
+
+    put_u4(buffer, CONTAINER_MAGIC);
+    put_u2(buffer + 4, CONTAINER_VERSION);
+    put_u2(buffer + 6, 0);
+    put_u4(buffer + 8, size);
+    put_u4(buffer + 12, (uint32_t)class_count);
+    put_u4(buffer + 16, class_index);
+    put_u4(buffer + 20, method_total);
+    put_u4(buffer + 24, method_index);
+
+    for (int c = 0; c < class_count; c++) {
+        Class* cls = sorted[c];
+        uint8_t* entry = buffer + class_index + c * CONTAINER_CLASS_SIZE;
+
+        put_u4(entry, write_string(buffer, &end, cls->name));
+        put_u4(entry + 4, next_method);
+        put_u4(entry + 8, (uint32_t)cls->method_count);
+        put_u4(entry + 12, constant_area + next_constant * CONTAINER_CONSTANT_SIZE);
+        put_u4(entry + 16, (uint32_t)(cls->constant_count - 1));
+
+        for (int i = 1; i < cls->constant_count; i++) {
+            uint8_t* constant = buffer + constant_area + next_constant++ * CONTAINER_CONSTANT_SIZE;
+            put_u4(constant, (uint32_t)cls->constants[i].tag);
+            put_u4(constant + 4, write_string(buffer, &end, cls->constants[i].name));
+            put_u4(constant + 8, write_string(buffer, &end, cls->constants[i].descriptor));
+        }
+
+        for (int i = 0; i < cls->method_count; i++) {
+            methods[i] = &cls->methods[i];
+        }
+        qsort(methods, cls->method_count, sizeof(Method*), compare_methods);
+        for (int i = 0; i < cls->method_count; i++) {
+            Method* method = methods[i];
+            uint8_t* m = buffer + method_index + next_method++ * CONTAINER_METHOD_SIZE;
+            put_u4(m, write_string(buffer, &end, method->name));
+            put_u4(m + 4, write_string(buffer, &end, method->descriptor));
+            put_u4(m + 8, end);
+            put_u4(m + 12, (uint32_t)method->code_length);
+            put_u2(m + 16, (uint16_t)method->max_stack);
+            put_u2(m + 18, (uint16_t)(method->locals_count -
+                                      (method->prepared ? TOS_SCRATCH_LOCALS : 0)));
+            memcpy(buffer + end, method->code, (size_t)method->code_length);
+            end += (uint32_t)method->code_length;
+        }
+    }
+
+    file = fopen(filename, "wb");
+    if (!file) {
+        printf("Error: Cannot create file %s\n", filename);
+        goto out;
+    }
+    if (fwrite(buffer, 1, size, file) != size) {
+        printf("Error: Cannot write container data\n");
+        fclose(file);
+        goto out;
+    }
+    fclose(file);
+    status = 0;
+
+out:
+    free(buffer);
+    free(sorted);
+    return status;
+}
@@ -16,4 +16,86 @@ int load_bytecode_file(const char* filename, uint8_t** bytecode, int* length);
 int save_bytecode_file(const char* filename, uint8_t* bytecode, int length);
 void free_bytecode(uint8_t* bytecode);
 
+/*
+ * Container format (version 2)
+ *
+ * Holds any number of classes and their methods. Every integer is
+ * big-endian, as in Java class files, and every structure has a fixed
+ * layout with no padding, so files move between hosts unchanged.
+ *
+ *   Header (32 bytes)
+ *     u4 magic                 CONTAINER_MAGIC ("ARUV")
+ *     u2 major_version         CONTAINER_VERSION
+ *     u2 minor_version
+ *     u4 file_size
+ *     u4 class_count
+ *     u4 class_index_offset    Class entries, sorted by name
+ *     u4 method_count
+ *     u4 method_index_offset   Method entries, grouped by class and sorted
+ *                              by name, then descriptor, within each class
+ *     u4 reserved
+ *
+ *   Class entry (24 bytes)
+ *     u4 name_offset           Offsets of NUL-terminated strings
+ *     u4 first_method          Index of the class's first method entry
+ *     u4 method_count
+ *     u4 constant_offset       Constant entries; entry i is pool index i+1
+ *     u4 constant_count
+ *     u4 reserved
+ *
+ *   Constant entry (12 bytes)
+ *     u4 tag                   CONSTANT_Methodref
+ *     u4 name_offset
+ *     u4 descriptor_offset
+ *
+ *   Method entry (24 bytes), of a static method with code
+ *     u4 name_offset
+ *     u4 descriptor_offset
+ *     u4 code_offset
+ *     u4 code_length
+ *     u2 max_stack
+ *     u2 max_locals
+ *     u4 reserved
+ *
+ * All offsets are from the start of the file.
+ */
+#define CONTAINER_MAGIC 0x41525556
+#define CONTAINER_VERSION 2
+#define CONTAINER_HEADER_SIZE 32
+#define CONTAINER_CLASS_SIZE 24
+#define CONTAINER_CONSTANT_SIZE 12
+#define CONTAINER_METHOD_SIZE 24
+
+/* An open container. The file is mapped, not read: code and strings handed
+ * out by the loader point straight into the mapping, and only the pages
+ * actually used are ever read from disk. */
+typedef struct Container {
+    const uint8_t* data;
+    size_t size;
+    int mapped;             /* data is an mmap (else a malloc'd copy) */
+    uint32_t class_count;
+    uint32_t method_count;
+    const uint8_t* classes;
+    const uint8_t* methods;
+} Container;
+
+/* One method as described by the container's index */
+typedef struct {
+    const char* name;
+    const char* descriptor;
+    const uint8_t* code;
+    uint32_t code_length;
+    uint16_t max_stack;
+    uint16_t max_locals;
+} ContainerMethod;
+
+int container_open(const char* filename, Container* container);
+void container_close(Container* container);
+Class* container_load_class(Container* container, const char* name);
+int container_find_method(const Container* container, int class_index,
+                          const char* name, const char* descriptor,
+                          ContainerMethod* method);
+int container_check(Class* cls, char* reason, size_t size);
+int container_write(const char* filename, Class** classes, int class_count);
+
 #endif
@@ -0,0 +1,1061 @@
+#include "jvm.h"
+#include <pthread.h>
+
+/*
+ * Classes, methods and the constant pool
+ *
+ * A Class owns its methods and a constant pool of symbolic references.
+ * invokestatic names its target through a Methodref constant; the
+ * interpreter resolves it by name the first time a call site runs and
+ * caches the Method* in the constant and in that call site.
+ *
+ * Classes that name each other, as superclass, interface or owner of a
+ * member, are put in a ClassRegistry, where the names are looked up.
+ * class_link() does that the first time code needs the class's layout:
+ * it links the superclass and interfaces, lays out the instance fields
+ * after the inherited ones, so code of a superclass finds its fields at
+ * the same slots in any subclass, and builds the dispatch tables.
+ *
+ * The vtable holds the method an object of the class runs for each
+ * virtual method slot: a copy of the superclass's, with overriding
+ * methods in their slots and new ones appended. The itable has an entry
+ * for each interface the class implements with its methods in the
+ * interface's order, and is searched for the interface, which a call
+ * site's inline cache makes rare.
+ *
+ * A name a registry doesn't have is looked up among the built-in classes
+ * (class_system()): java/lang/Throwable and the exceptions and errors the
+ * interpreter raises, which have no fields and no methods, as their
+ * constructors would do nothing, and java/lang/String and StringBuilder,
+ * whose methods are native (string.c).
+ *
+ * Every class has an id, kept in its objects' type words; class_by_id()
+ * maps it back. A class must outlive its objects, and the classes of a
+ * registry are destroyed together, so no call site is left caching the
+ * id of a class that is gone.
+ */
+
+/* Live classes by id; 0 is never used. Entries are written under the
+ * lock and read without it, since a class's entry only changes when no
+ * object of it is left. */
+static Class* class_ids[MAX_CLASS_IDS];
+static uint32_t next_class_id = 1;
+static pthread_mutex_t class_ids_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Take a free id for cls. Ids are handed out round-robin, so a freed one
+ * is reused as late as possible. Returns 0 if every id is taken. */
+static uint32_t assign_class_id(Class* cls) {
+    uint32_t id = 0;
+
+    pthread_mutex_lock(&class_ids_lock);
+    for (int i = 0; i < MAX_CLASS_IDS - 1; i++) {
+        uint32_t candidate = next_class_id;
+        next_class_id = next_class_id + 1 < MAX_CLASS_IDS ? next_class_id + 1 : 1;
+        if (!class_ids[candidate]) {
+            class_ids[candidate] = cls;
+            id = candidate;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&class_ids_lock);
+    return id;
+}
+
+/* The class with id, or NULL */
+Class* class_by_id(uint32_t id) {
+    return id < MAX_CLASS_IDS ? class_ids[id] : NULL;
+}
+
+/* Heap copy of a string (strdup is not C99) */
+static char* copy_string(const char* s) {
+    char* copy;
+    if (!s) {
+        return NULL;
+    }
+    copy = (char*)malloc(strlen(s) + 1);
+    if (copy) {
+        strcpy(copy, s);
+    }
+    return copy;
+}
+
+/* Create an empty class */
+Class* class_create(const char* name) {
+    Class* cls = (Class*)malloc(sizeof(Class));
+    if (!cls) {
+        return NULL;
+    }
+    memset(cls, 0, sizeof(Class));
+    cls->id = assign_class_id(cls);
+    if (cls->id == 0) {
+        printf("Error: too many classes\n");
+        free(cls);
+        return NULL;
+    }
+    cls->name = copy_string(name);
+    cls->constant_count = 1;
+    return cls;
+}
+
+/* Free memory of a class, unless it lies in the snapshot image the class
+ * was loaded from */
+static void class_free(const Class* cls, void* p) {
+    if (!cls->registry || !snapshot_owns(cls->registry, p)) {
+        free(p);
+    }
+}
+
+/* Destroy a class and everything it owns. Its objects must be gone. */
+void class_destroy(Class* cls) {
+    if (!cls) {
+        return;
+    }
+    pthread_mutex_lock(&class_ids_lock);
+    class_ids[cls->id] = NULL;
+    pthread_mutex_unlock(&class_ids_lock);
+    for (int i = 0; i < cls->method_count; i++) {
+        Method* method = &cls->methods[i];
+        method_release(method);
+        class_free(cls, method->handlers);
+        class_free(cls, method->name);
+        class_free(cls, method->descriptor);
+    }
+    for (int i = 0; i < cls->field_count; i++) {
+        class_free(cls, cls->fields[i].name);
+        class_free(cls, cls->fields[i].descriptor);
+    }
+    for (int i = 1; i < cls->constant_count; i++) {
+        class_free(cls, cls->constants[i].name);
+        class_free(cls, cls->constants[i].class_name);
+        class_free(cls, cls->constants[i].descriptor);
+        class_free(cls, cls->constants[i].chars);
+    }
+    for (int i = 0; i < cls->interface_count; i++) {
+        class_free(cls, cls->interface_names[i]);
+    }
+    for (int i = 0; i < cls->itable_length; i++) {
+        free(cls->itable[i].methods);
+    }
+    free(cls->itable);
+    free(cls->vtable);
+    class_free(cls, cls->super_name);
+    free(cls->name);
+    free(cls->class_file);
+    free(cls);
+}
+
+/* Set the superclass by name; java/lang/Object, the default, needs none.
+ * Returns 0, or -1 if the class is already linked. */
+int class_set_super(Class* cls, const char* name) {
+    if (cls->linked) {
+        printf("Error: class %s is already in use\n", cls->name);
+        return -1;
+    }
+    free(cls->super_name);
+    cls->super_name = NULL;
+    if (name && strcmp(name, "java/lang/Object") != 0) {
+        cls->super_name = copy_string(name);
+        if (!cls->super_name) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Name an interface the class implements, or an interface extends.
+ * Returns 0, or -1 on error. */
+int class_add_interface(Class* cls, const char* name) {
+    if (cls->linked) {
+        printf("Error: class %s is already in use\n", cls->name);
+        return -1;
+    }
+    if (cls->interface_count >= MAX_INTERFACES) {
+        printf("Error: too many interfaces in class %s\n", cls->name);
+        return -1;
+    }
+    cls->interface_names[cls->interface_count] = copy_string(name);
+    if (!cls->interface_names[cls->interface_count]) {
+        return -1;
+    }
+    cls->interface_count++;
+    return 0;
+}
+
+/* Make cls an interface: it has abstract methods and no objects */
+void class_set_interface(Class* cls) {
+    cls->access_flags |= ACC_INTERFACE | ACC_ABSTRACT;
+}
+
+/*
+ * Skip one field type in a descriptor and return the number of stack
+ * slots it takes (long and double take two), or -1 if it is malformed.
+ */
+static int field_type_slots(const char** p) {
+    const char* q = *p;
+    int slots;
+
+    while (*q == '[') {
+        q++;
+    }
+    switch (*q) {
+        case 'B': case 'C': case 'F': case 'I': case 'S': case 'Z':
+            slots = 1;
+            break;
+        case 'J': case 'D':
+            slots = 2;
+            break;
+        case 'L':
+            while (*q && *q != ';') {
+                q++;
+            }
+            if (*q != ';') {
+                return -1;
+            }
+            slots = 1;
+            break;
+        default:
+            return -1;
+    }
+    if (q != *p && **p == '[') {
+        slots = 1;              /* Arrays are references */
+    }
+    *p = q + 1;
+    return slots;
+}
+
+/*
+ * Count the argument and return slots of a method descriptor such as
+ * "(II)I". Returns 0 on success, -1 if the descriptor is malformed.
+ */
+int parse_descriptor(const char* descriptor, int* arg_slots, int* return_slots) {
+    const char* p = descriptor;
+    int args = 0;
+    int slots;
+
+    if (!p || *p != '(') {
+        return -1;
+    }
+    p++;
+    while (*p && *p != ')') {
+        if ((slots = field_type_slots(&p)) < 0) {
+            return -1;
+        }
+        args += slots;
+    }
+    if (*p != ')') {
+        return -1;
+    }
+    p++;
+    if (p[0] == 'V' && p[1] == '\0') {
+        *return_slots = 0;
+    } else if ((slots = field_type_slots(&p)) >= 0 && *p == '\0') {
+        *return_slots = slots;
+    } else {
+        return -1;
+    }
+    *arg_slots = args;
+    return 0;
+}
+
+/*
+ * Add a method with the given ACC_ flags; without ACC_STATIC, it takes the
+ * receiver in local 0. The code is not copied and must outlive the class.
+ * Instance methods can't be added once the class is linked, as they
+ * would be missing from its vtable.
+ */
+Method* class_define_method(Class* cls, int access_flags, const char* name,
+                            const char* descriptor, uint8_t* code, int code_length) {
+    Method* method;
+    int arg_slots, return_slots;
+
+    if (cls->method_count >= MAX_METHODS) {
+        printf("Error: too many methods in class %s\n", cls->name);
+        return NULL;
+    }
+    if (parse_descriptor(descriptor, &arg_slots, &return_slots) != 0) {
+        printf("Error: unsupported descriptor %s for %s\n", descriptor, name);
+        return NULL;
+    }
+    if (!(access_flags & ACC_STATIC)) {
+        if (cls->linked) {
+            printf("Error: class %s is already in use\n", cls->name);
+            return NULL;
+        }
+        arg_slots++;
+    }
+
+    method = &cls->methods[cls->method_count++];
+    memset(method, 0, sizeof(Method));
+    method->name = copy_string(name);
+    method->descriptor = copy_string(descriptor);
+    method->owner = cls;
+    method->access_flags = access_flags;
+    method->vtable_index = -1;
+    method->arg_slots = arg_slots;
+    method->return_slots = return_slots;
+    method->code = code;
+    method->code_length = code_length;
+    method->locals_count = arg_slots;
+    if (access_flags & ACC_ABSTRACT) {
+        cls->access_flags |= ACC_ABSTRACT;
+    }
+    return method;
+}
+
+/* Add a static method */
+Method* class_add_method(Class* cls, const char* name, const char* descriptor,
+                         uint8_t* code, int code_length) {
+    return class_define_method(cls, ACC_STATIC, name, descriptor, code, code_length);
+}
+
+/* Add an instance method, called with invokevirtual or invokespecial */
+Method* class_add_instance_method(Class* cls, const char* name, const char* descriptor,
+                                  uint8_t* code, int code_length) {
+    return class_define_method(cls, 0, name, descriptor, code, code_length);
+}
+
+/* Add an abstract method, which makes the class abstract */
+Method* class_add_abstract_method(Class* cls, const char* name, const char* descriptor) {
+    return class_define_method(cls, ACC_ABSTRACT, name, descriptor, NULL, 0);
+}
+
+/* Add an instance method implemented by a C function, as the built-in
+ * classes have */
+Method* class_add_native_method(Class* cls, const char* name, const char* descriptor,
+                                NativeFunction native) {
+    Method* method = class_define_method(cls, ACC_NATIVE, name, descriptor, NULL, 0);
+    if (method) {
+        method->native = native;
+    }
+    return method;
+}
+
+/*
+ * Append an entry to a method's exception table, whose order is the order
+ * handlers are tried in. Pcs are checked when the method is decoded.
+ * Returns 0, or -1 if the method has already run.
+ */
+int method_add_exception_handler(Method* method, int start_pc, int end_pc, int handler_pc,
+                                 int catch_type) {
+    ExceptionHandler* handlers;
+    ExceptionHandler* handler;
+
+    if (method->prepared) {
+        printf("Error: method %s is already in use\n", method->name);
+        return -1;
+    }
+    if ((start_pc | end_pc | handler_pc | catch_type) & ~0xffff) {
+        printf("Error: bad exception handler in method %s\n", method->name);
+        return -1;
+    }
+    handlers = (ExceptionHandler*)realloc(method->handlers,
+                                          sizeof(ExceptionHandler) * (method->handler_count + 1));
+    if (!handlers) {
+        printf("Error: out of memory\n");
+        return -1;
+    }
+    method->handlers = handlers;
+    handler = &handlers[method->handler_count++];
+    handler->start_pc = (uint16_t)start_pc;
+    handler->end_pc = (uint16_t)end_pc;
+    handler->handler_pc = (uint16_t)handler_pc;
+    handler->catch_type = (uint16_t)catch_type;
+    return 0;
+}
+
+/* Add a resolved member or class constant and return its index, or -1 */
+static int add_constant(Class* cls, int tag, const char* name, const char* descriptor) {
+    Constant* constant;
+
+    if (cls->constant_count >= MAX_CONSTANTS) {
+        printf("Error: constant pool of class %s is full\n", cls->name);
+        return -1;
+    }
+    constant = &cls->constants[cls->constant_count];
+    memset(constant, 0, sizeof(Constant));
+    constant->tag = tag;
+    constant->resolved = 1;
+    constant->name = copy_string(name);
+    constant->descriptor = copy_string(descriptor);
+    return cls->constant_count++;
+}
+
+/* Add a Methodref constant and return its constant pool index, or -1 */
+int class_add_method_ref(Class* cls, const char* name, const char* descriptor) {
+    return add_constant(cls, CONSTANT_Methodref, name, descriptor);
+}
+
+/* Add a Methodref constant for a method of another class, or -1 */
+int class_add_external_method_ref(Class* cls, const char* class_name, const char* name,
+                                  const char* descriptor) {
+    int index = add_constant(cls, CONSTANT_Methodref, name, descriptor);
+    if (index >= 0) {
+        cls->constants[index].class_name = copy_string(class_name);
+    }
+    return index;
+}
+
+/* Add an InterfaceMethodref constant, as invokeinterface uses, or -1 */
+int class_add_interface_method_ref(Class* cls, const char* class_name, const char* name,
+                                   const char* descriptor) {
+    int index = class_add_external_method_ref(cls, class_name, name, descriptor);
+    if (index >= 0) {
+        cls->constants[index].tag = CONSTANT_InterfaceMethodref;
+    }
+    return index;
+}
+
+/* Add a Fieldref constant for a field of cls itself, or -1 */
+int class_add_field_ref(Class* cls, const char* name, const char* descriptor) {
+    return add_constant(cls, CONSTANT_Fieldref, name, descriptor);
+}
+
+/* Add a Class constant, as used by new, or -1 */
+int class_add_class_ref(Class* cls, const char* name) {
+    return add_constant(cls, CONSTANT_Class, name, NULL);
+}
+
+/* Add a Long constant, as ldc2_w loads, and return its index, or -1.
+ * Like the class file format, it takes two pool indexes. */
+int class_add_long_constant(Class* cls, int64_t value) {
+    int index = add_constant(cls, CONSTANT_Long, NULL, NULL);
+    if (index < 0) {
+        return -1;
+    }
+    if (cls->constant_count >= MAX_CONSTANTS) {
+        printf("Error: constant pool of class %s is full\n", cls->name);
+        cls->constant_count--;
+        return -1;
+    }
+    cls->constants[index].wide = value;
+    memset(&cls->constants[cls->constant_count++], 0, sizeof(Constant));
+    return index;
+}
+
+/* Add a String constant, as ldc loads, with text in modified UTF-8, and
+ * return its index, or -1 */
+int class_add_string_constant(Class* cls, const char* text) {
+    int index = add_constant(cls, CONSTANT_String, text, NULL);
+    if (index < 0) {
+        return -1;
+    }
+    if (string_decode_constant(&cls->constants[index], text) != 0) {
+        printf("Error: bad string constant in class %s\n", cls->name);
+        free(cls->constants[index].name);
+        cls->constant_count--;
+        return -1;
+    }
+    return index;
+}
+
+#ifdef JVM_FLOAT
+/* Add a Float constant, as ldc loads, and return its index, or -1 */
+int class_add_float_constant(Class* cls, float value) {
+    int index = add_constant(cls, CONSTANT_Float, NULL, NULL);
+    if (index >= 0) {
+        memcpy(&cls->constants[index].value, &value, sizeof(value));
+    }
+    return index;
+}
+
+/* Add a Double constant and return its index, or -1 */
+int class_add_double_constant(Class* cls, double value) {
+    int64_t bits;
+    int index;
+
+    memcpy(&bits, &value, sizeof(bits));
+    index = class_add_long_constant(cls, bits);
+    if (index >= 0) {
+        cls->constants[index].tag = CONSTANT_Double;
+    }
+    return index;
+}
+#endif
+
+/* Add an instance field and return its index, or -1. Fields take one
+ * word each, so long and double fields are not supported. */
+int class_add_field(Class* cls, const char* name, const char* descriptor) {
+    const char* p = descriptor;
+    Field* field;
+
+    if (cls->linked) {
+        printf("Error: class %s is already in use\n", cls->name);
+        return -1;
+    }
+    if (cls->field_count >= MAX_FIELDS) {
+        printf("Error: too many fields in class %s\n", cls->name);
+        return -1;
+    }
+    if (field_type_slots(&p) != 1 || *p != '\0') {
+        printf("Error: unsupported field type %s for %s\n", descriptor, name);
+        return -1;
+    }
+    field = &cls->fields[cls->field_count];
+    field->name = copy_string(name);
+    field->descriptor = copy_string(descriptor);
+    field->owner = cls;
+    field->slot = -1;
+    if (!field->name || !field->descriptor) {
+        free(field->name);
+        free(field->descriptor);
+        return -1;
+    }
+    return cls->field_count++;
+}
+
+/* class_find(), reporting a class that is missing */
+static Class* find_class(const Class* cls, const char* name) {
+    Class* found = class_find(cls, name);
+    if (!found) {
+        printf("Error: class %s is not loaded\n", name);
+    }
+    return found;
+}
+
+/* Is method called through the dispatch tables? Static and private
+ * methods and constructors are called directly. */
+static int is_virtual(const Method* method) {
+    return !(method->access_flags & (ACC_STATIC | ACC_PRIVATE)) && method->name[0] != '<';
+}
+
+static int same_signature(const Method* a, const Method* b) {
+    return strcmp(a->name, b->name) == 0 && strcmp(a->descriptor, b->descriptor) == 0;
+}
+
+/* Does method take an object of its own class as an argument? The
+ * verifier trusts such an argument to be one, which callers can only
+ * promise when they call the method by its own class. */
+static int takes_own_class(const Method* method) {
+    size_t length = strlen(method->owner->name);
+    const char* p = method->descriptor + 1;
+
+    while (*p && *p != ')') {
+        const char* start = p;
+        if (field_type_slots(&p) < 0) {
+            return 0;
+        }
+        if (*start == 'L' && (size_t)(p - start) == length + 2 &&
+            memcmp(start + 1, method->owner->name, length) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Can method run for calls to declared, a method of another class? */
+static int check_override(const Method* method, const Method* declared) {
+    if (method->owner != declared->owner && takes_own_class(method)) {
+        printf("Error: %s.%s%s takes a %s, so it cannot implement %s.%s\n",
+               method->owner->name, method->name, method->descriptor, method->owner->name,
+               declared->owner->name, declared->name);
+        return -1;
+    }
+    return 0;
+}
+
+/* The superclass's vtable, with cls's virtual methods put in the slots of
+ * those they override or appended */
+static int build_vtable(Class* cls) {
+    int length = cls->super ? cls->super->vtable_length : 0;
+    Method** vtable = (Method**)malloc(sizeof(Method*) * (size_t)(length + cls->method_count + 1));
+
+    if (!vtable) {
+        printf("Error: out of memory\n");
+        return -1;
+    }
+    if (length > 0) {
+        memcpy(vtable, cls->super->vtable, sizeof(Method*) * (size_t)length);
+    }
+    for (int i = 0; i < cls->method_count; i++) {
+        Method* method = &cls->methods[i];
+        int slot = 0;
+
+        if (!is_virtual(method)) {
+            continue;
+        }
+        while (slot < length && !same_signature(vtable[slot], method)) {
+            slot++;
+        }
+        if (slot < length && check_override(method, vtable[slot]) != 0) {
+            free(vtable);
+            return -1;
+        }
+        if (slot == length) {
+            length++;
+        }
+        vtable[slot] = method;
+        method->vtable_index = slot;
+    }
+    cls->vtable = vtable;
+    cls->vtable_length = length;
+    return 0;
+}
+
+/* An interface's vtable lists its methods, which are all abstract; an
+ * itable entry has the same order */
+static int build_interface_table(Class* cls) {
+    Method** methods = (Method**)malloc(sizeof(Method*) * (size_t)(cls->method_count + 1));
+    int length = 0;
+
+    if (!methods) {
+        printf("Error: out of memory\n");
+        return -1;
+    }
+    for (int i = 0; i < cls->method_count; i++) {
+        Method* method = &cls->methods[i];
+        if (!is_virtual(method)) {
+            continue;
+        }
+        if (!(method->access_flags & ACC_ABSTRACT)) {
+            printf("Error: default method %s.%s is not supported\n", cls->name, method->name);
+            free(methods);
+            return -1;
+        }
+        method->vtable_index = length;
+        methods[length++] = method;
+    }
+    cls->vtable = methods;
+    cls->vtable_length = length;
+    return 0;
+}
+
+/* Give cls an itable entry for interface and its superinterfaces, unless
+ * it has them. Each method is found in cls's vtable; one cls doesn't
+ * implement stays the abstract interface method, and fails when called. */
+static int add_itable_entry(Class* cls, Class* interface) {
+    ITableEntry* itable;
+    Method** methods;
+
+    for (int i = 0; i < cls->itable_length; i++) {
+        if (cls->itable[i].interface == interface) {
+            return 0;
+        }
+    }
+    itable = (ITableEntry*)realloc(cls->itable, sizeof(ITableEntry) * (size_t)(cls->itable_length + 1));
+    if (!itable) {
+        printf("Error: out of memory\n");
+        return -1;
+    }
+    cls->itable = itable;
+    methods = (Method**)malloc(sizeof(Method*) * (size_t)(interface->vtable_length + 1));
+    if (!methods) {
+        printf("Error: out of memory\n");
+        return -1;
+    }
+    for (int i = 0; i < interface->vtable_length; i++) {
+        Method* declared = interface->vtable[i];
+        methods[i] = declared;
+        for (int slot = 0; slot < cls->vtable_length; slot++) {
+            if (same_signature(cls->vtable[slot], declared)) {
+                if (check_override(cls->vtable[slot], declared) != 0) {
+                    free(methods);
+                    return -1;
+                }
+                methods[i] = cls->vtable[slot];
+                break;
+            }
+        }
+    }
+    itable[cls->itable_length].interface = interface;
+    itable[cls->itable_length].methods = methods;
+    cls->itable_length++;
+    for (int i = 0; i < interface->interface_count; i++) {
+        if (add_itable_entry(cls, interface->interfaces[i]) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Free the dispatch tables */
+static void free_tables(Class* cls) {
+    for (int i = 0; i < cls->itable_length; i++) {
+        free(cls->itable[i].methods);
+    }
+    free(cls->itable);
+    free(cls->vtable);
+    cls->itable = NULL;
+    cls->itable_length = 0;
+    cls->vtable = NULL;
+    cls->vtable_length = 0;
+}
+
+/*
+ * Link a class the first time its layout or dispatch tables are needed:
+ * link its superclass and interfaces, assign its fields the slots after
+ * the inherited ones and build its vtable and itable. Returns 0, or -1
+ * if a class it names is missing or the hierarchy is unusable.
+ */
+int class_link(Class* cls) {
+    int slot;
+
+    if (cls->linked > 0) {
+        return 0;
+    }
+    if (cls->linked < 0) {
+        printf("Error: class %s inherits from itself\n", cls->name);
+        return -1;
+    }
+    cls->linked = -1;
+
+    if (cls->super_name) {
+        cls->super = find_class(cls, cls->super_name);
+        if (!cls->super || class_link(cls->super) != 0) {
+            goto fail;
+        }
+        if (cls->super->access_flags & ACC_INTERFACE) {
+            printf("Error: class %s extends interface %s\n", cls->name, cls->super->name);
+            goto fail;
+        }
+        if (cls->super->access_flags & ACC_FINAL) {
+            printf("Error: class %s extends final class %s\n", cls->name, cls->super->name);
+            goto fail;
+        }
+    }
+    for (int i = 0; i < cls->interface_count; i++) {
+        cls->interfaces[i] = find_class(cls, cls->interface_names[i]);
+        if (!cls->interfaces[i] || class_link(cls->interfaces[i]) != 0) {
+            goto fail;
+        }
+        if (!(cls->interfaces[i]->access_flags & ACC_INTERFACE)) {
+            printf("Error: %s is not an interface\n", cls->interfaces[i]->name);
+            goto fail;
+        }
+    }
+
+    slot = cls->super ? cls->super->instance_fields : 0;
+    cls->ref_map = cls->super ? cls->super->ref_map : 0;
+    if (slot + cls->field_count > MAX_FIELDS) {
+        printf("Error: too many fields in class %s\n", cls->name);
+        goto fail;
+    }
+    for (int i = 0; i < cls->field_count; i++) {
+        const char* descriptor = cls->fields[i].descriptor;
+        if (descriptor[0] == 'L' || descriptor[0] == '[') {
+            cls->ref_map |= 1u << slot;
+        }
+        cls->fields[i].slot = slot++;
+    }
+    cls->instance_fields = slot;
+
+    if (cls->access_flags & ACC_INTERFACE) {
+        if (build_interface_table(cls) != 0) {
+            goto fail;
+        }
+    } else {
+        if (build_vtable(cls) != 0) {
+            goto fail;
+        }
+        /* Inherited interfaces first, with this class's overrides */
+        for (int i = 0; cls->super && i < cls->super->itable_length; i++) {
+            if (add_itable_entry(cls, cls->super->itable[i].interface) != 0) {
+                goto fail;
+            }
+        }
+        for (int i = 0; i < cls->interface_count; i++) {
+            if (add_itable_entry(cls, cls->interfaces[i]) != 0) {
+                goto fail;
+            }
+        }
+    }
+    cls->linked = 1;
+    return 0;
+
+fail:
+    free_tables(cls);
+    cls->super = NULL;
+    cls->linked = 0;
+    return -1;
+}
+
+/* Is cls, which is linked, of is or a subclass of it, or implements it? */
+int class_is_subtype(const Class* cls, const Class* of) {
+    for (const Class* c = cls; c; c = c->super) {
+        if (c == of) {
+            return 1;
+        }
+    }
+    for (int i = 0; i < cls->itable_length; i++) {
+        if (cls->itable[i].interface == of) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Find an instance field, declared by the class or inherited */
+Field* class_find_field(Class* cls, const char* name, const char* descriptor) {
+    if (class_link(cls) != 0) {
+        return NULL;
+    }
+    for (; cls; cls = cls->super) {
+        for (int i = 0; i < cls->field_count; i++) {
+            Field* field = &cls->fields[i];
+            if (strcmp(field->name, name) == 0 && strcmp(field->descriptor, descriptor) == 0) {
+                return field;
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Find a method by name, and by descriptor unless descriptor is NULL.
+ * Classes loaded from a container pull the method in on first use. */
+Method* class_find_method(Class* cls, const char* name, const char* descriptor) {
+    for (int i = 0; i < cls->method_count; i++) {
+        Method* method = &cls->methods[i];
+        if (strcmp(method->name, name) == 0 &&
+            (!descriptor || strcmp(method->descriptor, descriptor) == 0)) {
+            return method;
+        }
+    }
+    if (cls->container) {
+        return container_load_method(cls, name, descriptor);
+    }
+    return NULL;
+}
+
+/* The method a reference to cls, which is linked, names: cls's own, else
+ * the nearest superclass's, else one of the interfaces' */
+Method* class_resolve_method(Class* cls, const char* name, const char* descriptor) {
+    Method* method = NULL;
+
+    for (Class* c = cls; c && !method; c = c->super) {
+        method = class_find_method(c, name, descriptor);
+    }
+    for (Class* c = cls; c && !method; c = c->super) {
+        for (int i = 0; i < c->interface_count && !method; i++) {
+            method = class_resolve_method(c->interfaces[i], name, descriptor);
+        }
+    }
+    return method;
+}
+
+/* The method an object of class cls runs for a call to declared, which
+ * cls must be a subtype of: from its vtable for a class method, from its
+ * itable for an interface method. NULL if cls doesn't implement the
+ * interface. */
+Method* class_select_method(const Class* cls, Method* declared) {
+    if (declared->vtable_index < 0) {
+        return declared;
+    }
+    if (declared->owner->access_flags & ACC_INTERFACE) {
+        for (int i = 0; i < cls->itable_length; i++) {
+            if (cls->itable[i].interface == declared->owner) {
+                return cls->itable[i].methods[declared->vtable_index];
+            }
+        }
+        return NULL;
+    }
+    return cls->vtable[declared->vtable_index];
+}
+
+/* Create an empty registry */
+ClassRegistry* class_registry_create(void) {
+    ClassRegistry* registry = (ClassRegistry*)calloc(1, sizeof(ClassRegistry));
+    if (!registry) {
+        printf("Error: out of memory\n");
+    }
+    return registry;
+}
+
+/* Destroy a registry and its classes */
+void class_registry_destroy(ClassRegistry* registry) {
+    if (!registry) {
+        return;
+    }
+    for (int i = 0; i < registry->count; i++) {
+        class_destroy(registry->classes[i]);
+    }
+    snapshot_unmap(registry);
+    free(registry);
+}
+
+/* Hand a class to a registry, which destroys it with the others. Returns
+ * 0, or -1 if the name is taken or the registry is full. */
+int class_registry_add(ClassRegistry* registry, Class* cls) {
+    if (cls->registry || class_registry_find(registry, cls->name)) {
+        printf("Error: class %s is already loaded\n", cls->name);
+        return -1;
+    }
+    if (registry->count >= MAX_CLASSES) {
+        printf("Error: too many classes\n");
+        return -1;
+    }
+    registry->classes[registry->count++] = cls;
+    cls->registry = registry;
+    return 0;
+}
+
+/* The class of the registry with this name, or NULL */
+Class* class_registry_find(const ClassRegistry* registry, const char* name) {
+    for (int i = 0; i < registry->count; i++) {
+        if (strcmp(registry->classes[i]->name, name) == 0) {
+            return registry->classes[i];
+        }
+    }
+    return NULL;
+}
+
+/* The throwables the interpreter raises and the String classes, with
+ * their superclasses */
+static const char* const system_classes[][2] = {
+    {THROWABLE_CLASS, NULL},
+    {"java/lang/Exception", THROWABLE_CLASS},
+    {"java/lang/Error", THROWABLE_CLASS},
+    {"java/lang/RuntimeException", "java/lang/Exception"},
+    {"java/lang/ArithmeticException", "java/lang/RuntimeException"},
+    {"java/lang/IndexOutOfBoundsException", "java/lang/RuntimeException"},
+    {"java/lang/ArrayIndexOutOfBoundsException", "java/lang/IndexOutOfBoundsException"},
+    {STRING_INDEX_EXCEPTION, "java/lang/IndexOutOfBoundsException"},
+    {"java/lang/NegativeArraySizeException", "java/lang/RuntimeException"},
+    {"java/lang/NullPointerException", "java/lang/RuntimeException"},
+    {"java/lang/VirtualMachineError", "java/lang/Error"},
+    {"java/lang/StackOverflowError", "java/lang/VirtualMachineError"},
+    {STRING_CLASS, NULL},
+    {STRING_BUILDER_CLASS, NULL}
+};
+
+static ClassRegistry* system_registry;
+static pthread_once_t system_once = PTHREAD_ONCE_INIT;
+
+/* Create and link the built-in classes, once per process. They are never
+ * destroyed, so their ids stay valid in any JVM. */
+static void create_system_classes(void) {
+    int count = (int)(sizeof(system_classes) / sizeof(system_classes[0]));
+    ClassRegistry* registry = class_registry_create();
+    int ok = registry != NULL;
+
+    for (int i = 0; ok && i < count; i++) {
+        Class* cls = class_create(system_classes[i][0]);
+        ok = cls && class_registry_add(registry, cls) == 0;
+        if (!ok) {
+            class_destroy(cls);
+        } else if (system_classes[i][1]) {
+            ok = class_set_super(cls, system_classes[i][1]) == 0;
+        }
+    }
+    ok = ok && string_define_classes(registry) == 0;
+    for (int i = 0; ok && i < count; i++) {
+        ok = class_link(registry->classes[i]) == 0;
+    }
+    if (!ok) {
+        class_registry_destroy(registry);
+        return;
+    }
+    system_registry = registry;
+}
+
+/* The built-in class with this name, or NULL */
+Class* class_system(const char* name) {
+    pthread_once(&system_once, create_system_classes);
+    return system_registry ? class_registry_find(system_registry, name) : NULL;
+}
+
+/* The class a class names: looked up in its registry, then among the
+ * built-in classes. NULL if there is none. */
+Class* class_find(const Class* from, const char* name) {
+    Class* found = from->registry ? class_registry_find(from->registry, name) : NULL;
+    return found ? found : class_system(name);
+}
+
+/* NUL-terminated copy of Utf8 constant index, or NULL if it isn't one */
+static char* utf8_text(Class* cls, int index) {
+    const Constant* constant;
+    char* text;
+
+    if (index <= 0 || index >= cls->constant_count) {
+        return NULL;
+    }
+    constant = &cls->constants[index];
+    if (constant->tag != CONSTANT_Utf8) {
+        return NULL;
+    }
+    text = (char*)malloc(constant->utf8_length + 1);
+    if (text) {
+        memcpy(text, constant->utf8, constant->utf8_length);
+        text[constant->utf8_length] = '\0';
+    }
+    return text;
+}
+
+/*
+ * Resolve constant index of cls the first time something uses it: follow
+ * its references to the Utf8 entries that name things and cache copies of
+ * the names in the entry. Returns 0, or -1 if the entry is unusable.
+ */
+int class_resolve_constant(Class* cls, int index) {
+    Constant* constant;
+
+    if (index <= 0 || index >= cls->constant_count) {
+        return -1;
+    }
+    constant = &cls->constants[index];
+    if (constant->resolved) {
+        return 0;
+    }
+
+    switch (constant->tag) {
+        case CONSTANT_Integer:
+        case CONSTANT_Float:
+        case CONSTANT_Long:
+        case CONSTANT_Double:
+            break;
+        case CONSTANT_Utf8:
+            constant->name = utf8_text(cls, index);
+            if (!constant->name) {
+                return -1;
+            }
+            break;
+        case CONSTANT_Class:
+        case CONSTANT_String:
+            constant->name = utf8_text(cls, constant->ref1);
+            if (!constant->name) {
+                return -1;
+            }
+            if (constant->tag == CONSTANT_String &&
+                string_decode_constant(constant, constant->name) != 0) {
+                free(constant->name);
+                constant->name = NULL;
+                return -1;
+            }
+            break;
+        case CONSTANT_Fieldref:
+        case CONSTANT_Methodref:
+        case CONSTANT_InterfaceMethodref: {
+            const Constant* owner;
+            const Constant* name_and_type;
+
+            if (constant->ref1 >= cls->constant_count || constant->ref2 >= cls->constant_count) {
+                return -1;
+            }
+            owner = &cls->constants[constant->ref1];
+            name_and_type = &cls->constants[constant->ref2];
+            if (owner->tag != CONSTANT_Class || name_and_type->tag != CONSTANT_NameAndType) {
+                return -1;
+            }
+            constant->class_name = utf8_text(cls, owner->ref1);
+            constant->name = utf8_text(cls, name_and_type->ref1);
+            constant->descriptor = utf8_text(cls, name_and_type->ref2);
+            if (!constant->class_name || !constant->name || !constant->descriptor) {
+                free(constant->class_name);
+                free(constant->name);
+                free(constant->descriptor);
+                constant->class_name = NULL;
+                constant->name = NULL;
+                constant->descriptor = NULL;
+                return -1;
+            }
+            /* References to this class's own members need no class lookup */
+            if (strcmp(constant->class_name, cls->name) == 0) {
+                free(constant->class_name);
+                constant->class_name = NULL;
+            }
+            break;
+        }
+        default:
+            return -1;
+    }
+    constant->resolved = 1;
+    return 0;
+}
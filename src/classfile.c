@@ -0,0 +1,352 @@
+#include "jvm.h"
+
+/*
+ * Java class file parser
+ *
+ * Loads a javac-produced .class file into a Class. The file is kept in
+ * memory for the life of the class: method code and Utf8 constants point
+ * into it rather than being copied. Parsing only records each constant's
+ * raw operands; names and descriptors are decoded by
+ * class_resolve_constant() the first time a running method needs them.
+ *
+ * Methods are registered by name and descriptor with the max_stack and
+ * max_locals of their Code attribute, which the verifier then enforces,
+ * and its exception table; abstract methods without code, for the vtables
+ * and itables. The super class and interfaces are recorded by name and
+ * looked up when the class is linked in its ClassRegistry. Instance fields are registered for the
+ * object layout; static fields and other attributes are skipped for now.
+ */
+
+#define CLASS_MAGIC 0xCAFEBABE
+
+/* Bounds-checked big-endian reader over the file */
+typedef struct {
+    const uint8_t* data;
+    size_t length;
+    size_t pos;
+    int error;              /* Set when a read runs past the end */
+} Reader;
+
+static uint32_t read_u(Reader* r, int bytes) {
+    uint32_t value = 0;
+    if (r->error || r->length - r->pos < (size_t)bytes) {
+        r->error = 1;
+        return 0;
+    }
+    for (int i = 0; i < bytes; i++) {
+        value = (value << 8) | r->data[r->pos++];
+    }
+    return value;
+}
+
+static void skip(Reader* r, size_t bytes) {
+    if (r->error || r->length - r->pos < bytes) {
+        r->error = 1;
+        return;
+    }
+    r->pos += bytes;
+}
+
+/* Skip an attributes table */
+static void skip_attributes(Reader* r) {
+    uint32_t count = read_u(r, 2);
+    for (uint32_t i = 0; i < count && !r->error; i++) {
+        read_u(r, 2);
+        skip(r, read_u(r, 4));
+    }
+}
+
+/* Does Utf8 constant index spell s? */
+static int utf8_equals(const Class* cls, int index, const char* s) {
+    const Constant* constant;
+    if (index <= 0 || index >= cls->constant_count) {
+        return 0;
+    }
+    constant = &cls->constants[index];
+    return constant->tag == CONSTANT_Utf8 && (size_t)constant->utf8_length == strlen(s) &&
+           memcmp(constant->utf8, s, constant->utf8_length) == 0;
+}
+
+/* Read the constant pool. Returns 0 on success, -1 on a malformed entry. */
+static int parse_constants(Reader* r, Class* cls) {
+    int count = (int)read_u(r, 2);
+
+    if (count > MAX_CONSTANTS) {
+        printf("Class file error: %d constants, at most %d supported\n", count, MAX_CONSTANTS);
+        return -1;
+    }
+    for (int i = 1; i < count && !r->error; i++) {
+        Constant* constant = &cls->constants[i];
+        constant->tag = (int)read_u(r, 1);
+        switch (constant->tag) {
+            case CONSTANT_Utf8:
+                constant->utf8_length = (int)read_u(r, 2);
+                constant->utf8 = r->data + r->pos;
+                skip(r, constant->utf8_length);
+                break;
+            case CONSTANT_Integer:
+                constant->value = (int32_t)read_u(r, 4);
+                break;
+            case CONSTANT_Float:
+                constant->value = (int32_t)read_u(r, 4);
+                break;
+            case CONSTANT_Long:
+            case CONSTANT_Double: {
+                /* Eight bytes, and the next index is unusable */
+                uint64_t high = read_u(r, 4);
+                constant->wide = (int64_t)(high << 32 | read_u(r, 4));
+                i++;
+                break;
+            }
+            case CONSTANT_Class:
+            case CONSTANT_String:
+            case CONSTANT_MethodType:
+            case CONSTANT_Module:
+            case CONSTANT_Package:
+                constant->ref1 = (uint16_t)read_u(r, 2);
+                break;
+            case CONSTANT_Fieldref:
+            case CONSTANT_Methodref:
+            case CONSTANT_InterfaceMethodref:
+            case CONSTANT_NameAndType:
+            case CONSTANT_Dynamic:
+            case CONSTANT_InvokeDynamic:
+                constant->ref1 = (uint16_t)read_u(r, 2);
+                constant->ref2 = (uint16_t)read_u(r, 2);
+                break;
+            case CONSTANT_MethodHandle:
+                constant->ref1 = (uint16_t)read_u(r, 1);
+                constant->ref2 = (uint16_t)read_u(r, 2);
+                break;
+            default:
+                printf("Class file error: unknown constant tag %d at #%d\n", constant->tag, i);
+                return -1;
+        }
+    }
+    cls->constant_count = count > 0 ? count : 1;
+    return r->error ? -1 : 0;
+}
+
+/* Read one field_info and add the field if it is an instance field */
+static int parse_field(Reader* r, Class* cls) {
+    int access_flags = (int)read_u(r, 2);
+    int name_index = (int)read_u(r, 2);
+    int descriptor_index = (int)read_u(r, 2);
+
+    skip_attributes(r);
+    if (r->error || (access_flags & ACC_STATIC)) {
+        return 0;
+    }
+    if (class_resolve_constant(cls, name_index) != 0 ||
+        class_resolve_constant(cls, descriptor_index) != 0 ||
+        cls->constants[name_index].tag != CONSTANT_Utf8 ||
+        cls->constants[descriptor_index].tag != CONSTANT_Utf8) {
+        printf("Class file error: bad field name or descriptor\n");
+        return -1;
+    }
+    return class_add_field(cls, cls->constants[name_index].name,
+                           cls->constants[descriptor_index].name) < 0 ? -1 : 0;
+}
+
+/* Read one method_info and add the method unless it is native */
+static int parse_method(Reader* r, Class* cls) {
+    int access_flags, name_index, descriptor_index, attribute_count;
+    const uint8_t* code = NULL;
+    uint32_t code_length = 0;
+    size_t handler_table = 0, resume;
+    int handler_count = 0;
+    int max_stack = 0, max_locals = 0;
+    char* name;
+    char* descriptor;
+    Method* method;
+
+    access_flags = (int)read_u(r, 2);
+    name_index = (int)read_u(r, 2);
+    descriptor_index = (int)read_u(r, 2);
+    attribute_count = (int)read_u(r, 2);
+
+    for (int i = 0; i < attribute_count && !r->error; i++) {
+        int attribute_name = (int)read_u(r, 2);
+        uint32_t length = read_u(r, 4);
+        size_t end = r->pos + length;
+
+        if (!utf8_equals(cls, attribute_name, "Code")) {
+            skip(r, length);
+            continue;
+        }
+        max_stack = (int)read_u(r, 2);
+        max_locals = (int)read_u(r, 2);
+        code_length = read_u(r, 4);
+        code = r->data + r->pos;
+        skip(r, code_length);
+        handler_count = (int)read_u(r, 2);  /* Exception table, read below */
+        handler_table = r->pos;
+        skip(r, (uint32_t)handler_count * 8);
+        skip_attributes(r);
+        if (!r->error && r->pos != end) {
+            printf("Class file error: bad Code attribute length\n");
+            return -1;
+        }
+    }
+    if (r->error) {
+        return -1;
+    }
+    if (!code && !(access_flags & ACC_ABSTRACT)) {
+        return 0;                           /* Native */
+    }
+
+    if (class_resolve_constant(cls, name_index) != 0 ||
+        class_resolve_constant(cls, descriptor_index) != 0 ||
+        cls->constants[name_index].tag != CONSTANT_Utf8 ||
+        cls->constants[descriptor_index].tag != CONSTANT_Utf8) {
+        printf("Class file error: bad method name or descriptor\n");
+        return -1;
+    }
+    name = cls->constants[name_index].name;
+    descriptor = cls->constants[descriptor_index].name;
+
+    method = class_define_method(cls,
+                                 access_flags & (ACC_STATIC | ACC_PRIVATE | ACC_ABSTRACT |
+                                                 ACC_SYNCHRONIZED),
+                                 name, descriptor, (uint8_t*)code, (int)code_length);
+    if (!method) {
+        return -1;
+    }
+    method->max_stack = max_stack;
+    if (max_locals > method->locals_count) {
+        method->locals_count = max_locals;
+    }
+    method->limits_declared = 1;
+
+    /* The entries were bounds-checked when skipped */
+    resume = r->pos;
+    r->pos = handler_table;
+    for (int i = 0; i < handler_count; i++) {
+        int start_pc = (int)read_u(r, 2);
+        int end_pc = (int)read_u(r, 2);
+        int handler_pc = (int)read_u(r, 2);
+        int catch_type = (int)read_u(r, 2);
+        if (method_add_exception_handler(method, start_pc, end_pc, handler_pc, catch_type) != 0) {
+            return -1;
+        }
+    }
+    r->pos = resume;
+    return 0;
+}
+
+/*
+ * Build a Class from the bytes of a class file. The class takes ownership
+ * of data (which must come from malloc) whether or not parsing succeeds.
+ */
+Class* class_parse(uint8_t* data, size_t length) {
+    Reader r = {data, length, 0, 0};
+    Class* cls;
+    int access_flags, this_class, super_class, count;
+
+    if (read_u(&r, 4) != CLASS_MAGIC) {
+        printf("Class file error: bad magic number\n");
+        free(data);
+        return NULL;
+    }
+    read_u(&r, 2);                          /* minor_version */
+    read_u(&r, 2);                          /* major_version */
+
+    cls = class_create("");
+    if (!cls) {
+        free(data);
+        return NULL;
+    }
+    cls->class_file = data;
+
+    if (parse_constants(&r, cls) != 0) {
+        if (r.error) {
+            printf("Class file error: truncated constant pool\n");
+        }
+        goto fail;
+    }
+
+    access_flags = (int)read_u(&r, 2);
+    this_class = (int)read_u(&r, 2);
+    super_class = (int)read_u(&r, 2);
+    if (r.error || class_resolve_constant(cls, this_class) != 0 ||
+        cls->constants[this_class].tag != CONSTANT_Class) {
+        printf("Class file error: bad this_class\n");
+        goto fail;
+    }
+    free(cls->name);
+    cls->name = (char*)malloc(strlen(cls->constants[this_class].name) + 1);
+    if (!cls->name) {
+        goto fail;
+    }
+    strcpy(cls->name, cls->constants[this_class].name);
+    if (access_flags & ACC_INTERFACE) {
+        class_set_interface(cls);
+    }
+    /* java/lang/Object alone has none */
+    if (super_class != 0 && (class_resolve_constant(cls, super_class) != 0 ||
+                             cls->constants[super_class].tag != CONSTANT_Class ||
+                             class_set_super(cls, cls->constants[super_class].name) != 0)) {
+        printf("Class file error: bad super_class\n");
+        goto fail;
+    }
+
+    count = (int)read_u(&r, 2);             /* Interfaces */
+    for (int i = 0; i < count && !r.error; i++) {
+        int index = (int)read_u(&r, 2);
+        if (r.error || class_resolve_constant(cls, index) != 0 ||
+            cls->constants[index].tag != CONSTANT_Class ||
+            class_add_interface(cls, cls->constants[index].name) != 0) {
+            printf("Class file error: bad interface\n");
+            goto fail;
+        }
+    }
+    count = (int)read_u(&r, 2);             /* Fields */
+    for (int i = 0; i < count && !r.error; i++) {
+        if (parse_field(&r, cls) != 0) {
+            goto fail;
+        }
+    }
+
+    count = (int)read_u(&r, 2);
+    for (int i = 0; i < count && !r.error; i++) {
+        if (parse_method(&r, cls) != 0) {
+            goto fail;
+        }
+    }
+    skip_attributes(&r);                    /* Class attributes */
+
+    if (r.error) {
+        printf("Class file error: truncated file\n");
+        goto fail;
+    }
+    return cls;
+
+fail:
+    class_destroy(cls);
+    return NULL;
+}
+
+/* Read and parse a .class file */
+Class* class_load_file(const char* filename) {
+    FILE* file = fopen(filename, "rb");
+    uint8_t* data;
+    long length;
+
+    if (!file) {
+        printf("Error: Cannot open file %s\n", filename);
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    data = length > 0 ? (uint8_t*)malloc((size_t)length) : NULL;
+    if (!data || fread(data, 1, (size_t)length, file) != (size_t)length) {
+        printf("Error: Cannot read file %s\n", filename);
+        free(data);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+    return class_parse(data, (size_t)length);
+}
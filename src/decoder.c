@@ -0,0 +1,853 @@
+#include "jvm.h"
+
+/*
+ * Bytecode pre-decoder
+ *
+ * Translates raw bytecode into the fixed-width Insn format run by
+ * jvm_execute_method(). The translation is done in two passes: the first
+ * finds instruction boundaries and assigns each one an instruction index,
+ * the second emits instructions with branch offsets resolved to absolute
+ * instruction indexes.
+ */
+
+/* Bytes of padding after a switch opcode at pc, which align its operands
+ * to a multiple of four from the start of the code */
+#define SWITCH_PADDING(pc) ((4 - ((pc) + 1) % 4) % 4)
+
+/* Length in bytes of a tableswitch or lookupswitch at pc, or -1 if its
+ * operands run past the end of the code or are out of range */
+static int switch_length(uint8_t* code, int pc, int length) {
+    int p = pc + 1 + SWITCH_PADDING(pc);
+    int64_t entries;
+    int64_t total;
+
+    if (p + 12 > length) {
+        return -1;
+    }
+    p += 4;                                 /* Default offset */
+    if (code[pc] == OP_TABLESWITCH) {
+        int32_t low = read_int32(code, &p);
+        int32_t high = read_int32(code, &p);
+        if (high < low) {
+            return -1;
+        }
+        entries = (int64_t)high - low + 1;
+        total = p - pc + entries * 4;
+    } else {
+        int32_t pairs = read_int32(code, &p);
+        if (pairs < 0) {
+            return -1;
+        }
+        entries = pairs;
+        total = p - pc + entries * 8;
+    }
+    return pc + total > length ? -1 : (int)total;
+}
+
+/* Length in bytes of the instruction at pc, or -1 if it is truncated */
+static int instruction_length(uint8_t* code, int pc, int length) {
+    switch (code[pc]) {
+        case OP_BIPUSH:
+        case OP_LDC:
+        case OP_ILOAD:
+        case OP_LLOAD:
+        case OP_FLOAD:
+        case OP_DLOAD:
+        case OP_ALOAD:
+        case OP_ISTORE:
+        case OP_LSTORE:
+        case OP_FSTORE:
+        case OP_DSTORE:
+        case OP_ASTORE:
+        case OP_NEWARRAY:
+        case OP_RET:
+            return 2;
+        case OP_SIPUSH:
+        case OP_IINC:
+        case OP_LDC_W:
+        case OP_LDC2_W:
+        case OP_IFEQ:
+        case OP_IFNE:
+        case OP_IFLT:
+        case OP_IFGE:
+        case OP_IFGT:
+        case OP_IFLE:
+        case OP_IF_ICMPEQ:
+        case OP_IF_ICMPNE:
+        case OP_IF_ICMPLT:
+        case OP_IF_ICMPGE:
+        case OP_IF_ICMPGT:
+        case OP_IF_ICMPLE:
+        case OP_IF_ACMPEQ:
+        case OP_IF_ACMPNE:
+        case OP_IFNULL:
+        case OP_IFNONNULL:
+        case OP_GOTO:
+        case OP_INVOKESTATIC:
+        case OP_INVOKESPECIAL:
+        case OP_INVOKEVIRTUAL:
+        case OP_JSR:
+        case OP_GETSTATIC:
+        case OP_PUTSTATIC:
+        case OP_GETFIELD:
+        case OP_PUTFIELD:
+        case OP_NEW:
+        case OP_ANEWARRAY:
+        case OP_CHECKCAST:
+        case OP_INSTANCEOF:
+            return 3;
+        case OP_MULTIANEWARRAY:             /* Index, dimensions */
+            return 4;
+        case OP_INVOKEINTERFACE:            /* Index, argument count, 0 */
+        case OP_INVOKEDYNAMIC:              /* Index, 0, 0 */
+        case OP_GOTO_W:
+        case OP_JSR_W:
+            return 5;
+        case OP_WIDE:                       /* Opcode, 16-bit local[, 16-bit increment] */
+            if (pc + 1 >= length) {
+                return -1;
+            }
+            return code[pc + 1] == OP_IINC ? 6 : 4;
+        case OP_TABLESWITCH:
+        case OP_LOOKUPSWITCH:
+            return switch_length(code, pc, length);
+        default:
+            return 1;
+    }
+}
+
+/* Instruction index of the branch target pc + offset, or -1 with an error
+ * if it is not the start of an instruction */
+static int branch_target(const int* insn_at, int length, int pc, int32_t offset) {
+    int64_t target = (int64_t)pc + offset;
+    if (target < 0 || target > length || insn_at[target] < 0) {
+        printf("Decode error: bad branch target %lld at pc=%d\n", (long long)target, pc);
+        return -1;
+    }
+    return insn_at[target];
+}
+
+/* Keys at or below this many per jump table entry go in a jump table */
+#define SWITCH_DENSITY 2
+
+/* Open-addressed hash table over a sparse switch's keys, at most half full */
+static int hash_switch(SwitchTable* table) {
+    int bits = 1;
+    uint32_t mask;
+
+    while ((1 << bits) < 2 * table->count) {
+        bits++;
+    }
+    table->hash = (uint32_t*)calloc((size_t)1 << bits, sizeof(uint32_t));
+    if (!table->hash) {
+        return -1;
+    }
+    table->hash_shift = 32 - bits;
+    mask = ((uint32_t)1 << bits) - 1;
+    for (int i = 0; i < table->count; i++) {
+        uint32_t slot = ((uint32_t)table->keys[i] * 2654435769u) >> table->hash_shift;
+        while (table->hash[slot]) {
+            slot = (slot + 1) & mask;
+        }
+        table->hash[slot] = (uint32_t)i + 1;
+    }
+    return 0;
+}
+
+/*
+ * Decode the switch at pc into table. A tableswitch becomes a jump table
+ * as it is; a lookupswitch does too if its keys fill at least half of
+ * their range, and otherwise keeps its keys, which must be ascending.
+ * Returns 0, or -1 on error.
+ */
+static int decode_switch(uint8_t* code, int pc, int length, const int* insn_at,
+                         SwitchTable* table) {
+    int p = pc + 1 + SWITCH_PADDING(pc);
+    int pairs;
+
+    memset(table, 0, sizeof(SwitchTable));
+    table->default_target = branch_target(insn_at, length, pc, read_int32(code, &p));
+    if (table->default_target < 0) {
+        return -1;
+    }
+
+    if (code[pc] == OP_TABLESWITCH) {
+        int32_t low = read_int32(code, &p);
+        int32_t high = read_int32(code, &p);
+        table->low = low;
+        table->count = (int)((int64_t)high - low + 1);
+        table->targets = (int*)malloc(sizeof(int) * (size_t)table->count);
+        if (!table->targets) {
+            printf("Decode error: out of memory\n");
+            return -1;
+        }
+        for (int i = 0; i < table->count; i++) {
+            table->targets[i] = branch_target(insn_at, length, pc, read_int32(code, &p));
+            if (table->targets[i] < 0) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    pairs = read_int32(code, &p);
+    table->count = pairs;
+    table->keys = (int32_t*)malloc(sizeof(int32_t) * (size_t)(pairs > 0 ? pairs : 1));
+    table->targets = (int*)malloc(sizeof(int) * (size_t)(pairs > 0 ? pairs : 1));
+    if (!table->keys || !table->targets) {
+        printf("Decode error: out of memory\n");
+        return -1;
+    }
+    for (int i = 0; i < pairs; i++) {
+        table->keys[i] = read_int32(code, &p);
+        table->targets[i] = branch_target(insn_at, length, pc, read_int32(code, &p));
+        if (table->targets[i] < 0) {
+            return -1;
+        }
+        if (i > 0 && table->keys[i] <= table->keys[i - 1]) {
+            printf("Decode error: lookupswitch keys out of order at pc=%d\n", pc);
+            return -1;
+        }
+    }
+
+    /* Dense enough: spread the cases over a jump table */
+    if (pairs == 0 ||
+        (int64_t)table->keys[pairs - 1] - table->keys[0] < (int64_t)pairs * SWITCH_DENSITY) {
+        int span = pairs == 0 ? 0 : (int)((int64_t)table->keys[pairs - 1] - table->keys[0] + 1);
+        int* targets = (int*)malloc(sizeof(int) * (size_t)(span > 0 ? span : 1));
+        if (!targets) {
+            printf("Decode error: out of memory\n");
+            return -1;
+        }
+        table->low = pairs == 0 ? 0 : table->keys[0];
+        for (int i = 0; i < span; i++) {
+            targets[i] = table->default_target;
+        }
+        for (int i = 0; i < pairs; i++) {
+            targets[(uint32_t)table->keys[i] - (uint32_t)table->low] = table->targets[i];
+        }
+        free(table->keys);
+        free(table->targets);
+        table->keys = NULL;
+        table->targets = targets;
+        table->count = span;
+        return 0;
+    }
+
+    if (pairs >= SWITCH_HASH_MIN && hash_switch(table) != 0) {
+        printf("Decode error: out of memory\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Position of key among a switch's cases, or -1 for the default. A jump
+ * table indexes by key - low; sparse keys are hashed or, in small sets,
+ * found by binary search.
+ */
+int switch_case(const SwitchTable* table, int32_t key) {
+    if (!table->keys) {
+        uint32_t index = (uint32_t)key - (uint32_t)table->low;
+        return index < (uint32_t)table->count ? (int)index : -1;
+    }
+    if (table->hash) {
+        uint32_t mask = UINT32_MAX >> table->hash_shift;
+        uint32_t slot = ((uint32_t)key * 2654435769u) >> table->hash_shift;
+        uint32_t entry;
+        while ((entry = table->hash[slot]) != 0) {
+            if (table->keys[entry - 1] == key) {
+                return (int)entry - 1;
+            }
+            slot = (slot + 1) & mask;
+        }
+        return -1;
+    } else {
+        int lo = 0;
+        int hi = table->count - 1;
+        while (lo <= hi) {
+            int mid = lo + (hi - lo) / 2;
+            if (table->keys[mid] < key) {
+                lo = mid + 1;
+            } else if (table->keys[mid] > key) {
+                hi = mid - 1;
+            } else {
+                return mid;
+            }
+        }
+        return -1;
+    }
+}
+
+/* Release a switch's arrays */
+static void switch_free(SwitchTable* table) {
+    free(table->targets);
+    free(table->keys);
+    free(table->hash);
+}
+
+/* Float and double instructions, or INSN_UNKNOWN where they are left out */
+#ifdef JVM_FLOAT
+#define FLOAT_INSN(op) (op)
+#else
+#define FLOAT_INSN(op) INSN_UNKNOWN
+#endif
+
+/* Typed loads and stores, in opcode order: i, l, f, d, a */
+static const uint16_t load_insns[] = {
+    INSN_ILOAD, INSN_LLOAD, FLOAT_INSN(INSN_FLOAD), FLOAT_INSN(INSN_DLOAD), INSN_ALOAD
+};
+static const uint16_t store_insns[] = {
+    INSN_ISTORE, INSN_LSTORE, FLOAT_INSN(INSN_FSTORE), FLOAT_INSN(INSN_DSTORE), INSN_ASTORE
+};
+
+/* Map a simple (operand-free) opcode to its internal form, or -1 */
+static int simple_insn(uint8_t op) {
+    switch (op) {
+        case OP_IADD: return INSN_IADD;
+        case OP_ISUB: return INSN_ISUB;
+        case OP_IMUL: return INSN_IMUL;
+        case OP_IDIV: return INSN_IDIV;
+        case OP_IREM: return INSN_IREM;
+        case OP_INEG: return INSN_INEG;
+        case OP_ISHL: return INSN_ISHL;
+        case OP_ISHR: return INSN_ISHR;
+        case OP_IUSHR: return INSN_IUSHR;
+        case OP_IAND: return INSN_IAND;
+        case OP_IOR: return INSN_IOR;
+        case OP_IXOR: return INSN_IXOR;
+        case OP_LADD: return INSN_LADD;
+        case OP_LSUB: return INSN_LSUB;
+        case OP_LMUL: return INSN_LMUL;
+        case OP_LDIV: return INSN_LDIV;
+        case OP_LREM: return INSN_LREM;
+        case OP_LNEG: return INSN_LNEG;
+        case OP_LSHL: return INSN_LSHL;
+        case OP_LSHR: return INSN_LSHR;
+        case OP_LUSHR: return INSN_LUSHR;
+        case OP_LAND: return INSN_LAND;
+        case OP_LOR: return INSN_LOR;
+        case OP_LXOR: return INSN_LXOR;
+        case OP_LCMP: return INSN_LCMP;
+        case OP_FADD: return FLOAT_INSN(INSN_FADD);
+        case OP_FSUB: return FLOAT_INSN(INSN_FSUB);
+        case OP_FMUL: return FLOAT_INSN(INSN_FMUL);
+        case OP_FDIV: return FLOAT_INSN(INSN_FDIV);
+        case OP_FREM: return FLOAT_INSN(INSN_FREM);
+        case OP_FNEG: return FLOAT_INSN(INSN_FNEG);
+        case OP_FCMPL: return FLOAT_INSN(INSN_FCMPL);
+        case OP_FCMPG: return FLOAT_INSN(INSN_FCMPG);
+        case OP_DADD: return FLOAT_INSN(INSN_DADD);
+        case OP_DSUB: return FLOAT_INSN(INSN_DSUB);
+        case OP_DMUL: return FLOAT_INSN(INSN_DMUL);
+        case OP_DDIV: return FLOAT_INSN(INSN_DDIV);
+        case OP_DREM: return FLOAT_INSN(INSN_DREM);
+        case OP_DNEG: return FLOAT_INSN(INSN_DNEG);
+        case OP_DCMPL: return FLOAT_INSN(INSN_DCMPL);
+        case OP_DCMPG: return FLOAT_INSN(INSN_DCMPG);
+        case OP_I2L: return INSN_I2L;
+        case OP_I2F: return FLOAT_INSN(INSN_I2F);
+        case OP_I2D: return FLOAT_INSN(INSN_I2D);
+        case OP_L2I: return INSN_L2I;
+        case OP_L2F: return FLOAT_INSN(INSN_L2F);
+        case OP_L2D: return FLOAT_INSN(INSN_L2D);
+        case OP_F2I: return FLOAT_INSN(INSN_F2I);
+        case OP_F2L: return FLOAT_INSN(INSN_F2L);
+        case OP_F2D: return FLOAT_INSN(INSN_F2D);
+        case OP_D2I: return FLOAT_INSN(INSN_D2I);
+        case OP_D2L: return FLOAT_INSN(INSN_D2L);
+        case OP_D2F: return FLOAT_INSN(INSN_D2F);
+        case OP_IRETURN: return INSN_IRETURN;
+        case OP_LRETURN: return INSN_LRETURN;
+        case OP_FRETURN: return FLOAT_INSN(INSN_FRETURN);
+        case OP_DRETURN: return FLOAT_INSN(INSN_DRETURN);
+        case OP_ARETURN: return INSN_ARETURN;
+        case OP_RETURN: return INSN_RETURN;
+        case OP_ATHROW: return INSN_ATHROW;
+        case OP_ACONST_NULL: return INSN_ACONST_NULL;
+        case OP_POP: return INSN_POP;
+        case OP_POP2: return INSN_POP2;
+        case OP_DUP: return INSN_DUP;
+        case OP_DUP2: return INSN_DUP2;
+        case OP_ARRAYLENGTH: return INSN_ARRAYLENGTH;
+        case OP_IALOAD: return INSN_IALOAD;
+        case OP_IASTORE: return INSN_IASTORE;
+        case OP_MONITORENTER: return INSN_MONITORENTER;
+        case OP_MONITOREXIT: return INSN_MONITOREXIT;
+        case OP_HALT: return INSN_HALT;
+        default: return -1;
+    }
+}
+
+/* Map a branch opcode to its internal form, or -1 */
+static int branch_insn(uint8_t op) {
+    switch (op) {
+        case OP_IF_ICMPEQ: return INSN_IF_ICMPEQ;
+        case OP_IF_ICMPNE: return INSN_IF_ICMPNE;
+        case OP_IF_ICMPLT: return INSN_IF_ICMPLT;
+        case OP_IF_ICMPGE: return INSN_IF_ICMPGE;
+        case OP_IF_ICMPGT: return INSN_IF_ICMPGT;
+        case OP_IF_ICMPLE: return INSN_IF_ICMPLE;
+        case OP_IF_ACMPEQ: return INSN_IF_ACMPEQ;
+        case OP_IF_ACMPNE: return INSN_IF_ACMPNE;
+        case OP_IFEQ: return INSN_IFEQ;
+        case OP_IFNE: return INSN_IFNE;
+        case OP_IFLT: return INSN_IFLT;
+        case OP_IFGE: return INSN_IFGE;
+        case OP_IFGT: return INSN_IFGT;
+        case OP_IFLE: return INSN_IFLE;
+        case OP_IFNULL: return INSN_IFNULL;
+        case OP_IFNONNULL: return INSN_IFNONNULL;
+        case OP_GOTO: return INSN_GOTO;
+        default: return -1;
+    }
+}
+
+/* Map an invoke opcode to its internal form, or -1 */
+static int invoke_insn(uint8_t op) {
+    switch (op) {
+        case OP_INVOKESTATIC: return INSN_INVOKESTATIC;
+        case OP_INVOKESPECIAL: return INSN_INVOKESPECIAL;
+        case OP_INVOKEVIRTUAL: return INSN_INVOKEVIRTUAL;
+        case OP_INVOKEINTERFACE: return INSN_INVOKEINTERFACE;
+        default: return -1;
+    }
+}
+
+/* Map an opcode whose operand is a constant pool index to its internal
+ * form, or -1. Invokes are handled separately: they also get a call site. */
+static int constant_insn(uint8_t op) {
+    switch (op) {
+        case OP_GETFIELD: return INSN_GETFIELD;
+        case OP_PUTFIELD: return INSN_PUTFIELD;
+        case OP_NEW: return INSN_NEW;
+        default: return -1;
+    }
+}
+
+/* Convert an exception table's pcs to instruction indexes. Returns 0, or
+ * -1 with an error if an entry does not cover whole instructions. */
+static int decode_handlers(const ExceptionHandler* handlers, int handler_count, int length,
+                           const int* insn_at, DecodedCode* decoded) {
+    if (handler_count == 0) {
+        return 0;
+    }
+    decoded->handlers = (DecodedHandler*)malloc(sizeof(DecodedHandler) * handler_count);
+    if (!decoded->handlers) {
+        printf("Decode error: out of memory\n");
+        return -1;
+    }
+    for (int i = 0; i < handler_count; i++) {
+        const ExceptionHandler* handler = &handlers[i];
+        DecodedHandler* entry = &decoded->handlers[i];
+
+        if (handler->start_pc >= handler->end_pc || handler->end_pc > length ||
+            handler->handler_pc >= length || insn_at[handler->start_pc] < 0 ||
+            insn_at[handler->end_pc] < 0 || insn_at[handler->handler_pc] < 0) {
+            printf("Decode error: bad exception handler %d\n", i);
+            return -1;
+        }
+        entry->start = insn_at[handler->start_pc];
+        entry->end = insn_at[handler->end_pc];
+        entry->target = insn_at[handler->handler_pc];
+        entry->catch_type = handler->catch_type;
+        entry->catch_class = NULL;
+        decoded->handler_count++;
+    }
+    return 0;
+}
+
+/* Decode bytecode, with its exception table, into decoded->insns. Returns
+ * 0 on success, -1 on error. */
+int decode_bytecode(uint8_t* code, int length, const ExceptionHandler* handlers,
+                    int handler_count, DecodedCode* decoded) {
+    int* insn_at;       /* Bytecode pc -> instruction index, -1 mid-instruction */
+    int count = 0;
+    int call_sites = 0;
+    int switches = 0;
+    int pc;
+
+    decoded->insns = NULL;
+    decoded->bytecode_pc = NULL;
+    decoded->count = 0;
+    decoded->call_sites = NULL;
+    decoded->call_site_count = 0;
+    decoded->switches = NULL;
+    decoded->switch_count = 0;
+    decoded->handlers = NULL;
+    decoded->handler_count = 0;
+    decoded->stack_depth = NULL;
+    decoded->slot_types = NULL;
+    decoded->frame_slots = 0;
+    decoded->in_image = 0;
+
+    insn_at = (int*)malloc(sizeof(int) * (length + 1));
+    if (!insn_at) {
+        printf("Decode error: out of memory\n");
+        return -1;
+    }
+    for (pc = 0; pc <= length; pc++) {
+        insn_at[pc] = -1;
+    }
+
+    /* Pass 1: instruction boundaries. nop emits nothing, so it shares
+     * the index of the instruction that follows it. */
+    pc = 0;
+    while (pc < length) {
+        int len = instruction_length(code, pc, length);
+        if (len < 0 || pc + len > length) {
+            printf("Decode error: truncated instruction at pc=%d\n", pc);
+            free(insn_at);
+            return -1;
+        }
+        insn_at[pc] = count;
+        if (code[pc] != OP_NOP) {
+            count++;
+        }
+        if (invoke_insn(code[pc]) >= 0) {
+            call_sites++;
+        }
+        if (code[pc] == OP_TABLESWITCH || code[pc] == OP_LOOKUPSWITCH) {
+            switches++;
+        }
+        pc += len;
+    }
+    insn_at[length] = count;    /* Falling off the end reaches INSN_END */
+    count++;
+
+    decoded->insns = (Insn*)malloc(sizeof(Insn) * count);
+    decoded->bytecode_pc = (int*)malloc(sizeof(int) * count);
+    if (call_sites > 0) {
+        decoded->call_sites = (CallSite*)malloc(sizeof(CallSite) * call_sites);
+    }
+    if (switches > 0) {
+        decoded->switches = (SwitchTable*)calloc(switches, sizeof(SwitchTable));
+    }
+    if (!decoded->insns || !decoded->bytecode_pc || (call_sites > 0 && !decoded->call_sites) ||
+        (switches > 0 && !decoded->switches)) {
+        printf("Decode error: out of memory\n");
+        free(insn_at);
+        decoded_free(decoded);
+        return -1;
+    }
+
+    /* Pass 2: emit instructions with resolved operands */
+    pc = 0;
+    while (pc < length) {
+        uint8_t op = code[pc];
+        Insn* insn = &decoded->insns[insn_at[pc]];
+        int kind;
+
+        if (op == OP_NOP) {
+            pc++;
+            continue;
+        }
+
+        decoded->bytecode_pc[insn_at[pc]] = pc;
+        insn->a = 0;
+        insn->k = 0;
+
+        if (op >= OP_ICONST_M1 && op <= OP_ICONST_5) {
+            insn->op = INSN_ICONST;
+            insn->k = (int32_t)op - OP_ICONST_0;
+        } else if (op == OP_BIPUSH) {
+            insn->op = INSN_ICONST;
+            insn->k = (int8_t)code[pc + 1];
+        } else if (op == OP_SIPUSH) {
+            int operand_pc = pc + 1;
+            insn->op = INSN_ICONST;
+            insn->k = read_int16(code, &operand_pc);
+        } else if (op == OP_LDC || op == OP_LDC_W) {
+            int operand_pc = pc + 1;
+            insn->op = INSN_LDC;
+            insn->k = (op == OP_LDC) ? code[pc + 1] : (uint16_t)read_int16(code, &operand_pc);
+        } else if (op == OP_LDC2_W) {
+            int operand_pc = pc + 1;
+            insn->op = INSN_LDC2_W;
+            insn->k = (uint16_t)read_int16(code, &operand_pc);
+        } else if (op == OP_LCONST_0 || op == OP_LCONST_1) {
+            insn->op = INSN_LCONST;
+            insn->k = op - OP_LCONST_0;
+        } else if (op >= OP_FCONST_0 && op <= OP_FCONST_2) {
+            /* The bits of 0.0f, 1.0f and 2.0f */
+            static const int32_t float_bits[] = {0, 0x3f800000, 0x40000000};
+            insn->op = FLOAT_INSN(INSN_FCONST);
+            insn->k = float_bits[op - OP_FCONST_0];
+        } else if (op == OP_DCONST_0 || op == OP_DCONST_1) {
+            insn->op = FLOAT_INSN(INSN_DCONST);
+            insn->k = op - OP_DCONST_0;
+        } else if (op >= OP_ILOAD && op <= OP_ALOAD) {
+            insn->op = load_insns[op - OP_ILOAD];
+            insn->a = code[pc + 1];
+        } else if (op >= OP_ILOAD_0 && op <= OP_ALOAD_3) {
+            /* Four short forms per type, for locals 0 to 3 */
+            insn->op = load_insns[(op - OP_ILOAD_0) / 4];
+            insn->a = (op - OP_ILOAD_0) % 4;
+        } else if (op >= OP_ISTORE && op <= OP_ASTORE) {
+            insn->op = store_insns[op - OP_ISTORE];
+            insn->a = code[pc + 1];
+        } else if (op >= OP_ISTORE_0 && op <= OP_ASTORE_3) {
+            insn->op = store_insns[(op - OP_ISTORE_0) / 4];
+            insn->a = (op - OP_ISTORE_0) % 4;
+        } else if (op == OP_IINC) {
+            insn->op = INSN_IINC;
+            insn->a = code[pc + 1];
+            insn->k = (int8_t)code[pc + 2];
+        } else if (op == OP_NEWARRAY) {
+            insn->op = INSN_NEWARRAY;
+            insn->a = code[pc + 1];
+        } else if ((kind = branch_insn(op)) >= 0) {
+            int operand_pc = pc + 1;
+            int target = branch_target(insn_at, length, pc, read_int16(code, &operand_pc));
+            if (target < 0) {
+                free(insn_at);
+                decoded_free(decoded);
+                return -1;
+            }
+            insn->op = (uint16_t)kind;
+            insn->k = target;
+        } else if (op == OP_TABLESWITCH || op == OP_LOOKUPSWITCH) {
+            SwitchTable* table = &decoded->switches[decoded->switch_count];
+            int status = decode_switch(code, pc, length, insn_at, table);
+            decoded->switch_count++;
+            if (status != 0) {
+                free(insn_at);
+                decoded_free(decoded);
+                return -1;
+            }
+            insn->op = table->keys ? INSN_LOOKUPSWITCH : INSN_TABLESWITCH;
+            insn->a = (uint16_t)(decoded->switch_count - 1);
+        } else if ((kind = invoke_insn(op)) >= 0) {
+            int operand_pc = pc + 1;
+            CallSite* site = &decoded->call_sites[decoded->call_site_count];
+            site->target = NULL;
+            site->class_id = 0;
+            site->arg_slots = 0;
+            insn->op = (uint16_t)kind;
+            insn->a = (uint16_t)decoded->call_site_count++;
+            insn->k = (uint16_t)read_int16(code, &operand_pc);
+        } else if ((kind = constant_insn(op)) >= 0) {
+            int operand_pc = pc + 1;
+            insn->op = (uint16_t)kind;
+            insn->k = (uint16_t)read_int16(code, &operand_pc);
+        } else if ((kind = simple_insn(op)) >= 0) {
+            insn->op = (uint16_t)kind;
+        } else {
+            insn->op = INSN_UNKNOWN;
+        }
+        if (insn->op == INSN_UNKNOWN) {
+            printf("Decode error: unsupported opcode 0x%02x at pc=%d\n", op, pc);
+            free(insn_at);
+            decoded_free(decoded);
+            return -1;
+        }
+
+        pc += instruction_length(code, pc, length);
+    }
+
+    decoded->insns[count - 1].op = INSN_END;
+    decoded->insns[count - 1].a = 0;
+    decoded->insns[count - 1].k = 0;
+    decoded->bytecode_pc[count - 1] = length;
+    decoded->count = count;
+
+    if (decode_handlers(handlers, handler_count, length, insn_at, decoded) != 0) {
+        free(insn_at);
+        decoded_free(decoded);
+        return -1;
+    }
+    free(insn_at);
+    return 0;
+}
+
+/* Release the arrays owned by a DecodedCode. Those of a method loaded
+ * from a snapshot stay with the image, except the ones that hold
+ * pointers. */
+void decoded_free(DecodedCode* decoded) {
+    if (!decoded->in_image) {
+        free(decoded->insns);
+        free(decoded->bytecode_pc);
+        for (int i = 0; i < decoded->switch_count; i++) {
+            switch_free(&decoded->switches[i]);
+        }
+        free(decoded->stack_depth);
+        free(decoded->slot_types);
+    }
+    free(decoded->call_sites);
+    free(decoded->switches);
+    free(decoded->handlers);
+    decoded->insns = NULL;
+    decoded->bytecode_pc = NULL;
+    decoded->call_sites = NULL;
+    decoded->switches = NULL;
+    decoded->handlers = NULL;
+    decoded->stack_depth = NULL;
+    decoded->slot_types = NULL;
+    decoded->count = 0;
+    decoded->call_site_count = 0;
+    decoded->switch_count = 0;
+    decoded->handler_count = 0;
+    decoded->in_image = 0;
+}
+
+/* Names of internal instructions, indexed by InsnOp */
+static const char* insn_names[INSN_COUNT] = {
+    "iconst", "aconst_null", "ldc", "iload", "aload", "istore", "astore",
+    "iadd", "isub", "imul", "idiv", "irem", "ineg", "if_icmpeq", "if_icmpne",
+    "if_icmplt", "if_icmpge", "if_icmpgt", "if_icmple", "if_acmpeq",
+    "if_acmpne", "ifeq", "ifne", "iflt", "ifge", "ifgt", "ifle", "ifnull",
+    "ifnonnull", "goto", "tableswitch", "lookupswitch", "invokestatic",
+    "invokespecial", "invokevirtual", "invokeinterface", "invokespecial_checked",
+    "ireturn", "areturn", "return", "athrow", "pop", "dup", "new",
+    "newarray", "arraylength", "iaload", "iastore", "getfield", "putfield",
+    "monitorenter", "monitorexit", "iinc", "ishl", "ishr", "iushr", "iand",
+    "ior", "ixor", "lconst", "fconst", "dconst", "ldc2_w", "lload", "fload",
+    "dload", "lstore", "fstore", "dstore", "lreturn", "freturn", "dreturn",
+    "pop2", "dup2", "ladd", "lsub", "lmul", "ldiv", "lrem", "lneg", "lshl",
+    "lshr", "lushr", "land", "lor", "lxor", "lcmp", "fadd", "fsub", "fmul",
+    "fdiv", "frem", "fneg", "fcmpl", "fcmpg", "dadd", "dsub", "dmul", "ddiv",
+    "drem", "dneg", "dcmpl", "dcmpg", "i2l", "i2f", "i2d", "l2i", "l2f", "l2d",
+    "f2i", "f2l", "f2d", "d2i", "d2l", "d2f", "iload_iload_if_icmpeq",
+    "iload_iload_if_icmpne", "iload_iload_if_icmplt", "iload_iload_if_icmpge",
+    "iload_iload_if_icmpgt", "iload_iload_if_icmple",
+    "iload_iconst_iadd_istore", "iload_iload_iadd", "yield", "sleep", "invokenative", "halt",
+    "unknown", "end"
+};
+
+/* Name of an internal instruction, for dumps and reports */
+const char* insn_name(int op) {
+    return op >= 0 && op < INSN_COUNT ? insn_names[op] : "?";
+}
+
+/* The instruction a superinstruction starts with, or op itself */
+int insn_base_op(int op) {
+    return op >= INSN_ILOAD_ILOAD_IF_ICMPEQ && op <= INSN_ILOAD_ILOAD_IADD ? INSN_ILOAD : op;
+}
+
+/* Number of instructions, and so of bytecodes, one dispatch of op runs */
+int insn_bytecodes(int op) {
+    if (op >= INSN_ILOAD_ILOAD_IF_ICMPEQ && op <= INSN_ILOAD_ILOAD_IF_ICMPLE) {
+        return 3;
+    }
+    switch (op) {
+        case INSN_ILOAD_ICONST_IADD_ISTORE: return 4;
+        case INSN_ILOAD_ILOAD_IADD: return 3;
+        default: return 1;
+    }
+}
+
+/*
+ * Rewrite the first instruction of each common sequence into a
+ * superinstruction that works on the locals directly. Runs on verified,
+ * quickened code. The rest of the sequence is left as it is: the fused
+ * handler reads its operands from there and skips over it, and a branch
+ * into the middle of the sequence runs the original instructions.
+ */
+void fuse_superinstructions(DecodedCode* decoded) {
+    Insn* insns = decoded->insns;
+
+    for (int i = 0; i + 2 < decoded->count; i++) {
+        Insn* insn = &insns[i];
+
+        if (insn->op != INSN_ILOAD || decoded->stack_depth[i] < 0) {
+            continue;
+        }
+        if (insns[i + 1].op == INSN_ILOAD) {
+            int next = insns[i + 2].op;
+            if (next >= INSN_IF_ICMPEQ && next <= INSN_IF_ICMPLE) {
+                insn->op = (uint16_t)(INSN_ILOAD_ILOAD_IF_ICMPEQ + (next - INSN_IF_ICMPEQ));
+            } else if (next == INSN_IADD) {
+                insn->op = INSN_ILOAD_ILOAD_IADD;
+            }
+        } else if (insns[i + 1].op == INSN_ICONST && insns[i + 2].op == INSN_IADD &&
+                   i + 3 < decoded->count && insns[i + 3].op == INSN_ISTORE) {
+            insn->op = INSN_ILOAD_ICONST_IADD_ISTORE;
+        }
+    }
+}
+
+/* Print pre-decoded instructions, one per line */
+void decoded_dump(const DecodedCode* decoded) {
+    printf("\nPre-decoded instructions:\n");
+    for (int i = 0; i < decoded->count; i++) {
+        const Insn* insn = &decoded->insns[i];
+        printf("%3d (pc %04x): %-10s", i, decoded->bytecode_pc[i], insn_names[insn->op]);
+        switch (insn->op) {
+            case INSN_ICONST:
+            case INSN_LCONST:
+            case INSN_FCONST:
+            case INSN_DCONST: printf(" %d", insn->k); break;
+            case INSN_ILOAD:
+            case INSN_LLOAD:
+            case INSN_FLOAD:
+            case INSN_DLOAD:
+            case INSN_ALOAD:
+            case INSN_ISTORE:
+            case INSN_LSTORE:
+            case INSN_FSTORE:
+            case INSN_DSTORE:
+            case INSN_ASTORE:
+            case INSN_NEWARRAY:
+            case INSN_ILOAD_ILOAD_IF_ICMPEQ:
+            case INSN_ILOAD_ILOAD_IF_ICMPNE:
+            case INSN_ILOAD_ILOAD_IF_ICMPLT:
+            case INSN_ILOAD_ILOAD_IF_ICMPGE:
+            case INSN_ILOAD_ILOAD_IF_ICMPGT:
+            case INSN_ILOAD_ILOAD_IF_ICMPLE:
+            case INSN_ILOAD_ICONST_IADD_ISTORE:
+            case INSN_ILOAD_ILOAD_IADD: printf(" %d", insn->a); break;
+            case INSN_IINC: printf(" %d %d", insn->a, insn->k); break;
+            case INSN_IF_ICMPEQ:
+            case INSN_IF_ICMPNE:
+            case INSN_IF_ICMPLT:
+            case INSN_IF_ICMPGE:
+            case INSN_IF_ICMPGT:
+            case INSN_IF_ICMPLE:
+            case INSN_IF_ACMPEQ:
+            case INSN_IF_ACMPNE:
+            case INSN_IFEQ:
+            case INSN_IFNE:
+            case INSN_IFLT:
+            case INSN_IFGE:
+            case INSN_IFGT:
+            case INSN_IFLE:
+            case INSN_IFNULL:
+            case INSN_IFNONNULL:
+            case INSN_GOTO: printf(" -> %d", insn->k); break;
+            case INSN_TABLESWITCH:
+            case INSN_LOOKUPSWITCH: {
+                const SwitchTable* table = &decoded->switches[insn->a];
+                for (int c = 0; c < table->count; c++) {
+                    if (table->keys) {
+                        printf(" %d->%d", table->keys[c], table->targets[c]);
+                    } else if (table->targets[c] != table->default_target) {
+                        printf(" %d->%d", (int32_t)((uint32_t)table->low + (uint32_t)c),
+                               table->targets[c]);
+                    }
+                }
+                printf(" default->%d", table->default_target);
+                break;
+            }
+            case INSN_LDC:
+            case INSN_LDC2_W:
+            case INSN_INVOKESTATIC:
+            case INSN_INVOKESPECIAL:
+            case INSN_INVOKEVIRTUAL:
+            case INSN_INVOKEINTERFACE:
+            case INSN_INVOKESPECIAL_CHECKED:
+            case INSN_INVOKENATIVE:
+            case INSN_NEW:
+            case INSN_GETFIELD:
+            case INSN_PUTFIELD: printf(" #%d", insn->k); break;
+            case INSN_UNKNOWN: printf(" 0x%02x", insn->k); break;
+            default: break;
+        }
+        printf("\n");
+    }
+    for (int i = 0; i < decoded->handler_count; i++) {
+        const DecodedHandler* handler = &decoded->handlers[i];
+        printf("catch #%d: %d..%d -> %d\n", handler->catch_type, handler->start,
+               handler->end - 1, handler->target);
+    }
+    printf("\n");
+}
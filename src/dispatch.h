@@ -0,0 +1,34 @@
+#ifndef DISPATCH_H
+#define DISPATCH_H
+
+/*
+ * Dispatch macros shared by the interpreter loops.
+ *
+ * Handler bodies are written once and compiled either as the cases of a
+ * portable switch loop or, with JVM_THREADED_DISPATCH, as labels reached
+ * through a per-opcode address table. Threaded dispatch ends every handler
+ * with its own indirect jump, so the branch predictor sees one jump site
+ * per opcode instead of a single shared one.
+ *
+ * Each loop defines its own NEXT/DISPATCH macro, since fetching the next
+ * opcode differs between raw bytecode and pre-decoded instructions.
+ */
+#include "jvm.h"
+
+#ifdef JVM_THREADED_DISPATCH
+
+/* Labels-as-values is a GNU extension; keep -Wpedantic quiet about it */
+#pragma GCC diagnostic ignored "-Wpedantic"
+#pragma GCC diagnostic ignored "-Woverride-init"
+
+#define CASE(op)    L_##op
+#define DEFAULT     L_DEFAULT
+
+#else
+
+#define CASE(op)    case op
+#define DEFAULT     default
+
+#endif
+
+#endif
@@ -0,0 +1,505 @@
+#define _POSIX_C_SOURCE 199309L
+#include "jvm.h"
+#include <time.h>
+
+/*
+ * Object heap and mark-compact garbage collector
+ *
+ * Objects are bump-allocated from jvm->heap up to jvm->heap_limit. When an
+ * allocation doesn't fit, the collector runs with the interpreter stopped
+ * at the allocating instruction, every frame's ip saved:
+ *
+ *   1. Mark. The roots are the reference slots of each live frame: the
+ *      verifier's slot types for the instruction a frame is stopped at say
+ *      which of its locals and stack slots hold references, so no int is
+ *      ever mistaken for one. The monitors held and the object a native
+ *      method keeps are roots too. Reachable objects get the mark bit in their
+ *      GC word. Reference fields, which the ref_map of the object's class
+ *      picks out, are traced with a small fixed mark stack; if it
+ *      overflows, a rescan of the heap finds the marked objects whose
+ *      children were dropped. The intern table is not a root: the
+ *      Strings in it that are not marked are removed from it.
+ *   2. Plan. In address order, each marked object's GC word receives the
+ *      address it will slide down to.
+ *   3. Update. Every root and every reference field of a live object is
+ *      replaced by the forwarding address of the object it points to.
+ *   4. Slide. Live objects move down over the garbage in address order,
+ *      keeping their allocation order, and heap_ptr drops to the end of the
+ *      last one.
+ *
+ * The collector allocates nothing, so the memory the heap can use is fixed
+ * by HEAP_SIZE (and GC_STACK_SIZE) at build time.
+ *
+ * Green threads allocate from thread-local allocation buffers (TLABs):
+ * each takes a run of the heap at a time and bump-allocates inside it
+ * with no lock, since only carving a new buffer moves heap_ptr. A buffer
+ * is retired by turning what is left of it into a dead int[], so the heap
+ * stays a walkable sequence of objects. The GC word of a locked object
+ * holds its owner, which the plan and slide overwrite; the collector
+ * puts the owners back from the threads' monitor records at the end.
+ */
+
+#define GC_MARK 1u
+
+/* Collector state for one collection */
+typedef struct {
+    JVM* jvm;
+    int sp;                 /* Mark stack top */
+    int overflow;           /* Some children didn't fit on the mark stack */
+} Collector;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/* Size in words of an object, header included, from its type word */
+static uint32_t object_words(uint32_t type) {
+    if (type & BYTE_ARRAY_FLAG) {
+        return BYTE_ARRAY_WORDS(type & ~(ARRAY_FLAG | BYTE_ARRAY_FLAG));
+    }
+    if (type & ARRAY_FLAG) {
+        return OBJECT_HEADER_WORDS + (type & ~ARRAY_FLAG);
+    }
+    return OBJECT_HEADER_WORDS + OBJECT_FIELDS(type);
+}
+
+/* Bit i set if field i holds a reference, from the object's class */
+static uint32_t object_ref_map(uint32_t type) {
+    return (type & ARRAY_FLAG) ? 0 : class_by_id(OBJECT_CLASS_ID(type))->ref_map;
+}
+
+/* Where the object at ref moves to; valid between plan and slide */
+static int32_t forwarded(JVM* jvm, int32_t ref) {
+    return (int32_t)(HEAP_OBJECT(jvm, ref)[0] & ~GC_MARK);
+}
+
+/*
+ * Call visit on every reference slot of frames first..last, where last is
+ * the top. A frame below the top is stopped in a call: its ip is the
+ * instruction after the invoke, and the arguments on top of its stack are
+ * the callee's locals, which the callee's frame covers.
+ */
+static void visit_frames(Collector* gc, int first, int last,
+                         void (*visit)(Collector* gc, Value* slot)) {
+    for (int f = first; f <= last; f++) {
+        const Frame* frame = &gc->jvm->frames[f];
+        const DecodedCode* decoded = &frame->method->decoded;
+        int index = (int)(frame->ip - decoded->insns);
+        const uint8_t* types;
+        int live;
+
+        if (f < last) {
+            const Insn* call = &decoded->insns[--index];
+            live = frame->locals_count + decoded->stack_depth[index] -
+                   decoded->call_sites[call->a].arg_slots;
+        } else {
+            live = frame->locals_count + decoded->stack_depth[index];
+        }
+        types = decoded->slot_types + (size_t)index * decoded->frame_slots;
+        for (int slot = 0; slot < live; slot++) {
+            if (SLOT_IS_REF(types[slot]) && frame->locals[slot].i != 0) {
+                visit(gc, &frame->locals[slot]);
+            }
+        }
+    }
+}
+
+static void visit_monitors(Collector* gc, Monitors* monitors,
+                           void (*visit)(Collector* gc, Value* slot)) {
+    for (int i = 0; i < monitors->count; i++) {
+        visit(gc, &monitors->held[i].object);
+    }
+}
+
+/* Call visit on every reference slot of the running frames, and on the
+ * monitors held and native roots. Under a scheduler, each green thread that has started
+ * has frames in its own segment; a switched-out thread's top frame
+ * stopped at a blocking point, budget check or allocation, where its ip
+ * and depth are as exact as at a call. A thread that has not started has
+ * only its arguments. */
+static void visit_roots(Collector* gc, void (*visit)(Collector* gc, Value* slot)) {
+    JVM* jvm = gc->jvm;
+
+    visit_monitors(gc, &jvm->monitors, visit);
+    if (jvm->native_root.i != 0) {
+        visit(gc, &jvm->native_root);
+    }
+#ifdef JVM_GREEN_THREADS
+    if (jvm->scheduler) {
+        Scheduler* scheduler = jvm->scheduler;
+        for (int i = 0; i < scheduler->thread_count; i++) {
+            GreenThread* t = &scheduler->threads[i];
+            if (t->state == THREAD_DONE) {
+                continue;
+            }
+            if (t->started) {
+                visit_frames(gc, t->frame_base, t->fp, visit);
+            } else {
+                const uint8_t* types = t->method->decoded.slot_types;
+                for (int slot = 0; slot < t->method->arg_slots; slot++) {
+                    Value* arg = &jvm->stack[t->stack_base + slot];
+                    if (SLOT_IS_REF(types[slot]) && arg->i != 0) {
+                        visit(gc, arg);
+                    }
+                }
+            }
+            visit_monitors(gc, &t->monitors, visit);
+            if (t->native_root.i != 0) {
+                visit(gc, &t->native_root);
+            }
+        }
+        return;
+    }
+#endif
+    if (jvm->running) {
+        visit_frames(gc, 0, jvm->fp, visit);
+    }
+}
+
+/* Put the owner back in the GC word of each monitor held */
+static void restore_owners(JVM* jvm, const Monitors* monitors, uint32_t owner) {
+    for (int i = 0; i < monitors->count; i++) {
+        HEAP_OBJECT(jvm, monitors->held[i].object.i)[0] = owner << LOCK_OWNER_SHIFT;
+    }
+}
+
+/* Mark ref and queue it for tracing if it has reference fields */
+static void mark(Collector* gc, int32_t ref) {
+    uint32_t* object = HEAP_OBJECT(gc->jvm, ref);
+
+    if (ref == 0 || (object[0] & GC_MARK)) {
+        return;
+    }
+    object[0] |= GC_MARK;
+    if (object_ref_map(object[1]) == 0) {
+        return;
+    }
+    if (gc->sp < GC_STACK_SIZE) {
+        gc->jvm->gc_stack[gc->sp++] = ref;
+    } else {
+        gc->overflow = 1;
+    }
+}
+
+static void mark_root(Collector* gc, Value* slot) {
+    mark(gc, slot->i);
+}
+
+/* Mark the children of a marked object */
+static void trace(Collector* gc, int32_t ref) {
+    const uint32_t* object = HEAP_OBJECT(gc->jvm, ref);
+    uint32_t refs = object_ref_map(object[1]);
+
+    for (uint32_t i = 0; refs != 0; i++, refs >>= 1) {
+        if (refs & 1) {
+            mark(gc, (int32_t)object[OBJECT_HEADER_WORDS + i]);
+        }
+    }
+}
+
+static void drain(Collector* gc) {
+    while (gc->sp > 0) {
+        trace(gc, gc->jvm->gc_stack[--gc->sp]);
+    }
+}
+
+/* Mark everything reachable from the roots */
+static void mark_heap(Collector* gc) {
+    JVM* jvm = gc->jvm;
+
+    visit_roots(gc, mark_root);
+    drain(gc);
+    while (gc->overflow) {
+        gc->overflow = 0;
+        for (int32_t ref = HEAP_BASE; ref < jvm->heap_ptr;
+             ref += (int32_t)object_words(HEAP_OBJECT(jvm, ref)[1]) * 4) {
+            if (HEAP_OBJECT(jvm, ref)[0] & GC_MARK) {
+                trace(gc, ref);
+                drain(gc);
+            }
+        }
+    }
+}
+
+/* Slot an interned String's hashCode starts its probe at */
+static int string_home(JVM* jvm, int32_t s) {
+    return STRING_TABLE_INDEX(HEAP_OBJECT(jvm, s)[OBJECT_HEADER_WORDS + STRING_HASH]);
+}
+
+/* Remove the interned Strings that are not marked. Each removal closes
+ * the gap it leaves by moving later entries of the probe run back
+ * (Knuth's Algorithm R), so lookups still stop at the first free slot. */
+static void prune_strings(JVM* jvm) {
+    StringTable* table = &jvm->strings;
+    const int mask = STRING_TABLE_SIZE - 1;
+    int i = 0;
+
+    while (i < STRING_TABLE_SIZE && table->count > 0) {
+        int32_t s = table->entries[i];
+        int hole = i;
+
+        if (s == 0 || (HEAP_OBJECT(jvm, s)[0] & GC_MARK)) {
+            i++;
+            continue;
+        }
+        table->entries[hole] = 0;
+        table->count--;
+        for (int j = (hole + 1) & mask; table->entries[j] != 0; j = (j + 1) & mask) {
+            int home = string_home(jvm, table->entries[j]);
+            /* It may move unless its home is cyclically in (hole, j] */
+            if (j > hole ? home <= hole || home > j : home <= hole && home > j) {
+                table->entries[hole] = table->entries[j];
+                table->entries[j] = 0;
+                hole = j;
+            }
+        }
+        /* Slot i again, as an entry may have moved into it */
+    }
+}
+
+static void update_root(Collector* gc, Value* slot) {
+    slot->i = forwarded(gc->jvm, slot->i);
+}
+
+/* Collect garbage. Frames 0..jvm->fp are roots while a method is running,
+ * and the top frame's ip must be the instruction that is allocating. Under
+ * a scheduler, no green thread may be running but the allocating one,
+ * stopped with its fp saved. */
+void jvm_gc(JVM* jvm) {
+    Collector gc = {jvm, 0, 0};
+    uint64_t start = now_ns();
+    uint64_t pause;
+    int32_t to = HEAP_BASE;
+    int32_t ref;
+
+#ifdef JVM_GREEN_THREADS
+    if (jvm->scheduler) {
+        for (int i = 0; i < jvm->scheduler->thread_count; i++) {
+            heap_retire_tlab(jvm, &jvm->scheduler->threads[i]);
+        }
+    }
+#endif
+    mark_heap(&gc);
+    prune_strings(jvm);
+
+    /* Plan: forwarding addresses in address order */
+    for (ref = HEAP_BASE; ref < jvm->heap_ptr;
+         ref += (int32_t)object_words(HEAP_OBJECT(jvm, ref)[1]) * 4) {
+        uint32_t* object = HEAP_OBJECT(jvm, ref);
+        if (object[0] & GC_MARK) {
+            object[0] = (uint32_t)to | GC_MARK;
+            to += (int32_t)object_words(object[1]) * 4;
+        }
+    }
+
+    /* Update: roots and interned Strings, then the reference fields of
+     * live objects */
+    visit_roots(&gc, update_root);
+    for (int i = 0; i < STRING_TABLE_SIZE && jvm->strings.count > 0; i++) {
+        if (jvm->strings.entries[i] != 0) {
+            jvm->strings.entries[i] = forwarded(jvm, jvm->strings.entries[i]);
+        }
+    }
+    for (ref = HEAP_BASE; ref < jvm->heap_ptr;
+         ref += (int32_t)object_words(HEAP_OBJECT(jvm, ref)[1]) * 4) {
+        uint32_t* object = HEAP_OBJECT(jvm, ref);
+        uint32_t refs;
+        if (!(object[0] & GC_MARK)) {
+            continue;
+        }
+        refs = object_ref_map(object[1]);
+        for (uint32_t i = 0; refs != 0; i++, refs >>= 1) {
+            int32_t child = (int32_t)object[OBJECT_HEADER_WORDS + i];
+            if ((refs & 1) && child != 0) {
+                object[OBJECT_HEADER_WORDS + i] = (uint32_t)forwarded(jvm, child);
+            }
+        }
+    }
+
+    /* Slide: each object moves to an address at or below its own */
+    ref = HEAP_BASE;
+    while (ref < jvm->heap_ptr) {
+        uint32_t* object = HEAP_OBJECT(jvm, ref);
+        uint32_t words = object_words(object[1]);
+        if (object[0] & GC_MARK) {
+            int32_t target = (int32_t)(object[0] & ~GC_MARK);
+            object[0] = 0;
+            memmove(HEAP_OBJECT(jvm, target), object, words * 4);
+        }
+        ref += (int32_t)words * 4;
+    }
+    jvm->heap_ptr = to;
+
+    restore_owners(jvm, &jvm->monitors, MONITOR_OWNER_MAIN);
+#ifdef JVM_GREEN_THREADS
+    if (jvm->scheduler) {
+        for (int i = 0; i < jvm->scheduler->thread_count; i++) {
+            const GreenThread* t = &jvm->scheduler->threads[i];
+            restore_owners(jvm, &t->monitors, (uint32_t)t->id);
+        }
+    }
+#endif
+
+    pause = now_ns() - start;
+    jvm->gc_count++;
+    jvm->gc_total_ns += pause;
+    if (pause > jvm->gc_max_pause_ns) {
+        jvm->gc_max_pause_ns = pause;
+    }
+}
+
+/* Give back the monitors of code that has stopped */
+void heap_release_monitors(JVM* jvm, Monitors* monitors) {
+    for (int i = 0; i < monitors->count; i++) {
+        LOCK_RELEASE(&HEAP_OBJECT(jvm, monitors->held[i].object.i)[0]);
+    }
+    monitors->count = 0;
+}
+
+/* Write the header of a new object of size bytes and zero its fields */
+static void init_object(JVM* jvm, int32_t ref, uint32_t bytes, uint32_t type) {
+    uint32_t* object = HEAP_OBJECT(jvm, ref);
+    object[0] = 0;
+    object[1] = type;
+    memset(object + OBJECT_HEADER_WORDS, 0, bytes - OBJECT_HEADER_WORDS * 4);
+}
+
+/*
+ * Allocate an object of the given size in words, header included, and
+ * type word. The fields are zeroed. Collects if the heap is full and
+ * returns 0 if there is still no room.
+ */
+int32_t heap_alloc(JVM* jvm, uint32_t words, uint32_t type) {
+    uint32_t bytes;
+    int32_t ref;
+
+    if (words > (uint32_t)jvm->heap_limit / 4) {
+        return 0;
+    }
+    bytes = words * 4;
+    if ((uint32_t)(jvm->heap_limit - jvm->heap_ptr) < bytes) {
+        jvm_gc(jvm);
+        if ((uint32_t)(jvm->heap_limit - jvm->heap_ptr) < bytes) {
+            return 0;
+        }
+    }
+    ref = jvm->heap_ptr;
+    jvm->heap_ptr += (int)bytes;
+    if (jvm->heap_ptr > jvm->heap_peak) {
+        jvm->heap_peak = jvm->heap_ptr;
+    }
+    jvm->bytes_allocated += bytes;
+    init_object(jvm, ref, bytes, type);
+    return ref;
+}
+
+#ifdef JVM_GREEN_THREADS
+/* A buffer never has exactly one word left, which could not hold the
+ * header of the dead array that retires it */
+static int tlab_fits(int32_t left, uint32_t bytes) {
+    return (uint32_t)left == bytes || (uint32_t)left >= bytes + 8;
+}
+
+/* Hand back the rest of a thread's buffer: to the heap if it ends at
+ * heap_ptr, or else as a dead int[] the collector will drop */
+void heap_retire_tlab(JVM* jvm, GreenThread* thread) {
+    int32_t left = thread->tlab_end - thread->tlab_ptr;
+
+    if (thread->tlab_end == jvm->heap_ptr) {
+        jvm->heap_ptr = thread->tlab_ptr;
+    } else if (left > 0) {
+        init_object(jvm, thread->tlab_ptr, OBJECT_HEADER_WORDS * 4,
+                    ARRAY_FLAG | (uint32_t)(left / 4 - OBJECT_HEADER_WORDS));
+    }
+    thread->tlab_ptr = thread->tlab_end = 0;
+}
+
+/*
+ * Give a thread a new buffer of about size bytes with room for an
+ * allocation of bytes. Several threads share heap_ptr, so the caller
+ * serializes this (see scheduler_refill_tlab()). Returns 0, or -1 if the
+ * heap has no room left without a collection.
+ */
+int heap_refill_tlab(JVM* jvm, GreenThread* thread, uint32_t bytes, uint32_t size) {
+    int32_t room;
+
+    heap_retire_tlab(jvm, thread);
+    room = jvm->heap_limit - jvm->heap_ptr;
+    if (size < bytes) {
+        size = bytes;
+    }
+    if ((uint32_t)room < size) {
+        size = (uint32_t)room;
+    }
+    if (!tlab_fits((int32_t)size, bytes)) {
+        /* Take just the allocation if the rest would be one word */
+        if ((uint32_t)room < bytes) {
+            return -1;
+        }
+        size = bytes;
+    }
+    thread->tlab_ptr = jvm->heap_ptr;
+    thread->tlab_end = jvm->heap_ptr + (int32_t)size;
+    jvm->heap_ptr = thread->tlab_end;
+    if (jvm->heap_ptr > jvm->heap_peak) {
+        jvm->heap_peak = jvm->heap_ptr;
+    }
+    return 0;
+}
+
+/*
+ * Allocate like heap_alloc() from a green thread's buffer, taking a new
+ * one when it runs out. Collects if the heap is full and returns 0 if
+ * there is still no room.
+ */
+int32_t heap_alloc_tlab(JVM* jvm, GreenThread* thread, uint32_t words, uint32_t type) {
+    uint32_t bytes;
+    int32_t ref;
+
+    if (words > (uint32_t)jvm->heap_limit / 4) {
+        return 0;
+    }
+    bytes = words * 4;
+    if (!tlab_fits(thread->tlab_end - thread->tlab_ptr, bytes) &&
+        scheduler_refill_tlab(jvm->scheduler, thread, bytes) != 0) {
+        return 0;
+    }
+    ref = thread->tlab_ptr;
+    thread->tlab_ptr += (int32_t)bytes;
+    thread->allocated += bytes;
+    init_object(jvm, ref, bytes, type);
+    return ref;
+}
+#endif
+
+/* Use only the first bytes of the heap region. Returns 0, or -1 if bytes
+ * is out of range or the live objects don't fit. */
+int jvm_set_heap_limit(JVM* jvm, int bytes) {
+    if (bytes < HEAP_BASE || bytes > HEAP_SIZE) {
+        printf("Error: heap limit must be between %d and %d bytes\n", HEAP_BASE, HEAP_SIZE);
+        return -1;
+    }
+    bytes &= ~3;
+    if (jvm->heap_ptr > bytes) {
+        jvm_gc(jvm);
+        if (jvm->heap_ptr > bytes) {
+            printf("Error: %d bytes of objects are live, over the %d byte limit\n",
+                   jvm->heap_ptr - HEAP_BASE, bytes);
+            return -1;
+        }
+    }
+    jvm->heap_limit = bytes;
+    return 0;
+}
+
+/* Print allocation and collection totals */
+void jvm_print_gc_stats(const JVM* jvm) {
+    printf("Heap: %llu bytes allocated, %d of %d bytes in use\n",
+           (unsigned long long)jvm->bytes_allocated, jvm->heap_ptr - HEAP_BASE,
+           jvm->heap_limit - HEAP_BASE);
+    printf("GC: %llu collections, %.3f ms total, %.3f ms max pause\n",
+           (unsigned long long)jvm->gc_count, (double)jvm->gc_total_ns / 1e6,
+           (double)jvm->gc_max_pause_ns / 1e6);
+}
@@ -0,0 +1,2133 @@
+#include "jvm.h"
+#include "dispatch.h"
+#ifdef JVM_FLOAT
+#include <math.h>
+#endif
+
+/*
+ * Pre-decoded instruction interpreter
+ *
+ * Runs the output of decode_bytecode(). Every operand was decoded at load
+ * time and branches carry absolute instruction indexes, so a handler is
+ * just the operation itself followed by the dispatch of the next one.
+ * The stream always ends in INSN_END, so no bounds check is needed
+ * between instructions either.
+ *
+ * Only verified methods run here (see method_prepare()). Each frame's
+ * locals and operand stack are carved out of jvm->stack at exactly the
+ * sizes the verifier computed, and the stack pointer lives in a local.
+ * Unless built with JVM_NO_TOS_CACHE, so does the value on top of the
+ * operand stack: an iadd is then one load and an add, not two loads and a
+ * store. The top is written back to its slot only where something else
+ * reads the stack in memory: calls, the collector and native code.
+ *
+ * A long or double takes two slots, in the operand stack as in the locals,
+ * and is copied in and out of them whole; after verification nothing at
+ * run time checks what a slot holds.
+ *
+ * Calls don't recurse in C. invokestatic saves the caller's resume point
+ * in its Frame and switches the loop's state to the callee, whose locals
+ * start at the arguments the caller just pushed; a return pops back to
+ * the caller the same way.
+ *
+ * Objects live in jvm->heap. An allocation may collect garbage, so before
+ * calling heap_alloc() a handler saves ip and fp where the collector looks
+ * for them; references are plain heap offsets, and the verifier has
+ * already turned the reference loads, stores, compares and returns into
+ * their int forms.
+ *
+ * Calls and loop back-edges are counted per method, and a method that gets
+ * hot is promoted to a faster tier (tier.c): superinstructions first, then
+ * with the JIT built in native code, run from there at method entry, on
+ * return from a call and at loop back-edges. Native code hands control
+ * back at the instructions it does not implement; the interpreter runs
+ * those and re-enters when it can.
+ *
+ * Unless built without the profilers, the loop also publishes its frame
+ * count at every call and return, and the top frame's position at loop
+ * back-edges, for the sampling profiler's signal handler (sampler.c).
+ *
+ * interp_profile.c compiles this file a second time with JVM_PROFILING
+ * defined, as jvm_execute_method_profiled(). That copy counts every
+ * instruction, branch outcome and, optionally, handler time into
+ * jvm->profile, and never enters native code so that nothing escapes the
+ * counts. The copy built here has none of its hooks.
+ */
+#ifdef JVM_PROFILING
+#define INTERPRETER jvm_execute_method_profiled
+#define THREAD_INTERPRETER jvm_execute_thread_profiled
+
+/* Count the instruction about to run, and charge the time since the last
+ * one to that one's opcode */
+#define PROFILE_INSN()                                          \
+    do {                                                        \
+        profile_counts[ip - insns]++;                           \
+        profile->op_count[ip->op]++;                            \
+        if (profile_cycles) {                                   \
+            uint64_t now = PROFILE_CLOCK();                     \
+            profile->op_cycles[profile_op] += now - profile_tick; \
+            profile_tick = now;                                 \
+            profile_op = ip->op;                                \
+        }                                                       \
+    } while (0)
+
+/* Switch the per-instruction counters to the running method */
+#define PROFILE_ENTER()                                         \
+    do {                                                        \
+        MethodProfile* counters = profile_method(profile, method); \
+        if (!counters) {                                        \
+            RUNTIME_ERROR("Profile error: out of memory\n");    \
+        }                                                       \
+        profile_counts = counters->executed;                    \
+        profile_taken = counters->taken;                        \
+    } while (0)
+
+#define PROFILE_TAKEN() (profile_taken[ip - insns]++)
+#else
+#define INTERPRETER jvm_execute_method
+#define THREAD_INTERPRETER jvm_execute_thread
+#define PROFILE_INSN() ((void)0)
+#define PROFILE_ENTER() ((void)0)
+#define PROFILE_TAKEN() ((void)0)
+#endif
+
+#ifdef JVM_THREADED_DISPATCH
+#define DISPATCH()  do { executed++; PROFILE_INSN(); goto *dispatch_table[ip->op]; } while (0)
+#else
+#define DISPATCH()  continue
+#endif
+
+/* Unchecked operand stack access. The verifier has proven the stack never
+ * underflows and never grows past max_stack, which the frame reserves.
+ * STACK_END() is one past the top value once it is in memory, and
+ * SET_STACK_END(p) takes up a stack in memory that ends at p.
+ * SET_STACK_EMPTY(p) starts an empty stack at p, and SET_STACK_RESULT(p, v)
+ * leaves v on top of the values below p. */
+#ifdef JVM_STACK_TRAFFIC
+#define STACK_LOAD(p)       (stack_loads++, *(p))
+#define STACK_STORE(p, v)   (stack_stores++, *(p) = (v))
+#else
+#define STACK_LOAD(p)       (*(p))
+#define STACK_STORE(p, v)   (*(p) = (v))
+#endif
+
+#ifdef JVM_TOS_CACHE
+/* The top value is cached in tos and sp points at its home slot, the one
+ * above the values in memory, so a push spills the old top and a pop
+ * reloads the new one. With the stack empty, sp points at the method's
+ * scratch local (TOS_SCRATCH_LOCALS), which takes the meaningless spill.
+ * Code that reads the stack in memory, such as the collector, a callee
+ * or native code, needs SPILL_TOS() first; FILL_TOS() picks up changes. */
+#define PUSH(v)         (STACK_STORE(sp, tos), sp++, tos = (v))
+#define POP(v)          ((v) = tos, sp--, tos = STACK_LOAD(sp))
+#define TOP()           tos
+#define SET_TOP(v)      (tos = (v))
+#define DROP()          (sp--, tos = STACK_LOAD(sp))
+#define SPILL_TOS()     STACK_STORE(sp, tos)
+#define FILL_TOS()      (tos = STACK_LOAD(sp))
+#define STACK_END()     (sp + 1)
+#define SET_STACK_END(p) (sp = (p) - 1, tos = STACK_LOAD(sp))
+#define SET_STACK_EMPTY(p) (sp = (p) - 1)
+#define SET_STACK_RESULT(p, v) (sp = (p), tos = (v))
+#else
+#define PUSH(v)         (STACK_STORE(sp, v), sp++)
+#define POP(v)          (sp--, (v) = STACK_LOAD(sp))
+#define TOP()           STACK_LOAD(sp - 1)
+#define SET_TOP(v)      STACK_STORE(sp - 1, v)
+#define DROP()          (sp--)
+#define SPILL_TOS()     ((void)0)
+#define FILL_TOS()      ((void)0)
+#define STACK_END()     sp
+#define SET_STACK_END(p) (sp = (p))
+#define SET_STACK_EMPTY(p) (sp = (p))
+#define SET_STACK_RESULT(p, v) (STACK_STORE(p, v), sp = (p) + 1)
+#endif
+
+#ifdef JVM_GREEN_THREADS
+#define NO_YIELD UINT64_MAX
+
+/* At a back-edge or call, switch a green thread out once its slice has
+ * run its budget. rerun is 1 if the instruction at ip was counted but
+ * will run again when the thread is switched back in. */
+#define CHECK_BUDGET(rerun)                                     \
+    do {                                                        \
+        if (executed >= yield_at) {                             \
+            executed -= (rerun);                                \
+            goto preempt;                                       \
+        }                                                       \
+    } while (0)
+
+/* Green threads stay in the interpreter, where the budget is checked */
+#define SCHEDULED() (yield_at != NO_YIELD)
+#else
+#define CHECK_BUDGET(rerun) ((void)0)
+#define SCHEDULED() 0
+#endif
+
+#ifdef JVM_PROFILER
+/* Publish the frames to the sampler's SIGPROF handler (sampler.c), which
+ * can interrupt this thread between any two instructions: how many are in
+ * use, and how far the top one has got. The fence keeps the compiler from
+ * moving the frame's own stores past the store that publishes it. Green
+ * threads are not sampled. */
+#ifdef __GNUC__
+#define SAMPLE_STORE(p, v)                                      \
+    (__atomic_signal_fence(__ATOMIC_RELEASE), __atomic_store_n(p, v, __ATOMIC_RELAXED))
+#else
+#define SAMPLE_STORE(p, v) (*(p) = (v))
+#endif
+#define SAMPLE_DEPTH(n)                                         \
+    do {                                                        \
+        if (!SCHEDULED())                                       \
+            SAMPLE_STORE(&jvm->frames_in_use, (n));             \
+    } while (0)
+#define SAMPLE_IP() SAMPLE_STORE(&frame->ip, ip)
+#else
+#define SAMPLE_DEPTH(n) ((void)0)
+#define SAMPLE_IP() ((void)0)
+#endif
+
+#ifndef JVM_PROFILING
+/* Count towards the next tier and promote the method when the count
+ * reaches its limit (tier.c). A promotion at a back-edge takes effect in
+ * the running frame at once: optimized code keeps every instruction at
+ * its index, and JIT_ENTER() follows. */
+#define COUNT_HOT(counter, limit, on_stack)                     \
+    do {                                                        \
+        if (!SCHEDULED() && ++method->counter >= method->limit) \
+            tier_promote(jvm, method, on_stack);                \
+    } while (0)
+#else
+#define COUNT_HOT(counter, limit, on_stack) ((void)0)
+#endif
+
+#if defined(JVM_JIT) && !defined(JVM_PROFILING)
+/* Continue natively from ip if the method has been compiled. The native
+ * code returns the instruction to resume at, and the verifier's depth for
+ * that instruction gives the operand stack pointer. */
+#define JIT_ENTER()                                             \
+    do {                                                        \
+        if (method->jit && !SCHEDULED()) {                      \
+            uint64_t native_count = 0;                          \
+            int resume;                                         \
+            SPILL_TOS();                                        \
+            resume = jit_run(method, (int)(ip - insns), locals, &native_count); \
+            executed += native_count;                           \
+            ip = insns + resume;                                \
+            SET_STACK_END(locals + method->locals_count +       \
+                          method->decoded.stack_depth[resume]); \
+        }                                                       \
+    } while (0)
+#else
+#define JIT_ENTER() ((void)0)
+#endif
+
+/* Jump to instruction k; backward jumps are loop back-edges */
+#define BRANCH(k)                                               \
+    do {                                                        \
+        const Insn* target = insns + (k);                       \
+        if (target <= ip) {                                     \
+            ip = target;                                        \
+            SAMPLE_IP();                                        \
+            CHECK_BUDGET(0);                                    \
+            COUNT_HOT(backedges, backedge_limit, 1);            \
+            JIT_ENTER();                                        \
+        } else {                                                \
+            ip = target;                                        \
+        }                                                       \
+    } while (0)
+
+/* Integer compare-and-branch: jump to instruction k when a <op> b */
+#define IF_ICMP(cmp)                                            \
+    do {                                                        \
+        Value a, b;                                             \
+        POP(b);                                                 \
+        POP(a);                                                 \
+        if (a.i cmp b.i) {                                      \
+            PROFILE_TAKEN();                                    \
+            BRANCH(ip->k);                                      \
+        } else {                                                \
+            ip++;                                               \
+        }                                                       \
+    } while (0)
+
+/* Compare an int with zero and branch to instruction k when v <op> 0 */
+#define IF_ZERO(cmp)                                            \
+    do {                                                        \
+        Value v;                                                \
+        POP(v);                                                 \
+        if (v.i cmp 0) {                                        \
+            PROFILE_TAKEN();                                    \
+            BRANCH(ip->k);                                      \
+        } else {                                                \
+            ip++;                                               \
+        }                                                       \
+    } while (0)
+
+/* Replace the two ints on top with expr of a and b */
+#define INT_BINARY(expr)                                        \
+    do {                                                        \
+        Value a, b, r;                                          \
+        POP(b);                                                 \
+        a = TOP();                                              \
+        r.i = (expr);                                           \
+        SET_TOP(r);                                             \
+    } while (0)
+
+/* A long or double goes on and off the stack as its two halves, which
+ * keep its bytes in memory order (see WIDE_GET() in jvm.h) */
+#define PUSH_WIDE(v)                                            \
+    do {                                                        \
+        Value halves[2];                                        \
+        WIDE_SET(halves, v);                                    \
+        PUSH(halves[0]);                                        \
+        PUSH(halves[1]);                                        \
+    } while (0)
+#define POP_WIDE(v)                                             \
+    do {                                                        \
+        Value halves[2];                                        \
+        POP(halves[1]);                                         \
+        POP(halves[0]);                                         \
+        WIDE_GET(halves, v);                                    \
+    } while (0)
+
+/* Replace the two longs or doubles on top with expr of a and b */
+#define WIDE_BINARY(type, expr)                                 \
+    do {                                                        \
+        type a, b, r;                                           \
+        POP_WIDE(b);                                            \
+        POP_WIDE(a);                                            \
+        r = (expr);                                             \
+        PUSH_WIDE(r);                                           \
+    } while (0)
+
+/* Replace the two floats on top with expr of a and b */
+#define FLOAT_BINARY(expr)                                      \
+    do {                                                        \
+        Value va, vb, r;                                        \
+        float a, b;                                             \
+        POP(vb);                                                \
+        va = TOP();                                             \
+        a = va.f;                                               \
+        b = vb.f;                                               \
+        r.f = (expr);                                           \
+        SET_TOP(r);                                             \
+    } while (0)
+
+/* Three-way compare of a and b, giving nan when either is NaN */
+#define COMPARE(a, b, nan) ((a) > (b) ? 1 : (a) == (b) ? 0 : (a) < (b) ? -1 : (nan))
+
+/* iload a; iload b; if_icmp<cmp>, fused: the second load and the branch
+ * are the next two instructions. A taken branch is charged to the head,
+ * which is where the profiler counts the whole sequence. */
+#define FUSED_IF_ICMP(cmp)                                      \
+    do {                                                        \
+        executed += 2;                                          \
+        if (locals[ip->a].i cmp locals[ip[1].a].i) {            \
+            PROFILE_TAKEN();                                    \
+            ip += 2;                                            \
+            BRANCH(ip->k);                                      \
+        } else {                                                \
+            ip += 3;                                            \
+        }                                                       \
+    } while (0)
+
+/* Stop with a runtime error */
+#define RUNTIME_ERROR(...)                                      \
+    do {                                                        \
+        printf(__VA_ARGS__);                                    \
+        goto fail;                                              \
+    } while (0)
+
+/* Raise a new exception of a built-in class at ip */
+#define THROW_NEW(name)                                         \
+    do {                                                        \
+        throw_class = class_system(name);                       \
+        goto throw_new;                                         \
+    } while (0)
+
+#define ARITHMETIC_EXCEPTION "java/lang/ArithmeticException"
+#define INDEX_EXCEPTION "java/lang/ArrayIndexOutOfBoundsException"
+#define NULL_POINTER_EXCEPTION "java/lang/NullPointerException"
+
+/* Make the running frames visible to the garbage collector; FILL_TOS()
+ * afterwards, as the collector may have moved the object on top. A green
+ * thread's frames are found through the thread. */
+#ifdef JVM_GREEN_THREADS
+#define SYNC_FRAMES()                                           \
+    do {                                                        \
+        SPILL_TOS();                                            \
+        frame->ip = ip;                                         \
+        *(thread ? &thread->fp : &jvm->fp) = fp;                \
+    } while (0)
+
+/* Green threads allocate from their own buffer */
+#define ALLOC(words, type)                                      \
+    (thread ? heap_alloc_tlab(jvm, thread, words, type) : heap_alloc(jvm, words, type))
+#else
+#define SYNC_FRAMES()                                           \
+    do {                                                        \
+        SPILL_TOS();                                            \
+        frame->ip = ip;                                         \
+        jvm->fp = fp;                                           \
+    } while (0)
+
+#define ALLOC(words, type) heap_alloc(jvm, words, type)
+#endif
+
+/* Point a frame at a method whose arguments are already in locals */
+static void enter_frame(Frame* frame, Method* method, Value* locals) {
+    frame->method = method;
+    frame->locals = locals;
+    frame->code = method->code;
+    frame->code_length = method->code_length;
+    frame->locals_count = method->locals_count;
+    frame->pc = 0;
+    /* The scratch local only ever holds a dead value */
+    for (int i = method->arg_slots; i < method->locals_count - TOS_SCRATCH_LOCALS; i++) {
+        locals[i].i = 0;
+    }
+}
+
+/* Slow path of invokestatic and invokespecial: look the target up by
+ * name, prepare it and remember it in the constant and the call site so
+ * later calls skip the lookup */
+static Method* resolve_call(Method* caller, const Insn* insn) {
+    Constant* constant = &caller->owner->constants[insn->k];
+    Method* target = constant->method;
+    int arg_slots, return_slots;
+
+    if (!target) {
+        if (constant->class_name) {
+            printf("Error: class %s is not loaded\n", constant->class_name);
+            return NULL;
+        }
+        target = class_find_method(caller->owner, constant->name, constant->descriptor);
+        if (!target) {
+            printf("Error: no method %s%s in class %s\n", constant->name,
+                   constant->descriptor, caller->owner->name);
+            return NULL;
+        }
+    }
+    /* The receiver of an instance method takes a slot of its own */
+    parse_descriptor(constant->descriptor, &arg_slots, &return_slots);
+    if (target->arg_slots != arg_slots + (insn->op == INSN_INVOKESPECIAL)) {
+        printf("Error: %s%s is %s method\n", constant->name, constant->descriptor,
+               insn->op == INSN_INVOKESPECIAL ? "a static" : "an instance");
+        return NULL;
+    }
+    if (target->access_flags & ACC_ABSTRACT) {
+        printf("Error: %s%s is abstract\n", constant->name, constant->descriptor);
+        return NULL;
+    }
+    if (method_prepare(target) != 0) {
+        return NULL;
+    }
+    constant->method = target;
+    caller->decoded.call_sites[insn->a].target = target;
+    return target;
+}
+
+/* Slow path of invokevirtual, invokeinterface and a checked invokespecial:
+ * select the method the receiver's class runs for the one the verifier
+ * resolved, and prepare it. With fill set, the call site's inline cache
+ * takes the first class seen there; later classes keep coming here. */
+static Method* dispatch_call(JVM* jvm, Method* caller, const Insn* insn, int32_t receiver,
+                             int fill) {
+    Method* declared = caller->owner->constants[insn->k].method;
+    CallSite* site = &caller->decoded.call_sites[insn->a];
+    uint32_t type = HEAP_OBJECT(jvm, receiver)[1];
+    Class* cls = (type & ARRAY_FLAG) ? NULL : class_by_id(OBJECT_CLASS_ID(type));
+    Method* target;
+
+    if (!cls || !class_is_subtype(cls, declared->owner)) {
+        printf("Error: %s has no method %s.%s%s\n", cls ? cls->name : "array",
+               declared->owner->name, declared->name, declared->descriptor);
+        return NULL;
+    }
+    /* invokespecial names its target; only the receiver needed checking */
+    target = insn->op == INSN_INVOKESPECIAL_CHECKED ? declared : class_select_method(cls, declared);
+    if (!target || (target->access_flags & ACC_ABSTRACT)) {
+        printf("Error: %s does not implement %s.%s%s\n", cls->name, declared->owner->name,
+               declared->name, declared->descriptor);
+        return NULL;
+    }
+    if (method_prepare(target) != 0) {
+        return NULL;
+    }
+    if (fill) {
+        jvm->inline_cache_misses++;
+        if (site->class_id == 0) {
+            site->target = target;
+            site->class_id = cls->id;
+        }
+    }
+    return target;
+}
+
+#ifndef JVM_PROFILING
+/* Link every method a dispatched call can run: the one declared and its
+ * implementations in the classes loaded alongside the caller */
+static int link_dispatch(Method* caller, const Insn* insn) {
+    Method* declared = caller->owner->constants[insn->k].method;
+    const ClassRegistry* registry = caller->owner->registry;
+
+    if (!declared) {
+        return -1;
+    }
+    if (!(declared->access_flags & ACC_ABSTRACT) && method_link(declared) != 0) {
+        return -1;
+    }
+    if (insn->op == INSN_INVOKESPECIAL_CHECKED || !registry) {
+        return 0;
+    }
+    for (int i = 0; i < registry->count; i++) {
+        Class* cls = registry->classes[i];
+        Method* target;
+
+        if (cls->linked != 1 || !class_is_subtype(cls, declared->owner)) {
+            continue;
+        }
+        target = class_select_method(cls, declared);
+        if (target && !(target->access_flags & ACC_ABSTRACT) && method_link(target) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+#endif
+
+#ifndef JVM_PROFILING
+/* Resolve every call method can reach and optimize the code, so that
+ * threads running it at the same time never write a call site, and don't
+ * stay in the baseline tier for want of counting. Returns 0, or -1 if a
+ * call cannot be resolved. */
+int method_link(Method* method) {
+    if (method_optimize(method) != 0) {
+        return -1;
+    }
+    if (method->linked) {
+        return 0;
+    }
+    /* Marked before the recursion, which ends it */
+    method->linked = 1;
+    for (int i = 0; i < method->decoded.count; i++) {
+        const Insn* insn = &method->decoded.insns[i];
+        Method* target;
+
+        if (method->decoded.stack_depth[i] < 0) {
+            continue;
+        }
+        if (insn->op == INSN_INVOKEVIRTUAL || insn->op == INSN_INVOKEINTERFACE ||
+            insn->op == INSN_INVOKESPECIAL_CHECKED) {
+            if (link_dispatch(method, insn) != 0) {
+                method->linked = 0;
+                return -1;
+            }
+            continue;
+        }
+        if (insn->op != INSN_INVOKESTATIC && insn->op != INSN_INVOKESPECIAL) {
+            continue;
+        }
+        target = method->decoded.call_sites[insn->a].target;
+        if (!target) {
+            target = resolve_call(method, insn);
+        }
+        if (!target || method_link(target) != 0) {
+            method->linked = 0;
+            return -1;
+        }
+    }
+    return 0;
+}
+#endif
+
+/* Target of the first handler of method that covers instruction index
+ * and catches an exception of class cls, or -1. Only a throw searches the
+ * exception table; code that doesn't throw never looks at it. */
+static int find_handler(const Method* method, int index, const Class* cls) {
+    const DecodedCode* decoded = &method->decoded;
+
+    for (int i = 0; i < decoded->handler_count; i++) {
+        const DecodedHandler* handler = &decoded->handlers[i];
+        if (index >= handler->start && index < handler->end &&
+            (!handler->catch_class || class_is_subtype(cls, handler->catch_class))) {
+            return handler->target;
+        }
+    }
+    return -1;
+}
+
+/* The record of a monitor held in monitors, or NULL */
+static MonitorRecord* find_monitor(Monitors* monitors, Value object) {
+    for (int i = 0; i < monitors->count; i++) {
+        if (monitors->held[i].object.i == object.i) {
+            return &monitors->held[i];
+        }
+    }
+    return NULL;
+}
+
+#ifdef JVM_FLOAT
+/* Java's conversions of a float or double to int and long: NaN becomes 0
+ * and values out of range saturate, where C leaves both undefined */
+static int32_t double_to_int(double d) {
+    if (d != d) {
+        return 0;
+    }
+    if (d >= 2147483647.0) {
+        return INT32_MAX;
+    }
+    if (d <= -2147483648.0) {
+        return INT32_MIN;
+    }
+    return (int32_t)d;
+}
+
+static int64_t double_to_long(double d) {
+    if (d != d) {
+        return 0;
+    }
+    if (d >= 9223372036854775807.0) {       /* 2^63 as a double */
+        return INT64_MAX;
+    }
+    if (d <= -9223372036854775808.0) {
+        return INT64_MIN;
+    }
+    return (int64_t)d;
+}
+#endif
+
+/* Print the long or double the outermost method returned in halves */
+static void print_wide_result(const Method* method, const Value* halves) {
+    int64_t value;
+#ifdef JVM_FLOAT
+    if (strchr(method->descriptor, ')')[1] == 'D') {
+        double d;
+        WIDE_GET(halves, d);
+        printf("Method returned: %g\n", d);
+        return;
+    }
+#else
+    (void)method;
+#endif
+    WIDE_GET(halves, value);
+    printf("Method returned: %lld\n", (long long)value);
+}
+
+/* Monitors held by the running code, and its owner id in GC words */
+#ifdef JVM_GREEN_THREADS
+#define MONITORS() (thread ? &thread->monitors : &jvm->monitors)
+#define OWNER() (thread ? (uint32_t)thread->id : MONITOR_OWNER_MAIN)
+#else
+#define MONITORS() (&jvm->monitors)
+#define OWNER() MONITOR_OWNER_MAIN
+#endif
+
+/* The green thread running, for the out-of-line helpers below */
+#ifdef JVM_GREEN_THREADS
+#define CURRENT_THREAD thread
+#else
+#define CURRENT_THREAD NULL
+#endif
+
+/*
+ * The slow paths of string ldc and invokenative live out of the loop. Their
+ * NativeCall has its address taken, and inside the loop it cost the hot
+ * call and return handlers registers and stack slots.
+ */
+#if defined(__GNUC__)
+#define NOINLINE __attribute__((noinline))
+#else
+#define NOINLINE
+#endif
+
+/* A native method call on thread's behalf, or the JVM's if NULL, for args */
+static void native_call(NativeCall* call, JVM* jvm, struct GreenThread* thread, Value* args) {
+    call->jvm = jvm;
+    call->thread = thread;
+    call->args = args;
+#ifdef JVM_GREEN_THREADS
+    call->root = thread ? &thread->native_root : &jvm->native_root;
+#else
+    call->root = &jvm->native_root;
+#endif
+    call->result.i = 0;
+    call->exception = NULL;
+}
+
+/* Intern a String constant the first time ldc loads it. Returns the
+ * String, or 0 after an error. */
+static NOINLINE int32_t intern_constant(JVM* jvm, struct GreenThread* thread,
+                                        const Constant* constant) {
+    NativeCall call;
+    native_call(&call, jvm, thread, NULL);
+    return string_intern_constant(&call, constant);
+}
+
+/* What call_native() returns when the native reported an error itself */
+static const char native_error[] = "";
+
+/* Run target's native code on args, its receiver and arguments on top of
+ * the operand stack; a result replaces args[0]. Returns NULL, the name of
+ * the exception to throw, or native_error after an error was reported. */
+static NOINLINE const char* call_native(JVM* jvm, struct GreenThread* thread,
+                                        const Method* target, Value* args) {
+    NativeCall call;
+    native_call(&call, jvm, thread, args);
+    if (target->native(&call) != 0) {
+        return call.exception ? call.exception : native_error;
+    }
+    if (target->return_slots) {
+        args[0] = call.result;
+    }
+    return NULL;
+}
+
+/* Push a frame for target, whose receiver and arguments are the top
+ * target->arg_slots values of the stack, in memory, and continue in it */
+#define ENTER_CALL(target)                                      \
+    do {                                                        \
+        Value* callee_locals = STACK_END() - (target)->arg_slots; \
+        Value* callee_end = callee_locals + (target)->locals_count + (target)->max_stack; \
+        if (fp + 1 >= frame_end || callee_end > stack_end) {    \
+            THROW_NEW("java/lang/StackOverflowError");          \
+        }                                                       \
+        if (callee_end > stack_high) {                          \
+            stack_high = callee_end;                            \
+        }                                                       \
+        frame->ip = ip + 1;                                     \
+        frame = &jvm->frames[++fp];                             \
+        if (fp > fp_high) {                                     \
+            fp_high = fp;                                       \
+        }                                                       \
+        enter_frame(frame, (target), callee_locals);            \
+        method = (target);                                      \
+        insns = method->decoded.insns;                          \
+        ip = insns;                                             \
+        SAMPLE_IP();                                            \
+        SAMPLE_DEPTH(fp + 1);                                   \
+        locals = callee_locals;                                 \
+        SET_STACK_EMPTY(locals + method->locals_count);         \
+        calls++;                                                \
+        PROFILE_ENTER();                                        \
+        COUNT_HOT(invocations, invocation_limit, 0);            \
+        JIT_ENTER();                                            \
+    } while (0)
+
+/* Return to the caller's frame and instruction stream */
+#define LEAVE_FRAME()                                           \
+    do {                                                        \
+        frame = &jvm->frames[--fp];                             \
+        SAMPLE_DEPTH(fp + 1);                                   \
+        method = frame->method;                                 \
+        insns = method->decoded.insns;                          \
+        locals = frame->locals;                                 \
+        ip = frame->ip;                                         \
+        PROFILE_ENTER();                                        \
+    } while (0)
+
+/*
+ * Run method, whose arguments are on jvm->stack, or a green thread's slice
+ * of it. A thread keeps its state in the thread: method is its entry point
+ * on the first slice and NULL after that, and nothing JVM-wide is written
+ * but objects, so threads can run on several OS threads at once.
+ */
+#ifdef JVM_GREEN_THREADS
+static int interpret(JVM* jvm, Method* method, GreenThread* thread) {
+#else
+static int interpret(JVM* jvm, Method* method) {
+#endif
+#ifdef JVM_THREADED_DISPATCH
+    static const void* const dispatch_table[INSN_COUNT] = {
+        [INSN_ICONST]    = &&L_INSN_ICONST,
+        [INSN_ACONST_NULL] = &&L_INSN_ACONST_NULL,
+        [INSN_LDC]       = &&L_INSN_LDC,
+        [INSN_ILOAD]     = &&L_INSN_ILOAD,
+        [INSN_ALOAD]     = &&L_INSN_ALOAD,
+        [INSN_ISTORE]    = &&L_INSN_ISTORE,
+        [INSN_ASTORE]    = &&L_INSN_ASTORE,
+        [INSN_IADD]      = &&L_INSN_IADD,
+        [INSN_ISUB]      = &&L_INSN_ISUB,
+        [INSN_IMUL]      = &&L_INSN_IMUL,
+        [INSN_IDIV]      = &&L_INSN_IDIV,
+        [INSN_IREM]      = &&L_INSN_IREM,
+        [INSN_INEG]      = &&L_INSN_INEG,
+        [INSN_IF_ICMPEQ] = &&L_INSN_IF_ICMPEQ,
+        [INSN_IF_ICMPNE] = &&L_INSN_IF_ICMPNE,
+        [INSN_IF_ICMPLT] = &&L_INSN_IF_ICMPLT,
+        [INSN_IF_ICMPGE] = &&L_INSN_IF_ICMPGE,
+        [INSN_IF_ICMPGT] = &&L_INSN_IF_ICMPGT,
+        [INSN_IF_ICMPLE] = &&L_INSN_IF_ICMPLE,
+        [INSN_IF_ACMPEQ] = &&L_INSN_IF_ACMPEQ,
+        [INSN_IF_ACMPNE] = &&L_INSN_IF_ACMPNE,
+        [INSN_IFEQ]      = &&L_INSN_IFEQ,
+        [INSN_IFNE]      = &&L_INSN_IFNE,
+        [INSN_IFLT]      = &&L_INSN_IFLT,
+        [INSN_IFGE]      = &&L_INSN_IFGE,
+        [INSN_IFGT]      = &&L_INSN_IFGT,
+        [INSN_IFLE]      = &&L_INSN_IFLE,
+        [INSN_IFNULL]    = &&L_INSN_IFNULL,
+        [INSN_IFNONNULL] = &&L_INSN_IFNONNULL,
+        [INSN_GOTO]      = &&L_INSN_GOTO,
+        [INSN_TABLESWITCH] = &&L_INSN_TABLESWITCH,
+        [INSN_LOOKUPSWITCH] = &&L_INSN_LOOKUPSWITCH,
+        [INSN_INVOKESTATIC] = &&L_INSN_INVOKESTATIC,
+        [INSN_INVOKESPECIAL] = &&L_INSN_INVOKESPECIAL,
+        [INSN_INVOKEVIRTUAL] = &&L_INSN_INVOKEVIRTUAL,
+        [INSN_INVOKEINTERFACE] = &&L_INSN_INVOKEINTERFACE,
+        [INSN_INVOKESPECIAL_CHECKED] = &&L_INSN_INVOKESPECIAL_CHECKED,
+        [INSN_IRETURN]   = &&L_INSN_IRETURN,
+        [INSN_ARETURN]   = &&L_INSN_ARETURN,
+        [INSN_RETURN]    = &&L_INSN_RETURN,
+        [INSN_ATHROW]    = &&L_INSN_ATHROW,
+        [INSN_POP]       = &&L_INSN_POP,
+        [INSN_DUP]       = &&L_INSN_DUP,
+        [INSN_NEW]       = &&L_INSN_NEW,
+        [INSN_NEWARRAY]  = &&L_INSN_NEWARRAY,
+        [INSN_ARRAYLENGTH] = &&L_INSN_ARRAYLENGTH,
+        [INSN_IALOAD]    = &&L_INSN_IALOAD,
+        [INSN_IASTORE]   = &&L_INSN_IASTORE,
+        [INSN_GETFIELD]  = &&L_INSN_GETFIELD,
+        [INSN_PUTFIELD]  = &&L_INSN_PUTFIELD,
+        [INSN_MONITORENTER] = &&L_INSN_MONITORENTER,
+        [INSN_MONITOREXIT] = &&L_INSN_MONITOREXIT,
+        [INSN_IINC]      = &&L_INSN_IINC,
+        [INSN_ISHL]      = &&L_INSN_ISHL,
+        [INSN_ISHR]      = &&L_INSN_ISHR,
+        [INSN_IUSHR]     = &&L_INSN_IUSHR,
+        [INSN_IAND]      = &&L_INSN_IAND,
+        [INSN_IOR]       = &&L_INSN_IOR,
+        [INSN_IXOR]      = &&L_INSN_IXOR,
+        [INSN_LCONST]    = &&L_INSN_LCONST,
+        [INSN_LDC2_W]    = &&L_INSN_LDC2_W,
+        [INSN_LLOAD]     = &&L_INSN_LLOAD,
+        [INSN_LSTORE]    = &&L_INSN_LSTORE,
+        [INSN_LRETURN]   = &&L_INSN_LRETURN,
+        [INSN_POP2]      = &&L_INSN_POP2,
+        [INSN_DUP2]      = &&L_INSN_DUP2,
+        [INSN_LADD]      = &&L_INSN_LADD,
+        [INSN_LSUB]      = &&L_INSN_LSUB,
+        [INSN_LMUL]      = &&L_INSN_LMUL,
+        [INSN_LDIV]      = &&L_INSN_LDIV,
+        [INSN_LREM]      = &&L_INSN_LREM,
+        [INSN_LNEG]      = &&L_INSN_LNEG,
+        [INSN_LSHL]      = &&L_INSN_LSHL,
+        [INSN_LSHR]      = &&L_INSN_LSHR,
+        [INSN_LUSHR]     = &&L_INSN_LUSHR,
+        [INSN_LAND]      = &&L_INSN_LAND,
+        [INSN_LOR]       = &&L_INSN_LOR,
+        [INSN_LXOR]      = &&L_INSN_LXOR,
+        [INSN_LCMP]      = &&L_INSN_LCMP,
+        [INSN_I2L]       = &&L_INSN_I2L,
+        [INSN_L2I]       = &&L_INSN_L2I,
+#ifdef JVM_FLOAT
+        [INSN_FCONST]    = &&L_INSN_FCONST,
+        [INSN_DCONST]    = &&L_INSN_DCONST,
+        [INSN_FLOAD]     = &&L_INSN_FLOAD,
+        [INSN_DLOAD]     = &&L_INSN_DLOAD,
+        [INSN_FSTORE]    = &&L_INSN_FSTORE,
+        [INSN_DSTORE]    = &&L_INSN_DSTORE,
+        [INSN_FRETURN]   = &&L_INSN_FRETURN,
+        [INSN_DRETURN]   = &&L_INSN_DRETURN,
+        [INSN_FADD]      = &&L_INSN_FADD,
+        [INSN_FSUB]      = &&L_INSN_FSUB,
+        [INSN_FMUL]      = &&L_INSN_FMUL,
+        [INSN_FDIV]      = &&L_INSN_FDIV,
+        [INSN_FREM]      = &&L_INSN_FREM,
+        [INSN_FNEG]      = &&L_INSN_FNEG,
+        [INSN_FCMPL]     = &&L_INSN_FCMPL,
+        [INSN_FCMPG]     = &&L_INSN_FCMPG,
+        [INSN_DADD]      = &&L_INSN_DADD,
+        [INSN_DSUB]      = &&L_INSN_DSUB,
+        [INSN_DMUL]      = &&L_INSN_DMUL,
+        [INSN_DDIV]      = &&L_INSN_DDIV,
+        [INSN_DREM]      = &&L_INSN_DREM,
+        [INSN_DNEG]      = &&L_INSN_DNEG,
+        [INSN_DCMPL]     = &&L_INSN_DCMPL,
+        [INSN_DCMPG]     = &&L_INSN_DCMPG,
+        [INSN_I2F]       = &&L_INSN_I2F,
+        [INSN_I2D]       = &&L_INSN_I2D,
+        [INSN_L2F]       = &&L_INSN_L2F,
+        [INSN_L2D]       = &&L_INSN_L2D,
+        [INSN_F2I]       = &&L_INSN_F2I,
+        [INSN_F2L]       = &&L_INSN_F2L,
+        [INSN_F2D]       = &&L_INSN_F2D,
+        [INSN_D2I]       = &&L_INSN_D2I,
+        [INSN_D2L]       = &&L_INSN_D2L,
+        [INSN_D2F]       = &&L_INSN_D2F,
+#endif
+        [INSN_ILOAD_ILOAD_IF_ICMPEQ] = &&L_INSN_ILOAD_ILOAD_IF_ICMPEQ,
+        [INSN_ILOAD_ILOAD_IF_ICMPNE] = &&L_INSN_ILOAD_ILOAD_IF_ICMPNE,
+        [INSN_ILOAD_ILOAD_IF_ICMPLT] = &&L_INSN_ILOAD_ILOAD_IF_ICMPLT,
+        [INSN_ILOAD_ILOAD_IF_ICMPGE] = &&L_INSN_ILOAD_ILOAD_IF_ICMPGE,
+        [INSN_ILOAD_ILOAD_IF_ICMPGT] = &&L_INSN_ILOAD_ILOAD_IF_ICMPGT,
+        [INSN_ILOAD_ILOAD_IF_ICMPLE] = &&L_INSN_ILOAD_ILOAD_IF_ICMPLE,
+        [INSN_ILOAD_ICONST_IADD_ISTORE] = &&L_INSN_ILOAD_ICONST_IADD_ISTORE,
+        [INSN_ILOAD_ILOAD_IADD] = &&L_INSN_ILOAD_ILOAD_IADD,
+        [INSN_YIELD]     = &&L_INSN_YIELD,
+        [INSN_SLEEP]     = &&L_INSN_SLEEP,
+        [INSN_INVOKENATIVE] = &&L_INSN_INVOKENATIVE,
+        [INSN_HALT]      = &&L_INSN_HALT,
+        [INSN_UNKNOWN]   = &&L_INSN_UNKNOWN,
+        [INSN_END]       = &&L_INSN_END
+    };
+#endif
+    int base_fp = jvm->fp;
+    int entry_sp;
+    Value* stack_end = jvm->stack + STACK_SIZE;
+    int frame_end = MAX_FRAMES;
+    int fp = base_fp;
+    Frame* frame = &jvm->frames[fp];
+    const Insn* insns;
+    const Insn* ip;
+    Value* locals;
+    Value* sp;
+#ifdef JVM_TOS_CACHE
+    Value tos;
+#endif
+    Value* stack_high;
+    int fp_high = fp;
+    uint64_t executed = 0;
+    uint64_t calls = 1;
+#ifdef JVM_STACK_TRAFFIC
+    uint64_t stack_loads = 0;
+    uint64_t stack_stores = 0;
+#endif
+#ifdef JVM_GREEN_THREADS
+    uint64_t yield_at = NO_YIELD;
+#endif
+    int result = 0;
+    int failed = 0;                     /* Stopped by a runtime error */
+    Value thrown = {0};                 /* The exception being thrown */
+    const Class* throw_class = NULL;    /* The class of one to raise */
+#ifdef JVM_PROFILING
+    Profile* const profile = jvm->profile;
+    const int profile_cycles = profile->mode & PROFILE_CYCLES;
+    uint64_t* profile_counts = NULL;
+    uint64_t* profile_taken = NULL;
+    uint64_t profile_tick = PROFILE_CLOCK();
+    int profile_op = INSN_END;      /* Charged with the set-up time */
+#endif
+
+#ifdef JVM_GREEN_THREADS
+    /* A green thread stays inside its own segments and runs for one slice */
+    if (thread) {
+        base_fp = thread->frame_base;
+        stack_end = jvm->stack + thread->stack_limit;
+        frame_end = thread->frame_limit;
+        yield_at = (uint64_t)jvm->scheduler->budget;
+        if (!method) {
+            /* Switch the thread back in where it stopped */
+            entry_sp = thread->stack_base;
+            fp = thread->fp;
+            frame = &jvm->frames[fp];
+            method = frame->method;
+            insns = method->decoded.insns;
+            ip = frame->ip;
+            locals = frame->locals;
+            stack_high = jvm->stack;    /* Unused: spawn set the peaks */
+            calls = 0;
+            SET_STACK_END(jvm->stack + thread->sp);
+            PROFILE_ENTER();
+            goto run;
+        }
+        fp = base_fp;
+        frame = &jvm->frames[fp];
+        entry_sp = thread->stack_base;
+    } else {
+        entry_sp = jvm->sp - method->arg_slots;
+    }
+#else
+    entry_sp = jvm->sp - method->arg_slots;
+#endif
+    insns = method->decoded.insns;
+    ip = insns;
+    locals = &jvm->stack[entry_sp];
+    stack_high = locals + method->locals_count + method->max_stack;
+
+    if (entry_sp < 0) {
+        printf("Error: %s needs %d arguments on the stack\n", method->name, method->arg_slots);
+        return -1;
+    }
+    if (stack_high > stack_end) {
+        printf("Stack overflow!\n");
+        return -1;
+    }
+
+#ifdef JVM_GREEN_THREADS
+    if (!thread) {
+        jvm->running++;
+    }
+#else
+    jvm->running++;
+#endif
+    enter_frame(frame, method, locals);
+    SAMPLE_IP();
+    SAMPLE_DEPTH(fp + 1);
+    SET_STACK_END(locals + method->locals_count);
+    PROFILE_ENTER();
+    COUNT_HOT(invocations, invocation_limit, 0);
+    JIT_ENTER();
+
+#ifdef JVM_GREEN_THREADS
+run:
+#endif
+#ifdef JVM_THREADED_DISPATCH
+    DISPATCH();
+    {
+        {
+#else
+    for (;;) {
+        executed++;
+        PROFILE_INSN();
+        switch (ip->op) {
+#endif
+            CASE(INSN_ICONST):
+            CASE(INSN_ACONST_NULL):
+#ifdef JVM_FLOAT
+            CASE(INSN_FCONST):          /* k is the float's bits */
+#endif
+            {
+                Value v = {ip->k};
+                PUSH(v);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_LDC): {
+                /* The verifier turns int and float ldc into iconst, so this
+                 * loads a String: the interned one, made the first time */
+                const Constant* constant = &method->owner->constants[ip->k];
+                Value v = {string_find(jvm, constant)};
+                if (v.i == 0) {
+                    SYNC_FRAMES();
+                    v.i = intern_constant(jvm, CURRENT_THREAD, constant);
+                    FILL_TOS();
+                    if (v.i == 0) {
+                        goto fail;
+                    }
+                }
+                PUSH(v);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_ILOAD):
+            CASE(INSN_ALOAD):
+#ifdef JVM_FLOAT
+            CASE(INSN_FLOAD):
+#endif
+                PUSH(locals[ip->a]);
+                ip++;
+                DISPATCH();
+
+            CASE(INSN_ISTORE):
+            CASE(INSN_ASTORE):
+#ifdef JVM_FLOAT
+            CASE(INSN_FSTORE):
+#endif
+                POP(locals[ip->a]);
+                ip++;
+                DISPATCH();
+
+            /* Wrapping arithmetic is done unsigned, where C defines it */
+            CASE(INSN_IADD): {
+                Value a, b;
+                POP(b);
+                a = TOP();
+                Value r = {(int32_t)((uint32_t)a.i + (uint32_t)b.i)};
+                SET_TOP(r);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_ISUB): {
+                Value a, b;
+                POP(b);
+                a = TOP();
+                Value r = {(int32_t)((uint32_t)a.i - (uint32_t)b.i)};
+                SET_TOP(r);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_IMUL): {
+                Value a, b;
+                POP(b);
+                a = TOP();
+                Value r = {(int32_t)((uint32_t)a.i * (uint32_t)b.i)};
+                SET_TOP(r);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_IDIV): {
+                Value a, b;
+                POP(b);
+                a = TOP();
+                if (b.i == 0) {
+                    THROW_NEW(ARITHMETIC_EXCEPTION);
+                }
+                Value r;
+                /* INT_MIN / -1 overflows in C; Java wraps to INT_MIN */
+                r.i = b.i == -1 ? (int32_t)(0 - (uint32_t)a.i) : a.i / b.i;
+                SET_TOP(r);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_IREM): {
+                Value a, b;
+                POP(b);
+                a = TOP();
+                if (b.i == 0) {
+                    THROW_NEW(ARITHMETIC_EXCEPTION);
+                }
+                Value r;
+                r.i = b.i == -1 ? 0 : a.i % b.i;
+                SET_TOP(r);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_INEG): {
+                Value a = TOP();
+                Value r = {(int32_t)(0 - (uint32_t)a.i)};
+                SET_TOP(r);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_IF_ICMPEQ):
+            CASE(INSN_IF_ACMPEQ):
+                IF_ICMP(==);
+                DISPATCH();
+
+            CASE(INSN_IF_ICMPNE):
+            CASE(INSN_IF_ACMPNE):
+                IF_ICMP(!=);
+                DISPATCH();
+
+            CASE(INSN_IF_ICMPLT):
+                IF_ICMP(<);
+                DISPATCH();
+
+            CASE(INSN_IF_ICMPGE):
+                IF_ICMP(>=);
+                DISPATCH();
+
+            CASE(INSN_IF_ICMPGT):
+                IF_ICMP(>);
+                DISPATCH();
+
+            CASE(INSN_IF_ICMPLE):
+                IF_ICMP(<=);
+                DISPATCH();
+
+            CASE(INSN_IFEQ):
+                IF_ZERO(==);
+                DISPATCH();
+
+            CASE(INSN_IFNE):
+                IF_ZERO(!=);
+                DISPATCH();
+
+            CASE(INSN_IFLT):
+                IF_ZERO(<);
+                DISPATCH();
+
+            CASE(INSN_IFGE):
+                IF_ZERO(>=);
+                DISPATCH();
+
+            CASE(INSN_IFGT):
+                IF_ZERO(>);
+                DISPATCH();
+
+            CASE(INSN_IFLE):
+                IF_ZERO(<=);
+                DISPATCH();
+
+            CASE(INSN_IFNULL): {
+                Value v;
+                POP(v);
+                if (v.i == 0) {
+                    PROFILE_TAKEN();
+                    BRANCH(ip->k);
+                } else {
+                    ip++;
+                }
+                DISPATCH();
+            }
+
+            CASE(INSN_IFNONNULL): {
+                Value v;
+                POP(v);
+                if (v.i != 0) {
+                    PROFILE_TAKEN();
+                    BRANCH(ip->k);
+                } else {
+                    ip++;
+                }
+                DISPATCH();
+            }
+
+            CASE(INSN_GOTO):
+                BRANCH(ip->k);
+                DISPATCH();
+
+            /* One unsigned compare covers both ends of the jump table */
+            CASE(INSN_TABLESWITCH): {
+                const SwitchTable* table = &method->decoded.switches[ip->a];
+                uint32_t slot;
+                int to;
+                Value v;
+                POP(v);
+                slot = (uint32_t)v.i - (uint32_t)table->low;
+                if (slot < (uint32_t)table->count) {
+                    PROFILE_TAKEN();
+                    to = table->targets[slot];
+                } else {
+                    to = table->default_target;
+                }
+                BRANCH(to);
+                DISPATCH();
+            }
+
+            CASE(INSN_LOOKUPSWITCH): {
+                const SwitchTable* table = &method->decoded.switches[ip->a];
+                int slot, to;
+                Value v;
+                POP(v);
+                slot = switch_case(table, v.i);
+                if (slot >= 0) {
+                    PROFILE_TAKEN();
+                    to = table->targets[slot];
+                } else {
+                    to = table->default_target;
+                }
+                BRANCH(to);
+                DISPATCH();
+            }
+
+            CASE(INSN_INVOKESTATIC):
+            CASE(INSN_INVOKESPECIAL): {
+                Method* target = method->decoded.call_sites[ip->a].target;
+                CHECK_BUDGET(1);
+                if (!target) {
+                    target = resolve_call(method, ip);
+                    if (!target) {
+                        goto fail;
+                    }
+                }
+                SPILL_TOS();
+                ENTER_CALL(target);
+                DISPATCH();
+            }
+
+            CASE(INSN_INVOKEVIRTUAL):
+            CASE(INSN_INVOKEINTERFACE):
+            CASE(INSN_INVOKESPECIAL_CHECKED): {
+                const CallSite* site = &method->decoded.call_sites[ip->a];
+                Method* target;
+                Value receiver;
+                CHECK_BUDGET(1);
+                SPILL_TOS();
+                receiver = STACK_END()[-site->arg_slots];
+                if (receiver.i == 0) {
+                    THROW_NEW(NULL_POINTER_EXCEPTION);
+                }
+                /* The inline cache: one compare for the receiver's class */
+                if (OBJECT_CLASS_ID(HEAP_OBJECT(jvm, receiver.i)[1]) == site->class_id) {
+                    target = site->target;
+                } else {
+                    target = dispatch_call(jvm, method, ip, receiver.i, !SCHEDULED());
+                    if (!target) {
+                        goto fail;
+                    }
+                }
+                ENTER_CALL(target);
+                DISPATCH();
+            }
+
+            CASE(INSN_IRETURN):
+            CASE(INSN_ARETURN):
+#ifdef JVM_FLOAT
+            CASE(INSN_FRETURN):
+#endif
+            {
+                Value ret;
+                POP(ret);
+                if (fp == base_fp) {
+                    result = ret.i;
+                    if (jvm->verbose) printf("Method returned: %d\n", result);
+                    goto done;
+                }
+                /* The callee's arguments are popped too */
+                SET_STACK_RESULT(locals, ret);
+                LEAVE_FRAME();
+                JIT_ENTER();
+                DISPATCH();
+            }
+
+            CASE(INSN_RETURN):
+                if (fp == base_fp) {
+                    if (jvm->verbose) printf("Method returned (void)\n");
+                    goto done;
+                }
+                SET_STACK_END(locals);
+                LEAVE_FRAME();
+                JIT_ENTER();
+                DISPATCH();
+
+            CASE(INSN_ATHROW): {
+                uint32_t type;
+                POP(thrown);
+                if (thrown.i == 0) {
+                    THROW_NEW(NULL_POINTER_EXCEPTION);
+                }
+                type = HEAP_OBJECT(jvm, thrown.i)[1];
+                if ((type & ARRAY_FLAG) ||
+                    !class_is_subtype(class_by_id(OBJECT_CLASS_ID(type)),
+                                      class_system(THROWABLE_CLASS))) {
+                    RUNTIME_ERROR("Error: athrow of an object that is not a Throwable\n");
+                }
+                goto throw;
+            }
+
+            CASE(INSN_POP):
+                DROP();
+                ip++;
+                DISPATCH();
+
+            CASE(INSN_DUP): {
+                Value v = TOP();
+                PUSH(v);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_NEW): {
+                /* The verifier resolved and linked the class */
+                const Class* cls = method->owner->constants[ip->k].cls;
+                Value v;
+                SYNC_FRAMES();
+                v.i = ALLOC(OBJECT_HEADER_WORDS + cls->instance_fields,
+                            OBJECT_TYPE(cls->id, cls->instance_fields));
+                FILL_TOS();
+                if (v.i == 0) {
+                    RUNTIME_ERROR("Out of heap memory!\n");
+                }
+                PUSH(v);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_NEWARRAY): {
+                Value count, v;
+                POP(count);
+                if (count.i < 0) {
+                    THROW_NEW("java/lang/NegativeArraySizeException");
+                }
+                SYNC_FRAMES();
+                v.i = ALLOC(OBJECT_HEADER_WORDS + (uint32_t)count.i,
+                            ARRAY_FLAG | (uint32_t)count.i);
+                FILL_TOS();
+                if (v.i == 0) {
+                    RUNTIME_ERROR("Out of heap memory!\n");
+                }
+                PUSH(v);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_ARRAYLENGTH): {
+                Value array = TOP();
+                if (array.i == 0) {
+                    THROW_NEW(NULL_POINTER_EXCEPTION);
+                }
+                Value v = {(int32_t)(HEAP_OBJECT(jvm, array.i)[1] & ~ARRAY_FLAG)};
+                SET_TOP(v);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_IALOAD): {
+                Value array, index;
+                const uint32_t* object;
+                POP(index);
+                array = TOP();
+                if (array.i == 0) {
+                    THROW_NEW(NULL_POINTER_EXCEPTION);
+                }
+                object = HEAP_OBJECT(jvm, array.i);
+                if ((uint32_t)index.i >= (object[1] & ~ARRAY_FLAG)) {
+                    THROW_NEW(INDEX_EXCEPTION);
+                }
+                Value v = {(int32_t)object[OBJECT_HEADER_WORDS + index.i]};
+                SET_TOP(v);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_IASTORE): {
+                Value array, index, v;
+                uint32_t* object;
+                POP(v);
+                POP(index);
+                POP(array);
+                if (array.i == 0) {
+                    THROW_NEW(NULL_POINTER_EXCEPTION);
+                }
+                object = HEAP_OBJECT(jvm, array.i);
+                if ((uint32_t)index.i >= (object[1] & ~ARRAY_FLAG)) {
+                    THROW_NEW(INDEX_EXCEPTION);
+                }
+                object[OBJECT_HEADER_WORDS + index.i] = (uint32_t)v.i;
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_GETFIELD): {
+                Value object = TOP();
+                if (object.i == 0) {
+                    THROW_NEW(NULL_POINTER_EXCEPTION);
+                }
+                Value v = {(int32_t)HEAP_OBJECT(jvm, object.i)[OBJECT_HEADER_WORDS + ip->a]};
+                SET_TOP(v);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_PUTFIELD): {
+                Value object, v;
+                POP(v);
+                POP(object);
+                if (object.i == 0) {
+                    THROW_NEW(NULL_POINTER_EXCEPTION);
+                }
+                HEAP_OBJECT(jvm, object.i)[OBJECT_HEADER_WORDS + ip->a] = (uint32_t)v.i;
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_MONITORENTER): {
+                Value object = TOP();
+                Monitors* monitors = MONITORS();
+                MonitorRecord* record;
+                if (object.i == 0) {
+                    THROW_NEW(NULL_POINTER_EXCEPTION);
+                }
+                record = find_monitor(monitors, object);
+                if (record) {
+                    record->count++;
+                } else {
+                    uint32_t expected = 0;
+                    if (monitors->count == MAX_HELD_MONITORS) {
+                        RUNTIME_ERROR("More than %d monitors held!\n", MAX_HELD_MONITORS);
+                    }
+                    if (!LOCK_CLAIM(&HEAP_OBJECT(jvm, object.i)[0], &expected, OWNER())) {
+#ifdef JVM_GREEN_THREADS
+                        /* Let the owner run, and try again next slice */
+                        if (thread) {
+                            thread->monitor_waits++;
+                            goto preempt;
+                        }
+#endif
+                        RUNTIME_ERROR("Monitor held by thread %u!\n",
+                                      (unsigned)(expected >> LOCK_OWNER_SHIFT));
+                    }
+                    record = &monitors->held[monitors->count++];
+                    record->object = object;
+                    record->count = 1;
+                }
+                DROP();
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_MONITOREXIT): {
+                Value object;
+                Monitors* monitors = MONITORS();
+                MonitorRecord* record;
+                POP(object);
+                if (object.i == 0) {
+                    THROW_NEW(NULL_POINTER_EXCEPTION);
+                }
+                record = find_monitor(monitors, object);
+                if (!record) {
+                    RUNTIME_ERROR("Monitor not held!\n");
+                }
+                if (--record->count == 0) {
+                    *record = monitors->held[--monitors->count];
+                    LOCK_RELEASE(&HEAP_OBJECT(jvm, object.i)[0]);
+                }
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_IINC):
+                locals[ip->a].i = (int32_t)((uint32_t)locals[ip->a].i + (uint32_t)ip->k);
+                ip++;
+                DISPATCH();
+
+            /* Shifts use the low five bits of the count; the unsigned
+             * forms keep them defined for every value */
+            CASE(INSN_ISHL):
+                INT_BINARY((int32_t)((uint32_t)a.i << (b.i & 0x1f)));
+                ip++;
+                DISPATCH();
+
+            CASE(INSN_ISHR):
+                INT_BINARY(a.i >> (b.i & 0x1f));
+                ip++;
+                DISPATCH();
+
+            CASE(INSN_IUSHR):
+                INT_BINARY((int32_t)((uint32_t)a.i >> (b.i & 0x1f)));
+                ip++;
+                DISPATCH();
+
+            CASE(INSN_IAND):
+                INT_BINARY(a.i & b.i);
+                ip++;
+                DISPATCH();
+
+            CASE(INSN_IOR):
+                INT_BINARY(a.i | b.i);
+                ip++;
+                DISPATCH();
+
+            CASE(INSN_IXOR):
+                INT_BINARY(a.i ^ b.i);
+                ip++;
+                DISPATCH();
+
+            /* long, and the two-slot moves that double shares with it */
+            CASE(INSN_LCONST): {
+                int64_t v = ip->k;
+                PUSH_WIDE(v);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_LDC2_W):
+                PUSH_WIDE(method->owner->constants[ip->k].wide);
+                ip++;
+                DISPATCH();
+
+            CASE(INSN_LLOAD):
+#ifdef JVM_FLOAT
+            CASE(INSN_DLOAD):
+#endif
+                PUSH(locals[ip->a]);
+                PUSH(locals[ip->a + 1]);
+                ip++;
+                DISPATCH();
+
+            CASE(INSN_LSTORE):
+#ifdef JVM_FLOAT
+            CASE(INSN_DSTORE):
+#endif
+                POP(locals[ip->a + 1]);
+                POP(locals[ip->a]);
+                ip++;
+                DISPATCH();
+
+            CASE(INSN_LRETURN):
+#ifdef JVM_FLOAT
+            CASE(INSN_DRETURN):
+#endif
+            {
+                Value low, high;
+                POP(high);
+                POP(low);
+                if (fp == base_fp) {
+                    jvm->wide_result[0] = low;
+                    jvm->wide_result[1] = high;
+                    if (jvm->verbose) print_wide_result(method, jvm->wide_result);
+                    goto done;
+                }
+                SET_STACK_RESULT(locals, low);
+                PUSH(high);
+                LEAVE_FRAME();
+                JIT_ENTER();
+                DISPATCH();
+            }
+
+            CASE(INSN_POP2):
+                DROP();
+                DROP();
+                ip++;
+                DISPATCH();
+
+            CASE(INSN_DUP2): {
+                Value a, b;
+                POP(b);
+                a = TOP();
+                PUSH(b);
+                PUSH(a);
+                PUSH(b);
+                ip++;
+                DISPATCH();
+            }
+
+            /* Wrapping arithmetic is done unsigned, where C defines it */
+            CASE(INSN_LADD):
+                WIDE_BINARY(int64_t, (int64_t)((uint64_t)a + (uint64_t)b));
+                ip++;
+                DISPATCH();
+
+            CASE(INSN_LSUB):
+                WIDE_BINARY(int64_t, (int64_t)((uint64_t)a - (uint64_t)b));
+                ip++;
+                DISPATCH();
+
+            CASE(INSN_LMUL):
+                WIDE_BINARY(int64_t, (int64_t)((uint64_t)a * (uint64_t)b));
+                ip++;
+                DISPATCH();
+
+            CASE(INSN_LDIV):
+            CASE(INSN_LREM): {
+                int64_t a, b, r;
+                POP_WIDE(b);
+                POP_WIDE(a);
+                if (b == 0) {
+                    THROW_NEW(ARITHMETIC_EXCEPTION);
+                }
+                /* INT64_MIN / -1 overflows in C; Java wraps to INT64_MIN */
+                if (b == -1) {
+                    r = ip->op == INSN_LDIV ? (int64_t)(0 - (uint64_t)a) : 0;
+                } else {
+                    r = ip->op == INSN_LDIV ? a / b : a % b;
+                }
+                PUSH_WIDE(r);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_LNEG): {
+                int64_t a;
+                POP_WIDE(a);
+                a = (int64_t)(0 - (uint64_t)a);
+                PUSH_WIDE(a);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_LSHL):
+            CASE(INSN_LSHR):
+            CASE(INSN_LUSHR): {
+                Value count;
+                int64_t a;
+                int shift;
+                POP(count);
+                POP_WIDE(a);
+                shift = count.i & 0x3f;
+                if (ip->op == INSN_LSHL) {
+                    a = (int64_t)((uint64_t)a << shift);
+                } else if (ip->op == INSN_LSHR) {
+                    a >>= shift;
+                } else {
+                    a = (int64_t)((uint64_t)a >> shift);
+                }
+                PUSH_WIDE(a);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_LAND):
+                WIDE_BINARY(int64_t, a & b);
+                ip++;
+                DISPATCH();
+
+            CASE(INSN_LOR):
+                WIDE_BINARY(int64_t, a | b);
+                ip++;
+                DISPATCH();
+
+            CASE(INSN_LXOR):
+                WIDE_BINARY(int64_t, a ^ b);
+                ip++;
+                DISPATCH();
+
+            CASE(INSN_LCMP): {
+                int64_t a, b;
+                Value r;
+                POP_WIDE(b);
+                POP_WIDE(a);
+                r.i = COMPARE(a, b, 0);
+                PUSH(r);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_I2L): {
+                Value v;
+                int64_t r;
+                POP(v);
+                r = v.i;
+                PUSH_WIDE(r);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_L2I): {
+                int64_t a;
+                Value r;
+                POP_WIDE(a);
+                r.i = (int32_t)a;
+                PUSH(r);
+                ip++;
+                DISPATCH();
+            }
+
+#ifdef JVM_FLOAT
+            /* float and double, as IEEE 754 single and double precision */
+            CASE(INSN_DCONST): {
+                double v = ip->k;
+                PUSH_WIDE(v);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_FADD):
+                FLOAT_BINARY(a + b);
+                ip++;
+                DISPATCH();
+
+            CASE(INSN_FSUB):
+                FLOAT_BINARY(a - b);
+                ip++;
+                DISPATCH();
+
+            CASE(INSN_FMUL):
+                FLOAT_BINARY(a * b);
+                ip++;
+                DISPATCH();
+
+            CASE(INSN_FDIV):
+                FLOAT_BINARY(a / b);
+                ip++;
+                DISPATCH();
+
+            CASE(INSN_FREM):
+                FLOAT_BINARY(fmodf(a, b));
+                ip++;
+                DISPATCH();
+
+            CASE(INSN_FNEG): {
+                Value v = TOP();
+                v.f = -v.f;
+                SET_TOP(v);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_FCMPL):
+            CASE(INSN_FCMPG): {
+                Value a, b, r;
+                POP(b);
+                a = TOP();
+                r.i = COMPARE(a.f, b.f, ip->op == INSN_FCMPL ? -1 : 1);
+                SET_TOP(r);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_DADD):
+                WIDE_BINARY(double, a + b);
+                ip++;
+                DISPATCH();
+
+            CASE(INSN_DSUB):
+                WIDE_BINARY(double, a - b);
+                ip++;
+                DISPATCH();
+
+            CASE(INSN_DMUL):
+                WIDE_BINARY(double, a * b);
+                ip++;
+                DISPATCH();
+
+            CASE(INSN_DDIV):
+                WIDE_BINARY(double, a / b);
+                ip++;
+                DISPATCH();
+
+            CASE(INSN_DREM):
+                WIDE_BINARY(double, fmod(a, b));
+                ip++;
+                DISPATCH();
+
+            CASE(INSN_DNEG): {
+                double a;
+                POP_WIDE(a);
+                a = -a;
+                PUSH_WIDE(a);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_DCMPL):
+            CASE(INSN_DCMPG): {
+                double a, b;
+                Value r;
+                POP_WIDE(b);
+                POP_WIDE(a);
+                r.i = COMPARE(a, b, ip->op == INSN_DCMPL ? -1 : 1);
+                PUSH(r);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_I2F): {
+                Value v = TOP();
+                v.f = (float)v.i;
+                SET_TOP(v);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_I2D): {
+                Value v;
+                double r;
+                POP(v);
+                r = v.i;
+                PUSH_WIDE(r);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_L2F): {
+                int64_t a;
+                Value r;
+                POP_WIDE(a);
+                r.f = (float)a;
+                PUSH(r);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_L2D): {
+                int64_t a;
+                double r;
+                POP_WIDE(a);
+                r = (double)a;
+                PUSH_WIDE(r);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_F2I): {
+                Value v = TOP();
+                v.i = double_to_int(v.f);
+                SET_TOP(v);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_F2L): {
+                Value v;
+                int64_t r;
+                POP(v);
+                r = double_to_long(v.f);
+                PUSH_WIDE(r);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_F2D): {
+                Value v;
+                double r;
+                POP(v);
+                r = v.f;
+                PUSH_WIDE(r);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_D2I): {
+                double a;
+                Value r;
+                POP_WIDE(a);
+                r.i = double_to_int(a);
+                PUSH(r);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_D2L): {
+                double a;
+                int64_t r;
+                POP_WIDE(a);
+                r = double_to_long(a);
+                PUSH_WIDE(r);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_D2F): {
+                double a;
+                Value r;
+                POP_WIDE(a);
+                r.f = (float)a;
+                PUSH(r);
+                ip++;
+                DISPATCH();
+            }
+#endif
+
+            /* Superinstructions (see fuse_superinstructions()). Each runs
+             * its whole sequence and counts every bytecode in it. */
+            CASE(INSN_ILOAD_ILOAD_IF_ICMPEQ):
+                FUSED_IF_ICMP(==);
+                DISPATCH();
+
+            CASE(INSN_ILOAD_ILOAD_IF_ICMPNE):
+                FUSED_IF_ICMP(!=);
+                DISPATCH();
+
+            CASE(INSN_ILOAD_ILOAD_IF_ICMPLT):
+                FUSED_IF_ICMP(<);
+                DISPATCH();
+
+            CASE(INSN_ILOAD_ILOAD_IF_ICMPGE):
+                FUSED_IF_ICMP(>=);
+                DISPATCH();
+
+            CASE(INSN_ILOAD_ILOAD_IF_ICMPGT):
+                FUSED_IF_ICMP(>);
+                DISPATCH();
+
+            CASE(INSN_ILOAD_ILOAD_IF_ICMPLE):
+                FUSED_IF_ICMP(<=);
+                DISPATCH();
+
+            CASE(INSN_ILOAD_ICONST_IADD_ISTORE):
+                locals[ip[3].a].i = (int32_t)((uint32_t)locals[ip->a].i + (uint32_t)ip[1].k);
+                executed += 3;
+                ip += 4;
+                DISPATCH();
+
+            CASE(INSN_ILOAD_ILOAD_IADD): {
+                Value r = {(int32_t)((uint32_t)locals[ip->a].i + (uint32_t)locals[ip[1].a].i)};
+                PUSH(r);
+                executed += 2;
+                ip += 3;
+                DISPATCH();
+            }
+
+            /* Blocking points. Outside a scheduler there is no one to
+             * yield to, and sleep only drops its argument. */
+            CASE(INSN_YIELD):
+                ip++;
+#ifdef JVM_GREEN_THREADS
+                if (thread) {
+                    goto preempt;
+                }
+#endif
+                DISPATCH();
+
+            CASE(INSN_SLEEP): {
+                Value ticks;
+                POP(ticks);
+                ip++;
+#ifdef JVM_GREEN_THREADS
+                if (thread) {
+                    thread->state = THREAD_SLEEPING;
+                    thread->sleep_ticks = ticks.i > 0 ? ticks.i : 0;
+                    goto preempt;
+                }
+#else
+                (void)ticks;
+#endif
+                DISPATCH();
+            }
+
+            /* A native method runs on the operand stack, without a frame.
+             * It may allocate, so the frames are synced first. */
+            CASE(INSN_INVOKENATIVE): {
+                const Method* target = method->decoded.call_sites[ip->a].target;
+                Value* args = STACK_END() - target->arg_slots;
+                const char* exception;
+                SYNC_FRAMES();
+                if (!(target->access_flags & ACC_STATIC) && args[0].i == 0) {
+                    THROW_NEW(NULL_POINTER_EXCEPTION);
+                }
+                exception = call_native(jvm, CURRENT_THREAD, target, args);
+                if (exception == native_error) {
+                    goto fail;
+                }
+                if (exception) {
+                    THROW_NEW(exception);
+                }
+                calls++;
+                SET_STACK_END(args + target->return_slots);
+                ip++;
+                DISPATCH();
+            }
+
+            CASE(INSN_HALT):
+                if (jvm->verbose) printf("Execution halted\n");
+                goto done;
+
+            CASE(INSN_UNKNOWN):
+                printf("Unknown opcode: 0x%02x at pc=%d\n", ip->k,
+                       method->decoded.bytecode_pc[ip - insns]);
+                goto fail;
+
+            CASE(INSN_END):
+                /* The sentinel is not a bytecode; don't count it. Falling
+                 * off the end of a void method returns from it. */
+                executed--;
+                if (fp == base_fp) {
+                    if (jvm->verbose) printf("Reached end of bytecode\n");
+                    goto done;
+                }
+                SET_STACK_END(locals);
+                LEAVE_FRAME();
+                JIT_ENTER();
+                DISPATCH();
+
+#ifndef JVM_THREADED_DISPATCH
+            DEFAULT:
+                printf("Bad instruction %d\n", ip->op);
+                goto fail;
+#endif
+        }
+
+        /* Only reached by goto, from an instruction that throws. The stack
+         * the instruction left is dropped before the exception object is
+         * allocated: the handler starts with an empty one, and the
+         * collector must not take stale slots of it for references. */
+throw_new:
+        if (!throw_class) {
+            RUNTIME_ERROR("Error: out of memory\n");
+        }
+        memset(locals + method->locals_count, 0, sizeof(Value) * method->max_stack);
+        SET_STACK_EMPTY(locals + method->locals_count);
+        SYNC_FRAMES();
+        thrown.i = ALLOC(OBJECT_HEADER_WORDS + throw_class->instance_fields,
+                         OBJECT_TYPE(throw_class->id, throw_class->instance_fields));
+        if (thrown.i == 0) {
+            RUNTIME_ERROR("Out of heap memory!\n");
+        }
+
+        /* Unwind to the first handler for thrown, from the instruction at
+         * ip outwards: through the frame's exception table, then its
+         * callers' at the invokes they stopped in */
+throw:
+        {
+            const Class* cls = class_by_id(OBJECT_CLASS_ID(HEAP_OBJECT(jvm, thrown.i)[1]));
+            const Method* thrower = method;
+            int throw_pc = method->decoded.bytecode_pc[ip - insns];
+            int target;
+
+            while ((target = find_handler(method, (int)(ip - insns), cls)) < 0) {
+                if (fp == base_fp) {
+                    printf("Uncaught %s thrown at pc=%d of %s\n", cls->name, throw_pc,
+                           thrower->name);
+                    goto fail;
+                }
+                LEAVE_FRAME();
+                ip--;
+            }
+            ip = insns + target;
+            SET_STACK_EMPTY(locals + method->locals_count);
+            PUSH(thrown);
+        }
+        DISPATCH();
+    }
+
+fail:
+    result = -1;
+    failed = 1;
+    goto done;
+
+#ifdef JVM_GREEN_THREADS
+preempt:
+    /* Switch the thread out. Its frames already say where each caller
+     * resumes; the top frame, sp and fp are all that is left to save. */
+    SPILL_TOS();
+    frame->ip = ip;
+    thread->sp = (int)(STACK_END() - jvm->stack);
+    thread->fp = fp;
+    if (thread->state == THREAD_RUNNING) {
+        thread->state = THREAD_READY;
+    }
+#endif
+
+done:
+#ifdef JVM_PROFILING
+    if (profile_cycles) {
+        profile->op_cycles[profile_op] += PROFILE_CLOCK() - profile_tick;
+    }
+    profile->runs++;
+#endif
+    frame->pc = method->decoded.bytecode_pc[ip - insns];
+#ifdef JVM_GREEN_THREADS
+    if (thread) {
+        /* The scheduler adds up the totals */
+        thread->slice_ticks = executed;
+        thread->calls += calls;
+        return result;
+    }
+#endif
+    jvm->running--;
+    jvm->failed = failed;
+    SAMPLE_DEPTH(base_fp);
+    jvm->fp = base_fp;
+    jvm->sp = entry_sp;
+    /* High-water marks, for jvm_reset() */
+    if (stack_high - jvm->stack > jvm->stack_peak) {
+        jvm->stack_peak = (int)(stack_high - jvm->stack);
+    }
+    if (fp_high > jvm->frame_peak) {
+        jvm->frame_peak = fp_high;
+    }
+    jvm->instructions += executed;
+    jvm->calls += calls;
+#ifdef JVM_STACK_TRAFFIC
+    jvm->stack_loads += stack_loads;
+    jvm->stack_stores += stack_stores;
+#endif
+    return result;
+}
+
+int INTERPRETER(JVM* jvm, Method* method) {
+    int result;
+#if defined(JVM_PROFILER) && !defined(JVM_PROFILING)
+    if (jvm->profile) {
+        return jvm_execute_method_profiled(jvm, method);
+    }
+#endif
+#ifdef JVM_GREEN_THREADS
+    result = interpret(jvm, method, NULL);
+#else
+    result = interpret(jvm, method);
+#endif
+    /* Monitors still held when the outermost method stops are released */
+    if (jvm->running == 0 && jvm->monitors.count > 0) {
+        heap_release_monitors(jvm, &jvm->monitors);
+    }
+    return result;
+}
+
+#ifdef JVM_GREEN_THREADS
+/* Run the next slice of a green thread, starting it if it has not run */
+int THREAD_INTERPRETER(JVM* jvm, GreenThread* thread) {
+#if defined(JVM_PROFILER) && !defined(JVM_PROFILING)
+    if (jvm->profile) {
+        return jvm_execute_thread_profiled(jvm, thread);
+    }
+#endif
+    if (thread->started) {
+        return interpret(jvm, NULL, thread);
+    }
+    thread->started = 1;
+    return interpret(jvm, thread->method, thread);
+}
+#endif
@@ -0,0 +1,16 @@
+/*
+ * Profiling interpreter
+ *
+ * The pre-decoded interpreter compiled again with its profiling hooks in,
+ * as jvm_execute_method_profiled(). jvm_execute_method() hands a run over
+ * to it when the JVM has a profile (see jvm_set_profile()), which keeps
+ * the counting out of the ordinary loop. PROFILER=0 leaves it out.
+ */
+#include "jvm.h"
+
+#ifdef JVM_PROFILER
+#define JVM_PROFILING 1
+#include "interp.c"
+#else
+typedef int interp_profile_unused;  /* ISO C needs something to compile */
+#endif
@@ -0,0 +1,506 @@
+/*
+ * Baseline template JIT for x86-64
+ *
+ * Translates a verified method's pre-decoded instructions into native code,
+ * one fixed template per instruction. The frame layout is exactly the
+ * interpreter's: locals at [rbx], the operand stack at [r14]. The verifier
+ * gives every instruction a static stack depth, so each stack slot maps to
+ * a fixed memory operand and the native code needs no stack pointer at
+ * all. Branches become direct jumps between templates.
+ *
+ * Native code can be entered at any instruction and leaves by returning
+ * the index of the instruction the interpreter should run next. It exits
+ * that way at everything it does not handle itself (calls, returns, halt,
+ * division by zero), and the interpreter picks up at that instruction with
+ * the same frame. That is what makes the fallback for unsupported opcodes
+ * free, and it is also how the interpreter enters compiled loops mid-method
+ * (on-stack replacement) and returns into compiled callers.
+ */
+#define _DEFAULT_SOURCE
+
+#include "jvm.h"
+
+#ifdef JVM_JIT
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* Compiled code for one method */
+struct JitCode {
+    uint8_t* buffer;            /* mmap'd region, read+execute once built */
+    size_t size;
+    uint8_t** entry;            /* Native address of each instruction */
+};
+
+/* Native entry: locals, operand stack base, bytecode counter, start address */
+typedef int (*JitEntry)(Value* locals, Value* stack, uint64_t* executed, const void* start);
+
+/* Code generation buffer */
+typedef struct {
+    uint8_t* code;
+    int length;
+    int capacity;
+} Emitter;
+
+/* A rel32 displacement to patch once the target instruction is placed */
+typedef struct {
+    int at;                     /* Offset of the rel32 field */
+    int target;                 /* Target instruction index */
+} Fixup;
+
+static void emit_byte(Emitter* e, uint8_t b) {
+    if (e->length < e->capacity) {
+        e->code[e->length] = b;
+    }
+    e->length++;
+}
+
+static void emit_bytes(Emitter* e, const uint8_t* bytes, int count) {
+    for (int i = 0; i < count; i++) {
+        emit_byte(e, bytes[i]);
+    }
+}
+
+static void emit_int32(Emitter* e, int32_t value) {
+    emit_byte(e, (uint8_t)(value & 0xff));
+    emit_byte(e, (uint8_t)((value >> 8) & 0xff));
+    emit_byte(e, (uint8_t)((value >> 16) & 0xff));
+    emit_byte(e, (uint8_t)((value >> 24) & 0xff));
+}
+
+static void patch_int32(Emitter* e, int at, int32_t value) {
+    if (at + 4 <= e->capacity) {
+        e->code[at] = (uint8_t)(value & 0xff);
+        e->code[at + 1] = (uint8_t)((value >> 8) & 0xff);
+        e->code[at + 2] = (uint8_t)((value >> 16) & 0xff);
+        e->code[at + 3] = (uint8_t)((value >> 24) & 0xff);
+    }
+}
+
+/*
+ * Instruction templates. "slot" is an operand stack index, addressed as
+ * [r14 + 4*slot]; "local" is [rbx + 4*local]. r15 points at the caller's
+ * bytecode counter.
+ */
+
+/* <op> eax, [r14 + 4*slot] for op in mov (8B), add (03), sub (2B), cmp (3B) */
+static void emit_eax_slot(Emitter* e, uint8_t op, int slot) {
+    uint8_t bytes[] = {0x41, op, 0x86};
+    emit_bytes(e, bytes, 3);
+    emit_int32(e, slot * 4);
+}
+
+/* mov [r14 + 4*slot], eax */
+static void emit_store_slot(Emitter* e, int slot) {
+    uint8_t bytes[] = {0x41, 0x89, 0x86};
+    emit_bytes(e, bytes, 3);
+    emit_int32(e, slot * 4);
+}
+
+/* mov eax, [rbx + 4*local] / mov [rbx + 4*local], eax */
+static void emit_local(Emitter* e, int store, int local) {
+    emit_byte(e, store ? 0x89 : 0x8b);
+    emit_byte(e, 0x83);
+    emit_int32(e, local * 4);
+}
+
+/* mov eax, index; jmp exit -- leave native code, resume at index */
+static void emit_exit(Emitter* e, int index, int exit_offset) {
+    emit_byte(e, 0xb8);
+    emit_int32(e, index);
+    emit_byte(e, 0xe9);
+    emit_int32(e, exit_offset - (e->length + 4));
+}
+
+/* add qword [r15], count -- bytecodes about to run natively */
+static void emit_count(Emitter* e, int count) {
+    uint8_t bytes[] = {0x49, 0x81, 0x07};
+    emit_bytes(e, bytes, 3);
+    emit_int32(e, count);
+}
+
+/* Does the JIT handle this instruction itself, or exit to the interpreter?
+ * A superinstruction compiles as its first instruction: the rest of the
+ * sequence is still in place after it. */
+static int is_native(uint16_t op) {
+    switch (insn_base_op(op)) {
+        case INSN_ICONST:
+        case INSN_ILOAD:
+        case INSN_ISTORE:
+        case INSN_IADD:
+        case INSN_ISUB:
+        case INSN_IMUL:
+        case INSN_IDIV:
+        case INSN_IREM:
+        case INSN_INEG:
+        case INSN_IF_ICMPEQ:
+        case INSN_IF_ICMPNE:
+        case INSN_IF_ICMPLT:
+        case INSN_IF_ICMPGE:
+        case INSN_IF_ICMPGT:
+        case INSN_IF_ICMPLE:
+        case INSN_IFEQ:
+        case INSN_IFNE:
+        case INSN_IFLT:
+        case INSN_IFGE:
+        case INSN_IFGT:
+        case INSN_IFLE:
+        case INSN_IFNULL:
+        case INSN_IFNONNULL:
+        case INSN_GOTO:
+        case INSN_POP:
+        case INSN_DUP:
+        case INSN_IINC:
+        case INSN_IAND:
+        case INSN_IOR:
+        case INSN_IXOR:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static int is_branch(uint16_t op) {
+    return op >= INSN_IF_ICMPEQ && op <= INSN_GOTO;
+}
+
+/* Second opcode byte of jcc rel32 for each compare-and-branch */
+static uint8_t condition_code(uint16_t op) {
+    switch (op) {
+        case INSN_IF_ICMPEQ: return 0x84;   /* je */
+        case INSN_IF_ICMPNE: return 0x85;   /* jne */
+        case INSN_IF_ICMPLT: return 0x8c;   /* jl */
+        case INSN_IF_ICMPGE: return 0x8d;   /* jge */
+        case INSN_IF_ICMPGT: return 0x8f;   /* jg */
+        case INSN_IFEQ: return 0x84;        /* je */
+        case INSN_IFNE: return 0x85;        /* jne */
+        case INSN_IFLT: return 0x8c;        /* jl */
+        case INSN_IFGE: return 0x8d;        /* jge */
+        case INSN_IFGT: return 0x8f;        /* jg */
+        case INSN_IFNULL: return 0x84;      /* je */
+        case INSN_IFNONNULL: return 0x85;   /* jne */
+        default: return 0x8e;               /* jle */
+    }
+}
+
+/*
+ * Generate code for a method into e. Basic block leaders (entry, branch
+ * targets, instructions after a branch or an exit) are marked in leader[]
+ * so each block can bump the bytecode counter once on entry.
+ */
+static void generate(const Method* method, Emitter* e, const char* leader,
+                     int* offsets, Fixup* fixups, int* div_exits) {
+    const DecodedCode* decoded = &method->decoded;
+    int fixup_count = 0;
+    int div_count = 0;
+    int exit_offset;
+
+    /* Prologue: save callee-saved registers, load the frame, jump to start */
+    {
+        uint8_t prologue[] = {
+            0x53,                   /* push rbx */
+            0x41, 0x56,             /* push r14 */
+            0x41, 0x57,             /* push r15 */
+            0x48, 0x89, 0xfb,       /* mov rbx, rdi */
+            0x49, 0x89, 0xf6,       /* mov r14, rsi */
+            0x49, 0x89, 0xd7,       /* mov r15, rdx */
+            0xff, 0xe1              /* jmp rcx */
+        };
+        emit_bytes(e, prologue, sizeof(prologue));
+    }
+
+    /* Shared epilogue; eax already holds the resume index */
+    exit_offset = e->length;
+    {
+        uint8_t epilogue[] = {
+            0x41, 0x5f,             /* pop r15 */
+            0x41, 0x5e,             /* pop r14 */
+            0x5b,                   /* pop rbx */
+            0xc3                    /* ret */
+        };
+        emit_bytes(e, epilogue, sizeof(epilogue));
+    }
+
+    for (int i = 0; i < decoded->count; i++) {
+        const Insn* insn = &decoded->insns[i];
+        int d = decoded->stack_depth[i];
+
+        offsets[i] = e->length;
+
+        if (d < 0 || !is_native(insn->op)) {
+            emit_exit(e, i, exit_offset);
+            continue;
+        }
+
+        if (leader[i]) {
+            int count = 0;
+            for (int j = i; j < decoded->count && is_native(decoded->insns[j].op); j++) {
+                if (j > i && leader[j]) break;
+                count++;
+                if (is_branch(decoded->insns[j].op)) break;
+            }
+            emit_count(e, count);
+        }
+
+        switch (insn_base_op(insn->op)) {
+            case INSN_ICONST: {
+                uint8_t bytes[] = {0x41, 0xc7, 0x86};   /* mov dword [r14+d], imm32 */
+                emit_bytes(e, bytes, 3);
+                emit_int32(e, d * 4);
+                emit_int32(e, insn->k);
+                break;
+            }
+            case INSN_ILOAD:
+                emit_local(e, 0, insn->a);
+                emit_store_slot(e, d);
+                break;
+            case INSN_IINC: {
+                uint8_t bytes[] = {0x81, 0x83};         /* add dword [rbx+local], imm32 */
+                emit_bytes(e, bytes, 2);
+                emit_int32(e, insn->a * 4);
+                emit_int32(e, insn->k);
+                break;
+            }
+            case INSN_ISTORE:
+                emit_eax_slot(e, 0x8b, d - 1);
+                emit_local(e, 1, insn->a);
+                break;
+            case INSN_IADD:
+            case INSN_ISUB:
+                emit_eax_slot(e, 0x8b, d - 2);
+                emit_eax_slot(e, insn->op == INSN_IADD ? 0x03 : 0x2b, d - 1);
+                emit_store_slot(e, d - 2);
+                break;
+            case INSN_IAND:
+            case INSN_IOR:
+            case INSN_IXOR: {
+                static const uint8_t ops[] = {0x23, 0x0b, 0x33};  /* and/or/xor eax, [r14+d] */
+                emit_eax_slot(e, 0x8b, d - 2);
+                emit_eax_slot(e, ops[insn->op - INSN_IAND], d - 1);
+                emit_store_slot(e, d - 2);
+                break;
+            }
+            case INSN_IMUL: {
+                uint8_t bytes[] = {0x41, 0x0f, 0xaf, 0x86};  /* imul eax, [r14+d] */
+                emit_eax_slot(e, 0x8b, d - 2);
+                emit_bytes(e, bytes, 4);
+                emit_int32(e, (d - 1) * 4);
+                emit_store_slot(e, d - 2);
+                break;
+            }
+            case INSN_IDIV:
+            case INSN_IREM: {
+                int rem = insn->op == INSN_IREM;
+                uint8_t load_ecx[] = {0x41, 0x8b, 0x8e};     /* mov ecx, [r14+d] */
+                uint8_t test_ecx[] = {0x85, 0xc9};           /* test ecx, ecx */
+                uint8_t jz[] = {0x0f, 0x84};                 /* jz rel32 */
+                uint8_t minus_one[] = {0x83, 0xf9, 0xff};    /* cmp ecx, -1 */
+
+                emit_bytes(e, load_ecx, 3);
+                emit_int32(e, (d - 1) * 4);
+                emit_bytes(e, test_ecx, 2);
+                emit_bytes(e, jz, 2);
+                div_exits[div_count * 2] = e->length;        /* Patched below */
+                div_exits[div_count * 2 + 1] = i;
+                div_count++;
+                emit_int32(e, 0);
+                emit_eax_slot(e, 0x8b, d - 2);
+                /* x / -1 would trap on INT_MIN; Java wraps it instead */
+                emit_bytes(e, minus_one, 3);
+                emit_byte(e, 0x75);                          /* jne divide */
+                emit_byte(e, 4);
+                emit_byte(e, rem ? 0x31 : 0xf7);             /* xor eax, eax / neg eax */
+                emit_byte(e, rem ? 0xc0 : 0xd8);
+                emit_byte(e, 0xeb);                          /* jmp store */
+                emit_byte(e, rem ? 5 : 3);
+                emit_byte(e, 0x99);                          /* divide: cdq */
+                emit_byte(e, 0xf7);                          /* idiv ecx */
+                emit_byte(e, 0xf9);
+                if (rem) {
+                    emit_byte(e, 0x89);                      /* mov eax, edx */
+                    emit_byte(e, 0xd0);
+                }
+                emit_store_slot(e, d - 2);                   /* store: */
+                break;
+            }
+            case INSN_INEG: {
+                uint8_t bytes[] = {0x41, 0xf7, 0x9e};        /* neg dword [r14+d] */
+                emit_bytes(e, bytes, 3);
+                emit_int32(e, (d - 1) * 4);
+                break;
+            }
+            case INSN_POP:
+                break;
+            case INSN_DUP:
+                emit_eax_slot(e, 0x8b, d - 1);
+                emit_store_slot(e, d);
+                break;
+            case INSN_IFEQ:
+            case INSN_IFNE:
+            case INSN_IFLT:
+            case INSN_IFGE:
+            case INSN_IFGT:
+            case INSN_IFLE:
+            case INSN_IFNULL:
+            case INSN_IFNONNULL: {
+                uint8_t bytes[] = {0x41, 0x83, 0xbe};        /* cmp dword [r14+d], 0 */
+                emit_bytes(e, bytes, 3);
+                emit_int32(e, (d - 1) * 4);
+                emit_byte(e, 0);
+                emit_byte(e, 0x0f);
+                emit_byte(e, condition_code(insn->op));
+                fixups[fixup_count].at = e->length;
+                fixups[fixup_count].target = insn->k;
+                fixup_count++;
+                emit_int32(e, 0);
+                break;
+            }
+            case INSN_GOTO:
+                emit_byte(e, 0xe9);
+                fixups[fixup_count].at = e->length;
+                fixups[fixup_count].target = insn->k;
+                fixup_count++;
+                emit_int32(e, 0);
+                break;
+            default:    /* Compare and branch */
+                emit_eax_slot(e, 0x8b, d - 2);
+                emit_eax_slot(e, 0x3b, d - 1);
+                emit_byte(e, 0x0f);
+                emit_byte(e, condition_code(insn->op));
+                fixups[fixup_count].at = e->length;
+                fixups[fixup_count].target = insn->k;
+                fixup_count++;
+                emit_int32(e, 0);
+                break;
+        }
+    }
+
+    /* Out-of-line exits for division by zero: the interpreter throws the
+     * ArithmeticException */
+    for (int i = 0; i < div_count; i++) {
+        patch_int32(e, div_exits[i * 2], e->length - (div_exits[i * 2] + 4));
+        emit_exit(e, div_exits[i * 2 + 1], exit_offset);
+    }
+
+    for (int i = 0; i < fixup_count; i++) {
+        patch_int32(e, fixups[i].at, offsets[fixups[i].target] - (fixups[i].at + 4));
+    }
+}
+
+/* Compile a prepared method. Returns 0 on success, -1 if it can't be. */
+int jit_compile(Method* method) {
+    const DecodedCode* decoded = &method->decoded;
+    struct JitCode* jit;
+    Emitter e;
+    char* leader;
+    int* offsets;
+    Fixup* fixups;
+    int* div_exits;
+    long page = sysconf(_SC_PAGESIZE);
+    int status = -1;
+
+    method->jit_attempted = 1;
+    if (!method->prepared || !decoded->stack_depth) {
+        return -1;
+    }
+
+    leader = (char*)calloc(decoded->count, 1);
+    offsets = (int*)malloc(sizeof(int) * decoded->count);
+    fixups = (Fixup*)malloc(sizeof(Fixup) * decoded->count);
+    div_exits = (int*)malloc(sizeof(int) * 2 * decoded->count);
+    jit = (struct JitCode*)calloc(1, sizeof(struct JitCode));
+    if (!leader || !offsets || !fixups || !div_exits || !jit) {
+        goto out;
+    }
+
+    /* Block leaders: entry, branch targets, and whatever follows a branch
+     * or an instruction the interpreter runs. Switches run in the
+     * interpreter, which can enter native code at any of their targets. */
+    leader[0] = 1;
+    for (int i = 0; i < decoded->count; i++) {
+        const Insn* insn = &decoded->insns[i];
+        if (is_branch(insn->op)) {
+            leader[insn->k] = 1;
+        }
+        if (insn->op == INSN_TABLESWITCH || insn->op == INSN_LOOKUPSWITCH) {
+            const SwitchTable* table = &decoded->switches[insn->a];
+            for (int j = 0; j < table->count; j++) {
+                leader[table->targets[j]] = 1;
+            }
+            leader[table->default_target] = 1;
+        }
+        if ((is_branch(insn->op) || !is_native(insn->op)) && i + 1 < decoded->count) {
+            leader[i + 1] = 1;
+        }
+    }
+
+    /* Size the code with a dry run, then generate into the real buffer */
+    e.code = NULL;
+    e.length = 0;
+    e.capacity = 0;
+    generate(method, &e, leader, offsets, fixups, div_exits);
+
+    jit->size = ((size_t)e.length + (size_t)page - 1) / (size_t)page * (size_t)page;
+    jit->buffer = (uint8_t*)mmap(NULL, jit->size, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit->buffer == MAP_FAILED) {
+        jit->buffer = NULL;
+        goto out;
+    }
+    e.code = jit->buffer;
+    e.capacity = (int)jit->size;
+    e.length = 0;
+    generate(method, &e, leader, offsets, fixups, div_exits);
+
+    if (mprotect(jit->buffer, jit->size, PROT_READ | PROT_EXEC) != 0) {
+        goto out;
+    }
+
+    jit->entry = (uint8_t**)malloc(sizeof(uint8_t*) * decoded->count);
+    if (!jit->entry) {
+        goto out;
+    }
+    for (int i = 0; i < decoded->count; i++) {
+        jit->entry[i] = jit->buffer + offsets[i];
+    }
+
+    method->jit = jit;
+    jit = NULL;
+    status = 0;
+
+out:
+    if (jit) {
+        if (jit->buffer) {
+            munmap(jit->buffer, jit->size);
+        }
+        free(jit);
+    }
+    free(leader);
+    free(offsets);
+    free(fixups);
+    free(div_exits);
+    return status;
+}
+
+/* Run compiled code from instruction index; returns where to resume */
+int jit_run(Method* method, int index, Value* locals, uint64_t* executed) {
+    JitEntry entry;
+    void* code = method->jit->buffer;
+
+    /* ISO C has no object-to-function pointer cast; copy the bits */
+    memcpy(&entry, &code, sizeof(entry));
+    return entry(locals, locals + method->locals_count, executed, method->jit->entry[index]);
+}
+
+/* Release a method's compiled code */
+void jit_free(Method* method) {
+    if (method->jit) {
+        munmap(method->jit->buffer, method->jit->size);
+        free(method->jit->entry);
+        free(method->jit);
+        method->jit = NULL;
+    }
+    method->jit_attempted = 0;
+}
+
+#endif
@@ -1,4 +1,43 @@
 #include "jvm.h"
+#include "dispatch.h"
+
+/* Set the registers, counters and options to their initial values */
+static void init_state(JVM* jvm) {
+    jvm->sp = 0;
+    jvm->stack_peak = 0;
+    jvm->fp = 0;
+    jvm->frame_peak = 0;
+    jvm->running = 0;
+    jvm->failed = 0;
+    jvm->heap_ptr = HEAP_BASE;
+    jvm->heap_limit = HEAP_SIZE;
+    jvm->heap_peak = HEAP_BASE;
+    jvm->bytes_allocated = 0;
+    jvm->gc_count = 0;
+    jvm->gc_total_ns = 0;
+    jvm->gc_max_pause_ns = 0;
+    jvm->debug = 0;  /* Debug mode off by default */
+    jvm->verbose = 1;
+    jvm->instructions = 0;
+    jvm->calls = 0;
+    jvm->profile = NULL;
+    jvm->sampler = NULL;
+    jvm->frames_in_use = 0;
+    jvm->monitors.count = 0;
+    jvm->native_root.i = 0;
+    jvm->strings.count = 0;
+    jvm->strings.lock = 0;
+    jvm->wide_result[0].i = 0;
+    jvm->wide_result[1].i = 0;
+    tier_init(&jvm->tiers);
+#ifdef JVM_STACK_TRAFFIC
+    jvm->stack_loads = 0;
+    jvm->stack_stores = 0;
+#endif
+#ifdef JVM_GREEN_THREADS
+    jvm->scheduler = NULL;
+#endif
+}
 
 /* Create a new JVM instance */
 JVM* jvm_create(void) {
@@ -7,45 +46,121 @@ JVM* jvm_create(void) {
         return NULL;
     }
     
-    /* Initialize stack */
-    jvm->sp = 0;
-    jvm->fp = 0;
-    jvm->heap_ptr = 0;
-    jvm->debug = 0;  /* Debug mode off by default */
+    init_state(jvm);
     
     /* Clear memory */
     memset(jvm->stack, 0, sizeof(jvm->stack));
     memset(jvm->frames, 0, sizeof(jvm->frames));
     memset(jvm->heap, 0, sizeof(jvm->heap));
+    memset(jvm->strings.entries, 0, sizeof(jvm->strings.entries));
     
     return jvm;
 }
 
-/* Destroy JVM instance */
+/*
+ * Put a JVM that is not running back in the state jvm_create() leaves it
+ * in, ready for the next program. Only what earlier runs touched is
+ * cleared: the stack, frames and heap up to their high-water marks, which
+ * for a short program is a few hundred bytes of a struct that is tens of
+ * kilobytes, and the intern table if it has entries. A profile, and any
+ * samples, are dropped without a report.
+ */
+void jvm_reset(JVM* jvm) {
+    memset(jvm->stack, 0, (size_t)jvm->stack_peak * sizeof(Value));
+    memset(jvm->frames, 0, (size_t)(jvm->frame_peak + 1) * sizeof(Frame));
+    memset(jvm->heap, 0, (size_t)jvm->heap_peak);
+    if (jvm->strings.count > 0) {
+        memset(jvm->strings.entries, 0, sizeof(jvm->strings.entries));
+    }
+    if (jvm->profile) {
+        profile_free(jvm->profile);
+    }
+    if (jvm->sampler) {
+        sampler_free(jvm->sampler);
+    }
+    init_state(jvm);
+}
+
+/* Destroy JVM instance, reporting its profile and samples if it was
+ * profiling or sampling */
 void jvm_destroy(JVM* jvm) {
     if (jvm) {
+        if (jvm->profile) {
+            jvm_profile_report(jvm, stdout);
+            if (jvm->profile->output) {
+                jvm_profile_write(jvm, jvm->profile->output);
+            }
+            profile_free(jvm->profile);
+        }
+        if (jvm->sampler) {
+            sampler_finish(jvm);
+        }
         free(jvm);
     }
 }
 
-/* Push value onto operand stack */
-void jvm_push(JVM* jvm, Value value) {
+/* Push value onto operand stack. Returns 0, or -1 if the stack is full. */
+int jvm_push(JVM* jvm, Value value) {
     if (jvm->sp >= STACK_SIZE) {
         printf("Stack overflow!\n");
-        exit(1);
+        return -1;
     }
     jvm->stack[jvm->sp++] = value;
+    if (jvm->sp > jvm->stack_peak) {
+        jvm->stack_peak = jvm->sp;
+    }
+    return 0;
 }
 
-/* Pop value from operand stack */
-Value jvm_pop(JVM* jvm) {
+/* Pop value from operand stack. Returns 0, or -1 if the stack is empty. */
+int jvm_pop(JVM* jvm, Value* value) {
     if (jvm->sp <= 0) {
         printf("Stack underflow!\n");
-        exit(1);
+        return -1;
     }
-    return jvm->stack[--jvm->sp];
+    *value = jvm->stack[--jvm->sp];
+    return 0;
+}
+
+/* Push the two slots of a long or double argument, or neither if they
+ * don't both fit. Returns 0, or -1 if the stack is full. */
+static int push_wide(JVM* jvm, const Value* halves) {
+    if (jvm->sp >= STACK_SIZE - 1) {
+        printf("Stack overflow!\n");
+        return -1;
+    }
+    jvm_push(jvm, halves[0]);
+    return jvm_push(jvm, halves[1]);
+}
+
+int jvm_push_long(JVM* jvm, int64_t value) {
+    Value halves[2];
+    WIDE_SET(halves, value);
+    return push_wide(jvm, halves);
 }
 
+/* What the last method run returned, if it returned a long */
+int64_t jvm_result_long(const JVM* jvm) {
+    int64_t value;
+    WIDE_GET(jvm->wide_result, value);
+    return value;
+}
+
+#ifdef JVM_FLOAT
+int jvm_push_double(JVM* jvm, double value) {
+    Value halves[2];
+    WIDE_SET(halves, value);
+    return push_wide(jvm, halves);
+}
+
+/* What the last method run returned, if it returned a double */
+double jvm_result_double(const JVM* jvm) {
+    double value;
+    WIDE_GET(jvm->wide_result, value);
+    return value;
+}
+#endif
+
 /* Read 16-bit signed integer from bytecode */
 int16_t read_int16(uint8_t* code, int* pc) {
     int16_t value = (int16_t)((code[*pc] << 8) | code[*pc + 1]);
@@ -55,8 +170,8 @@ int16_t read_int16(uint8_t* code, int* pc) {
 
 /* Read 32-bit signed integer from bytecode */
 int32_t read_int32(uint8_t* code, int* pc) {
-    int32_t value = (int32_t)((code[*pc] << 24) | (code[*pc + 1] << 16) | 
-                              (code[*pc + 2] << 8) | code[*pc + 3]);
+    int32_t value = (int32_t)(((uint32_t)code[*pc] << 24) | ((uint32_t)code[*pc + 1] << 16) |
+                              ((uint32_t)code[*pc + 2] << 8) | code[*pc + 3]);
     *pc += 4;
     return value;
 }
@@ -76,9 +191,147 @@ void jvm_set_debug(JVM* jvm, int debug) {
     jvm->debug = debug;
 }
 
-/* Main execution loop */
+/* Enable/disable the messages printed when a method returns or halts */
+void jvm_set_verbose(JVM* jvm, int verbose) {
+    jvm->verbose = verbose;
+}
+
+/* Raw-bytecode loop: fetch the next opcode straight from the code array */
+#ifdef JVM_THREADED_DISPATCH
+#define NEXT                                                    \
+    do {                                                        \
+        if (pc >= length) goto end_of_code;                     \
+        opcode = code[pc++];                                    \
+        executed++;                                             \
+        if (jvm->debug) trace_instruction(jvm, pc - 1, opcode); \
+        goto *dispatch_table[opcode];                           \
+    } while (0)
+#else
+#define NEXT        break
+#endif
+
+/* Operand stack access that stops the loop on overflow or underflow */
+#define PUSH(v)     do { if (jvm_push(jvm, v) != 0) goto stack_error; } while (0)
+#define POP(v)      do { if (jvm_pop(jvm, &(v)) != 0) goto stack_error; } while (0)
+
+/* Print one line of the debug execution trace */
+static void trace_instruction(JVM* jvm, int pc, uint8_t opcode) {
+    printf("  %04x: op 0x%02x  ", pc, opcode);
+    jvm_print_stack(jvm);
+}
+
+/* Decode and verify a method so it can run on the fast interpreter, in
+ * the baseline tier */
+int method_prepare(Method* method) {
+    if (method->prepared) {
+        return 0;
+    }
+    if (decode_bytecode(method->code, method->code_length, method->handlers,
+                        method->handler_count, &method->decoded) != 0) {
+        return -1;
+    }
+    if (verify_method(method) != 0) {
+        decoded_free(&method->decoded);
+        return -1;
+    }
+    method->prepared = 1;
+    return 0;
+}
+
+/* Free what method_prepare(), the tiers and the JIT allocated */
+void method_release(Method* method) {
+#ifdef JVM_JIT
+    jit_free(method);
+#endif
+    if (method->prepared) {
+        decoded_free(&method->decoded);
+        method->prepared = 0;
+    }
+    method->linked = 0;
+    method->tier = TIER_BASELINE;
+    method->invocation_limit = 0;
+    method->backedge_limit = 0;
+}
+
+/* Run bytecode as a top-level method: prepare it, then execute */
 int jvm_execute(JVM* jvm, uint8_t* bytecode, int length) {
+    Method method;
+    int result;
+    
+    /* Debug traces are produced by the raw interpreter, pc by pc */
+    if (jvm->debug) {
+        return jvm_execute_raw(jvm, bytecode, length);
+    }
+    
+    memset(&method, 0, sizeof(method));
+    method.name = "<main>";
+    method.code = bytecode;
+    method.code_length = length;
+    if (method_prepare(&method) != 0) {
+        return -1;
+    }
+    result = jvm_execute_method(jvm, &method);
+    method_release(&method);
+    return result;
+}
+
+/*
+ * Raw-bytecode execution loop. Operands and branch offsets are decoded
+ * as they are executed; kept for debugging and as a reference for the
+ * pre-decoded interpreter in interp.c.
+ */
+int jvm_execute_raw(JVM* jvm, uint8_t* bytecode, int length) {
+#ifdef JVM_THREADED_DISPATCH
+    static const void* const dispatch_table[256] = {
+        [0 ... 255]     = &&L_DEFAULT,
+        [OP_NOP]        = &&L_OP_NOP,
+        [OP_ICONST_M1]  = &&L_OP_ICONST_M1,
+        [OP_ICONST_0]   = &&L_OP_ICONST_0,
+        [OP_ICONST_1]   = &&L_OP_ICONST_1,
+        [OP_ICONST_2]   = &&L_OP_ICONST_2,
+        [OP_ICONST_3]   = &&L_OP_ICONST_3,
+        [OP_ICONST_4]   = &&L_OP_ICONST_4,
+        [OP_ICONST_5]   = &&L_OP_ICONST_5,
+        [OP_BIPUSH]     = &&L_OP_BIPUSH,
+        [OP_SIPUSH]     = &&L_OP_SIPUSH,
+        [OP_ILOAD]      = &&L_OP_ILOAD,
+        [OP_ILOAD_0]    = &&L_OP_ILOAD_0,
+        [OP_ILOAD_1]    = &&L_OP_ILOAD_1,
+        [OP_ILOAD_2]    = &&L_OP_ILOAD_2,
+        [OP_ILOAD_3]    = &&L_OP_ILOAD_3,
+        [OP_ISTORE]     = &&L_OP_ISTORE,
+        [OP_ISTORE_0]   = &&L_OP_ISTORE_0,
+        [OP_ISTORE_1]   = &&L_OP_ISTORE_1,
+        [OP_ISTORE_2]   = &&L_OP_ISTORE_2,
+        [OP_ISTORE_3]   = &&L_OP_ISTORE_3,
+        [OP_IADD]       = &&L_OP_IADD,
+        [OP_ISUB]       = &&L_OP_ISUB,
+        [OP_IMUL]       = &&L_OP_IMUL,
+        [OP_IDIV]       = &&L_OP_IDIV,
+        [OP_IREM]       = &&L_OP_IREM,
+        [OP_INEG]       = &&L_OP_INEG,
+        [OP_IINC]       = &&L_OP_IINC,
+        [OP_IF_ICMPEQ]  = &&L_OP_IF_ICMPEQ,
+        [OP_IF_ICMPNE]  = &&L_OP_IF_ICMPNE,
+        [OP_IF_ICMPLT]  = &&L_OP_IF_ICMPLT,
+        [OP_IF_ICMPGE]  = &&L_OP_IF_ICMPGE,
+        [OP_IF_ICMPGT]  = &&L_OP_IF_ICMPGT,
+        [OP_IF_ICMPLE]  = &&L_OP_IF_ICMPLE,
+        [OP_GOTO]       = &&L_OP_GOTO,
+        [OP_TABLESWITCH] = &&L_OP_TABLESWITCH,
+        [OP_LOOKUPSWITCH] = &&L_OP_LOOKUPSWITCH,
+        [OP_IRETURN]    = &&L_OP_IRETURN,
+        [OP_RETURN]     = &&L_OP_RETURN,
+        [OP_HALT]       = &&L_OP_HALT
+    };
+#endif
     Frame* frame = &jvm->frames[jvm->fp];
+    uint8_t* code = bytecode;
+    int pc = 0;
+    uint64_t executed = 0;
+    uint8_t opcode;
+    int result = 0;
+    
     frame->code = bytecode;
     frame->code_length = length;
     frame->pc = 0;
@@ -93,262 +346,347 @@ int jvm_execute(JVM* jvm, uint8_t* bytecode, int length) {
     memset(frame->locals, 0, sizeof(Value) * LOCALS_SIZE);
     
     /* Main execution loop */
-    while (frame->pc < frame->code_length) {
-        uint8_t opcode = frame->code[frame->pc++];
+#ifdef JVM_THREADED_DISPATCH
+    NEXT;
+    {
+        {
+#else
+    while (pc < length) {
+        opcode = code[pc++];
+        executed++;
+        if (jvm->debug) trace_instruction(jvm, pc - 1, opcode);
         
         switch (opcode) {
-            case OP_NOP:
+#endif
+            CASE(OP_NOP):
                 /* No operation */
-                break;
+                NEXT;
                 
-            case OP_ICONST_M1: {
+            CASE(OP_ICONST_M1): {
                 Value v = {-1};
-                jvm_push(jvm, v);
-                break;
+                PUSH(v);
+                NEXT;
             }
             
-            case OP_ICONST_0: {
+            CASE(OP_ICONST_0): {
                 Value v = {0};
-                jvm_push(jvm, v);
-                break;
+                PUSH(v);
+                NEXT;
             }
             
-            case OP_ICONST_1: {
+            CASE(OP_ICONST_1): {
                 Value v = {1};
-                jvm_push(jvm, v);
-                break;
+                PUSH(v);
+                NEXT;
             }
             
-            case OP_ICONST_2: {
+            CASE(OP_ICONST_2): {
                 Value v = {2};
-                jvm_push(jvm, v);
-                break;
+                PUSH(v);
+                NEXT;
             }
             
-            case OP_ICONST_3: {
+            CASE(OP_ICONST_3): {
                 Value v = {3};
-                jvm_push(jvm, v);
-                break;
+                PUSH(v);
+                NEXT;
             }
             
-            case OP_ICONST_4: {
+            CASE(OP_ICONST_4): {
                 Value v = {4};
-                jvm_push(jvm, v);
-                break;
+                PUSH(v);
+                NEXT;
             }
             
-            case OP_ICONST_5: {
+            CASE(OP_ICONST_5): {
                 Value v = {5};
-                jvm_push(jvm, v);
-                break;
+                PUSH(v);
+                NEXT;
             }
             
-            case OP_BIPUSH: {
-                int8_t byte_val = (int8_t)frame->code[frame->pc++];
+            CASE(OP_BIPUSH): {
+                int8_t byte_val = (int8_t)code[pc++];
                 Value v = {(int32_t)byte_val};
-                jvm_push(jvm, v);
-                break;
+                PUSH(v);
+                NEXT;
             }
             
-            case OP_SIPUSH: {
-                int16_t short_val = read_int16(frame->code, &frame->pc);
+            CASE(OP_SIPUSH): {
+                int16_t short_val = read_int16(code, &pc);
                 Value v = {(int32_t)short_val};
-                jvm_push(jvm, v);
-                break;
+                PUSH(v);
+                NEXT;
             }
             
-            case OP_ILOAD: {
-                uint8_t index = frame->code[frame->pc++];
-                jvm_push(jvm, frame->locals[index]);
-                break;
+            CASE(OP_ILOAD): {
+                uint8_t index = code[pc++];
+                PUSH(frame->locals[index]);
+                NEXT;
             }
             
-            case OP_ILOAD_0:
-                jvm_push(jvm, frame->locals[0]);
-                break;
+            CASE(OP_ILOAD_0):
+                PUSH(frame->locals[0]);
+                NEXT;
                 
-            case OP_ILOAD_1:
-                jvm_push(jvm, frame->locals[1]);
-                break;
+            CASE(OP_ILOAD_1):
+                PUSH(frame->locals[1]);
+                NEXT;
                 
-            case OP_ILOAD_2:
-                jvm_push(jvm, frame->locals[2]);
-                break;
+            CASE(OP_ILOAD_2):
+                PUSH(frame->locals[2]);
+                NEXT;
                 
-            case OP_ILOAD_3:
-                jvm_push(jvm, frame->locals[3]);
-                break;
+            CASE(OP_ILOAD_3):
+                PUSH(frame->locals[3]);
+                NEXT;
                 
-            case OP_ISTORE: {
-                uint8_t index = frame->code[frame->pc++];
-                frame->locals[index] = jvm_pop(jvm);
-                break;
+            CASE(OP_ISTORE): {
+                uint8_t index = code[pc++];
+                POP(frame->locals[index]);
+                NEXT;
             }
             
-            case OP_ISTORE_0:
-                frame->locals[0] = jvm_pop(jvm);
-                break;
+            CASE(OP_ISTORE_0):
+                POP(frame->locals[0]);
+                NEXT;
                 
-            case OP_ISTORE_1:
-                frame->locals[1] = jvm_pop(jvm);
-                break;
+            CASE(OP_ISTORE_1):
+                POP(frame->locals[1]);
+                NEXT;
                 
-            case OP_ISTORE_2:
-                frame->locals[2] = jvm_pop(jvm);
-                break;
+            CASE(OP_ISTORE_2):
+                POP(frame->locals[2]);
+                NEXT;
                 
-            case OP_ISTORE_3:
-                frame->locals[3] = jvm_pop(jvm);
-                break;
+            CASE(OP_ISTORE_3):
+                POP(frame->locals[3]);
+                NEXT;
                 
-            case OP_IADD: {
-                Value b = jvm_pop(jvm);
-                Value a = jvm_pop(jvm);
-                Value result = {a.i + b.i};
-                jvm_push(jvm, result);
-                break;
+            /* Wrapping arithmetic is done unsigned, where C defines it */
+            CASE(OP_IADD): {
+                Value a, b;
+                POP(b);
+                POP(a);
+                Value result = {(int32_t)((uint32_t)a.i + (uint32_t)b.i)};
+                PUSH(result);
+                NEXT;
             }
             
-            case OP_ISUB: {
-                Value b = jvm_pop(jvm);
-                Value a = jvm_pop(jvm);
-                Value result = {a.i - b.i};
-                jvm_push(jvm, result);
-                break;
+            CASE(OP_ISUB): {
+                Value a, b;
+                POP(b);
+                POP(a);
+                Value result = {(int32_t)((uint32_t)a.i - (uint32_t)b.i)};
+                PUSH(result);
+                NEXT;
             }
             
-            case OP_IMUL: {
-                Value b = jvm_pop(jvm);
-                Value a = jvm_pop(jvm);
-                Value result = {a.i * b.i};
-                jvm_push(jvm, result);
-                break;
+            CASE(OP_IMUL): {
+                Value a, b;
+                POP(b);
+                POP(a);
+                Value result = {(int32_t)((uint32_t)a.i * (uint32_t)b.i)};
+                PUSH(result);
+                NEXT;
             }
             
-            case OP_IDIV: {
-                Value b = jvm_pop(jvm);
-                Value a = jvm_pop(jvm);
+            CASE(OP_IDIV): {
+                Value a, b;
+                POP(b);
+                POP(a);
                 if (b.i == 0) {
                     printf("Division by zero!\n");
-                    free(frame->locals);
-                    return -1;
+                    result = -1;
+                    goto done;
                 }
-                Value result = {a.i / b.i};
-                jvm_push(jvm, result);
-                break;
+                Value result;
+                /* INT_MIN / -1 overflows in C; Java wraps to INT_MIN */
+                result.i = b.i == -1 ? (int32_t)(0 - (uint32_t)a.i) : a.i / b.i;
+                PUSH(result);
+                NEXT;
             }
             
-            case OP_IREM: {
-                Value b = jvm_pop(jvm);
-                Value a = jvm_pop(jvm);
+            CASE(OP_IREM): {
+                Value a, b;
+                POP(b);
+                POP(a);
                 if (b.i == 0) {
                     printf("Division by zero!\n");
-                    free(frame->locals);
-                    return -1;
+                    result = -1;
+                    goto done;
                 }
-                Value result = {a.i % b.i};
-                jvm_push(jvm, result);
-                break;
+                Value result;
+                result.i = b.i == -1 ? 0 : a.i % b.i;
+                PUSH(result);
+                NEXT;
+            }
+            
+            CASE(OP_INEG): {
+                Value a;
+                POP(a);
+                Value result = {(int32_t)(0 - (uint32_t)a.i)};
+                PUSH(result);
+                NEXT;
             }
             
-            case OP_INEG: {
-                Value a = jvm_pop(jvm);
-                Value result = {-a.i};
-                jvm_push(jvm, result);
-                break;
+            CASE(OP_IINC): {
+                uint8_t index = code[pc++];
+                int8_t delta = (int8_t)code[pc++];
+                frame->locals[index].i =
+                    (int32_t)((uint32_t)frame->locals[index].i + (uint32_t)delta);
+                NEXT;
             }
             
-            case OP_IF_ICMPEQ: {
-                int16_t offset = read_int16(frame->code, &frame->pc);
-                Value b = jvm_pop(jvm);
-                Value a = jvm_pop(jvm);
+            CASE(OP_IF_ICMPEQ): {
+                int16_t offset = read_int16(code, &pc);
+                Value a, b;
+                POP(b);
+                POP(a);
                 if (a.i == b.i) {
-                    frame->pc += offset - 3; /* -3 because we already advanced pc */
+                    pc += offset - 3; /* -3 because we already advanced pc */
                 }
-                break;
+                NEXT;
             }
             
-            case OP_IF_ICMPNE: {
-                int16_t offset = read_int16(frame->code, &frame->pc);
-                Value b = jvm_pop(jvm);
-                Value a = jvm_pop(jvm);
+            CASE(OP_IF_ICMPNE): {
+                int16_t offset = read_int16(code, &pc);
+                Value a, b;
+                POP(b);
+                POP(a);
                 if (a.i != b.i) {
-                    frame->pc += offset - 3;
+                    pc += offset - 3;
                 }
-                break;
+                NEXT;
             }
             
-            case OP_IF_ICMPLT: {
-                int16_t offset = read_int16(frame->code, &frame->pc);
-                Value b = jvm_pop(jvm);
-                Value a = jvm_pop(jvm);
+            CASE(OP_IF_ICMPLT): {
+                int16_t offset = read_int16(code, &pc);
+                Value a, b;
+                POP(b);
+                POP(a);
                 if (a.i < b.i) {
-                    frame->pc += offset - 3;
+                    pc += offset - 3;
                 }
-                break;
+                NEXT;
             }
             
-            case OP_IF_ICMPGE: {
-                int16_t offset = read_int16(frame->code, &frame->pc);
-                Value b = jvm_pop(jvm);
-                Value a = jvm_pop(jvm);
+            CASE(OP_IF_ICMPGE): {
+                int16_t offset = read_int16(code, &pc);
+                Value a, b;
+                POP(b);
+                POP(a);
                 if (a.i >= b.i) {
-                    frame->pc += offset - 3;
+                    pc += offset - 3;
                 }
-                break;
+                NEXT;
             }
             
-            case OP_IF_ICMPGT: {
-                int16_t offset = read_int16(frame->code, &frame->pc);
-                Value b = jvm_pop(jvm);
-                Value a = jvm_pop(jvm);
+            CASE(OP_IF_ICMPGT): {
+                int16_t offset = read_int16(code, &pc);
+                Value a, b;
+                POP(b);
+                POP(a);
                 if (a.i > b.i) {
-                    frame->pc += offset - 3;
+                    pc += offset - 3;
                 }
-                break;
+                NEXT;
             }
             
-            case OP_IF_ICMPLE: {
-                int16_t offset = read_int16(frame->code, &frame->pc);
-                Value b = jvm_pop(jvm);
-                Value a = jvm_pop(jvm);
+            CASE(OP_IF_ICMPLE): {
+                int16_t offset = read_int16(code, &pc);
+                Value a, b;
+                POP(b);
+                POP(a);
                 if (a.i <= b.i) {
-                    frame->pc += offset - 3;
+                    pc += offset - 3;
+                }
+                NEXT;
+            }
+            
+            CASE(OP_GOTO): {
+                int16_t offset = read_int16(code, &pc);
+                pc += offset - 3;
+                NEXT;
+            }
+            
+            /* Switch operands start at the next multiple of four, and
+             * their offsets are from the switch opcode */
+            CASE(OP_TABLESWITCH): {
+                int base = pc - 1;
+                int32_t offset, low, high;
+                Value key;
+                POP(key);
+                pc = (pc + 3) & ~3;
+                offset = read_int32(code, &pc);
+                low = read_int32(code, &pc);
+                high = read_int32(code, &pc);
+                if (key.i >= low && key.i <= high) {
+                    pc += (int)(((int64_t)key.i - low) * 4);
+                    offset = read_int32(code, &pc);
                 }
-                break;
+                pc = base + offset;
+                NEXT;
             }
             
-            case OP_GOTO: {
-                int16_t offset = read_int16(frame->code, &frame->pc);
-                frame->pc += offset - 3;
-                break;
+            CASE(OP_LOOKUPSWITCH): {
+                int base = pc - 1;
+                int32_t offset, pairs;
+                Value key;
+                POP(key);
+                pc = (pc + 3) & ~3;
+                offset = read_int32(code, &pc);
+                pairs = read_int32(code, &pc);
+                for (int32_t i = 0; i < pairs; i++) {
+                    int32_t match = read_int32(code, &pc);
+                    int32_t target = read_int32(code, &pc);
+                    if (match == key.i) {
+                        offset = target;
+                        break;
+                    }
+                }
+                pc = base + offset;
+                NEXT;
             }
             
-            case OP_IRETURN: {
-                Value result = jvm_pop(jvm);
-                free(frame->locals);
-                printf("Method returned: %d\n", result.i);
-                return result.i;
+            CASE(OP_IRETURN): {
+                Value ret;
+                POP(ret);
+                result = ret.i;
+                if (jvm->verbose) printf("Method returned: %d\n", result);
+                goto done;
             }
             
-            case OP_RETURN:
-                free(frame->locals);
-                printf("Method returned (void)\n");
-                return 0;
+            CASE(OP_RETURN):
+                if (jvm->verbose) printf("Method returned (void)\n");
+                goto done;
                 
-            case OP_HALT:
-                free(frame->locals);
-                printf("Execution halted\n");
-                return 0;
+            CASE(OP_HALT):
+                if (jvm->verbose) printf("Execution halted\n");
+                goto done;
                 
-            default:
-                printf("Unknown opcode: 0x%02x at pc=%d\n", opcode, frame->pc - 1);
-                free(frame->locals);
-                return -1;
+            DEFAULT:
+                printf("Unknown opcode: 0x%02x at pc=%d\n", opcode, pc - 1);
+                result = -1;
+                goto done;
         }
     }
     
+#ifdef JVM_THREADED_DISPATCH
+end_of_code:
+#endif
+    if (jvm->verbose) printf("Reached end of bytecode\n");
+    goto done;
+
+stack_error:
+    result = -1;
+
+done:
+    frame->pc = pc;
     free(frame->locals);
-    printf("Reached end of bytecode\n");
-    return 0;
+    jvm->instructions += executed;
+    return result;
 }
+
+#undef NEXT
+#undef PUSH
+#undef POP
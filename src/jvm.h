@@ -9,13 +9,152 @@
 /* Basic JVM constants */
 #define STACK_SIZE 1024
 #define LOCALS_SIZE 256
-#define HEAP_SIZE 8192
 #define MAX_METHODS 64
-#define MAX_CLASSES 32
+#define MAX_CLASSES 32          /* In one ClassRegistry */
+#define MAX_FRAMES 256
+#define MAX_CONSTANTS 256
+#define MAX_FIELDS 32           /* Per object, inherited ones included */
+#define MAX_INTERFACES 8        /* Named by one class */
+#define MAX_CLASS_IDS 1024      /* Classes in existence at once */
+
+/*
+ * Object heap budget in bytes. The heap is a fixed region inside the JVM
+ * struct, so this is all the memory objects and arrays can ever use; build
+ * with -DHEAP_SIZE=... to fit a board, or lower the limit at run time with
+ * jvm_set_heap_limit(). GC_STACK_SIZE bounds the collector's mark stack.
+ */
+#ifndef HEAP_SIZE
+#define HEAP_SIZE 8192
+#endif
+#ifndef GC_STACK_SIZE
+#define GC_STACK_SIZE 64
+#endif
+
+/*
+ * Interpreter dispatch mode. GCC and Clang get threaded dispatch (computed
+ * goto through a per-opcode label table); other compilers, or builds with
+ * -DJVM_SWITCH_DISPATCH, use the portable C99 switch loop.
+ */
+#if defined(__GNUC__) && !defined(JVM_SWITCH_DISPATCH)
+#define JVM_THREADED_DISPATCH 1
+#endif
+
+/*
+ * Baseline JIT (src/jit.c). Built for x86-64 hosts when the Makefile passes
+ * -DJVM_ENABLE_JIT; any other target, or JIT=0, runs interpreter only.
+ * A method is compiled once it has been called JIT_INVOKE_THRESHOLD times
+ * or has taken JIT_BACKEDGE_THRESHOLD backward branches.
+ */
+#if defined(JVM_ENABLE_JIT) && defined(__x86_64__)
+#define JVM_JIT 1
+#endif
+#ifndef JIT_INVOKE_THRESHOLD
+#define JIT_INVOKE_THRESHOLD 100
+#endif
+#ifndef JIT_BACKEDGE_THRESHOLD
+#define JIT_BACKEDGE_THRESHOLD 1000
+#endif
+
+/*
+ * Tiered execution (src/tier.c). A method starts in TIER_BASELINE, the
+ * pre-decoded instructions as verified, and is promoted to TIER_OPTIMIZED,
+ * its superinstructions fused, once it has been called
+ * OPTIMIZE_INVOKE_THRESHOLD times or has taken OPTIMIZE_BACKEDGE_THRESHOLD
+ * backward branches; then with the JIT to TIER_NATIVE at the thresholds
+ * above. Counts run from the first call, so each threshold is a total.
+ */
+#ifndef OPTIMIZE_INVOKE_THRESHOLD
+#define OPTIMIZE_INVOKE_THRESHOLD 2
+#endif
+#ifndef OPTIMIZE_BACKEDGE_THRESHOLD
+#define OPTIMIZE_BACKEDGE_THRESHOLD 50
+#endif
+#define TIER_BASELINE 0
+#define TIER_OPTIMIZED 1
+#define TIER_NATIVE 2
+#define TIER_COUNT 3
+#ifdef JVM_JIT
+#define TIER_TOP TIER_NATIVE
+#else
+#define TIER_TOP TIER_OPTIMIZED
+#endif
+#define TIER_EVENTS 16              /* Promotions jvm_print_tier_stats() lists */
+
+/*
+ * Execution profiler (src/profile.c) and sampling profiler
+ * (src/sampler.c). Built in unless -DJVM_NO_PROFILER (PROFILER=0).
+ * Profiled runs use a second copy of the interpreter loop,
+ * src/interp_profile.c, so the ordinary loop has no counting code in it;
+ * jvm_set_profile() switches a JVM over to the profiling copy. Sampling
+ * needs no copy: the ordinary loop keeps jvm->frames_in_use and the top
+ * frame's ip up to date at calls, returns and loop back-edges, and a
+ * SIGPROF handler reads the frames from there.
+ */
+#ifndef JVM_NO_PROFILER
+#define JVM_PROFILER 1
+#endif
+
+/*
+ * Top-of-stack caching (src/interp.c). Unless -DJVM_NO_TOS_CACHE (TOS=0),
+ * the interpreter keeps the top operand stack value in a register. The
+ * verifier then gives every method TOS_SCRATCH_LOCALS extra local past
+ * its own, which takes the spill of the cached value when the stack is
+ * empty.
+ */
+/*
+ * -DJVM_STACK_TRAFFIC counts the operand stack slots the interpreter reads
+ * and writes in jvm->stack_loads and jvm->stack_stores (make bench-traffic).
+ */
+#ifndef JVM_NO_TOS_CACHE
+#define JVM_TOS_CACHE 1
+#define TOS_SCRATCH_LOCALS 1
+#else
+#define TOS_SCRATCH_LOCALS 0
+#endif
+
+/*
+ * Superinstruction fusion (fuse_superinstructions() in src/decoder.c).
+ * On unless -DJVM_NO_FUSION (FUSION=0): common load/compare and
+ * load/add/store sequences run as one dispatch.
+ */
+#ifndef JVM_NO_FUSION
+#define JVM_FUSION 1
+#endif
+
+/*
+ * Green threads (src/sched.c). Unless -DJVM_NO_GREEN_THREADS
+ * (GREEN_THREADS=0), one JVM can run several tasks, on one OS thread or
+ * spread over a pool of worker threads, switched by a scheduler every
+ * SCHED_DEFAULT_BUDGET bytecodes or when a task calls
+ * aruvi/Scheduler.yield() or sleep(). The interpreter checks the budget
+ * only at backward branches and calls. Threads allocate from TLABs of at
+ * most TLAB_SIZE bytes.
+ */
+#ifndef JVM_NO_GREEN_THREADS
+#define JVM_GREEN_THREADS 1
+#endif
+#define MAX_GREEN_THREADS 64        /* Below MONITOR_OWNER_MAIN */
+#define MAX_WORKERS 64
+#define TLAB_SIZE 512
+#define SCHED_DEFAULT_BUDGET 1000
+#define SCHED_DEFAULT_STACK 128     /* Stack slots per thread */
+#define SCHED_DEFAULT_FRAMES 32
+#define SCHEDULER_CLASS "aruvi/Scheduler"
+
+/*
+ * Floating point. Unless -DJVM_NO_FLOAT (FLOAT=0), the float and double
+ * instructions are built in and the interpreter links against libm. An
+ * integer-only target leaves them out; code that uses them is then
+ * rejected by the verifier as unsupported. long is always available.
+ */
+#ifndef JVM_NO_FLOAT
+#define JVM_FLOAT 1
+#endif
 
 /* Basic Java bytecode opcodes - starting with essentials */
 typedef enum {
     OP_NOP          = 0x00,
+    OP_ACONST_NULL  = 0x01,
     OP_ICONST_M1    = 0x02,
     OP_ICONST_0     = 0x03,
     OP_ICONST_1     = 0x04,
@@ -23,85 +162,1147 @@ typedef enum {
     OP_ICONST_3     = 0x06,
     OP_ICONST_4     = 0x07,
     OP_ICONST_5     = 0x08,
+    OP_LCONST_0     = 0x09,
+    OP_LCONST_1     = 0x0a,
+    OP_FCONST_0     = 0x0b,
+    OP_FCONST_1     = 0x0c,
+    OP_FCONST_2     = 0x0d,
+    OP_DCONST_0     = 0x0e,
+    OP_DCONST_1     = 0x0f,
     OP_BIPUSH       = 0x10,
     OP_SIPUSH       = 0x11,
+    OP_LDC          = 0x12,
+    OP_LDC_W        = 0x13,
+    OP_LDC2_W       = 0x14,
     OP_ILOAD        = 0x15,
+    OP_LLOAD        = 0x16,
+    OP_FLOAD        = 0x17,
+    OP_DLOAD        = 0x18,
     OP_ILOAD_0      = 0x1a,
     OP_ILOAD_1      = 0x1b,
     OP_ILOAD_2      = 0x1c,
     OP_ILOAD_3      = 0x1d,
+    OP_LLOAD_0      = 0x1e,
+    OP_LLOAD_1      = 0x1f,
+    OP_LLOAD_2      = 0x20,
+    OP_LLOAD_3      = 0x21,
+    OP_FLOAD_0      = 0x22,
+    OP_FLOAD_1      = 0x23,
+    OP_FLOAD_2      = 0x24,
+    OP_FLOAD_3      = 0x25,
+    OP_DLOAD_0      = 0x26,
+    OP_DLOAD_1      = 0x27,
+    OP_DLOAD_2      = 0x28,
+    OP_DLOAD_3      = 0x29,
+    OP_ALOAD        = 0x19,
+    OP_ALOAD_0      = 0x2a,
+    OP_ALOAD_1      = 0x2b,
+    OP_ALOAD_2      = 0x2c,
+    OP_ALOAD_3      = 0x2d,
+    OP_IALOAD       = 0x2e,
     OP_ISTORE       = 0x36,
+    OP_LSTORE       = 0x37,
+    OP_FSTORE       = 0x38,
+    OP_DSTORE       = 0x39,
     OP_ISTORE_0     = 0x3b,
     OP_ISTORE_1     = 0x3c,
     OP_ISTORE_2     = 0x3d,
     OP_ISTORE_3     = 0x3e,
+    OP_LSTORE_0     = 0x3f,
+    OP_LSTORE_1     = 0x40,
+    OP_LSTORE_2     = 0x41,
+    OP_LSTORE_3     = 0x42,
+    OP_FSTORE_0     = 0x43,
+    OP_FSTORE_1     = 0x44,
+    OP_FSTORE_2     = 0x45,
+    OP_FSTORE_3     = 0x46,
+    OP_DSTORE_0     = 0x47,
+    OP_DSTORE_1     = 0x48,
+    OP_DSTORE_2     = 0x49,
+    OP_DSTORE_3     = 0x4a,
+    OP_ASTORE       = 0x3a,
+    OP_ASTORE_0     = 0x4b,
+    OP_ASTORE_1     = 0x4c,
+    OP_ASTORE_2     = 0x4d,
+    OP_ASTORE_3     = 0x4e,
+    OP_IASTORE      = 0x4f,
+    OP_POP          = 0x57,
+    OP_POP2         = 0x58,
+    OP_DUP          = 0x59,
+    OP_DUP2         = 0x5c,
     OP_IADD         = 0x60,
+    OP_LADD         = 0x61,
+    OP_FADD         = 0x62,
+    OP_DADD         = 0x63,
     OP_ISUB         = 0x64,
+    OP_LSUB         = 0x65,
+    OP_FSUB         = 0x66,
+    OP_DSUB         = 0x67,
     OP_IMUL         = 0x68,
+    OP_LMUL         = 0x69,
+    OP_FMUL         = 0x6a,
+    OP_DMUL         = 0x6b,
     OP_IDIV         = 0x6c,
+    OP_LDIV         = 0x6d,
+    OP_FDIV         = 0x6e,
+    OP_DDIV         = 0x6f,
     OP_IREM         = 0x70,
+    OP_LREM         = 0x71,
+    OP_FREM         = 0x72,
+    OP_DREM         = 0x73,
     OP_INEG         = 0x74,
+    OP_LNEG         = 0x75,
+    OP_FNEG         = 0x76,
+    OP_DNEG         = 0x77,
+    OP_ISHL         = 0x78,
+    OP_LSHL         = 0x79,
+    OP_ISHR         = 0x7a,
+    OP_LSHR         = 0x7b,
+    OP_IUSHR        = 0x7c,
+    OP_LUSHR        = 0x7d,
+    OP_IAND         = 0x7e,
+    OP_LAND         = 0x7f,
+    OP_IOR          = 0x80,
+    OP_LOR          = 0x81,
+    OP_IXOR         = 0x82,
+    OP_LXOR         = 0x83,
+    OP_IINC         = 0x84,
+    OP_I2L          = 0x85,
+    OP_I2F          = 0x86,
+    OP_I2D          = 0x87,
+    OP_L2I          = 0x88,
+    OP_L2F          = 0x89,
+    OP_L2D          = 0x8a,
+    OP_F2I          = 0x8b,
+    OP_F2L          = 0x8c,
+    OP_F2D          = 0x8d,
+    OP_D2I          = 0x8e,
+    OP_D2L          = 0x8f,
+    OP_D2F          = 0x90,
+    OP_LCMP         = 0x94,
+    OP_FCMPL        = 0x95,
+    OP_FCMPG        = 0x96,
+    OP_DCMPL        = 0x97,
+    OP_DCMPG        = 0x98,
+    OP_IFEQ         = 0x99,
+    OP_IFNE         = 0x9a,
+    OP_IFLT         = 0x9b,
+    OP_IFGE         = 0x9c,
+    OP_IFGT         = 0x9d,
+    OP_IFLE         = 0x9e,
     OP_IF_ICMPEQ    = 0x9f,
     OP_IF_ICMPNE    = 0xa0,
     OP_IF_ICMPLT    = 0xa1,
     OP_IF_ICMPGE    = 0xa2,
     OP_IF_ICMPGT    = 0xa3,
     OP_IF_ICMPLE    = 0xa4,
+    OP_IF_ACMPEQ    = 0xa5,
+    OP_IF_ACMPNE    = 0xa6,
     OP_GOTO         = 0xa7,
+    OP_JSR          = 0xa8,
+    OP_RET          = 0xa9,
+    OP_TABLESWITCH  = 0xaa,
+    OP_LOOKUPSWITCH = 0xab,
     OP_IRETURN      = 0xac,
+    OP_LRETURN      = 0xad,
+    OP_FRETURN      = 0xae,
+    OP_DRETURN      = 0xaf,
+    OP_ARETURN      = 0xb0,
     OP_RETURN       = 0xb1,
+    OP_GETSTATIC    = 0xb2,
+    OP_PUTSTATIC    = 0xb3,
+    OP_GETFIELD     = 0xb4,
+    OP_PUTFIELD     = 0xb5,
+    OP_INVOKEVIRTUAL = 0xb6,
+    OP_INVOKESPECIAL = 0xb7,
     OP_INVOKESTATIC = 0xb8,
+    OP_INVOKEINTERFACE = 0xb9,
+    OP_INVOKEDYNAMIC = 0xba,
+    OP_NEW          = 0xbb,
+    OP_NEWARRAY     = 0xbc,
+    OP_ANEWARRAY    = 0xbd,
+    OP_ARRAYLENGTH  = 0xbe,
+    OP_ATHROW       = 0xbf,
+    OP_CHECKCAST    = 0xc0,
+    OP_INSTANCEOF   = 0xc1,
+    OP_MONITORENTER = 0xc2,
+    OP_MONITOREXIT  = 0xc3,
+    OP_WIDE         = 0xc4,
+    OP_MULTIANEWARRAY = 0xc5,
+    OP_IFNULL       = 0xc6,
+    OP_IFNONNULL    = 0xc7,
+    OP_GOTO_W       = 0xc8,
+    OP_JSR_W        = 0xc9,
     OP_HALT         = 0xff  /* Custom opcode for stopping execution */
 } Opcode;
 
-/* JVM value types */
+/*
+ * Pre-decoded instruction set.
+ *
+ * decode_bytecode() translates a method's raw bytecode into an array of
+ * fixed-width Insn records before it runs: constants and local indexes
+ * are decoded once, and branch offsets become absolute instruction
+ * indexes, so the hot loop never parses operands.
+ */
+typedef enum {
+    INSN_ICONST,        /* push k (iconst_*, bipush, sipush) */
+    INSN_ACONST_NULL,
+    INSN_LDC,           /* push String constant k of the method's class,
+                           interned; the verifier turns int and float ldc
+                           into iconst */
+    INSN_ILOAD,         /* push locals[a] */
+    INSN_ALOAD,
+    INSN_ISTORE,        /* locals[a] = pop */
+    INSN_ASTORE,
+    INSN_IADD,
+    INSN_ISUB,
+    INSN_IMUL,
+    INSN_IDIV,
+    INSN_IREM,
+    INSN_INEG,
+    INSN_IF_ICMPEQ,     /* compare and branch to instruction k */
+    INSN_IF_ICMPNE,
+    INSN_IF_ICMPLT,
+    INSN_IF_ICMPGE,
+    INSN_IF_ICMPGT,
+    INSN_IF_ICMPLE,
+    INSN_IF_ACMPEQ,
+    INSN_IF_ACMPNE,
+    INSN_IFEQ,          /* pop an int and branch to instruction k if it is
+                           <cond> 0 */
+    INSN_IFNE,
+    INSN_IFLT,
+    INSN_IFGE,
+    INSN_IFGT,
+    INSN_IFLE,
+    INSN_IFNULL,        /* pop and branch to instruction k if null */
+    INSN_IFNONNULL,
+    INSN_GOTO,          /* continue at instruction k */
+    INSN_TABLESWITCH,   /* pop a key, jump through jump table a */
+    INSN_LOOKUPSWITCH,  /* pop a key, look it up in sparse switch a */
+    INSN_INVOKESTATIC,  /* call constant k through call site a */
+    INSN_INVOKESPECIAL, /* constructor, private or superclass method call */
+    INSN_INVOKEVIRTUAL, /* call through the receiver's vtable, with an
+                           inline cache in call site a */
+    INSN_INVOKEINTERFACE,   /* the same through the receiver's itable */
+    INSN_INVOKESPECIAL_CHECKED, /* invokespecial on a receiver the verifier
+                           can't type; its class is checked like a virtual
+                           call's */
+    INSN_IRETURN,
+    INSN_ARETURN,
+    INSN_RETURN,
+    INSN_ATHROW,        /* throw the exception on top of the stack */
+    INSN_POP,
+    INSN_DUP,
+    INSN_NEW,           /* allocate an object of class constant k */
+    INSN_NEWARRAY,      /* allocate an int[]; array type a */
+    INSN_ARRAYLENGTH,
+    INSN_IALOAD,
+    INSN_IASTORE,
+    INSN_GETFIELD,      /* field constant k; once verified, a is its slot */
+    INSN_PUTFIELD,
+    INSN_MONITORENTER,  /* lock the object on top of the stack */
+    INSN_MONITOREXIT,
+    INSN_IINC,          /* locals[a] += k */
+    INSN_ISHL,
+    INSN_ISHR,
+    INSN_IUSHR,
+    INSN_IAND,
+    INSN_IOR,
+    INSN_IXOR,
+
+    /* long, float and double. A long or double takes two slots, locals[a]
+     * and locals[a + 1] for a local; the verifier turns the float loads,
+     * stores and returns into their int forms, and the double ones into
+     * their long forms, since they only move bits. */
+    INSN_LCONST,        /* push long k (lconst_*) */
+    INSN_FCONST,        /* push float constant k, given as its bits */
+    INSN_DCONST,        /* push double k (dconst_*) */
+    INSN_LDC2_W,        /* push long or double constant k of the method's class */
+    INSN_LLOAD,
+    INSN_FLOAD,
+    INSN_DLOAD,
+    INSN_LSTORE,
+    INSN_FSTORE,
+    INSN_DSTORE,
+    INSN_LRETURN,
+    INSN_FRETURN,
+    INSN_DRETURN,
+    INSN_POP2,          /* pop a long or double, or two other values */
+    INSN_DUP2,
+    INSN_LADD,
+    INSN_LSUB,
+    INSN_LMUL,
+    INSN_LDIV,
+    INSN_LREM,
+    INSN_LNEG,
+    INSN_LSHL,
+    INSN_LSHR,
+    INSN_LUSHR,
+    INSN_LAND,
+    INSN_LOR,
+    INSN_LXOR,
+    INSN_LCMP,
+    INSN_FADD,
+    INSN_FSUB,
+    INSN_FMUL,
+    INSN_FDIV,
+    INSN_FREM,
+    INSN_FNEG,
+    INSN_FCMPL,
+    INSN_FCMPG,
+    INSN_DADD,
+    INSN_DSUB,
+    INSN_DMUL,
+    INSN_DDIV,
+    INSN_DREM,
+    INSN_DNEG,
+    INSN_DCMPL,
+    INSN_DCMPG,
+    INSN_I2L,
+    INSN_I2F,
+    INSN_I2D,
+    INSN_L2I,
+    INSN_L2F,
+    INSN_L2D,
+    INSN_F2I,
+    INSN_F2L,
+    INSN_F2D,
+    INSN_D2I,
+    INSN_D2L,
+    INSN_D2F,
+
+    /* Superinstructions. Only the first instruction of a fused sequence is
+     * rewritten; the rest stay in place and supply the operands, so a
+     * branch into the middle of the sequence still runs the originals. */
+    INSN_ILOAD_ILOAD_IF_ICMPEQ,     /* iload a; iload; if_icmp<cond> */
+    INSN_ILOAD_ILOAD_IF_ICMPNE,
+    INSN_ILOAD_ILOAD_IF_ICMPLT,
+    INSN_ILOAD_ILOAD_IF_ICMPGE,
+    INSN_ILOAD_ILOAD_IF_ICMPGT,
+    INSN_ILOAD_ILOAD_IF_ICMPLE,
+    INSN_ILOAD_ICONST_IADD_ISTORE,  /* iload a; iconst; iadd; istore */
+    INSN_ILOAD_ILOAD_IADD,          /* iload a; iload; iadd */
+    INSN_YIELD,         /* aruvi/Scheduler.yield(), rewritten by the verifier */
+    INSN_SLEEP,         /* aruvi/Scheduler.sleep(int ticks) */
+    INSN_INVOKENATIVE,  /* call the native method of call site a on the
+                           operand stack, with no frame (verifier) */
+    INSN_HALT,
+    INSN_UNKNOWN,       /* unsupported opcode k, rejected by the decoder */
+    INSN_END,           /* end of bytecode sentinel */
+    INSN_COUNT
+} InsnOp;
+
 typedef struct {
+    uint16_t op;        /* InsnOp */
+    uint16_t a;         /* Local variable, call site or switch index */
+    int32_t k;          /* Immediate constant or absolute branch target */
+} Insn;
+
+struct Method;
+struct JitCode;
+struct Container;
+struct Class;
+
+/*
+ * Per-call-site cache. invokestatic and invokespecial keep the method the
+ * instruction resolved to. The other invokes choose the method by the
+ * receiver's class and keep their first choice as a monomorphic inline
+ * cache: a receiver of class class_id calls target after one compare,
+ * and any other goes through its vtable or itable.
+ */
+typedef struct {
+    struct Method* target;  /* NULL until the first call */
+    uint32_t class_id;      /* Receiver class of target; 0 while empty */
+    int arg_slots;          /* Receiver and arguments (verifier) */
+} CallSite;
+
+/*
+ * A tableswitch or lookupswitch, lowered when the method is decoded. Dense
+ * keys, which includes every tableswitch, become a jump table indexed by
+ * key - low. Sparse lookupswitch keys stay sorted for a binary search, and
+ * sets of SWITCH_HASH_MIN keys or more also get an open-addressed hash
+ * table over them, so a lookup takes about one probe however many cases
+ * there are.
+ */
+#define SWITCH_HASH_MIN 16
+
+typedef struct {
+    int32_t low;            /* Jump table: the key of targets[0] */
+    int count;              /* Entries in targets, and in keys if sparse */
+    int default_target;     /* Instruction index for any other key */
+    int* targets;           /* Instruction index of each case */
+    int32_t* keys;          /* Sparse: the keys, ascending; NULL for a table */
+    uint32_t* hash;         /* Large sparse: 1 + index into keys, 0 if free */
+    int hash_shift;         /* 32 - log2 of the hash table's size */
+} SwitchTable;
+
+/* An exception table entry with its bytecode ranges as instruction
+ * indexes: instructions [start, end) are covered */
+typedef struct {
+    int start;
+    int end;
+    int target;             /* The handler's first instruction */
+    int catch_type;         /* Class constant caught, 0 for any */
+    struct Class* catch_class;  /* That class, NULL for any (verifier) */
+} DecodedHandler;
+
+/* A method's bytecode after pre-decoding */
+typedef struct {
+    Insn* insns;            /* Instructions, terminated by INSN_END */
+    int count;              /* Number of instructions including INSN_END */
+    int* bytecode_pc;       /* Original bytecode pc of each instruction */
+    CallSite* call_sites;   /* One cache entry per invoke instruction */
+    int call_site_count;
+    SwitchTable* switches;  /* One per tableswitch or lookupswitch */
+    int switch_count;
+    DecodedHandler* handlers;   /* The exception table, in its order */
+    int handler_count;
+    int* stack_depth;       /* Operand stack depth on entry to each
+                               instruction, -1 if unreachable (verifier) */
+    uint8_t* slot_types;    /* SlotType of every local and stack slot on
+                               entry to each instruction, frame_slots per
+                               instruction (verifier) */
+    int frame_slots;        /* locals_count + max_stack */
+    int in_image;           /* insns, bytecode_pc, stack_depth, slot_types and
+                               the switches' arrays lie in a snapshot image
+                               and are not freed (snapshot.c) */
+} DecodedCode;
+
+/* What the verifier knows a local or operand stack slot holds */
+typedef enum {
+    SLOT_TOP,           /* Unset, or different types on different paths */
+    SLOT_INT,
+    SLOT_FLOAT,
+    SLOT_LONG,          /* First slot of a long... */
+    SLOT_LONG_HIGH,     /* ...and its second */
+    SLOT_DOUBLE,
+    SLOT_DOUBLE_HIGH,
+    SLOT_NULL,          /* aconst_null: compatible with any reference */
+    SLOT_OBJECT,        /* Instance of the method's own class */
+    SLOT_INT_ARRAY,
+    SLOT_REF            /* Any other reference */
+} SlotType;
+
+#define SLOT_IS_REF(t) ((t) >= SLOT_NULL)
+
+/* JVM value types: one 32-bit slot */
+typedef union {
     int32_t i;
+#ifdef JVM_FLOAT
+    float f;
+#endif
 } Value;
 
-/* Stack frame */
+/* A long or double takes two consecutive slots, which hold its eight
+ * bytes in memory order, so it moves in and out of them with one copy */
+#define WIDE_GET(slots, v)  memcpy(&(v), (slots), 8)
+#define WIDE_SET(slots, v)  memcpy((slots), &(v), 8)
+
+/*
+ * Stack frame. Frames run by the fast interpreter keep their locals and
+ * operand stack in jvm->stack: a callee's locals begin where the caller
+ * pushed the arguments, and its operand stack follows its locals.
+ */
 typedef struct {
-    Value* locals;      /* Local variables */
-    uint8_t* code;      /* Method bytecode */
-    int pc;             /* Program counter */
-    int locals_count;   /* Number of local variables */
-    int code_length;    /* Length of bytecode */
+    Value* locals;          /* Local variables */
+    uint8_t* code;          /* Method bytecode */
+    int pc;                 /* Program counter */
+    int locals_count;       /* Number of local variables */
+    int code_length;        /* Length of bytecode */
+    struct Method* method;  /* Method running in this frame */
+    const Insn* ip;         /* Where to resume after a call returns; in
+                               the top frame, the last loop head, call or
+                               return the interpreter passed */
 } Frame;
 
+/*
+ * Heap objects (heap.c). A reference is the byte offset of an object in
+ * jvm->heap and 0 is null, so the first object starts at HEAP_BASE.
+ * Each object has a two-word header followed by one word per field or
+ * array element:
+ *   word 0  GC word: between collections, the id of the thread holding
+ *           the object's monitor << LOCK_OWNER_SHIFT, or zero; the mark
+ *           bit and the forwarding address while the collector runs
+ *   word 1  type word: ARRAY_FLAG | length for an int[]; for an object,
+ *           its class id << 8 | its field count
+ * A byte[], which only Strings and StringBuilders hold (string.c), has
+ * ARRAY_FLAG | BYTE_ARRAY_FLAG | its length in bytes, which are packed
+ * four to a word.
+ * The class id leads to the Class (class_by_id()), whose ref_map tells
+ * the collector which fields hold references, and whose vtable and
+ * itable a virtual call dispatches through. An array's type word never
+ * has a class id's value, so one compare with a call site's cached id
+ * tells an object of that class from anything else.
+ */
+#define HEAP_BASE 8
+#define OBJECT_HEADER_WORDS 2
+#define ARRAY_FLAG 0x80000000u
+#define BYTE_ARRAY_FLAG 0x40000000u
+#define BYTE_ARRAY_WORDS(length) (OBJECT_HEADER_WORDS + ((uint32_t)(length) + 3) / 4)
+#define OBJECT_TYPE(class_id, fields) (((uint32_t)(class_id) << 8) | (uint32_t)(fields))
+#define OBJECT_CLASS_ID(type) ((type) >> 8)
+#define OBJECT_FIELDS(type) ((type) & 0xffu)
+#define HEAP_OBJECT(jvm, ref) (&(jvm)->heap[(uint32_t)(ref) / 4])
+
+/*
+ * Monitors are thin locks: monitorenter claims a free object with one
+ * compare-and-swap of its GC word, and a thread records each monitor it
+ * holds, with its entry count, in a Monitors list. Re-entering only
+ * bumps the count. The collector rewrites GC words, so it puts the
+ * owners back from these lists afterwards.
+ */
+#define LOCK_OWNER_SHIFT 8
+#define MONITOR_OWNER_MAIN 255      /* Code not running on a green thread */
+#define MAX_HELD_MONITORS 8         /* Distinct monitors one thread holds */
+
+typedef struct {
+    Value object;
+    int count;              /* Entries not yet exited */
+} MonitorRecord;
+
+typedef struct {
+    MonitorRecord held[MAX_HELD_MONITORS];
+    int count;
+} Monitors;
+
+/* Claim a free monitor's GC word for owner, or give it back. Other
+ * compilers than GCC and Clang only get single-threaded forms. */
+#ifdef __GNUC__
+#define LOCK_CLAIM(word, expected, owner)                                   \
+    __atomic_compare_exchange_n(word, expected, (uint32_t)(owner) << LOCK_OWNER_SHIFT, 0, \
+                                __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)
+#define LOCK_RELEASE(word) __atomic_store_n(word, 0u, __ATOMIC_RELEASE)
+#else
+#define LOCK_CLAIM(word, expected, owner)                                   \
+    (*(word) == 0 ? (*(word) = (uint32_t)(owner) << LOCK_OWNER_SHIFT, 1)    \
+                  : (*(expected) = *(word), 0))
+#define LOCK_RELEASE(word) (*(word) = 0u)
+#endif
+
+/*
+ * Interned Strings of one JVM (string.c): an open-addressed table of
+ * references to String objects, probed linearly from the slot their
+ * hashCode picks. Lookups take no lock; adding takes the spin lock. The
+ * table doesn't keep its Strings alive: the collector drops the ones
+ * nothing else references and forwards the others. Build with
+ * -DSTRING_TABLE_BITS=... for a table of another size.
+ */
+#ifndef STRING_TABLE_BITS
+#define STRING_TABLE_BITS 9
+#endif
+#define STRING_TABLE_SIZE (1 << STRING_TABLE_BITS)
+#define STRING_TABLE_MAX (STRING_TABLE_SIZE / 4 * 3)   /* Entries it holds */
+#define STRING_TABLE_INDEX(hash) \
+    ((int)(((uint32_t)(hash) * 2654435769u) >> (32 - STRING_TABLE_BITS)))
+
+typedef struct {
+    int32_t entries[STRING_TABLE_SIZE];     /* 0 if free */
+    int count;
+    uint32_t lock;
+} StringTable;
+
+/* Fields of java/lang/String: its characters, one byte each if coder is
+ * STRING_LATIN1 and two if STRING_UTF16, and its hashCode once computed,
+ * or 0 */
+#define STRING_VALUE 0
+#define STRING_CODER 1
+#define STRING_HASH 2
+#define STRING_LATIN1 0
+#define STRING_UTF16 1
+
+/* A promotion of one method, as jvm_print_tier_stats() lists it. The
+ * name is copied, since the method may be gone before the JVM is. */
+typedef struct {
+    char method[32];
+    int from, to;           /* Tiers */
+    uint32_t invocations;   /* The method's counts when it was promoted */
+    uint32_t backedges;
+    int on_stack;           /* Taken at a loop back-edge, by the frame running it */
+} TierEvent;
+
+/* Tier thresholds of one JVM and the promotions it has made */
+typedef struct {
+    uint32_t invocations[TIER_COUNT];   /* Calls that promote to each tier */
+    uint32_t backedges[TIER_COUNT];     /* Backward branches that do */
+    uint64_t promotions[TIER_COUNT];    /* Methods promoted to each tier */
+    uint64_t on_stack[TIER_COUNT];      /* Of those, at a loop back-edge */
+    uint64_t failed;                    /* Promotions that could not be made */
+    TierEvent events[TIER_EVENTS];      /* The latest promotions, oldest first */
+    int event_count;
+} TierStats;
+
 /* JVM runtime */
 typedef struct {
     Value stack[STACK_SIZE];    /* Operand stack */
     int sp;                     /* Stack pointer */
-    Frame frames[256];          /* Call stack */
+    int stack_peak;             /* Slots of stack[] ever written */
+    Frame frames[MAX_FRAMES];   /* Call stack */
     int fp;                     /* Frame pointer */
-    uint8_t heap[HEAP_SIZE];    /* Simple heap */
-    int heap_ptr;               /* Heap allocation pointer */
+    int frame_peak;             /* Highest frame ever entered */
+    int running;                /* jvm_execute_method() calls in progress */
+    int failed;                 /* The last of them ended in a runtime error,
+                                   such as an uncaught exception */
+    uint32_t heap[HEAP_SIZE / 4];   /* Object heap, see heap.c */
+    int heap_ptr;               /* Heap allocation pointer (byte offset) */
+    int heap_limit;             /* Bytes of heap in use as the budget */
+    int heap_peak;              /* Highest heap_ptr reached */
+    int32_t gc_stack[GC_STACK_SIZE];    /* Mark stack */
+    uint64_t bytes_allocated;   /* Total bytes ever allocated */
+    uint64_t gc_count;          /* Collections run */
+    uint64_t gc_total_ns;       /* Time spent collecting */
+    uint64_t gc_max_pause_ns;   /* Longest single collection */
     int debug;                  /* Debug mode flag */
+    int verbose;                /* Print return/halt messages */
+    Value wide_result[2];       /* A long or double the outermost method
+                                   returned (jvm_result_long()) */
+    uint64_t instructions;      /* Bytecodes executed so far */
+    uint64_t calls;             /* Method invocations so far */
+    uint64_t inline_cache_misses;   /* Virtual calls that missed their call
+                                   site's cache, outside green threads */
+    struct Profile* profile;    /* Execution profile, NULL unless profiling */
+    struct Sampler* sampler;    /* Sampling profiler, NULL unless sampling */
+    int frames_in_use;          /* frames[0..frames_in_use - 1] belong to
+                                   the running code, outside green threads;
+                                   published for the sampler */
+    Monitors monitors;          /* Held by code outside green threads */
+    Value native_root;          /* Object a native method outside green
+                                   threads keeps across an allocation */
+    StringTable strings;        /* Interned Strings (string.c) */
+    TierStats tiers;            /* Tier thresholds and promotions (tier.c) */
+#ifdef JVM_STACK_TRAFFIC
+    uint64_t stack_loads;       /* Operand stack slots read from memory */
+    uint64_t stack_stores;      /* Operand stack slots written to memory */
+#endif
+#ifdef JVM_GREEN_THREADS
+    struct Scheduler* scheduler;    /* Running green threads, or NULL */
+#endif
 } JVM;
 
-/* Method descriptor */
+#ifdef JVM_GREEN_THREADS
+/*
+ * A green thread runs in its own segments of jvm->stack and jvm->frames,
+ * carved out when it is spawned, so switching threads copies nothing:
+ * the interpreter stops with the thread's state in its Frames plus sp and
+ * fp, and picks up another thread's from the same places. Nothing the
+ * interpreter writes while running a thread is shared with other threads
+ * but the objects it touches, so threads can run on several OS threads
+ * at once.
+ */
+typedef enum {
+    THREAD_READY,           /* Waiting for its turn */
+    THREAD_RUNNING,
+    THREAD_SLEEPING,        /* Until the clock reaches wake_at */
+    THREAD_DONE
+} ThreadState;
+
+typedef struct GreenThread {
+    const char* name;
+    int id;                 /* 1-based, the owner id in its monitors */
+    struct Method* method;  /* Entry point; its arguments are pushed at spawn */
+    ThreadState state;
+    int started;            /* Has run; sp and fp hold its state */
+    int stack_base;         /* Its segment of jvm->stack: [stack_base, stack_limit) */
+    int stack_limit;
+    int frame_base;         /* Its segment of jvm->frames */
+    int frame_limit;
+    int sp;                 /* End of its operand stack while switched out */
+    int fp;                 /* Its top frame while switched out or collecting */
+    int result;             /* What the entry point returned, once DONE */
+    int sleep_ticks;        /* Length of the sleep it stopped for */
+    Monitors monitors;      /* Monitors it holds */
+    Value native_root;      /* Object a native method keeps across an allocation */
+    int32_t tlab_ptr;       /* Its allocation buffer: [tlab_ptr, tlab_end) */
+    int32_t tlab_end;
+    uint64_t allocated;     /* Bytes it has allocated */
+    uint64_t slice_ticks;   /* Bytecodes run in its last slice */
+    uint64_t calls;         /* Method invocations */
+    uint64_t monitor_waits; /* Times it found a monitor taken */
+    uint64_t wake_at;       /* Clock tick a sleep ends at */
+    uint64_t ready_at;      /* Tick it became ready, for its wait */
+    uint64_t ready_ns;      /* And the wall-clock time */
+    uint64_t ticks;         /* Bytecodes it has run */
+    uint64_t slices;        /* Times it was scheduled */
+    uint64_t max_slice;     /* Longest run between switches, in ticks */
+    uint64_t max_wait;      /* Longest ready-to-running delay, in ticks */
+    uint64_t max_wait_ns;   /* The same in wall-clock time */
+} GreenThread;
+
+/* Round-robin scheduler over the green threads of one JVM. Time is
+ * counted in ticks, one per bytecode run, so schedules are reproducible
+ * when the threads run on one OS thread. */
+typedef struct Scheduler {
+    JVM* jvm;
+    GreenThread threads[MAX_GREEN_THREADS];
+    int thread_count;
+    int next;               /* Round-robin position */
+    int budget;             /* Ticks a thread runs before it is switched */
+    int tlab_size;          /* Bytes a thread takes from the heap at a time */
+    uint64_t clock;         /* Ticks since the scheduler started */
+    uint64_t idle;          /* Ticks skipped with every thread asleep */
+    uint64_t switches;
+    struct WorkerPool* pool;    /* Worker threads, while running on several */
+    int workers;            /* OS threads of the last run */
+    uint64_t steals;        /* Threads a worker took from another's queue */
+    uint64_t wall_ns;       /* Duration of the last run */
+} Scheduler;
+#endif
+
+/* Access flags of classes and methods (values as in the class file format) */
+#define ACC_PRIVATE     0x0002
+#define ACC_STATIC      0x0008
+#define ACC_FINAL       0x0010
+#define ACC_SYNCHRONIZED 0x0020
+#define ACC_NATIVE      0x0100
+#define ACC_INTERFACE   0x0200
+#define ACC_ABSTRACT    0x0400
+
+/* Root of the classes athrow takes; it and its common subclasses are
+ * built in (class_system()) */
+#define THROWABLE_CLASS "java/lang/Throwable"
+
+/* Exception table entry as in a Code attribute: bytecode pcs, with the
+ * range [start_pc, end_pc) */
+typedef struct {
+    uint16_t start_pc;
+    uint16_t end_pc;
+    uint16_t handler_pc;
+    uint16_t catch_type;    /* Class constant caught, 0 for any */
+} ExceptionHandler;
+
+/*
+ * Call of a native method, which runs on the caller's operand stack: args
+ * is where the receiver and arguments start, and the result replaces
+ * them. An allocation may collect, which moves objects, so a native reads
+ * its references from args again after one, and keeps an object it has
+ * allocated itself in *root, which the collector updates. A native method
+ * returns 0, or -1 with exception naming the built-in class to throw, or
+ * with exception NULL after reporting an error.
+ */
 typedef struct {
+    JVM* jvm;
+    struct GreenThread* thread;     /* Allocates from its TLAB; NULL if none */
+    Value* args;
+    Value* root;
+    Value result;
+    const char* exception;
+} NativeCall;
+
+typedef int (*NativeFunction)(NativeCall* call);
+
+/* Method descriptor */
+typedef struct Method {
     char* name;
+    char* descriptor;       /* e.g. "(II)I"; NULL for top-level code */
+    struct Class* owner;    /* Class whose constant pool the code uses */
+    int access_flags;       /* ACC_STATIC, ACC_PRIVATE, ACC_ABSTRACT, ACC_NATIVE,
+                               ACC_SYNCHRONIZED (rejected by the verifier) */
+    int vtable_index;       /* Slot in the class's vtable, or for an interface
+                               method its index in the itable entry; -1 if
+                               calls to it are not dispatched (class_link) */
+    int arg_slots;          /* Local slots taken by the arguments */
+    int return_slots;       /* 2 for a long or double result, 1 for any
+                               other, 0 for void */
     uint8_t* code;
     int code_length;
-    int locals_count;
+    NativeFunction native;  /* Code of an ACC_NATIVE method, run by
+                               INSN_INVOKENATIVE; code is NULL */
+    ExceptionHandler* handlers; /* Exception table, owned; NULL if empty */
+    int handler_count;
+    int locals_count;       /* max_locals, computed by the verifier */
+    int max_stack;          /* Deepest operand stack, computed by the verifier */
+    int prepared;           /* Decoded and verified, ready to execute */
+    int limits_declared;    /* max_stack/locals_count came from a file; the
+                               verifier rejects code that needs more */
+    DecodedCode decoded;    /* Pre-decoded form of code */
+    struct JitCode* jit;    /* Native code, NULL until compiled */
+    int jit_attempted;      /* Compilation tried; don't try again */
+    int linked;             /* method_link() has resolved its calls */
+    int tier;               /* TIER_BASELINE, TIER_OPTIMIZED or TIER_NATIVE */
+    uint32_t invocations;   /* Calls so far, for promotion */
+    uint32_t backedges;     /* Backward branches taken so far */
+    uint32_t invocation_limit;  /* Counts at which tier_promote() runs */
+    uint32_t backedge_limit;    /* next; 0 until the method is first counted */
 } Method;
 
-/* Class descriptor */
+/* Constant pool tags (values as in the class file format) */
+#define CONSTANT_Utf8               1
+#define CONSTANT_Integer            3
+#define CONSTANT_Float              4
+#define CONSTANT_Long               5
+#define CONSTANT_Double             6
+#define CONSTANT_Class              7
+#define CONSTANT_String             8
+#define CONSTANT_Fieldref           9
+#define CONSTANT_Methodref          10
+#define CONSTANT_InterfaceMethodref 11
+#define CONSTANT_NameAndType        12
+#define CONSTANT_MethodHandle       15
+#define CONSTANT_MethodType         16
+#define CONSTANT_Dynamic            17
+#define CONSTANT_InvokeDynamic      18
+#define CONSTANT_Module             19
+#define CONSTANT_Package            20
+
+/*
+ * Constant pool entry. Index 0 is unused, as in class files.
+ *
+ * Entries parsed from a class file keep their raw operands and are only
+ * resolved, by class_resolve_constant(), when code that uses them runs;
+ * the results are cached in the entry. Entries added by
+ * class_add_method_ref() are created resolved.
+ */
+typedef struct {
+    int tag;
+    int resolved;           /* name/class_name/descriptor are filled in */
+    uint16_t ref1, ref2;    /* Raw operands: the pool indexes this refers to */
+    int32_t value;          /* Integer: the value; Float: its bits;
+                               String: the hashCode of its text */
+    int64_t wide;           /* Long: the value; Double: its bits */
+    const uint8_t* utf8;    /* Utf8: bytes in the class file, not NUL-terminated */
+    int utf8_length;
+    char* name;             /* Member refs: member name; Class: class name;
+                               String and Utf8: the text */
+    char* class_name;       /* Member refs: owning class, NULL for this class */
+    char* descriptor;       /* Member refs: type descriptor */
+    struct Method* method;  /* Methodref: the method it resolved to */
+    struct Class* cls;      /* Class: the class new resolved it to */
+    uint8_t* chars;         /* String: the text as a String's value holds it */
+    int chars_length;       /* In characters */
+    int coder;              /* STRING_LATIN1 or STRING_UTF16 */
+} Constant;
+
+/* Instance field; class_link() assigns the slots */
 typedef struct {
     char* name;
+    char* descriptor;
+    struct Class* owner;    /* Declaring class */
+    int slot;               /* Word index after the object header */
+} Field;
+
+/* The methods a class runs for the methods of one interface it implements,
+ * indexed by the interface methods' vtable_index */
+typedef struct {
+    struct Class* interface;
+    struct Method** methods;
+} ITableEntry;
+
+struct ClassRegistry;
+
+/* Class descriptor */
+typedef struct Class {
+    char* name;
+    int access_flags;       /* ACC_INTERFACE, ACC_ABSTRACT, ACC_FINAL */
+    uint32_t id;            /* In object type words; see class_by_id() */
     Method methods[MAX_METHODS];
     int method_count;
+    Constant constants[MAX_CONSTANTS];
+    int constant_count;     /* Next free index; starts at 1 */
+    Field fields[MAX_FIELDS];
+    int field_count;        /* Declared here, not inherited */
+    char* super_name;       /* NULL if the superclass is java/lang/Object */
+    char* interface_names[MAX_INTERFACES];
+    int interface_count;
+    struct ClassRegistry* registry;   /* Where the names above are looked up */
+
+    /* Set by class_link() */
+    int linked;             /* 1 once linked, -1 while linking */
+    struct Class* super;
+    struct Class* interfaces[MAX_INTERFACES];
+    int instance_fields;    /* Words of fields in an object, inherited included */
+    uint32_t ref_map;       /* Bit i set if field slot i holds a reference */
+    Method** vtable;        /* Method run for each virtual method slot */
+    int vtable_length;
+    ITableEntry* itable;    /* One entry per interface implemented, inherited
+                               and superinterfaces included */
+    int itable_length;
+
+    uint8_t* class_file;    /* Parsed .class bytes, owned; code points into it */
+    struct Container* container;  /* File methods are loaded from on demand */
+    int container_class;    /* This class's entry in the container's index */
 } Class;
 
+/* A set of classes that name each other, as the classes one class loader
+ * defines do: superclasses, interfaces and the classes of member
+ * references are looked up in the registry of the class naming them. It
+ * owns its classes, and the snapshot image they were loaded from, if
+ * any, which their names, code and decoded methods point into. */
+typedef struct ClassRegistry {
+    Class* classes[MAX_CLASSES];
+    int count;
+    uint8_t* image;         /* snapshot_load(); NULL otherwise */
+    size_t image_size;
+    int image_mapped;       /* image is an mmap (else a malloc'd copy) */
+} ClassRegistry;
+
+/*
+ * Execution profile of one JVM. Counts are kept per instruction of each
+ * method run, and what the report needs from the method is copied, since
+ * top-level code and classes may be gone before the JVM is destroyed.
+ */
+#define PROFILE_COUNTS 1        /* Count opcodes, instructions and branches */
+#define PROFILE_CYCLES 2        /* Also time each opcode's handlers */
+
+typedef struct {
+    const Method* method;           /* Identity only, never dereferenced */
+    const uint8_t* code;            /* With method, tells reused addresses apart */
+    char* name;                     /* "Class.method" */
+    int count;                      /* Instructions, including INSN_END */
+    int* bytecode_pc;
+    uint16_t* ops;
+    uint64_t* executed;             /* Per instruction */
+    uint64_t* taken;                /* Per conditional branch instruction */
+} MethodProfile;
+
+typedef struct Profile {
+    int mode;                       /* PROFILE_COUNTS, optionally | PROFILE_CYCLES */
+    uint64_t runs;                  /* Profiled jvm_execute_method() calls */
+    uint64_t op_count[INSN_COUNT];
+    uint64_t op_cycles[INSN_COUNT]; /* In PROFILE_CLOCK_UNIT */
+    MethodProfile* methods;
+    int method_count;
+    int method_capacity;
+    int last;                       /* Index of the last method looked up */
+    char* output;                   /* File written by jvm_destroy(), or NULL */
+} Profile;
+
+/* Handler timing uses the time-stamp counter on x86-64, otherwise the
+ * monotonic clock */
+#if defined(__x86_64__) && defined(__GNUC__)
+#define PROFILE_CLOCK() __builtin_ia32_rdtsc()
+#define PROFILE_CLOCK_UNIT "cycles"
+#else
+#define PROFILE_CLOCK() profile_clock_ns()
+#define PROFILE_CLOCK_UNIT "ns"
+#endif
+
 /* Function declarations */
 JVM* jvm_create(void);
 void jvm_destroy(JVM* jvm);
 int jvm_execute(JVM* jvm, uint8_t* bytecode, int length);
-void jvm_push(JVM* jvm, Value value);
-Value jvm_pop(JVM* jvm);
+int jvm_execute_raw(JVM* jvm, uint8_t* bytecode, int length);
+int jvm_execute_method(JVM* jvm, Method* method);  /* Arguments on jvm->stack */
+#ifdef JVM_GREEN_THREADS
+int jvm_execute_thread(JVM* jvm, GreenThread* thread);  /* Start or resume for a slice */
+#endif
+int jvm_push(JVM* jvm, Value value);      /* -1 on overflow */
+int jvm_pop(JVM* jvm, Value* value);      /* -1 on underflow */
+int jvm_push_long(JVM* jvm, int64_t value);
+int64_t jvm_result_long(const JVM* jvm);
+#ifdef JVM_FLOAT
+int jvm_push_double(JVM* jvm, double value);
+double jvm_result_double(const JVM* jvm);
+#endif
 void jvm_print_stack(JVM* jvm);
 void jvm_set_debug(JVM* jvm, int debug);  /* Enable/disable debug mode */
+void jvm_set_verbose(JVM* jvm, int verbose);
+void jvm_reset(JVM* jvm);
+
+/* Pool of reusable JVM instances, safe to share between threads (pool.c) */
+typedef struct JVMPool JVMPool;
+JVMPool* jvm_pool_create(int size);
+void jvm_pool_destroy(JVMPool* pool);
+JVM* jvm_pool_acquire(JVMPool* pool);
+void jvm_pool_release(JVMPool* pool, JVM* jvm);
+void jvm_pool_print_stats(JVMPool* pool);
+
+#ifdef JVM_GREEN_THREADS
+/* Green threads (sched.c) */
+Scheduler* scheduler_create(JVM* jvm, int budget);
+void scheduler_destroy(Scheduler* scheduler);
+GreenThread* scheduler_spawn(Scheduler* scheduler, const char* name, struct Method* method,
+                             const int* args, int arg_count, int stack_slots, int frames);
+int scheduler_run(Scheduler* scheduler, uint64_t max_ticks);
+int scheduler_run_parallel(Scheduler* scheduler, int workers);
+int scheduler_refill_tlab(Scheduler* scheduler, GreenThread* thread, uint32_t bytes);
+void scheduler_print_stats(const Scheduler* scheduler);
+#endif
+
+/* Parallel batch execution on worker threads (batch.c) */
+#define BATCH_MAX_ARGS 8
+#define BATCH_MAX_THREADS 64
+
+typedef struct {
+    char* path;             /* .class file, or a bytecode file */
+    char* method;           /* Static method of a .class file; NULL otherwise */
+    int args[BATCH_MAX_ARGS];
+    int arg_count;
+} BatchJob;
+
+typedef struct {
+    int status;             /* 0 if the job ran, -1 if it couldn't be loaded
+                               or stopped with a runtime error */
+    int result;             /* What the method returned */
+    uint64_t latency_ns;    /* Loading on a worker's first use included */
+    uint64_t instructions;  /* Bytecodes executed */
+    int worker;             /* Thread that ran it */
+} BatchResult;
+
+typedef struct {
+    int jobs;
+    int failed;
+    int threads;
+    uint64_t wall_ns;
+    uint64_t instructions;
+    uint64_t steals;        /* Ranges of jobs moved between workers */
+    uint64_t latency_p50_ns;
+    uint64_t latency_p90_ns;
+    uint64_t latency_p99_ns;
+    uint64_t latency_max_ns;
+} BatchStats;
+
+int batch_run(const BatchJob* jobs, int count, int threads, BatchResult* results,
+              BatchStats* stats);
+void batch_print_stats(const BatchStats* stats);
+int batch_read_jobs(const char* path, BatchJob** jobs, int* count);
+void batch_free_jobs(BatchJob* jobs, int count);
+
+/* Object heap and garbage collector (heap.c) */
+int32_t heap_alloc(JVM* jvm, uint32_t words, uint32_t type);
+void jvm_gc(JVM* jvm);
+void heap_release_monitors(JVM* jvm, Monitors* monitors);
+#ifdef JVM_GREEN_THREADS
+int32_t heap_alloc_tlab(JVM* jvm, GreenThread* thread, uint32_t words, uint32_t type);
+int heap_refill_tlab(JVM* jvm, GreenThread* thread, uint32_t bytes, uint32_t size);
+void heap_retire_tlab(JVM* jvm, GreenThread* thread);
+#endif
+int jvm_set_heap_limit(JVM* jvm, int bytes);
+void jvm_print_gc_stats(const JVM* jvm);
+
+/* Execution profiler (profile.c, interp_profile.c) */
+int jvm_set_profile(JVM* jvm, int mode);    /* 0 turns profiling off */
+int jvm_set_profile_output(JVM* jvm, const char* path);
+void jvm_profile_report(const JVM* jvm, FILE* out);
+int jvm_profile_write(const JVM* jvm, const char* path);  /* .csv or .json */
+MethodProfile* profile_method(Profile* profile, const Method* method);
+void profile_free(Profile* profile);
+uint64_t profile_clock_ns(void);
+
+/* Sampling profiler (sampler.c) */
+int jvm_set_sampling(JVM* jvm, int hz);     /* 0 stops and drops the samples */
+int jvm_set_sampling_output(JVM* jvm, const char* path);
+uint64_t jvm_sample_count(const JVM* jvm);
+void jvm_sampling_report(const JVM* jvm, FILE* out);
+int jvm_sampling_write(const JVM* jvm, const char* path);  /* Folded stacks */
+void sampler_finish(JVM* jvm);    /* Stop, report, write the output, free */
+void sampler_free(struct Sampler* sampler);
+#ifdef JVM_PROFILER
+int jvm_execute_method_profiled(JVM* jvm, Method* method);
+#ifdef JVM_GREEN_THREADS
+int jvm_execute_thread_profiled(JVM* jvm, GreenThread* thread);
+#endif
+#endif
+
+/* Pre-decoding (decoder.c) */
+int decode_bytecode(uint8_t* code, int length, const ExceptionHandler* handlers,
+                    int handler_count, DecodedCode* decoded);
+void decoded_free(DecodedCode* decoded);
+void decoded_dump(const DecodedCode* decoded);
+const char* insn_name(int op);
+int insn_base_op(int op);
+int insn_bytecodes(int op);
+void fuse_superinstructions(DecodedCode* decoded);
+int switch_case(const SwitchTable* table, int32_t key);
+
+/* Method preparation: decode and verify once, before the first call */
+int method_prepare(Method* method);
+void method_release(Method* method);
+int method_link(Method* method);    /* Resolve every call it can reach */
+
+/* Tiered execution (tier.c) */
+void tier_init(TierStats* tiers);
+void tier_promote(JVM* jvm, Method* method, int on_stack);
+int method_optimize(Method* method);
+int jvm_set_tier_threshold(JVM* jvm, int tier, uint32_t invocations, uint32_t backedges);
+const char* tier_name(int tier);
+void jvm_print_tier_stats(const JVM* jvm);
+
+/* Classes (class.c) */
+Class* class_create(const char* name);
+void class_destroy(Class* cls);
+Class* class_by_id(uint32_t id);
+int class_set_super(Class* cls, const char* name);
+int class_add_interface(Class* cls, const char* name);
+void class_set_interface(Class* cls);
+Method* class_define_method(Class* cls, int access_flags, const char* name,
+                            const char* descriptor, uint8_t* code, int code_length);
+Method* class_add_method(Class* cls, const char* name, const char* descriptor,
+                         uint8_t* code, int code_length);
+Method* class_add_instance_method(Class* cls, const char* name, const char* descriptor,
+                                  uint8_t* code, int code_length);
+Method* class_add_abstract_method(Class* cls, const char* name, const char* descriptor);
+Method* class_add_native_method(Class* cls, const char* name, const char* descriptor,
+                                NativeFunction native);
+int method_add_exception_handler(Method* method, int start_pc, int end_pc, int handler_pc,
+                                 int catch_type);
+int class_add_method_ref(Class* cls, const char* name, const char* descriptor);
+int class_add_external_method_ref(Class* cls, const char* class_name, const char* name,
+                                  const char* descriptor);
+int class_add_interface_method_ref(Class* cls, const char* class_name, const char* name,
+                                   const char* descriptor);
+int class_add_field(Class* cls, const char* name, const char* descriptor);
+int class_add_field_ref(Class* cls, const char* name, const char* descriptor);
+int class_add_class_ref(Class* cls, const char* name);
+int class_add_long_constant(Class* cls, int64_t value);
+int class_add_string_constant(Class* cls, const char* text);
+#ifdef JVM_FLOAT
+int class_add_float_constant(Class* cls, float value);
+int class_add_double_constant(Class* cls, double value);
+#endif
+int class_link(Class* cls);
+int class_is_subtype(const Class* cls, const Class* of);
+Field* class_find_field(Class* cls, const char* name, const char* descriptor);
+Method* class_find_method(Class* cls, const char* name, const char* descriptor);
+Method* class_resolve_method(Class* cls, const char* name, const char* descriptor);
+Method* class_select_method(const Class* cls, Method* declared);
+ClassRegistry* class_registry_create(void);
+void class_registry_destroy(ClassRegistry* registry);
+int class_registry_add(ClassRegistry* registry, Class* cls);
+Class* class_registry_find(const ClassRegistry* registry, const char* name);
+Class* class_find(const Class* from, const char* name);
+Class* class_system(const char* name);
+int class_resolve_constant(Class* cls, int index);
+int parse_descriptor(const char* descriptor, int* arg_slots, int* return_slots);
+
+/* Strings (string.c) */
+#define STRING_CLASS "java/lang/String"
+#define STRING_BUILDER_CLASS "java/lang/StringBuilder"
+#define STRING_INDEX_EXCEPTION "java/lang/StringIndexOutOfBoundsException"
+int string_define_classes(ClassRegistry* registry);
+int string_decode_constant(Constant* constant, const char* text);
+int32_t string_find(JVM* jvm, const Constant* constant);
+int32_t string_intern_constant(NativeCall* call, const Constant* constant);
+int jvm_string_text(const JVM* jvm, int32_t ref, char* buffer, int size);
+
+/* Java class files (classfile.c) */
+Class* class_parse(uint8_t* data, size_t length);
+Class* class_load_file(const char* filename);
+
+/* Startup snapshots of linked, verified classes (snapshot.c) */
+int snapshot_write(const char* filename, ClassRegistry* registry);
+ClassRegistry* snapshot_load(const char* filename);
+void snapshot_unmap(ClassRegistry* registry);
+int snapshot_owns(const ClassRegistry* registry, const void* p);
+
+/* Lazy method loading from a container file (bytecode_loader.c) */
+Method* container_load_method(Class* cls, const char* name, const char* descriptor);
+
+/* Bytecode verification (verifier.c) */
+int verify_method(Method* method);
+
+/* Baseline JIT (jit.c) */
+#ifdef JVM_JIT
+int jit_compile(Method* method);
+int jit_run(Method* method, int index, Value* locals, uint64_t* executed);
+void jit_free(Method* method);
+#endif
+
+/* Ahead-of-time translation to C (aot.c) */
+void aot_begin(FILE* out, const char* source);
+int aot_translate_method(FILE* out, Method* method);
+int aot_translate_class(FILE* out, Class* cls);
+int aot_translate_code(FILE* out, const char* name, uint8_t* code, int length);
+int aot_function_name(const Method* method, char* buffer, int size);
 
 /* Utility functions */
 int16_t read_int16(uint8_t* code, int* pc);
@@ -1,55 +1,8 @@
+#define _POSIX_C_SOURCE 200809L
 #include "jvm.h"
-
-/* Simple test programs written as bytecode arrays */
-
-/* Test 1: Simple arithmetic - compute 5 + 3 * 2 */
-uint8_t test_arithmetic[] = {
-    OP_ICONST_5,    /* Push 5 */
-    OP_ICONST_3,    /* Push 3 */
-    OP_ICONST_2,    /* Push 2 */
-    OP_IMUL,        /* 3 * 2 = 6 */
-    OP_IADD,        /* 5 + 6 = 11 */
-    OP_IRETURN      /* Return 11 */
-};
-
-/* Test 2: Local variables - store and load */
-uint8_t test_locals[] = {
-    OP_BIPUSH, 42,      /* Push 42 */
-    OP_ISTORE_0,        /* Store in local 0 */
-    OP_BIPUSH, 10,      /* Push 10 */
-    OP_ISTORE_1,        /* Store in local 1 */
-    OP_ILOAD_0,         /* Load local 0 (42) */
-    OP_ILOAD_1,         /* Load local 1 (10) */
-    OP_IADD,            /* 42 + 10 = 52 */
-    OP_IRETURN          /* Return 52 */
-};
-
-/* Test 3: Conditional branch - simple if statement */
-uint8_t test_branch[] = {
-    OP_BIPUSH, 10,      /* Push 10 */
-    OP_BIPUSH, 5,       /* Push 5 */
-    OP_IF_ICMPGT, 0, 6, /* If 10 > 5, jump +6 bytes */
-    OP_ICONST_0,        /* Push 0 (false case) */
-    OP_GOTO, 0, 3,      /* Jump over true case */
-    OP_ICONST_1,        /* Push 1 (true case) */
-    OP_IRETURN          /* Return result */
-};
-
-/* Test 4: Simple counting - just count to 3 and return */
-uint8_t test_loop[] = {
-    OP_ICONST_1,        /* counter = 1 */
-    OP_ISTORE_0,        /* store in local 0 */
-    OP_ILOAD_0,         /* load counter */
-    OP_ICONST_1,        /* add 1 */
-    OP_IADD,            
-    OP_ISTORE_0,        /* counter = 2 */
-    OP_ILOAD_0,         /* load counter */
-    OP_ICONST_1,        /* add 1 */
-    OP_IADD,            
-    OP_ISTORE_0,        /* counter = 3 */
-    OP_ILOAD_0,         /* load final value */
-    OP_IRETURN          /* return 3 */
-};
+#include "bytecode_loader.h"
+#include "test_programs.h"
+#include <pthread.h>
 
 /* Test runner function */
 void run_test(const char* name, uint8_t* bytecode, int length) {
@@ -68,6 +21,1001 @@ void run_test(const char* name, uint8_t* bytecode, int length) {
     jvm_destroy(jvm);
 }
 
+/* Run Integer.MIN_VALUE / -1 and % -1 pre-decoded and on the raw
+ * bytecode loop, which must both wrap rather than trap */
+void run_divide_overflow_test(void) {
+    JVM* jvm = jvm_create();
+    int decoded, raw;
+
+    printf("\n=== Running test: MIN_VALUE / -1 + MIN_VALUE %% -1 (expect -2147483648) ===\n");
+    if (!jvm) {
+        printf("Failed to create JVM\n");
+        return;
+    }
+    decoded = jvm_execute(jvm, test_divide_overflow, test_divide_overflow_length);
+    raw = jvm_execute_raw(jvm, test_divide_overflow, test_divide_overflow_length);
+    printf("Test result: %d, %d on the raw bytecode loop\n", decoded, raw);
+    jvm_destroy(jvm);
+}
+
+/* Test runner for a static method of a class, called with int arguments */
+void run_method_test(const char* name, Class* cls, const char* method_name,
+                     int* args, int arg_count) {
+    printf("\n=== Running test: %s ===\n", name);
+    
+    Method* method = class_find_method(cls, method_name, NULL);
+    if (!method || method_prepare(method) != 0) {
+        printf("Cannot run %s.%s\n", cls->name, method_name);
+        return;
+    }
+    
+    JVM* jvm = jvm_create();
+    if (!jvm) {
+        printf("Failed to create JVM\n");
+        return;
+    }
+    
+    for (int i = 0; i < arg_count; i++) {
+        Value v = {args[i]};
+        jvm_push(jvm, v);
+    }
+    
+    printf("Executing %s.%s...\n", cls->name, method_name);
+    int result = jvm_execute_method(jvm, method);
+    printf("Test result: %d (%llu calls)\n", result, (unsigned long long)jvm->calls);
+    
+    jvm_destroy(jvm);
+}
+
+/* Run a static int method that allocates, within a heap budget of
+ * heap_limit bytes, and report what the collector did */
+void run_heap_test(const char* name, Class* cls, const char* method_name,
+                   int* args, int arg_count, int heap_limit) {
+    printf("\n=== Running test: %s ===\n", name);
+    
+    Method* method = class_find_method(cls, method_name, NULL);
+    if (!method || method_prepare(method) != 0) {
+        printf("Cannot run %s.%s\n", cls->name, method_name);
+        return;
+    }
+    
+    JVM* jvm = jvm_create();
+    if (!jvm) {
+        printf("Failed to create JVM\n");
+        return;
+    }
+    if (jvm_set_heap_limit(jvm, heap_limit) != 0) {
+        jvm_destroy(jvm);
+        return;
+    }
+    
+    for (int i = 0; i < arg_count; i++) {
+        Value v = {args[i]};
+        jvm_push(jvm, v);
+    }
+    
+    jvm_set_verbose(jvm, 0);
+    printf("Executing %s.%s with a %d byte heap...\n", cls->name, method_name, heap_limit);
+    int result = jvm_execute_method(jvm, method);
+    printf("Test result: %d\n", result);
+    jvm_print_gc_stats(jvm);
+    
+    jvm_destroy(jvm);
+}
+
+/* Run fib(10) on the profiling interpreter. The report is printed when
+ * the JVM is destroyed; the opcode counts must add up to the bytecodes
+ * the JVM says it ran. */
+void run_profile_test(Class* recursion) {
+    Method* fib = class_find_method(recursion, "fib", "(I)I");
+    JVM* jvm;
+    uint64_t counted = 0;
+    Value v = {10};
+    
+    printf("\n=== Running test: Profiled fib(10) ===\n");
+    if (!fib || method_prepare(fib) != 0) {
+        printf("Cannot run fib\n");
+        return;
+    }
+    jvm = jvm_create();
+    if (!jvm) {
+        printf("Failed to create JVM\n");
+        return;
+    }
+    if (jvm_set_profile(jvm, PROFILE_COUNTS) != 0) {
+        jvm_destroy(jvm);
+        return;
+    }
+    
+    jvm_set_verbose(jvm, 0);
+    jvm_push(jvm, v);
+    int result = jvm_execute_method(jvm, fib);
+    for (int op = 0; op < INSN_COUNT; op++) {
+        if (op != INSN_END) {
+            counted += jvm->profile->op_count[op] * (uint64_t)insn_bytecodes(op);
+        }
+    }
+    printf("Test result: %d (%llu of %llu instructions counted)\n", result,
+           (unsigned long long)counted, (unsigned long long)jvm->instructions);
+    
+    jvm_destroy(jvm);
+}
+
+/* Sample fib(20) at 1 kHz until enough samples are in. Every stack must
+ * start at fib, and the folded stacks must add up to the samples taken. */
+#define SAMPLER_TEST_SAMPLES 50
+#define SAMPLER_TEST_RUNS 20000
+
+void run_sampler_test(Class* recursion) {
+    const char* path = "recursion.folded";
+    Method* fib = class_find_method(recursion, "fib", "(I)I");
+    JVM* jvm;
+    FILE* in;
+    char line[1024];
+    uint64_t folded = 0;
+    int result = 0, runs = 0, lines = 0, rooted = 0;
+
+    printf("\n=== Running test: Sampled fib(20) ===\n");
+    if (!fib || method_prepare(fib) != 0) {
+        printf("Cannot run fib\n");
+        return;
+    }
+    jvm = jvm_create();
+    if (!jvm) {
+        printf("Failed to create JVM\n");
+        return;
+    }
+    if (jvm_set_sampling(jvm, 1000) != 0) {
+        jvm_destroy(jvm);
+        return;
+    }
+
+    jvm_set_verbose(jvm, 0);
+    while (runs < SAMPLER_TEST_RUNS && jvm_sample_count(jvm) < SAMPLER_TEST_SAMPLES) {
+        Value v = {20};
+        jvm_push(jvm, v);
+        result = jvm_execute_method(jvm, fib);
+        runs++;
+    }
+    if (jvm_sampling_write(jvm, path) != 0 || !(in = fopen(path, "r"))) {
+        jvm_destroy(jvm);
+        remove(path);
+        return;
+    }
+    while (fgets(line, sizeof(line), in)) {
+        const char* count = strrchr(line, ' ');
+        lines++;
+        rooted += strncmp(line, "Recursion.fib", 13) == 0;
+        folded += count ? strtoull(count + 1, NULL, 10) : 0;
+    }
+    fclose(in);
+    remove(path);
+
+    if (lines > 0 && rooted == lines && folded == jvm_sample_count(jvm)) {
+        printf("Test result: %d (every sampled stack starts at fib, folded counts add up)\n",
+               result);
+    } else {
+        printf("Test result: %d (%llu samples in %d runs, %d of %d stacks at fib, %llu folded)\n",
+               result, (unsigned long long)jvm_sample_count(jvm), runs, rooted, lines,
+               (unsigned long long)folded);
+    }
+    jvm_destroy(jvm);
+}
+
+/* Run the superinstruction test as top-level code twice: optimized on its
+ * first call, then with a back-edge threshold its loop reaches, so that it
+ * is optimized on the stack. Then fib(15) on the same JVM, which its calls
+ * promote. */
+void run_tier_test(void) {
+    Class* recursion = test_recursion_class();
+    Method* fib = recursion ? class_find_method(recursion, "fib", "(I)I") : NULL;
+    JVM* jvm;
+    Value v = {15};
+    
+    printf("\n=== Running test: Tiered Execution, main loop and fib(15) ===\n");
+    if (!fib || method_prepare(fib) != 0) {
+        printf("Cannot run fib\n");
+        class_destroy(recursion);
+        return;
+    }
+    jvm = jvm_create();
+    if (!jvm) {
+        printf("Failed to create JVM\n");
+        class_destroy(recursion);
+        return;
+    }
+    
+    jvm_set_verbose(jvm, 0);
+    jvm_set_tier_threshold(jvm, TIER_OPTIMIZED, 1, OPTIMIZE_BACKEDGE_THRESHOLD);
+    int entered = jvm_execute(jvm, test_fused, test_fused_length);
+    jvm_set_tier_threshold(jvm, TIER_OPTIMIZED, OPTIMIZE_INVOKE_THRESHOLD, 5);
+    int replaced = jvm_execute(jvm, test_fused, test_fused_length);
+    int on_stack = jvm->tiers.on_stack[TIER_OPTIMIZED] == 1;
+    jvm_set_tier_threshold(jvm, TIER_OPTIMIZED, OPTIMIZE_INVOKE_THRESHOLD,
+                           OPTIMIZE_BACKEDGE_THRESHOLD);
+    jvm_push(jvm, v);
+    int result = jvm_execute_method(jvm, fib);
+    printf("Test result: %d, %d, %d (main loop %s, fib %s)\n", entered, replaced, result,
+           on_stack ? "optimized on the stack" : "NOT PROMOTED", tier_name(fib->tier));
+    jvm_print_tier_stats(jvm);
+    
+    jvm_destroy(jvm);
+    class_destroy(recursion);
+}
+
+/* Make a fresh directory under $TMPDIR, or /tmp, for the files a test
+ * writes, so none are left in the working directory. Returns 0 or -1. */
+static int make_temp_dir(char* dir, size_t size) {
+    const char* base = getenv("TMPDIR");
+    if (!base || !*base) {
+        base = "/tmp";
+    }
+    if (snprintf(dir, size, "%s/aruvijvm-XXXXXX", base) >= (int)size || !mkdtemp(dir)) {
+        printf("Cannot create a temporary directory\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* Nonzero if container_check refuses a class, as it must any class with
+ * constants other than Methodrefs to its own methods, or methods that are
+ * not static. Appends the reason to refusals. */
+static int container_refuses(Class* cls, char* refusals, size_t size) {
+    char reason[160];
+    size_t used = strlen(refusals);
+    int refused = cls && container_check(cls, reason, sizeof(reason)) != 0;
+    if (refused) {
+        snprintf(refusals + used, size - used, "%s%s", used > 0 ? "; " : "", reason);
+    }
+    class_destroy(cls);
+    return refused;
+}
+
+/* Write the Recursion class to a container file, map it back and call fib
+ * from it. Methods are loaded on first use, so only fib should be. Counter,
+ * with a Class and a Fieldref constant, Numeric, with Long constants, and
+ * Base, with an instance method, can't be written. */
+void run_container_test(Class* recursion) {
+    char dir[256], path[300];
+    char refusals[512] = "";
+    Container container;
+    Class* cls;
+    Method* fib;
+    Class* base = class_create("Base");
+    int refused;
+    
+    printf("\n=== Running test: Container File fib(10) ===\n");
+    if (base && !class_add_instance_method(base, "scale", "(I)I", test_base_scale,
+                                           test_base_scale_length)) {
+        class_destroy(base);
+        base = NULL;
+    }
+    refused = container_refuses(test_counter_class(), refusals, sizeof(refusals)) &&
+              container_refuses(test_numeric_class(), refusals, sizeof(refusals)) &&
+              container_refuses(base, refusals, sizeof(refusals));
+    if (make_temp_dir(dir, sizeof(dir)) != 0) {
+        return;
+    }
+    snprintf(path, sizeof(path), "%s/recursion.aruvi", dir);
+    if (container_write(path, &recursion, 1) != 0 || container_open(path, &container) != 0) {
+        remove(path);
+        remove(dir);
+        return;
+    }
+    
+    cls = container_load_class(&container, "Recursion");
+    fib = cls ? class_find_method(cls, "fib", "(I)I") : NULL;
+    if (fib && method_prepare(fib) == 0) {
+        JVM* jvm = jvm_create();
+        if (jvm) {
+            Value v = {10};
+            jvm_set_verbose(jvm, 0);
+            jvm_push(jvm, v);
+            int result = jvm_execute_method(jvm, fib);
+            printf("Test result: %d (%d of %u methods loaded; Counter, Numeric and Base %s: %s)\n",
+                   result, cls->method_count, container.method_count,
+                   refused ? "refused" : "NOT REFUSED", refusals);
+            jvm_destroy(jvm);
+        }
+    } else {
+        printf("Cannot run fib from %s\n", path);
+    }
+    
+    class_destroy(cls);
+    container_close(&container);
+    remove(path);
+    remove(dir);
+}
+
+/* Push int arguments and run a prepared static method */
+static int call_method(JVM* jvm, Method* method, const int* args, int arg_count) {
+    for (int i = 0; i < arg_count; i++) {
+        Value v = {args[i]};
+        jvm_push(jvm, v);
+    }
+    return jvm_execute_method(jvm, method);
+}
+
+/* Nonzero if any word of the stack, frames or heap is still set */
+static int jvm_dirty(const JVM* jvm) {
+    const unsigned char* bytes[] = {(const unsigned char*)jvm->stack,
+                                    (const unsigned char*)jvm->frames,
+                                    (const unsigned char*)jvm->heap};
+    const size_t sizes[] = {sizeof(jvm->stack), sizeof(jvm->frames), sizeof(jvm->heap)};
+
+    for (int r = 0; r < 3; r++) {
+        for (size_t i = 0; i < sizes[r]; i++) {
+            if (bytes[r][i]) {
+                return 1;
+            }
+        }
+    }
+    return jvm->sp != 0 || jvm->heap_ptr != HEAP_BASE || jvm->instructions != 0 ||
+           jvm->tiers.event_count != 0;
+}
+
+/* Run sieve(1000) on a pooled JVM, give it back and check that the next
+ * checkout gets the same instance, wiped, and can run fib(10) */
+void run_pool_reuse_test(Class* recursion, Class* node) {
+    Method* sieve = class_find_method(node, "sieve", NULL);
+    Method* fib = class_find_method(recursion, "fib", "(I)I");
+    int sieve_args[] = {1000};
+    int fib_args[] = {10};
+    JVMPool* pool;
+    JVM* first;
+    JVM* second;
+    
+    printf("\n=== Running test: JVM Pool Reuse sieve(1000), fib(10) ===\n");
+    if (!sieve || !fib || method_prepare(sieve) != 0 || method_prepare(fib) != 0) {
+        printf("Cannot run sieve and fib\n");
+        return;
+    }
+    pool = jvm_pool_create(1);
+    if (!pool) {
+        printf("Failed to create JVM pool\n");
+        return;
+    }
+    
+    first = jvm_pool_acquire(pool);
+    jvm_set_verbose(first, 0);
+    int primes = call_method(first, sieve, sieve_args, 1);
+    jvm_pool_release(pool, first);
+    
+    second = jvm_pool_acquire(pool);
+    int clean = !jvm_dirty(second);
+    jvm_set_verbose(second, 0);
+    int result = call_method(second, fib, fib_args, 1);
+    printf("Test result: %d after %d (%s instance, %s)\n", result, primes,
+           second == first ? "same" : "new", clean ? "reset clean" : "NOT CLEAN");
+    jvm_pool_release(pool, second);
+    jvm_pool_destroy(pool);
+}
+
+#define POOL_THREADS 4
+#define POOL_RUNS 250
+
+typedef struct {
+    JVMPool* pool;
+    int correct;            /* Runs that returned fib(10) */
+} PoolWorker;
+
+/* Check a JVM out per run. Each thread builds its own class, as methods
+ * keep call counters and JIT state that runs on other threads would share. */
+static void* pool_worker(void* arg) {
+    PoolWorker* worker = (PoolWorker*)arg;
+    Class* recursion = test_recursion_class();
+    Method* fib = recursion ? class_find_method(recursion, "fib", "(I)I") : NULL;
+    int fib_args[] = {10};
+    
+    if (fib && method_prepare(fib) == 0) {
+        for (int i = 0; i < POOL_RUNS; i++) {
+            JVM* jvm = jvm_pool_acquire(worker->pool);
+            if (!jvm) {
+                break;
+            }
+            jvm_set_verbose(jvm, 0);
+            if (call_method(jvm, fib, fib_args, 1) == 55) {
+                worker->correct++;
+            }
+            jvm_pool_release(worker->pool, jvm);
+        }
+    }
+    class_destroy(recursion);
+    return NULL;
+}
+
+/* Share a pool smaller than the number of threads, so checkouts can find
+ * it empty and returns can find it full */
+void run_pool_threads_test(void) {
+    pthread_t threads[POOL_THREADS];
+    PoolWorker workers[POOL_THREADS];
+    JVMPool* pool;
+    int started = 0, correct = 0;
+    
+    printf("\n=== Running test: JVM Pool Shared by %d Threads ===\n", POOL_THREADS);
+    pool = jvm_pool_create(POOL_THREADS / 2);
+    if (!pool) {
+        printf("Failed to create JVM pool\n");
+        return;
+    }
+    for (int t = 0; t < POOL_THREADS; t++) {
+        workers[t].pool = pool;
+        workers[t].correct = 0;
+        if (pthread_create(&threads[t], NULL, pool_worker, &workers[t]) != 0) {
+            break;
+        }
+        started++;
+    }
+    for (int t = 0; t < started; t++) {
+        pthread_join(threads[t], NULL);
+        correct += workers[t].correct;
+    }
+    printf("Test result: %d of %d runs returned fib(10)\n", correct, POOL_THREADS * POOL_RUNS);
+    jvm_pool_print_stats(pool);
+    jvm_pool_destroy(pool);
+}
+
+#define BATCH_TEST_JOBS 200
+
+/* Write three bytecode programs and the Fib class file to a temporary
+ * directory, run a batch of jobs over them on one thread and on four, and
+ * compare the results in order. One job divides by zero, and must be
+ * counted as failed. */
+void run_batch_test(void) {
+    const char* names[] = {"batch_arithmetic.aruvi", "batch_fused.aruvi", "Fib.class",
+                           "batch_failing.aruvi"};
+    char dir[256], files[4][300];
+    BatchJob jobs[BATCH_TEST_JOBS];
+    BatchResult serial[BATCH_TEST_JOBS], parallel[BATCH_TEST_JOBS];
+    BatchStats stats;
+    FILE* out;
+    int matched = 0;
+    
+    printf("\n=== Running test: Batch of %d Jobs on 4 Threads (expect 1 failed) ===\n",
+           BATCH_TEST_JOBS);
+    if (make_temp_dir(dir, sizeof(dir)) != 0) {
+        return;
+    }
+    for (int i = 0; i < 4; i++) {
+        snprintf(files[i], sizeof(files[i]), "%s/%s", dir, names[i]);
+    }
+    out = fopen(files[2], "wb");
+    if (!out || fwrite(test_class_file, 1, test_class_file_length, out) !=
+                    (size_t)test_class_file_length ||
+        save_bytecode_file(files[0], test_arithmetic, test_arithmetic_length) != 0 ||
+        save_bytecode_file(files[1], test_fused, test_fused_length) != 0 ||
+        save_bytecode_file(files[3], test_divide_by_zero, test_divide_by_zero_length) != 0) {
+        printf("Cannot write the batch programs\n");
+        if (out) fclose(out);
+        goto cleanup;
+    }
+    fclose(out);
+    
+    /* Mostly fib(n) for n up to 19, so jobs differ a lot in length */
+    memset(jobs, 0, sizeof(jobs));
+    for (int i = 0; i < BATCH_TEST_JOBS; i++) {
+        if (i % 10 < 2) {
+            jobs[i].path = files[i % 10];
+        } else {
+            jobs[i].path = files[2];
+            jobs[i].method = "fib";
+            jobs[i].args[0] = i % 20;
+            jobs[i].arg_count = 1;
+        }
+    }
+    jobs[BATCH_TEST_JOBS / 2].path = files[3];
+    jobs[BATCH_TEST_JOBS / 2].method = NULL;
+    jobs[BATCH_TEST_JOBS / 2].arg_count = 0;
+    if (batch_run(jobs, BATCH_TEST_JOBS, 1, serial, NULL) == 0 &&
+        batch_run(jobs, BATCH_TEST_JOBS, 4, parallel, &stats) == 0) {
+        for (int i = 0; i < BATCH_TEST_JOBS; i++) {
+            matched += serial[i].status == parallel[i].status &&
+                       (serial[i].status != 0 || serial[i].result == parallel[i].result);
+        }
+        printf("Test result: %d of %d jobs match the single-threaded run, %d failed "
+               "(job 7: fib(7) = %d)\n",
+               matched, BATCH_TEST_JOBS, stats.failed, parallel[7].result);
+        batch_print_stats(&stats);
+    }
+    
+cleanup:
+    for (int i = 0; i < 4; i++) {
+        remove(files[i]);
+    }
+    remove(dir);
+}
+
+/* Run the jobs of a job file and print their results in file order, then
+ * the throughput and latency of the batch */
+int run_batch_file(const char* filename, int threads) {
+    BatchJob* jobs;
+    BatchResult* results;
+    BatchStats stats;
+    int count;
+    
+    if (batch_read_jobs(filename, &jobs, &count) != 0) {
+        return -1;
+    }
+    results = (BatchResult*)malloc(sizeof(BatchResult) * (size_t)count);
+    if (!results || batch_run(jobs, count, threads, results, &stats) != 0) {
+        free(results);
+        batch_free_jobs(jobs, count);
+        return -1;
+    }
+    
+    printf("%5s %11s %10s %6s  %s\n", "job", "result", "us", "worker", "program");
+    for (int i = 0; i < count; i++) {
+        if (results[i].status == 0) {
+            printf("%5d %11d", i, results[i].result);
+        } else {
+            printf("%5d %11s", i, "failed");
+        }
+        printf(" %10.1f %6d  %s", (double)results[i].latency_ns / 1e3, results[i].worker,
+               jobs[i].path);
+        if (jobs[i].method) {
+            printf(" %s", jobs[i].method);
+            for (int a = 0; a < jobs[i].arg_count; a++) {
+                printf(" %d", jobs[i].args[a]);
+            }
+        }
+        printf("\n");
+    }
+    batch_print_stats(&stats);
+    
+    free(results);
+    batch_free_jobs(jobs, count);
+    return stats.failed ? -1 : 0;
+}
+
+#ifdef JVM_GREEN_THREADS
+#define SCHED_TEST_BUDGET 100
+
+/* Spawn the control, crunch and logger tasks on jvm and run them to the
+ * end. Returns the scheduler, or NULL on error. */
+static Scheduler* run_tasks(JVM* jvm, Class* tasks) {
+    static const char* const names[] = {"control", "crunch", "logger"};
+    const int args[][2] = {{20, 200}, {5000, 0}, {50, 0}};
+    const int arg_counts[] = {2, 1, 1};
+    Scheduler* scheduler = scheduler_create(jvm, SCHED_TEST_BUDGET);
+
+    if (!scheduler) {
+        return NULL;
+    }
+    for (int i = 0; i < 3; i++) {
+        Method* method = class_find_method(tasks, names[i], NULL);
+        if (!method || !scheduler_spawn(scheduler, names[i], method, args[i],
+                                        arg_counts[i], 0, 0)) {
+            scheduler_destroy(scheduler);
+            return NULL;
+        }
+    }
+    if (scheduler_run(scheduler, 0) != 0) {
+        scheduler_destroy(scheduler);
+        return NULL;
+    }
+    return scheduler;
+}
+
+/* A control loop that sleeps, a busy loop that never blocks and a logger
+ * that yields, on one JVM. The busy loop is preempted by its budget, so
+ * the control loop's wait stays bounded; a second run on a reset JVM
+ * gives the same schedule tick for tick. */
+void run_scheduler_test(void) {
+    Class* tasks = test_tasks_class();
+    JVM* jvm = jvm_create();
+    Scheduler* first = NULL;
+    Scheduler* second = NULL;
+
+    printf("\n=== Running test: Green Threads control, crunch(5000), logger(50) ===\n");
+    if (tasks && jvm) {
+        jvm_set_verbose(jvm, 0);
+        first = run_tasks(jvm, tasks);
+        jvm_reset(jvm);
+        jvm_set_verbose(jvm, 0);
+        second = run_tasks(jvm, tasks);
+    }
+    if (first && second) {
+        const GreenThread* t = first->threads;
+        int same = first->clock == second->clock && first->switches == second->switches;
+        for (int i = 0; i < first->thread_count; i++) {
+            same = same && t[i].ticks == second->threads[i].ticks &&
+                   t[i].max_wait == second->threads[i].max_wait;
+        }
+        scheduler_print_stats(first);
+        printf("Test result: %d, %d, %d (control waited at most %llu ticks, %s schedule)\n",
+               t[0].result, t[1].result, t[2].result, (unsigned long long)t[0].max_wait,
+               same ? "same" : "DIFFERENT");
+    } else {
+        printf("Cannot run the green thread tasks\n");
+    }
+    scheduler_destroy(first);
+    scheduler_destroy(second);
+    jvm_destroy(jvm);
+    class_destroy(tasks);
+}
+
+#define COUNTER_THREADS 8
+#define COUNTER_ADDS 2000
+
+/* Spawn COUNTER_THREADS adders on one new counter and run them on
+ * workers OS threads, or on this one if workers is 0. Returns the final
+ * count, the largest any thread saw, or -1 on error. */
+static int run_counter(JVM* jvm, Class* counter, int workers, Scheduler** out) {
+    Method* make = class_find_method(counter, "make", NULL);
+    Method* add = class_find_method(counter, "add", NULL);
+    Scheduler* scheduler = scheduler_create(jvm, SCHED_TEST_BUDGET);
+    int args[2];
+    int count = -1;
+
+    *out = scheduler;
+    if (!scheduler || !make || !add || method_prepare(make) != 0) {
+        return -1;
+    }
+    args[0] = jvm_execute_method(jvm, make);
+    args[1] = COUNTER_ADDS;
+    for (int i = 0; i < COUNTER_THREADS; i++) {
+        if (!scheduler_spawn(scheduler, "adder", add, args, 2, 0, 0)) {
+            return -1;
+        }
+    }
+    if ((workers > 0 ? scheduler_run_parallel(scheduler, workers)
+                     : scheduler_run(scheduler, 0)) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < COUNTER_THREADS; i++) {
+        if (scheduler->threads[i].result > count) {
+            count = scheduler->threads[i].result;
+        }
+    }
+    return count;
+}
+
+/* Green threads on 4 worker OS threads, all adding to one counter under
+ * its monitor and allocating garbage while they hold it, so collections
+ * stop the world with the monitor taken. No increment may be lost. */
+void run_parallel_test(void) {
+    Class* counter = test_counter_class();
+    JVM* jvm = jvm_create();
+    Scheduler* parallel = NULL;
+    Scheduler* serial = NULL;
+    int count = -1;
+    int serial_count = -1;
+    uint64_t collections = 0;
+
+    printf("\n=== Running test: %d Green Threads on 4 Workers, Counter.add(%d) ===\n",
+           COUNTER_THREADS, COUNTER_ADDS);
+    if (counter && jvm) {
+        jvm_set_verbose(jvm, 0);
+        count = run_counter(jvm, counter, 4, &parallel);
+        collections = jvm->gc_count;
+        jvm_reset(jvm);
+        jvm_set_verbose(jvm, 0);
+        serial_count = run_counter(jvm, counter, 0, &serial);
+    }
+    if (count >= 0 && serial_count >= 0) {
+        scheduler_print_stats(parallel);
+        printf("Test result: %d, %d on one thread (%s)\n", count, serial_count,
+               collections > 0 ? "collected with the monitor held" : "NO COLLECTION");
+    } else {
+        printf("Cannot run the counter threads\n");
+    }
+    scheduler_destroy(parallel);
+    scheduler_destroy(serial);
+    jvm_destroy(jvm);
+    class_destroy(counter);
+}
+
+#define GARBAGE_THREADS 4
+#define GARBAGE_CALLS 200
+
+/* Green threads whose virtual callee allocates in a 1 KiB heap, so the
+ * collector walks callers stopped in an invokevirtual; green threads
+ * leave its inline cache empty, so the caller's frame is sized from the
+ * call site alone */
+void run_virtual_gc_test(void) {
+    Class* garbage = test_garbage_class();
+    Method* run = garbage ? class_find_method(garbage, "run", "(I)I") : NULL;
+    JVM* jvm = jvm_create();
+    Scheduler* scheduler = NULL;
+    int args[1] = {GARBAGE_CALLS};
+    int ok = 0;
+
+    printf("\n=== Running test: %d Green Threads, Garbage.run(%d) with a 1024 byte heap ===\n",
+           GARBAGE_THREADS, GARBAGE_CALLS);
+    if (run && jvm && jvm_set_heap_limit(jvm, 1024) == 0) {
+        jvm_set_verbose(jvm, 0);
+        scheduler = scheduler_create(jvm, SCHED_TEST_BUDGET);
+        ok = scheduler != NULL;
+        for (int i = 0; ok && i < GARBAGE_THREADS; i++) {
+            ok = scheduler_spawn(scheduler, "garbage", run, args, 1, 0, 0) != NULL;
+        }
+        ok = ok && scheduler_run(scheduler, 0) == 0;
+    }
+    if (ok) {
+        int same = 1;
+        for (int i = 1; i < GARBAGE_THREADS; i++) {
+            same = same && scheduler->threads[i].result == scheduler->threads[0].result;
+        }
+        printf("Test result: %d on every thread%s (%llu collections)\n",
+               scheduler->threads[0].result, same ? "" : " NOT",
+               (unsigned long long)jvm->gc_count);
+    } else {
+        printf("Cannot run the garbage threads\n");
+    }
+    scheduler_destroy(scheduler);
+    jvm_destroy(jvm);
+    class_destroy(garbage);
+}
+#endif
+
+/* Number of constant pool entries that have been resolved */
+static int resolved_constants(const Class* cls) {
+    int count = 0;
+    for (int i = 1; i < cls->constant_count; i++) {
+        count += cls->constants[i].resolved;
+    }
+    return count;
+}
+
+/* Parse the built-in class file, then call fib and big from it */
+void run_class_file_test(void) {
+    uint8_t* data = (uint8_t*)malloc(test_class_file_length);
+    Class* cls;
+    
+    printf("\n=== Running test: Class File Fib.fib(10) + Fib.big() ===\n");
+    if (!data) {
+        return;
+    }
+    memcpy(data, test_class_file, test_class_file_length);
+    cls = class_parse(data, test_class_file_length);
+    if (!cls) {
+        return;
+    }
+    
+    int loaded = resolved_constants(cls);
+    Method* fib = class_find_method(cls, "fib", "(I)I");
+    Method* big = class_find_method(cls, "big", "()I");
+    JVM* jvm = jvm_create();
+    if (fib && big && jvm && method_prepare(fib) == 0 && method_prepare(big) == 0) {
+        Value v = {10};
+        jvm_set_verbose(jvm, 0);
+        jvm_push(jvm, v);
+        int result = jvm_execute_method(jvm, fib);
+        result += jvm_execute_method(jvm, big);
+        printf("Test result: %d (constants resolved: %d after loading, %d after running, of %d)\n",
+               result, loaded, resolved_constants(cls), cls->constant_count - 1);
+    } else {
+        printf("Cannot run methods of class %s\n", cls->name);
+    }
+    
+    if (jvm) jvm_destroy(jvm);
+    class_destroy(cls);
+
+    /* The same class with big() made synchronized, which loads but must
+     * not run without its monitor */
+    printf("\n=== Running test: Class File synchronized Fib.big() (expect rejected) ===\n");
+    data = (uint8_t*)malloc(test_class_file_length);
+    if (!data) {
+        return;
+    }
+    memcpy(data, test_class_file, test_class_file_length);
+    data[test_class_file_big_flags + 1] |= ACC_SYNCHRONIZED;
+    cls = class_parse(data, test_class_file_length);
+    if (!cls) {
+        return;
+    }
+    big = class_find_method(cls, "big", "()I");
+    printf("Test result: %s\n", big && method_prepare(big) != 0 ? "rejected" : "accepted");
+    class_destroy(cls);
+}
+
+/* long, float and double: methods that take and return two-slot values,
+ * called from bytecode and straight through the embedding API */
+void run_numeric_test(void) {
+    Class* cls = test_numeric_class();
+    JVM* jvm;
+    Method* mix;
+    Value i = {7};
+    int64_t mixed;
+
+    if (!cls) {
+        return;
+    }
+    int hash_args[] = {1000};
+    run_method_test("long hash(1000) (expect -1584185376)", cls, "hash", hash_args, 1);
+#ifdef JVM_FLOAT
+    int roots_args[] = {100};
+    int floats_args[] = {11};
+    run_method_test("double roots(100) (expect 671421)", cls, "roots", roots_args, 1);
+    run_method_test("float floats(11) (expect 175)", cls, "floats", floats_args, 1);
+#endif
+
+    printf("\n=== Running test: mix(-1L, 7) Through the API (expect -6364136202997932465) ===\n");
+    mix = class_find_method(cls, "mix", "(JI)J");
+    jvm = jvm_create();
+    if (!mix || !jvm || method_prepare(mix) != 0) {
+        printf("Cannot run %s.mix\n", cls->name);
+        if (jvm) jvm_destroy(jvm);
+        class_destroy(cls);
+        return;
+    }
+    jvm_set_verbose(jvm, 0);
+    jvm_push_long(jvm, INT64_C(-1));
+    jvm_push(jvm, i);
+    jvm_execute_method(jvm, mix);
+    mixed = jvm_result_long(jvm);
+#ifdef JVM_FLOAT
+    {
+        Method* root = class_find_method(cls, "root", "(D)D");
+        if (root && method_prepare(root) == 0) {
+            jvm_push_double(jvm, 2.0);
+            jvm_execute_method(jvm, root);
+            printf("root(2.0) = %.15f\n", jvm_result_double(jvm));
+        }
+    }
+#endif
+    printf("Test result: %lld\n", (long long)mixed);
+    jvm_destroy(jvm);
+    class_destroy(cls);
+}
+
+/* Run Lists.run(100) over an ArrayList and a LinkedList. Sites that only
+ * ever see one class miss their inline cache once; total() and sum() see
+ * both lists and keep missing on the second. */
+void run_dispatch_test(void) {
+    ClassRegistry* registry = test_lists_registry();
+    Class* lists = registry ? class_registry_find(registry, "Lists") : NULL;
+    Method* run = lists ? class_find_method(lists, "run", "(I)I") : NULL;
+    JVM* jvm;
+
+    printf("\n=== Running test: invokevirtual and invokeinterface run(100) (expect 19800) ===\n");
+    if (!run || method_prepare(run) != 0) {
+        printf("Cannot run Lists.run\n");
+        class_registry_destroy(registry);
+        return;
+    }
+    jvm = jvm_create();
+    if (jvm) {
+        Value v = {100};
+        jvm_set_verbose(jvm, 0);
+        jvm_push(jvm, v);
+        int result = jvm_execute_method(jvm, run);
+        printf("Test result: %d (%llu inline cache misses in %llu calls)\n", result,
+               (unsigned long long)jvm->inline_cache_misses, (unsigned long long)jvm->calls);
+        jvm_destroy(jvm);
+    }
+    class_registry_destroy(registry);
+}
+
+/* Run Exceptions.run(100), whose callees raise and catch an exception of
+ * every kind the interpreter throws, then guard(-1), which rethrows a
+ * BadInput nobody catches */
+void run_exception_test(void) {
+    ClassRegistry* registry = test_exceptions_registry();
+    Class* exceptions = registry ? class_registry_find(registry, "Exceptions") : NULL;
+    Method* run = exceptions ? class_find_method(exceptions, "run", "(I)I") : NULL;
+    Method* guard = exceptions ? class_find_method(exceptions, "guard", "(I)I") : NULL;
+    JVM* jvm;
+
+    printf("\n=== Running test: exception handlers run(100) (expect 5481) ===\n");
+    if (!run || !guard || method_prepare(run) != 0 || method_prepare(guard) != 0) {
+        printf("Cannot run Exceptions.run\n");
+        class_registry_destroy(registry);
+        return;
+    }
+    jvm = jvm_create();
+    if (jvm) {
+        Value v = {100};
+        Value bad = {-1};
+        int result, uncaught;
+        jvm_set_verbose(jvm, 0);
+        jvm_push(jvm, v);
+        result = jvm_execute_method(jvm, run);
+        jvm_push(jvm, bad);
+        uncaught = jvm_execute_method(jvm, guard);
+        printf("Test result: %d (guard(-1) uncaught: %d)\n", result, uncaught);
+        jvm_destroy(jvm);
+    }
+    class_registry_destroy(registry);
+}
+
+/* Run Strings.run(200), which builds labels under GC in a loop and
+ * compares and interns them, then label(42), whose text is read back */
+void run_string_test(void) {
+    ClassRegistry* registry = test_strings_registry();
+    Class* strings = registry ? class_registry_find(registry, "Strings") : NULL;
+    Method* run = strings ? class_find_method(strings, "run", "(I)I") : NULL;
+    Method* label = strings ? class_find_method(strings, "label", "(I)Ljava/lang/String;") : NULL;
+    JVM* jvm;
+
+    printf("\n=== Running test: strings run(200) (expect 99205120) ===\n");
+    if (!run || !label || method_prepare(run) != 0 || method_prepare(label) != 0) {
+        printf("Cannot run Strings.run\n");
+        class_registry_destroy(registry);
+        return;
+    }
+    jvm = jvm_create();
+    if (jvm) {
+        Value n = {200};
+        Value i = {42};
+        char text[32];
+        int result;
+        jvm_set_verbose(jvm, 0);
+        jvm_push(jvm, n);
+        result = jvm_execute_method(jvm, run);
+        jvm_push(jvm, i);
+        if (jvm_string_text(jvm, jvm_execute_method(jvm, label), text, sizeof(text)) < 0) {
+            strcpy(text, "?");
+        }
+        printf("Test result: %d (label(42): %s, %llu collections)\n", result, text,
+               (unsigned long long)jvm->gc_count);
+        jvm_destroy(jvm);
+    }
+    class_registry_destroy(registry);
+}
+
+/* Write a snapshot of a test registry, which is destroyed, load it back
+ * and run a static int method of it with one argument. Counts the classes
+ * and methods loaded, and those that came back verified. */
+static int run_from_snapshot(ClassRegistry* registry, const char* class_name,
+                             const char* method_name, int arg, int* classes, int* prepared) {
+    const char* path = "test.snapshot";
+    Class* cls;
+    Method* method;
+    JVM* jvm;
+    int result = -1;
+
+    if (!registry || snapshot_write(path, registry) != 0) {
+        class_registry_destroy(registry);
+        remove(path);
+        return -1;
+    }
+    class_registry_destroy(registry);
+    registry = snapshot_load(path);
+    remove(path);
+    if (!registry) {
+        return -1;
+    }
+    for (int c = 0; c < registry->count; c++) {
+        for (int i = 0; i < registry->classes[c]->method_count; i++) {
+            *prepared += registry->classes[c]->methods[i].prepared;
+        }
+    }
+    *classes += registry->count;
+
+    cls = class_registry_find(registry, class_name);
+    method = cls ? class_find_method(cls, method_name, "(I)I") : NULL;
+    jvm = jvm_create();
+    if (method && jvm) {
+        Value v = {arg};
+        jvm_set_verbose(jvm, 0);
+        jvm_push(jvm, v);
+        result = jvm_execute_method(jvm, method);
+    }
+    if (jvm) jvm_destroy(jvm);
+    class_registry_destroy(registry);
+    return result;
+}
+
+/* Run the dispatch, exception, string and switch tests from snapshots of
+ * their classes, which come back linked, verified and with their calls
+ * and switch tables resolved */
+void run_snapshot_test(void) {
+    int classes = 0, prepared = 0;
+    int lists, exceptions, strings, switches;
+
+    printf("\n=== Running test: Startup Snapshots (expect 19800, 5481, 99205120, 28271) ===\n");
+    lists = run_from_snapshot(test_lists_registry(), "Lists", "run", 100, &classes, &prepared);
+    exceptions = run_from_snapshot(test_exceptions_registry(), "Exceptions", "run", 100,
+                                   &classes, &prepared);
+    strings = run_from_snapshot(test_strings_registry(), "Strings", "run", 200, &classes,
+                                &prepared);
+    switches = run_from_snapshot(test_switches_registry(), "Switches", "run", 100, &classes,
+                                 &prepared);
+    printf("Test result: %d, %d, %d, %d (%d classes, %d methods loaded ready to run)\n", lists,
+           exceptions, strings, switches, classes, prepared);
+}
+
 /* Bytecode disassembler for debugging */
 void disassemble(uint8_t* bytecode, int length) {
     printf("\nBytecode disassembly:\n");
@@ -116,6 +1064,12 @@ void disassemble(uint8_t* bytecode, int length) {
             case OP_IDIV: printf("idiv\n"); break;
             case OP_IREM: printf("irem\n"); break;
             case OP_INEG: printf("ineg\n"); break;
+            case OP_IINC:
+                if (pc + 1 < length) {
+                    printf("iinc %d %d\n", bytecode[pc], (int8_t)bytecode[pc + 1]);
+                    pc += 2;
+                }
+                break;
             case OP_IF_ICMPEQ:
                 if (pc + 1 < length) {
                     int16_t offset = (int16_t)((bytecode[pc] << 8) | bytecode[pc + 1]);
@@ -165,8 +1119,59 @@ void disassemble(uint8_t* bytecode, int length) {
                     printf("goto %d\n", offset);
                 }
                 break;
+            case OP_TABLESWITCH:
+            case OP_LOOKUPSWITCH: {
+                /* Operands start at the next multiple of four; offsets are
+                 * from the switch itself */
+                int base = pc - 1;
+                int32_t default_offset, low, high, pairs;
+                pc = (pc + 3) & ~3;
+                if (op == OP_TABLESWITCH) {
+                    if (pc + 12 > length) {
+                        pc = length;
+                        break;
+                    }
+                    default_offset = read_int32(bytecode, &pc);
+                    low = read_int32(bytecode, &pc);
+                    high = read_int32(bytecode, &pc);
+                    printf("tableswitch %d..%d default %d\n", low, high, default_offset);
+                    for (int64_t key = low; key <= high && pc + 4 <= length; key++) {
+                        printf("%04x:     %lld: %d\n", base, (long long)key, read_int32(bytecode, &pc));
+                    }
+                } else {
+                    if (pc + 8 > length) {
+                        pc = length;
+                        break;
+                    }
+                    default_offset = read_int32(bytecode, &pc);
+                    pairs = read_int32(bytecode, &pc);
+                    printf("lookupswitch %d pairs default %d\n", pairs, default_offset);
+                    for (int i = 0; i < pairs && pc + 8 <= length; i++) {
+                        int32_t key = read_int32(bytecode, &pc);
+                        printf("%04x:     %d: %d\n", base, key, read_int32(bytecode, &pc));
+                    }
+                }
+                break;
+            }
+            case OP_LDC:
+                if (pc < length) printf("ldc #%d\n", bytecode[pc++]);
+                break;
+            case OP_LDC_W:
+                if (pc + 1 < length) {
+                    int index = (bytecode[pc] << 8) | bytecode[pc + 1];
+                    pc += 2;
+                    printf("ldc_w #%d\n", index);
+                }
+                break;
             case OP_IRETURN: printf("ireturn\n"); break;
             case OP_RETURN: printf("return\n"); break;
+            case OP_INVOKESTATIC:
+                if (pc + 1 < length) {
+                    int index = (bytecode[pc] << 8) | bytecode[pc + 1];
+                    pc += 2;
+                    printf("invokestatic #%d\n", index);
+                }
+                break;
             case OP_HALT: printf("halt\n"); break;
             default: printf("unknown_opcode 0x%02x\n", op); break;
         }
@@ -174,19 +1179,416 @@ void disassemble(uint8_t* bytecode, int length) {
     printf("\n");
 }
 
-int main() {
+/* Translate a .aruvi bytecode file to a C function named after the file */
+int aot_file(const char* input, const char* output) {
+    char name[64];
+    const char* base = strrchr(input, '/');
+    uint8_t* bytecode;
+    int length, status;
+    size_t n;
+    FILE* out;
+
+    base = base ? base + 1 : input;
+    n = strcspn(base, ".");
+    if (n >= sizeof(name)) {
+        n = sizeof(name) - 1;
+    }
+    memcpy(name, base, n);
+    name[n] = '\0';
+
+    if (load_bytecode_file(input, &bytecode, &length) != 0) {
+        return -1;
+    }
+    out = fopen(output, "w");
+    if (!out) {
+        printf("Error: Cannot create file %s\n", output);
+        free_bytecode(bytecode);
+        return -1;
+    }
+    aot_begin(out, input);
+    status = aot_translate_code(out, name, bytecode, length);
+    fclose(out);
+    free_bytecode(bytecode);
+    return status;
+}
+
+/*
+ * Translate the built-in test programs to C, followed by a main() that runs
+ * each translation and compares it with the interpreter's result.
+ */
+int aot_tests(const char* output) {
+    struct { const char* name; uint8_t* code; int length; } tests[] = {
+        {"test_arithmetic", test_arithmetic, 0},
+        {"test_locals", test_locals, 0},
+        {"test_branch", test_branch, 0},
+        {"test_loop", test_loop, 0},
+        {"test_fused", test_fused, 0},
+        {"test_switch_state", test_switch_state, 0},
+        {"test_switch_lookup", test_switch_lookup, 0}
+    };
+    int count = (int)(sizeof(tests) / sizeof(tests[0]));
+    int fib_args[] = {20};
+    int ack_args[] = {2, 3};
+    int super_arg = 7;
+    Class* recursion = test_recursion_class();
+    ClassRegistry* supers = test_supers_registry();
+    JVM* jvm = jvm_create();
+    FILE* out = fopen(output, "w");
+    int status = 0;
+
+    tests[0].length = test_arithmetic_length;
+    tests[1].length = test_locals_length;
+    tests[2].length = test_branch_length;
+    tests[3].length = test_loop_length;
+    tests[4].length = test_fused_length;
+    tests[5].length = test_switch_state_length;
+    tests[6].length = test_switch_lookup_length;
+
+    if (!recursion || !supers || !jvm || !out) {
+        printf("Error: cannot set up AOT tests\n");
+        status = -1;
+        goto out;
+    }
+    jvm_set_verbose(jvm, 0);
+
+    aot_begin(out, "the built-in test programs");
+    fprintf(out, "#include <stdio.h>\n");
+    for (int i = 0; i < count && status == 0; i++) {
+        status = aot_translate_code(out, tests[i].name, tests[i].code, tests[i].length);
+    }
+    if (status == 0) {
+        status = aot_translate_class(out, recursion);
+    }
+    /* Base and Derived, whose calls name Base; Supers allocates and stays
+     * on the interpreter */
+    if (status == 0) {
+        status = aot_translate_class(out, class_registry_find(supers, "Base"));
+    }
+    if (status == 0) {
+        status = aot_translate_class(out, class_registry_find(supers, "Derived"));
+    }
+    if (status != 0) {
+        goto out;
+    }
+
+    fprintf(out, "\nstatic int failures;\n");
+    fprintf(out, "\nstatic void check(const char* name, int32_t result, int32_t expected) {\n");
+    fprintf(out, "    printf(\"%%-24s %%10d %%10d  %%s\\n\", name, (int)result, (int)expected,\n");
+    fprintf(out, "           result == expected ? \"ok\" : \"MISMATCH\");\n");
+    fprintf(out, "    failures += result != expected;\n}\n");
+    fprintf(out, "\nint main(void) {\n    int32_t result;\n\n");
+    fprintf(out, "    printf(\"%%-24s %%10s %%10s\\n\", \"program\", \"aot\", \"interpreter\");\n");
+
+    /* Expected values come from running the same code on the interpreter */
+    for (int i = 0; i < count; i++) {
+        int expected = jvm_execute(jvm, tests[i].code, tests[i].length);
+        fprintf(out, "    ARUVI_RUN(result, aruvi_%s());\n", tests[i].name);
+        fprintf(out, "    check(\"%s\", result, %d);\n", tests[i].name, expected);
+    }
+    {
+        Method* fib = class_find_method(recursion, "fib", "(I)I");
+        Method* ack = class_find_method(recursion, "ack", "(II)I");
+        Value v;
+        int expected;
+
+        v.i = fib_args[0];
+        jvm_push(jvm, v);
+        expected = jvm_execute_method(jvm, fib);
+        fprintf(out, "    ARUVI_RUN(result, aruvi_Recursion_fib(%d));\n", fib_args[0]);
+        fprintf(out, "    check(\"fib(%d)\", result, %d);\n", fib_args[0], expected);
+
+        v.i = ack_args[0];
+        jvm_push(jvm, v);
+        v.i = ack_args[1];
+        jvm_push(jvm, v);
+        expected = jvm_execute_method(jvm, ack);
+        fprintf(out, "    ARUVI_RUN(result, aruvi_Recursion_ack(%d, %d));\n", ack_args[0], ack_args[1]);
+        fprintf(out, "    check(\"ack(%d, %d)\", result, %d);\n",
+                ack_args[0], ack_args[1], expected);
+    }
+    {
+        /* Translated code has no heap; Derived.scale ignores its receiver */
+        Method* scale = class_find_method(class_registry_find(supers, "Supers"), "scale", "(I)I");
+        Method* twice = class_find_method(class_registry_find(supers, "Derived"), "twice", "(I)I");
+        Value v = {super_arg};
+        int expected;
+
+        if (!scale || method_prepare(scale) != 0) {
+            status = -1;
+            goto out;
+        }
+        jvm_push(jvm, v);
+        expected = jvm_execute_method(jvm, scale);
+        fprintf(out, "    ARUVI_RUN(result, aruvi_Derived_scale(0, %d));\n", super_arg);
+        fprintf(out, "    check(\"super.scale(%d) + 1\", result, %d);\n", super_arg, expected);
+
+        jvm_push(jvm, v);
+        expected = jvm_execute_method(jvm, twice);
+        fprintf(out, "    ARUVI_RUN(result, aruvi_Derived_twice(%d));\n", super_arg);
+        fprintf(out, "    check(\"Base.twice(%d) + 1\", result, %d);\n", super_arg, expected);
+    }
+    fprintf(out, "\n    printf(\"%%s\\n\", failures ? \"AOT check FAILED\" : \"AOT check passed\");\n");
+    fprintf(out, "    return failures ? 1 : 0;\n}\n");
+
+out:
+    if (out) fclose(out);
+    if (jvm) jvm_destroy(jvm);
+    if (recursion) class_destroy(recursion);
+    class_registry_destroy(supers);
+    return status;
+}
+
+/* How to watch a program run from the command line */
+typedef struct {
+    int profile;                /* 0 or a jvm_set_profile() mode */
+    const char* profile_output; /* Where to write the profile, or NULL */
+    int sample;                 /* Sample at SAMPLE_HZ */
+    const char* sample_output;  /* Where to write the folded stacks, or NULL */
+} RunOptions;
+
+#define SAMPLE_HZ 1000
+
+/* Run a static int method of a class with int arguments */
+static int run_method(Class* cls, const char* method_name, char** args, int arg_count,
+                      const RunOptions* options) {
+    Method* method = class_find_method(cls, method_name, NULL);
+    JVM* jvm;
+    int result;
+
+    if (!method || method_prepare(method) != 0 || method->arg_slots != arg_count) {
+        printf("Cannot run %s.%s with %d arguments\n", cls->name, method_name, arg_count);
+        return -1;
+    }
+    jvm = jvm_create();
+    if (!jvm) {
+        return -1;
+    }
+    if ((options->profile &&
+         (jvm_set_profile(jvm, options->profile) != 0 ||
+          (options->profile_output &&
+           jvm_set_profile_output(jvm, options->profile_output) != 0))) ||
+        (options->sample &&
+         (jvm_set_sampling(jvm, SAMPLE_HZ) != 0 ||
+          (options->sample_output && jvm_set_sampling_output(jvm, options->sample_output) != 0)))) {
+        jvm_destroy(jvm);
+        return -1;
+    }
+    for (int i = 0; i < arg_count; i++) {
+        Value v = {atoi(args[i])};
+        jvm_push(jvm, v);
+    }
+    result = jvm_execute_method(jvm, method);
+    printf("%s.%s returned %d\n", cls->name, method_name, result);
+    jvm_destroy(jvm);
+    return 0;
+}
+
+/* Run a static int method of a .class file */
+int run_class_file(const char* filename, const char* method_name, char** args, int arg_count,
+                   const RunOptions* options) {
+    Class* cls = class_load_file(filename);
+    int status;
+
+    if (!cls) {
+        return -1;
+    }
+    status = run_method(cls, method_name, args, arg_count, options);
+    class_destroy(cls);
+    return status;
+}
+
+/* Load .class files into one registry and write a snapshot of it */
+int snapshot_class_files(const char* output, char** files, int count) {
+    ClassRegistry* registry = class_registry_create();
+    int status = registry ? 0 : -1;
+
+    for (int i = 0; i < count && status == 0; i++) {
+        Class* cls = class_load_file(files[i]);
+        if (!cls || class_registry_add(registry, cls) != 0) {
+            class_destroy(cls);
+            status = -1;
+        }
+    }
+    if (status == 0) {
+        status = snapshot_write(output, registry);
+    }
+    if (status == 0) {
+        printf("Wrote %d class%s to %s\n", registry->count, registry->count == 1 ? "" : "es",
+               output);
+    }
+    class_registry_destroy(registry);
+    return status;
+}
+
+/* Run a static int method of a class from a snapshot */
+int run_snapshot_file(const char* filename, const char* class_name, const char* method_name,
+                      char** args, int arg_count, const RunOptions* options) {
+    ClassRegistry* registry = snapshot_load(filename);
+    Class* cls;
+    int status = -1;
+
+    if (!registry) {
+        return -1;
+    }
+    cls = class_registry_find(registry, class_name);
+    if (cls) {
+        status = run_method(cls, method_name, args, arg_count, options);
+    } else {
+        printf("Error: no class %s in %s\n", class_name, filename);
+    }
+    class_registry_destroy(registry);
+    return status;
+}
+
+int main(int argc, char** argv) {
+    const char* program = argv[0];
+    RunOptions options = {0, NULL, 0, NULL};
+    int watched;
+    
+    /* --profile[=<file>], --profile-time[=<file>] and --sample[=<file>]
+     * before --class or --image */
+    while (argc >= 2 && (strncmp(argv[1], "--profile", 9) == 0 ||
+                         strncmp(argv[1], "--sample", 8) == 0)) {
+        const char* option;
+        const char** output;
+        if (strncmp(argv[1], "--profile", 9) == 0) {
+            option = argv[1] + 9;
+            options.profile = PROFILE_COUNTS;
+            if (strncmp(option, "-time", 5) == 0) {
+                options.profile |= PROFILE_CYCLES;
+                option += 5;
+            }
+            output = &options.profile_output;
+        } else {
+            option = argv[1] + 8;
+            options.sample = 1;
+            output = &options.sample_output;
+        }
+        if (*option == '=' && option[1]) {
+            *output = option + 1;
+        } else if (*option) {
+            argc = 0;               /* Unknown option: show the usage */
+            break;
+        }
+        argv++;
+        argc--;
+    }
+    watched = options.profile || options.sample;
+    
+    /* Run a method of a class file */
+    if (argc >= 4 && strcmp(argv[1], "--class") == 0) {
+        return run_class_file(argv[2], argv[3], argv + 4, argc - 4, &options) == 0 ? 0 : 1;
+    }
+
+    /* Write a startup snapshot of class files, or run from one */
+    if (argc >= 4 && strcmp(argv[1], "--snapshot") == 0 && !watched) {
+        return snapshot_class_files(argv[2], argv + 3, argc - 3) == 0 ? 0 : 1;
+    }
+    if (argc >= 5 && strcmp(argv[1], "--image") == 0) {
+        return run_snapshot_file(argv[2], argv[3], argv[4], argv + 5, argc - 5,
+                                 &options) == 0 ? 0 : 1;
+    }
+
+    /* Ahead-of-time translation modes */
+    if (argc == 4 && strcmp(argv[1], "--aot") == 0) {
+        return aot_file(argv[2], argv[3]) == 0 ? 0 : 1;
+    }
+    if (argc == 3 && strcmp(argv[1], "--aot-tests") == 0) {
+        return aot_tests(argv[2]) == 0 ? 0 : 1;
+    }
+    
+    /* Run a job file on worker threads */
+    if ((argc == 3 || argc == 4) && strcmp(argv[1], "--batch") == 0 && !watched) {
+        return run_batch_file(argv[2], argc == 4 ? atoi(argv[3]) : 4) == 0 ? 0 : 1;
+    }
+    if (argc != 1 || watched) {
+        printf("Usage: %s [--profile[-time][=<out.csv|out.json>]] [--sample[=<out.folded>]]\n"
+               "           [--class <file.class> <method> [int args...]]\n", program);
+        printf("       %s [--profile...] [--sample...] --image <file.snapshot> <class> <method> "
+               "[int args...]\n", program);
+        printf("       %s --snapshot <out.snapshot> <file.class>...\n", program);
+        printf("       %s [--aot <file.aruvi> <out.c> | --aot-tests <out.c>]\n", program);
+        printf("       %s --batch <jobs.txt> [threads]\n", program);
+        return 1;
+    }
+
     printf("AruviJVM - Simple Java Bytecode Interpreter\n");
     printf("===========================================\n");
     
     /* Run all tests */
-    run_test("Arithmetic (5 + 3 * 2)", test_arithmetic, sizeof(test_arithmetic));
-    run_test("Local Variables (42 + 10)", test_locals, sizeof(test_locals));
-    run_test("Conditional Branch (10 > 5)", test_branch, sizeof(test_branch));
-    run_test("Simple Counting (1+1+1)", test_loop, sizeof(test_loop));
+    run_test("Arithmetic (5 + 3 * 2)", test_arithmetic, test_arithmetic_length);
+    run_test("Local Variables (42 + 10)", test_locals, test_locals_length);
+    run_test("Conditional Branch (10 > 5)", test_branch, test_branch_length);
+    run_test("Simple Counting (1+1+1)", test_loop, test_loop_length);
+    run_test("Verifier Rejects Underflow (expect -1)", test_verify_underflow,
+             test_verify_underflow_length);
+    run_test("Decoder Rejects getstatic (expect -1)", test_decode_unsupported,
+             test_decode_unsupported_length);
+    run_test("Superinstructions and iinc (45 + 3 - 1)", test_fused, test_fused_length);
+    run_test("tableswitch State Machine (121)", test_switch_state, test_switch_state_length);
+    run_test("lookupswitch Hashed, Searched and Dense (16171)", test_switch_lookup,
+             test_switch_lookup_length);
+    run_divide_overflow_test();
+    
+    /* Tests that call static methods */
+    Class* recursion = test_recursion_class();
+    if (recursion) {
+        int fib_args[] = {10};
+        int ack_args[] = {2, 3};
+        run_method_test("Recursive Fibonacci fib(10)", recursion, "fib", fib_args, 1);
+        run_method_test("Ackermann ack(2, 3)", recursion, "ack", ack_args, 2);
+        run_container_test(recursion);
+        run_profile_test(recursion);
+        run_sampler_test(recursion);
+        class_destroy(recursion);
+    }
+    run_tier_test();
+    run_class_file_test();
+    run_numeric_test();
+    run_dispatch_test();
+    run_exception_test();
+    run_string_test();
+    run_snapshot_test();
+    
+    /* Tests that allocate objects and arrays */
+    Class* node = test_node_class();
+    if (node) {
+        int sieve_args[] = {1000};
+        int churn_args[] = {10, 1000};
+        int oom_args[] = {40, 1};
+        run_heap_test("Sieve of Eratosthenes sieve(1000)", node, "sieve", sieve_args, 1, HEAP_SIZE);
+        run_heap_test("Linked List Under GC churn(10, 1000)", node, "churn", churn_args, 2, 512);
+        run_heap_test("Heap Budget Exceeded (expect -1)", node, "churn", oom_args, 2, 512);
+        class_destroy(node);
+    }
+    
+    /* Tests that reuse JVM instances from a pool */
+    recursion = test_recursion_class();
+    node = test_node_class();
+    if (recursion && node) {
+        run_pool_reuse_test(recursion, node);
+    }
+    class_destroy(recursion);
+    class_destroy(node);
+    run_pool_threads_test();
+    run_batch_test();
+#ifdef JVM_GREEN_THREADS
+    run_scheduler_test();
+    run_parallel_test();
+    run_virtual_gc_test();
+#endif
     
     /* Show disassembly of one test for educational purposes */
     printf("\n=== Disassembly Example (Arithmetic Test) ===");
-    disassemble(test_arithmetic, sizeof(test_arithmetic));
+    disassemble(test_arithmetic, test_arithmetic_length);
+    
+    /* And the form the interpreter actually runs */
+    printf("=== Pre-decoded Example (Conditional Branch Test) ===");
+    DecodedCode decoded;
+    if (decode_bytecode(test_branch, test_branch_length, NULL, 0, &decoded) == 0) {
+        decoded_dump(&decoded);
+        decoded_free(&decoded);
+    }
     
     return 0;
 }
@@ -0,0 +1,128 @@
+#define _POSIX_C_SOURCE 200112L
+#include "jvm.h"
+#include <pthread.h>
+
+/*
+ * Pool of reusable JVM instances
+ *
+ * A JVM is one large struct: the operand stack, the frames and the object
+ * heap are arrays inside it, so jvm_create() has to allocate and clear all
+ * of it. A host that runs many short programs can keep instances in a
+ * pool instead. jvm_pool_acquire() checks out an instance that is ready to
+ * run, and jvm_pool_release() gives it back after jvm_reset(), which only
+ * clears what the run touched.
+ *
+ * Any thread may acquire and release; a mutex guards the list of idle
+ * instances, and the reset is done outside it. An instance belongs to one
+ * thread between acquire and release. When the pool runs dry, acquire
+ * creates a new instance, and a release that finds the pool full destroys
+ * the instance, so the pool never holds more than its size.
+ */
+
+struct JVMPool {
+    pthread_mutex_t lock;
+    JVM** idle;             /* Reset instances, ready to hand out */
+    int idle_count;
+    int size;               /* Most instances kept idle */
+    uint64_t acquired;      /* Instances checked out so far */
+    uint64_t created;       /* Instances jvm_create() made, up front included */
+    uint64_t destroyed;     /* Released into a full pool */
+};
+
+/* Create a pool holding size ready instances. Returns NULL on error. */
+JVMPool* jvm_pool_create(int size) {
+    JVMPool* pool;
+
+    if (size < 1) {
+        printf("Error: pool size must be at least 1\n");
+        return NULL;
+    }
+    pool = (JVMPool*)calloc(1, sizeof(JVMPool));
+    if (!pool) {
+        return NULL;
+    }
+    pool->idle = (JVM**)malloc(sizeof(JVM*) * (size_t)size);
+    if (!pool->idle || pthread_mutex_init(&pool->lock, NULL) != 0) {
+        free(pool->idle);
+        free(pool);
+        return NULL;
+    }
+    pool->size = size;
+    while (pool->idle_count < size) {
+        JVM* jvm = jvm_create();
+        if (!jvm) {
+            jvm_pool_destroy(pool);
+            return NULL;
+        }
+        pool->idle[pool->idle_count++] = jvm;
+        pool->created++;
+    }
+    return pool;
+}
+
+/* Destroy the pool and its idle instances. Instances still checked out
+ * are the caller's to jvm_destroy(). */
+void jvm_pool_destroy(JVMPool* pool) {
+    if (pool) {
+        for (int i = 0; i < pool->idle_count; i++) {
+            jvm_destroy(pool->idle[i]);
+        }
+        pthread_mutex_destroy(&pool->lock);
+        free(pool->idle);
+        free(pool);
+    }
+}
+
+/* Check out an instance, creating one if none is idle. Returns NULL if
+ * that fails. */
+JVM* jvm_pool_acquire(JVMPool* pool) {
+    JVM* jvm = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->acquired++;
+    if (pool->idle_count > 0) {
+        jvm = pool->idle[--pool->idle_count];
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    /* The pool was empty: make one without holding the lock */
+    if (!jvm) {
+        jvm = jvm_create();
+        if (jvm) {
+            pthread_mutex_lock(&pool->lock);
+            pool->created++;
+            pthread_mutex_unlock(&pool->lock);
+        }
+    }
+    return jvm;
+}
+
+/* Reset an instance and return it to the pool. It must not be running. */
+void jvm_pool_release(JVMPool* pool, JVM* jvm) {
+    if (!jvm) {
+        return;
+    }
+    jvm_reset(jvm);
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->idle_count < pool->size) {
+        pool->idle[pool->idle_count++] = jvm;
+        jvm = NULL;
+    } else {
+        pool->destroyed++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (jvm) {
+        jvm_destroy(jvm);
+    }
+}
+
+/* Print how often the pool could hand out an instance it already had */
+void jvm_pool_print_stats(JVMPool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    printf("Pool: %llu checkouts, %llu instances created, %llu destroyed, %d of %d idle\n",
+           (unsigned long long)pool->acquired, (unsigned long long)pool->created,
+           (unsigned long long)pool->destroyed, pool->idle_count, pool->size);
+    pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,468 @@
+#define _POSIX_C_SOURCE 199309L
+#include "jvm.h"
+#include <time.h>
+
+/*
+ * Execution profiler
+ *
+ * With a profile set, methods run on the profiling copy of the
+ * interpreter (interp_profile.c), which counts into jvm->profile:
+ *
+ *   - executions of each internal opcode, and with PROFILE_CYCLES the
+ *     time from the start of each instruction to the start of the next,
+ *     charged to its opcode. On x86-64 this is the time-stamp counter,
+ *     which includes the profiler's own few cycles per instruction.
+ *   - executions of each instruction of each method, reported by its
+ *     original bytecode pc.
+ *   - how often each conditional branch was taken; not taken is the rest.
+ *
+ * The JIT is bypassed while profiling, so every instruction is seen.
+ * jvm_destroy() prints a sorted report and, if jvm_set_profile_output()
+ * named a file, writes the counts there as CSV or JSON.
+ */
+
+/* Lines in each hot-spot table of the text report */
+#define PROFILE_REPORT_LINES 20
+
+/* One instruction in a sorted table */
+typedef struct {
+    const MethodProfile* method;
+    int index;
+    uint64_t count;
+} ProfileEntry;
+
+uint64_t profile_clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/* Branches with a taken count; a switch is taken when a case matches */
+static int is_conditional(int op) {
+    return (op >= INSN_IF_ICMPEQ && op < INSN_GOTO) ||
+           op == INSN_TABLESWITCH || op == INSN_LOOKUPSWITCH ||
+           (op >= INSN_ILOAD_ILOAD_IF_ICMPEQ && op <= INSN_ILOAD_ILOAD_IF_ICMPLE);
+}
+
+static char* copy_string(const char* s) {
+    char* copy = (char*)malloc(strlen(s) + 1);
+    if (copy) {
+        strcpy(copy, s);
+    }
+    return copy;
+}
+
+static void free_method_profile(MethodProfile* counters) {
+    free(counters->name);
+    free(counters->bytecode_pc);
+    free(counters->ops);
+    free(counters->executed);
+    free(counters->taken);
+}
+
+void profile_free(Profile* profile) {
+    if (!profile) {
+        return;
+    }
+    for (int i = 0; i < profile->method_count; i++) {
+        free_method_profile(&profile->methods[i]);
+    }
+    free(profile->methods);
+    free(profile->output);
+    free(profile);
+}
+
+/* Start profiling with mode PROFILE_COUNTS, optionally | PROFILE_CYCLES, or
+ * stop and drop the counts with mode 0. Returns 0, or -1 on failure. */
+int jvm_set_profile(JVM* jvm, int mode) {
+    if (mode == 0) {
+        profile_free(jvm->profile);
+        jvm->profile = NULL;
+        return 0;
+    }
+#ifndef JVM_PROFILER
+    printf("Error: built without the profiler (PROFILER=0)\n");
+    return -1;
+#else
+    if (jvm->running) {
+        printf("Error: cannot start profiling while a method is running\n");
+        return -1;
+    }
+    if (!jvm->profile) {
+        jvm->profile = (Profile*)calloc(1, sizeof(Profile));
+        if (!jvm->profile) {
+            printf("Profile error: out of memory\n");
+            return -1;
+        }
+    }
+    jvm->profile->mode = mode | PROFILE_COUNTS;
+    return 0;
+#endif
+}
+
+/* Have jvm_destroy() write the profile to path: JSON if it ends in .json,
+ * CSV otherwise */
+int jvm_set_profile_output(JVM* jvm, const char* path) {
+    char* copy;
+
+    if (!jvm->profile) {
+        printf("Error: profiling is not enabled\n");
+        return -1;
+    }
+    copy = copy_string(path);
+    if (!copy) {
+        printf("Profile error: out of memory\n");
+        return -1;
+    }
+    free(jvm->profile->output);
+    jvm->profile->output = copy;
+    return 0;
+}
+
+/*
+ * Counters for a prepared method, created on its first run. Top-level code
+ * runs from a Method on the stack, so a later run can reuse the address
+ * for different code; the code pointer and length tell them apart.
+ */
+MethodProfile* profile_method(Profile* profile, const Method* method) {
+    const DecodedCode* decoded = &method->decoded;
+    MethodProfile* counters;
+    char name[256];
+
+    if (profile->last < profile->method_count) {
+        counters = &profile->methods[profile->last];
+        if (counters->method == method && counters->code == method->code &&
+            counters->count == decoded->count) {
+            return counters;
+        }
+    }
+    for (int i = 0; i < profile->method_count; i++) {
+        counters = &profile->methods[i];
+        if (counters->method == method && counters->code == method->code &&
+            counters->count == decoded->count) {
+            profile->last = i;
+            return counters;
+        }
+    }
+
+    if (profile->method_count == profile->method_capacity) {
+        int capacity = profile->method_capacity ? profile->method_capacity * 2 : 8;
+        MethodProfile* methods = (MethodProfile*)realloc(profile->methods,
+                                                         capacity * sizeof(MethodProfile));
+        if (!methods) {
+            return NULL;
+        }
+        profile->methods = methods;
+        profile->method_capacity = capacity;
+    }
+    counters = &profile->methods[profile->method_count];
+    memset(counters, 0, sizeof(*counters));
+
+    if (method->owner && method->owner->name[0]) {
+        snprintf(name, sizeof(name), "%s.%s", method->owner->name, method->name);
+    } else {
+        snprintf(name, sizeof(name), "%s", method->name);
+    }
+    counters->method = method;
+    counters->code = method->code;
+    counters->count = decoded->count;
+    counters->name = copy_string(name);
+    counters->bytecode_pc = (int*)malloc(decoded->count * sizeof(int));
+    counters->ops = (uint16_t*)malloc(decoded->count * sizeof(uint16_t));
+    counters->executed = (uint64_t*)calloc(decoded->count, sizeof(uint64_t));
+    counters->taken = (uint64_t*)calloc(decoded->count, sizeof(uint64_t));
+    if (!counters->name || !counters->bytecode_pc || !counters->ops ||
+        !counters->executed || !counters->taken) {
+        free_method_profile(counters);
+        return NULL;
+    }
+    for (int i = 0; i < decoded->count; i++) {
+        counters->bytecode_pc[i] = decoded->bytecode_pc[i];
+        counters->ops[i] = decoded->insns[i].op;
+    }
+    profile->last = profile->method_count++;
+    return counters;
+}
+
+/* Bytecodes counted, leaving out the INSN_END sentinel like jvm->instructions.
+ * A superinstruction is counted once but stands for several bytecodes. */
+static uint64_t total_count(const Profile* profile) {
+    uint64_t total = 0;
+    for (int op = 0; op < INSN_COUNT; op++) {
+        if (op != INSN_END) {
+            total += profile->op_count[op] * (uint64_t)insn_bytecodes(op);
+        }
+    }
+    return total;
+}
+
+static int compare_entries(const void* a, const void* b) {
+    const ProfileEntry* x = (const ProfileEntry*)a;
+    const ProfileEntry* y = (const ProfileEntry*)b;
+    if (x->count != y->count) {
+        return x->count < y->count ? 1 : -1;
+    }
+    if (x->method != y->method) {
+        return x->method < y->method ? -1 : 1;      /* Same array: method order */
+    }
+    return x->index - y->index;
+}
+
+/* Executed instructions, optionally only conditional branches, sorted by
+ * count. Returns the number of entries, or -1 if out of memory. */
+static int sorted_instructions(const Profile* profile, int branches_only,
+                               ProfileEntry** entries) {
+    int total = 0, n = 0;
+
+    for (int m = 0; m < profile->method_count; m++) {
+        total += profile->methods[m].count;
+    }
+    *entries = (ProfileEntry*)malloc((total > 0 ? total : 1) * sizeof(ProfileEntry));
+    if (!*entries) {
+        return -1;
+    }
+    for (int m = 0; m < profile->method_count; m++) {
+        const MethodProfile* counters = &profile->methods[m];
+        for (int i = 0; i < counters->count; i++) {
+            if (counters->executed[i] == 0 || counters->ops[i] == INSN_END ||
+                (branches_only && !is_conditional(counters->ops[i]))) {
+                continue;
+            }
+            (*entries)[n].method = counters;
+            (*entries)[n].index = i;
+            (*entries)[n].count = counters->executed[i];
+            n++;
+        }
+    }
+    qsort(*entries, n, sizeof(ProfileEntry), compare_entries);
+    return n;
+}
+
+static double percent(uint64_t part, uint64_t whole) {
+    return whole ? 100.0 * (double)part / (double)whole : 0.0;
+}
+
+/* Print the profile as tables sorted by count: opcodes, the hottest
+ * instructions and the most executed conditional branches */
+void jvm_profile_report(const JVM* jvm, FILE* out) {
+    const Profile* profile = jvm->profile;
+    ProfileEntry ops[INSN_COUNT];
+    ProfileEntry* entries;
+    uint64_t total, cycles = 0;
+    int timed, n = 0;
+
+    if (!profile) {
+        return;
+    }
+    total = total_count(profile);
+    timed = profile->mode & PROFILE_CYCLES;
+    fprintf(out, "\n=== Profile: %llu instructions in %llu run%s ===\n",
+            (unsigned long long)total, (unsigned long long)profile->runs,
+            profile->runs == 1 ? "" : "s");
+
+    for (int op = 0; op < INSN_COUNT; op++) {
+        if (op != INSN_END && profile->op_count[op] > 0) {
+            ops[n].method = NULL;
+            ops[n].index = op;
+            ops[n].count = profile->op_count[op];
+            n++;
+        }
+        cycles += profile->op_cycles[op];
+    }
+    qsort(ops, n, sizeof(ProfileEntry), compare_entries);
+
+    fprintf(out, "Opcodes:\n  %-24s %12s %7s", "opcode", "count", "%");
+    if (timed) {
+        fprintf(out, " %14s %7s %10s", PROFILE_CLOCK_UNIT, "%", "per insn");
+    }
+    fprintf(out, "\n");
+    for (int i = 0; i < n; i++) {
+        uint64_t count = ops[i].count;
+        fprintf(out, "  %-24s %12llu %6.1f%%", insn_name(ops[i].index), (unsigned long long)count,
+                percent(count * (uint64_t)insn_bytecodes(ops[i].index), total));
+        if (timed) {
+            uint64_t spent = profile->op_cycles[ops[i].index];
+            fprintf(out, " %14llu %6.1f%% %10.1f", (unsigned long long)spent,
+                    percent(spent, cycles), (double)spent / (double)count);
+        }
+        fprintf(out, "\n");
+    }
+
+    n = sorted_instructions(profile, 0, &entries);
+    if (n < 0) {
+        printf("Profile error: out of memory\n");
+        return;
+    }
+    fprintf(out, "Hot instructions:\n  %12s %7s  %-24s %-6s %s\n",
+            "count", "%", "method", "pc", "instruction");
+    for (int i = 0; i < n && i < PROFILE_REPORT_LINES; i++) {
+        const MethodProfile* counters = entries[i].method;
+        fprintf(out, "  %12llu %6.1f%%  %-24s %04x   %s\n",
+                (unsigned long long)entries[i].count,
+                percent(entries[i].count * (uint64_t)insn_bytecodes(counters->ops[entries[i].index]),
+                        total),
+                counters->name, counters->bytecode_pc[entries[i].index],
+                insn_name(counters->ops[entries[i].index]));
+    }
+    free(entries);
+
+    n = sorted_instructions(profile, 1, &entries);
+    if (n < 0) {
+        printf("Profile error: out of memory\n");
+        return;
+    }
+    if (n > 0) {
+        fprintf(out, "Branches:\n  %-24s %-6s %-21s %12s %12s %8s\n",
+                "method", "pc", "instruction", "taken", "not taken", "taken %");
+    }
+    for (int i = 0; i < n && i < PROFILE_REPORT_LINES; i++) {
+        const MethodProfile* counters = entries[i].method;
+        uint64_t taken = counters->taken[entries[i].index];
+        fprintf(out, "  %-24s %04x   %-21s %12llu %12llu %7.1f%%\n",
+                counters->name, counters->bytecode_pc[entries[i].index],
+                insn_name(counters->ops[entries[i].index]), (unsigned long long)taken,
+                (unsigned long long)(entries[i].count - taken),
+                percent(taken, entries[i].count));
+    }
+    free(entries);
+}
+
+/* Method names come from class files, so quote them for CSV */
+static void write_csv_string(FILE* out, const char* s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        if (*s == '"') {
+            fputc('"', out);
+        }
+        fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+static void write_json_string(FILE* out, const char* s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/*
+ * One row per opcode, then one per executed instruction:
+ *   kind,method,pc,op,count,taken,not_taken,<clock unit>
+ * taken and not_taken are only filled in for conditional branches, and the
+ * clock column only for opcodes, when handlers were timed.
+ */
+static void write_csv(const Profile* profile, FILE* out) {
+    int timed = profile->mode & PROFILE_CYCLES;
+
+    fprintf(out, "kind,method,pc,op,count,taken,not_taken,%s\n", PROFILE_CLOCK_UNIT);
+    for (int op = 0; op < INSN_COUNT; op++) {
+        if (op == INSN_END || profile->op_count[op] == 0) {
+            continue;
+        }
+        fprintf(out, "opcode,,,%s,%llu,,,", insn_name(op),
+                (unsigned long long)profile->op_count[op]);
+        if (timed) {
+            fprintf(out, "%llu", (unsigned long long)profile->op_cycles[op]);
+        }
+        fprintf(out, "\n");
+    }
+    for (int m = 0; m < profile->method_count; m++) {
+        const MethodProfile* counters = &profile->methods[m];
+        for (int i = 0; i < counters->count; i++) {
+            if (counters->executed[i] == 0 || counters->ops[i] == INSN_END) {
+                continue;
+            }
+            fprintf(out, "insn,");
+            write_csv_string(out, counters->name);
+            fprintf(out, ",%d,%s,%llu,", counters->bytecode_pc[i], insn_name(counters->ops[i]),
+                    (unsigned long long)counters->executed[i]);
+            if (is_conditional(counters->ops[i])) {
+                fprintf(out, "%llu,%llu", (unsigned long long)counters->taken[i],
+                        (unsigned long long)(counters->executed[i] - counters->taken[i]));
+            } else {
+                fprintf(out, ",");
+            }
+            fprintf(out, ",\n");
+        }
+    }
+}
+
+/* The same counts as one JSON object, instructions grouped by method */
+static void write_json(const Profile* profile, FILE* out) {
+    int timed = profile->mode & PROFILE_CYCLES;
+    int first = 1;
+
+    fprintf(out, "{\n  \"instructions\": %llu,\n  \"runs\": %llu,\n",
+            (unsigned long long)total_count(profile), (unsigned long long)profile->runs);
+    fprintf(out, "  \"clock\": %s,\n", timed ? "\"" PROFILE_CLOCK_UNIT "\"" : "null");
+    fprintf(out, "  \"opcodes\": [");
+    for (int op = 0; op < INSN_COUNT; op++) {
+        if (op == INSN_END || profile->op_count[op] == 0) {
+            continue;
+        }
+        fprintf(out, "%s\n    {\"op\": \"%s\", \"count\": %llu", first ? "" : ",",
+                insn_name(op), (unsigned long long)profile->op_count[op]);
+        if (timed) {
+            fprintf(out, ", \"time\": %llu", (unsigned long long)profile->op_cycles[op]);
+        }
+        fprintf(out, "}");
+        first = 0;
+    }
+    fprintf(out, "\n  ],\n  \"methods\": [");
+    for (int m = 0; m < profile->method_count; m++) {
+        const MethodProfile* counters = &profile->methods[m];
+        fprintf(out, "%s\n    {\"method\": ", m > 0 ? "," : "");
+        write_json_string(out, counters->name);
+        fprintf(out, ", \"instructions\": [");
+        first = 1;
+        for (int i = 0; i < counters->count; i++) {
+            if (counters->executed[i] == 0 || counters->ops[i] == INSN_END) {
+                continue;
+            }
+            fprintf(out, "%s\n      {\"pc\": %d, \"op\": \"%s\", \"count\": %llu",
+                    first ? "" : ",", counters->bytecode_pc[i], insn_name(counters->ops[i]),
+                    (unsigned long long)counters->executed[i]);
+            if (is_conditional(counters->ops[i])) {
+                fprintf(out, ", \"taken\": %llu, \"not_taken\": %llu",
+                        (unsigned long long)counters->taken[i],
+                        (unsigned long long)(counters->executed[i] - counters->taken[i]));
+            }
+            fprintf(out, "}");
+            first = 0;
+        }
+        fprintf(out, "\n    ]}");
+    }
+    fprintf(out, "\n  ]\n}\n");
+}
+
+/* Write the profile to path, as JSON if it ends in .json and CSV otherwise */
+int jvm_profile_write(const JVM* jvm, const char* path) {
+    size_t length = strlen(path);
+    FILE* out;
+
+    if (!jvm->profile) {
+        printf("Error: profiling is not enabled\n");
+        return -1;
+    }
+    out = fopen(path, "w");
+    if (!out) {
+        printf("Error: Cannot create file %s\n", path);
+        return -1;
+    }
+    if (length >= 5 && strcmp(path + length - 5, ".json") == 0) {
+        write_json(jvm->profile, out);
+    } else {
+        write_csv(jvm->profile, out);
+    }
+    fclose(out);
+    return 0;
+}
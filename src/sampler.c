@@ -0,0 +1,631 @@
+#define _XOPEN_SOURCE 600
+#include "jvm.h"
+#include <pthread.h>
+#include <signal.h>
+#include <sys/time.h>
+
+/*
+ * Sampling profiler
+ *
+ * jvm_set_sampling(jvm, hz) arms an ITIMER_PROF timer, so the process gets
+ * SIGPROF about hz times per second of CPU time it uses. When the signal
+ * lands on the thread that started sampling while that thread runs Java
+ * code, the handler records the method and pc of every frame in
+ * jvm->frames[0..frames_in_use - 1], outermost first. The interpreter
+ * publishes those frames at calls, returns and loop back-edges, so a
+ * caller's pc is that of its call, and the top frame's is the loop head,
+ * call or return it last passed; keeping it exact would cost a store per
+ * instruction. Native code from the JIT runs in its method's frame, so its
+ * samples go to that method.
+ *
+ * The handler can't allocate or take a lock, so everything it writes is
+ * allocated up front and, while sampling, written by nothing else: a
+ * table of the methods seen, with their names copied, since top-level code
+ * and classes may be gone before the report, and a table of the distinct
+ * stacks with a count each, their frames kept in one array. A stack seen
+ * before only bumps its count, so a long run needs no draining. Samples
+ * with a new stack once the tables are full are counted as dropped.
+ *
+ * jvm_destroy() stops the timer, prints the hottest methods and pcs and,
+ * if jvm_set_sampling_output() named a file, writes the stacks there in
+ * the folded format flame graph tools read, one line per call path:
+ *
+ *   Main.main;Recursion.fib;Recursion.fib 212
+ *
+ * SIGPROF is process-wide, so one JVM at a time can be sampled, and it is
+ * sampled only on the thread that started the sampling, which should also
+ * stop it. Green threads are not sampled. The handler stays installed
+ * after sampling stops, as a signal already on its way would otherwise
+ * end the process.
+ */
+
+/* Table sizes: -DSAMPLE_TABLE_BITS=... for more or fewer distinct stacks */
+#ifndef SAMPLE_TABLE_BITS
+#define SAMPLE_TABLE_BITS 12
+#endif
+#define SAMPLE_STACKS (1 << SAMPLE_TABLE_BITS)
+#define SAMPLE_STACKS_MAX (SAMPLE_STACKS / 4 * 3)       /* Stacks it holds */
+#define SAMPLE_FRAMES (SAMPLE_STACKS * 16)              /* Frames of all of them */
+#define SAMPLE_METHODS 1024
+#define SAMPLE_METHODS_MAX (SAMPLE_METHODS / 4 * 3)
+#define SAMPLE_NAME_LENGTH 64
+#define SAMPLE_MAX_HZ 10000
+
+/* Lines in each table of the text report */
+#define SAMPLE_REPORT_LINES 20
+
+typedef struct {
+    const Method* method;           /* Identity only; NULL if the slot is free */
+    const uint8_t* code;            /* With method, tells reused addresses apart */
+    char name[SAMPLE_NAME_LENGTH];  /* "Class.method", cut short if need be */
+} SampleMethod;
+
+typedef struct {
+    int32_t method;                 /* Slot in methods[] */
+    int32_t pc;                     /* Bytecode pc, or -1 if unknown */
+} SampleFrame;
+
+typedef struct {
+    uint32_t hash;
+    uint32_t count;                 /* Samples; 0 if the slot is free */
+    int32_t first;                  /* Its frames are frames[first..first + depth - 1] */
+    int32_t depth;
+} SampleStack;
+
+typedef struct Sampler {
+    JVM* jvm;
+    pthread_t owner;                /* The thread it samples */
+    int hz;
+    char* output;                   /* Folded stacks file, or NULL */
+    uint64_t samples;               /* Taken in Java code */
+    uint64_t outside;               /* Taken with no Java code running */
+    uint64_t dropped;               /* Whose stack did not fit */
+    int method_count;
+    int stack_count;
+    int frame_count;
+    SampleFrame scratch[MAX_FRAMES];        /* The sample being taken */
+    SampleMethod methods[SAMPLE_METHODS];
+    SampleStack stacks[SAMPLE_STACKS];
+    SampleFrame frames[SAMPLE_FRAMES];
+} Sampler;
+
+/* Method or pc totals in the report */
+typedef struct {
+    int32_t method;
+    int32_t pc;
+    uint64_t self;                  /* Samples it was the top frame of */
+    uint64_t total;                 /* Samples it was anywhere in */
+} SampleTotal;
+
+/* A stack for sorting the folded output */
+typedef struct {
+    const SampleFrame* frames;
+    int depth;
+    uint64_t count;
+} SampleLine;
+
+/* The sampler the SIGPROF handler fills in, or NULL */
+static Sampler* active;
+
+/* Other compilers than GCC and Clang only get single-threaded forms */
+#ifdef __GNUC__
+#define ACTIVE_LOAD() __atomic_load_n(&active, __ATOMIC_ACQUIRE)
+#define ACTIVE_STORE(s) __atomic_store_n(&active, s, __ATOMIC_RELEASE)
+#else
+#define ACTIVE_LOAD() active
+#define ACTIVE_STORE(s) (active = (s))
+#endif
+
+/* Disarm the timer and let the tables be read. A signal already on its
+ * way finds no sampler and is ignored. */
+static void stop_timer(Sampler* sampler) {
+    struct itimerval off;
+
+    if (ACTIVE_LOAD() != sampler) {
+        return;
+    }
+    memset(&off, 0, sizeof(off));
+    setitimer(ITIMER_PROF, &off, NULL);
+    ACTIVE_STORE(NULL);
+}
+
+#ifdef JVM_PROFILER
+/* Make sampler the one the handler fills in, unless another one is */
+static int claim_signal(Sampler* sampler) {
+    Sampler* expected = NULL;
+#ifdef __GNUC__
+    return __atomic_compare_exchange_n(&active, &expected, sampler, 0, __ATOMIC_RELEASE,
+                                       __ATOMIC_RELAXED);
+#else
+    if (active != expected) {
+        return 0;
+    }
+    active = sampler;
+    return 1;
+#endif
+}
+
+/* "Class.method" into a method slot; snprintf is not safe in a handler */
+static void copy_name(char* out, const Method* method) {
+    int n = 0;
+
+    if (method->owner && method->owner->name[0]) {
+        for (const char* s = method->owner->name; *s && n < SAMPLE_NAME_LENGTH - 2; s++) {
+            out[n++] = *s;
+        }
+        out[n++] = '.';
+    }
+    for (const char* s = method->name; s && *s && n < SAMPLE_NAME_LENGTH - 1; s++) {
+        out[n++] = *s;
+    }
+    out[n] = '\0';
+}
+
+/* Slot of a method in the method table, added if new; -1 if it is full */
+static int method_slot(Sampler* sampler, const Method* method) {
+    uint32_t slot = (uint32_t)(((uintptr_t)method >> 4) * 2654435769u) & (SAMPLE_METHODS - 1);
+
+    for (;;) {
+        SampleMethod* entry = &sampler->methods[slot];
+        if (!entry->method) {
+            break;
+        }
+        if (entry->method == method && entry->code == method->code) {
+            return (int)slot;
+        }
+        slot = (slot + 1) & (SAMPLE_METHODS - 1);
+    }
+    if (sampler->method_count == SAMPLE_METHODS_MAX) {
+        return -1;
+    }
+    copy_name(sampler->methods[slot].name, method);
+    sampler->methods[slot].code = method->code;
+    sampler->methods[slot].method = method;
+    sampler->method_count++;
+    return (int)slot;
+}
+
+/* Count the stack in scratch[0..depth - 1], adding it if it is new */
+static void record_stack(Sampler* sampler, int depth, uint32_t hash) {
+    uint32_t slot = hash & (SAMPLE_STACKS - 1);
+    SampleStack* stack;
+
+    for (;;) {
+        stack = &sampler->stacks[slot];
+        if (stack->count == 0) {
+            break;
+        }
+        if (stack->hash == hash && stack->depth == depth) {
+            const SampleFrame* frames = &sampler->frames[stack->first];
+            int i = 0;
+            while (i < depth && frames[i].method == sampler->scratch[i].method &&
+                   frames[i].pc == sampler->scratch[i].pc) {
+                i++;
+            }
+            if (i == depth) {
+                stack->count++;
+                sampler->samples++;
+                return;
+            }
+        }
+        slot = (slot + 1) & (SAMPLE_STACKS - 1);
+    }
+    if (sampler->stack_count == SAMPLE_STACKS_MAX ||
+        sampler->frame_count + depth > SAMPLE_FRAMES) {
+        sampler->dropped++;
+        return;
+    }
+    for (int i = 0; i < depth; i++) {
+        sampler->frames[sampler->frame_count + i] = sampler->scratch[i];
+    }
+    stack->hash = hash;
+    stack->first = sampler->frame_count;
+    stack->depth = depth;
+    stack->count = 1;
+    sampler->frame_count += depth;
+    sampler->stack_count++;
+    sampler->samples++;
+}
+
+/* Frames the interpreter has published; the fence pairs with the one in
+ * its SAMPLE_STORE() */
+static int frames_in_use(const JVM* jvm) {
+#ifdef __GNUC__
+    int depth = __atomic_load_n(&jvm->frames_in_use, __ATOMIC_RELAXED);
+    __atomic_signal_fence(__ATOMIC_ACQUIRE);
+    return depth;
+#else
+    return jvm->frames_in_use;
+#endif
+}
+
+/* Read the running code's frames. This thread is stopped somewhere in the
+ * interpreter, which has published every frame up to frames_in_use. */
+static void take_sample(Sampler* sampler) {
+    const JVM* jvm = sampler->jvm;
+    int depth = frames_in_use(jvm);
+    uint32_t hash = 2166136261u;
+
+    if (depth <= 0 || depth > MAX_FRAMES) {
+        sampler->outside++;
+        return;
+    }
+    for (int i = 0; i < depth; i++) {
+        const Frame* frame = &jvm->frames[i];
+        const Method* method = frame->method;
+        SampleFrame* out = &sampler->scratch[i];
+        long index;
+
+        out->method = method_slot(sampler, method);
+        if (out->method < 0) {
+            sampler->dropped++;
+            return;
+        }
+        /* A caller resumes after its call */
+        index = frame->ip - method->decoded.insns - (i < depth - 1 ? 1 : 0);
+        out->pc = index >= 0 && index < method->decoded.count
+                      ? method->decoded.bytecode_pc[index] : -1;
+        hash = (hash ^ (uint32_t)out->method) * 16777619u;
+        hash = (hash ^ (uint32_t)out->pc) * 16777619u;
+    }
+    record_stack(sampler, depth, hash);
+}
+
+static void on_sigprof(int signal_number) {
+    Sampler* sampler = ACTIVE_LOAD();
+
+    (void)signal_number;
+    if (sampler && pthread_equal(pthread_self(), sampler->owner)) {
+        take_sample(sampler);
+    }
+}
+#endif
+
+/* Keep the handler out while the tables are read on the sampled thread */
+static void pause_sampling(sigset_t* saved) {
+    sigset_t block;
+
+    sigemptyset(&block);
+    sigaddset(&block, SIGPROF);
+    pthread_sigmask(SIG_BLOCK, &block, saved);
+}
+
+static void resume_sampling(const sigset_t* saved) {
+    pthread_sigmask(SIG_SETMASK, saved, NULL);
+}
+
+void sampler_free(Sampler* sampler) {
+    if (!sampler) {
+        return;
+    }
+    stop_timer(sampler);
+    free(sampler->output);
+    free(sampler);
+}
+
+/* Sample the code jvm runs on this thread hz times per second of CPU
+ * time, or stop and drop the samples with hz 0. Calling it again while
+ * sampling changes the rate. Returns 0, or -1 on failure. */
+int jvm_set_sampling(JVM* jvm, int hz) {
+    if (hz == 0) {
+        sampler_free(jvm->sampler);
+        jvm->sampler = NULL;
+        return 0;
+    }
+#ifndef JVM_PROFILER
+    printf("Error: built without the profiler (PROFILER=0)\n");
+    return -1;
+#else
+    {
+        Sampler* sampler = jvm->sampler;
+        struct itimerval timer;
+        long period_us;
+
+        if (hz < 0 || hz > SAMPLE_MAX_HZ) {
+            printf("Error: the sampling rate must be 1 to %d Hz\n", SAMPLE_MAX_HZ);
+            return -1;
+        }
+        if (!sampler) {
+            struct sigaction action;
+
+            sampler = (Sampler*)calloc(1, sizeof(Sampler));
+            if (!sampler) {
+                printf("Sampler error: out of memory\n");
+                return -1;
+            }
+            sampler->jvm = jvm;
+            sampler->owner = pthread_self();
+            if (!claim_signal(sampler)) {
+                printf("Error: another JVM is being sampled\n");
+                free(sampler);
+                return -1;
+            }
+            memset(&action, 0, sizeof(action));
+            action.sa_handler = on_sigprof;
+            action.sa_flags = SA_RESTART;
+            sigemptyset(&action.sa_mask);
+            if (sigaction(SIGPROF, &action, NULL) != 0) {
+                printf("Error: cannot handle SIGPROF\n");
+                ACTIVE_STORE(NULL);
+                free(sampler);
+                return -1;
+            }
+            jvm->sampler = sampler;
+        } else if (!pthread_equal(pthread_self(), sampler->owner)) {
+            printf("Error: sampling was started on another thread\n");
+            return -1;
+        }
+
+        period_us = 1000000L / hz;
+        timer.it_interval.tv_sec = period_us / 1000000L;
+        timer.it_interval.tv_usec = period_us % 1000000L;
+        timer.it_value = timer.it_interval;
+        if (setitimer(ITIMER_PROF, &timer, NULL) != 0) {
+            printf("Error: cannot start the profiling timer\n");
+            sampler_free(sampler);
+            jvm->sampler = NULL;
+            return -1;
+        }
+        sampler->hz = hz;
+        return 0;
+    }
+#endif
+}
+
+/* Have jvm_destroy() write the samples to path as folded stacks */
+int jvm_set_sampling_output(JVM* jvm, const char* path) {
+    char* copy;
+
+    if (!jvm->sampler) {
+        printf("Error: sampling is not enabled\n");
+        return -1;
+    }
+    copy = (char*)malloc(strlen(path) + 1);
+    if (!copy) {
+        printf("Sampler error: out of memory\n");
+        return -1;
+    }
+    strcpy(copy, path);
+    free(jvm->sampler->output);
+    jvm->sampler->output = copy;
+    return 0;
+}
+
+/* Samples taken in Java code so far */
+uint64_t jvm_sample_count(const JVM* jvm) {
+    return jvm->sampler ? jvm->sampler->samples : 0;
+}
+
+/* By method, then pc */
+static int compare_keys(const void* a, const void* b) {
+    const SampleTotal* x = (const SampleTotal*)a;
+    const SampleTotal* y = (const SampleTotal*)b;
+    if (x->method != y->method) {
+        return x->method < y->method ? -1 : 1;
+    }
+    return x->pc < y->pc ? -1 : x->pc > y->pc;
+}
+
+/* By total, then self, most first */
+static int compare_totals(const void* a, const void* b) {
+    const SampleTotal* x = (const SampleTotal*)a;
+    const SampleTotal* y = (const SampleTotal*)b;
+    if (x->total != y->total) {
+        return x->total < y->total ? 1 : -1;
+    }
+    if (x->self != y->self) {
+        return x->self < y->self ? 1 : -1;
+    }
+    return compare_keys(a, b);
+}
+
+/* By self, then total, most first */
+static int compare_self(const void* a, const void* b) {
+    const SampleTotal* x = (const SampleTotal*)a;
+    const SampleTotal* y = (const SampleTotal*)b;
+    if (x->self != y->self) {
+        return x->self < y->self ? 1 : -1;
+    }
+    return compare_totals(a, b);
+}
+
+/* By the methods of the frames, outermost first, so that stacks that only
+ * differ in pcs come together */
+static int compare_lines(const void* a, const void* b) {
+    const SampleLine* x = (const SampleLine*)a;
+    const SampleLine* y = (const SampleLine*)b;
+    for (int i = 0; i < x->depth && i < y->depth; i++) {
+        if (x->frames[i].method != y->frames[i].method) {
+            return x->frames[i].method < y->frames[i].method ? -1 : 1;
+        }
+    }
+    return x->depth - y->depth;
+}
+
+/* Count each method, or each method and pc, once per sample it is in,
+ * and as self in the samples it is on top of. Returns the number of
+ * totals, or -1 if out of memory. */
+static int sample_totals(const Sampler* sampler, int by_pc, SampleTotal** totals) {
+    int n = 0, merged = 0;
+
+    *totals = (SampleTotal*)malloc((sampler->frame_count > 0 ? sampler->frame_count : 1) *
+                                   sizeof(SampleTotal));
+    if (!*totals) {
+        return -1;
+    }
+    for (int s = 0; s < SAMPLE_STACKS; s++) {
+        const SampleStack* stack = &sampler->stacks[s];
+        const SampleFrame* frames = &sampler->frames[stack->first];
+
+        if (stack->count == 0) {
+            continue;
+        }
+        for (int i = 0; i < stack->depth; i++) {
+            int32_t pc = by_pc ? frames[i].pc : 0;
+            int seen = 0;
+
+            /* A recursive method is in the sample once */
+            for (int j = i + 1; j < stack->depth && !seen; j++) {
+                seen = frames[j].method == frames[i].method && (!by_pc || frames[j].pc == pc);
+            }
+            if (seen) {
+                continue;
+            }
+            (*totals)[n].method = frames[i].method;
+            (*totals)[n].pc = pc;
+            (*totals)[n].total = stack->count;
+            (*totals)[n].self = i == stack->depth - 1 ? stack->count : 0;
+            n++;
+        }
+    }
+    /* Sort by method and pc, then add up the runs */
+    qsort(*totals, n, sizeof(SampleTotal), compare_keys);
+    for (int i = 0; i < n; i++) {
+        if (merged > 0 && (*totals)[merged - 1].method == (*totals)[i].method &&
+            (*totals)[merged - 1].pc == (*totals)[i].pc) {
+            (*totals)[merged - 1].total += (*totals)[i].total;
+            (*totals)[merged - 1].self += (*totals)[i].self;
+        } else {
+            (*totals)[merged++] = (*totals)[i];
+        }
+    }
+    return merged;
+}
+
+static double percent(uint64_t part, uint64_t whole) {
+    return whole ? 100.0 * (double)part / (double)whole : 0.0;
+}
+
+/* Print the samples as tables: methods by the samples they were on top
+ * of, and methods and pcs by the samples they were in. A caller's pc is
+ * its call. */
+void jvm_sampling_report(const JVM* jvm, FILE* out) {
+    const Sampler* sampler = jvm->sampler;
+    SampleTotal* totals;
+    sigset_t saved;
+    int n;
+
+    if (!sampler) {
+        return;
+    }
+    pause_sampling(&saved);
+    fprintf(out, "\n=== Samples: %llu at %d Hz (%llu outside Java code, %llu dropped) ===\n",
+            (unsigned long long)sampler->samples, sampler->hz,
+            (unsigned long long)sampler->outside, (unsigned long long)sampler->dropped);
+
+    n = sample_totals(sampler, 0, &totals);
+    if (n < 0) {
+        resume_sampling(&saved);
+        printf("Sampler error: out of memory\n");
+        return;
+    }
+    qsort(totals, n, sizeof(SampleTotal), compare_self);
+    fprintf(out, "Methods:\n  %10s %7s %10s %7s  %s\n", "self", "%", "total", "%", "method");
+    for (int i = 0; i < n && i < SAMPLE_REPORT_LINES; i++) {
+        fprintf(out, "  %10llu %6.1f%% %10llu %6.1f%%  %s\n", (unsigned long long)totals[i].self,
+                percent(totals[i].self, sampler->samples), (unsigned long long)totals[i].total,
+                percent(totals[i].total, sampler->samples),
+                sampler->methods[totals[i].method].name);
+    }
+    free(totals);
+
+    n = sample_totals(sampler, 1, &totals);
+    if (n < 0) {
+        resume_sampling(&saved);
+        printf("Sampler error: out of memory\n");
+        return;
+    }
+    qsort(totals, n, sizeof(SampleTotal), compare_totals);
+    fprintf(out, "Hot spots:\n  %10s %7s %10s %7s  %-24s %s\n", "total", "%", "self", "%",
+            "method", "pc");
+    for (int i = 0; i < n && i < SAMPLE_REPORT_LINES; i++) {
+        fprintf(out, "  %10llu %6.1f%% %10llu %6.1f%%  %-24s ",
+                (unsigned long long)totals[i].total, percent(totals[i].total, sampler->samples),
+                (unsigned long long)totals[i].self, percent(totals[i].self, sampler->samples),
+                sampler->methods[totals[i].method].name);
+        if (totals[i].pc >= 0) {
+            fprintf(out, "%04x\n", totals[i].pc);
+        } else {
+            fprintf(out, "?\n");
+        }
+    }
+    free(totals);
+    resume_sampling(&saved);
+}
+
+/* A frame name with the separators of the folded format replaced */
+static void write_frame_name(FILE* out, const char* s) {
+    for (; *s; s++) {
+        fputc(*s == ';' || *s == ' ' || *s == '\n' ? '_' : *s, out);
+    }
+}
+
+/* Write the samples to path as folded stacks: one line per call path,
+ * its methods outermost first, separated by ';', then its count. Paths
+ * that differ only in pcs are added together. */
+int jvm_sampling_write(const JVM* jvm, const char* path) {
+    const Sampler* sampler = jvm->sampler;
+    SampleLine* lines;
+    sigset_t saved;
+    FILE* out;
+    int n = 0;
+
+    if (!sampler) {
+        printf("Error: sampling is not enabled\n");
+        return -1;
+    }
+    out = fopen(path, "w");
+    if (!out) {
+        printf("Error: Cannot create file %s\n", path);
+        return -1;
+    }
+    pause_sampling(&saved);
+    lines = (SampleLine*)malloc((sampler->stack_count > 0 ? sampler->stack_count : 1) *
+                                sizeof(SampleLine));
+    if (!lines) {
+        resume_sampling(&saved);
+        fclose(out);
+        printf("Sampler error: out of memory\n");
+        return -1;
+    }
+    for (int s = 0; s < SAMPLE_STACKS; s++) {
+        const SampleStack* stack = &sampler->stacks[s];
+        if (stack->count > 0) {
+            lines[n].frames = &sampler->frames[stack->first];
+            lines[n].depth = stack->depth;
+            lines[n].count = stack->count;
+            n++;
+        }
+    }
+    resume_sampling(&saved);
+
+    qsort(lines, n, sizeof(SampleLine), compare_lines);
+    for (int i = 0; i < n; i++) {
+        uint64_t count = lines[i].count;
+        while (i + 1 < n && compare_lines(&lines[i], &lines[i + 1]) == 0) {
+            count += lines[++i].count;
+        }
+        for (int f = 0; f < lines[i].depth; f++) {
+            if (f > 0) {
+                fputc(';', out);
+            }
+            write_frame_name(out, sampler->methods[lines[i].frames[f].method].name);
+        }
+        fprintf(out, " %llu\n", (unsigned long long)count);
+    }
+    free(lines);
+    fclose(out);
+    return 0;
+}
+
+/* Stop sampling, print the report, write the folded stacks if
+ * jvm_set_sampling_output() asked for them, and drop the samples */
+void sampler_finish(JVM* jvm) {
+    stop_timer(jvm->sampler);
+    jvm_sampling_report(jvm, stdout);
+    if (jvm->sampler->output) {
+        jvm_sampling_write(jvm, jvm->sampler->output);
+    }
+    sampler_free(jvm->sampler);
+    jvm->sampler = NULL;
+}
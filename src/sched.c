@@ -0,0 +1,721 @@
+#define _POSIX_C_SOURCE 200112L
+#include "jvm.h"
+#include <pthread.h>
+#include <time.h>
+
+/*
+ * Green threads with a cooperative instruction-budget scheduler
+ *
+ * Several tasks share one JVM. Each green thread gets its own segment of
+ * jvm->stack and of jvm->frames when it is spawned, laid out one after
+ * the other from the bottom, so no two threads ever touch the same slot
+ * and switching between them copies nothing: the interpreter stops a
+ * thread with its state already in its own frames, saves the two indexes
+ * sp and fp in the thread, and returns; jvm_execute_thread() picks the
+ * thread up from them for its next slice.
+ *
+ * A thread is switched out when it has used its budget of bytecodes, or
+ * at a blocking point: the verifier turns calls to aruvi/Scheduler.yield()
+ * and sleep(int ticks) into instructions of their own. The interpreter
+ * checks the budget only at backward branches and calls, so straight-line
+ * code runs unchecked and a slice can overrun its budget by at most one
+ * straight run of a method.
+ *
+ * Time is a virtual clock that advances by one tick per bytecode run.
+ * Threads are picked round-robin, and when all of them are asleep the
+ * clock jumps to the earliest wake-up. The same program and inputs always
+ * give the same schedule, so the wait between a thread becoming ready and
+ * running, which is what bounds a control loop's latency, can be measured
+ * exactly and compared between runs. The JIT is bypassed while scheduled,
+ * since native code cannot stop for the budget, and threads are not
+ * counted towards the tiers; both runs link and optimize the threads'
+ * code before they start instead.
+ *
+ * scheduler_run_parallel() runs the same threads M:N over a pool of OS
+ * worker threads instead. Each worker has its own run queue: it runs the
+ * thread at the front, puts it back at the end when its slice is over,
+ * and when its queue is empty steals from the end of another's, the
+ * thread that would wait longest there. Nothing the interpreter writes
+ * for a thread is shared but objects: threads allocate from their own
+ * TLABs (see heap.c), and monitors are thin locks taken with one atomic
+ * compare-and-swap, so the only lock taken while running bytecode is the
+ * pool's, when a TLAB runs out. If the heap is full then, that worker
+ * stops the world: it waits for the others to end their slices, which
+ * they do within a budget, collects and lets them go on. A thread that
+ * finds a monitor taken gives up its slice and tries again in the next.
+ * The clock still counts every bytecode, now run on any worker, so
+ * sleeps are as long as before but schedules are no longer reproducible.
+ */
+
+#ifdef JVM_GREEN_THREADS
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/* Create a scheduler for jvm; budget is in bytecodes. Returns NULL on error. */
+Scheduler* scheduler_create(JVM* jvm, int budget) {
+    Scheduler* scheduler;
+
+    /* A thread resumed at a call has already counted it once */
+    if (budget < 2) {
+        printf("Error: scheduler budget must be at least 2\n");
+        return NULL;
+    }
+    scheduler = (Scheduler*)calloc(1, sizeof(Scheduler));
+    if (scheduler) {
+        scheduler->jvm = jvm;
+        scheduler->budget = budget;
+        scheduler->tlab_size = TLAB_SIZE;
+    }
+    return scheduler;
+}
+
+void scheduler_destroy(Scheduler* scheduler) {
+    free(scheduler);
+}
+
+/*
+ * Add a thread that will run method with the given int arguments. It
+ * gets the next stack_slots slots of the operand stack and the next
+ * frames frames, or the defaults if these are 0. Returns NULL on error.
+ */
+GreenThread* scheduler_spawn(Scheduler* scheduler, const char* name, Method* method,
+                             const int* args, int arg_count, int stack_slots, int frames) {
+    JVM* jvm = scheduler->jvm;
+    GreenThread* t;
+    int stack_base = 0;
+    int frame_base = 0;
+
+    if (scheduler->thread_count >= MAX_GREEN_THREADS) {
+        printf("Error: at most %d green threads\n", MAX_GREEN_THREADS);
+        return NULL;
+    }
+    if (stack_slots <= 0) {
+        stack_slots = SCHED_DEFAULT_STACK;
+    }
+    if (frames <= 0) {
+        frames = SCHED_DEFAULT_FRAMES;
+    }
+    if (method_prepare(method) != 0) {
+        return NULL;
+    }
+    if (arg_count != method->arg_slots) {
+        printf("Error: %s takes %d arguments, not %d\n", method->name, method->arg_slots, arg_count);
+        return NULL;
+    }
+    /* A thread's result is one int; a long or double has nowhere to go */
+    if (method->return_slots == 2) {
+        printf("Error: thread %s cannot return a long or double\n", name);
+        return NULL;
+    }
+    if (method->locals_count + method->max_stack > stack_slots) {
+        printf("Error: thread %s needs more than %d stack slots\n", name, stack_slots);
+        return NULL;
+    }
+    if (scheduler->thread_count > 0) {
+        const GreenThread* last = &scheduler->threads[scheduler->thread_count - 1];
+        stack_base = last->stack_limit;
+        frame_base = last->frame_limit;
+    }
+    if (stack_base + stack_slots > STACK_SIZE || frame_base + frames > MAX_FRAMES) {
+        printf("Error: no room left for thread %s\n", name);
+        return NULL;
+    }
+
+    t = &scheduler->threads[scheduler->thread_count++];
+    memset(t, 0, sizeof(GreenThread));
+    t->name = name;
+    t->id = scheduler->thread_count;
+    t->method = method;
+    t->state = THREAD_READY;
+    t->stack_base = stack_base;
+    t->stack_limit = stack_base + stack_slots;
+    t->frame_base = frame_base;
+    t->frame_limit = frame_base + frames;
+    t->fp = frame_base;
+    t->ready_ns = now_ns();
+    for (int i = 0; i < arg_count; i++) {
+        jvm->stack[stack_base + i].i = args[i];
+    }
+
+    /* The whole segment may be used, which jvm_reset() has to know */
+    if (t->stack_limit > jvm->stack_peak) {
+        jvm->stack_peak = t->stack_limit;
+    }
+    if (t->frame_limit - 1 > jvm->frame_peak) {
+        jvm->frame_peak = t->frame_limit - 1;
+    }
+    return t;
+}
+
+/* Give every thread a TLAB of about its share of half the free heap, so
+ * that most of the heap is still there to be carved when one runs out */
+static void size_tlabs(Scheduler* scheduler) {
+    JVM* jvm = scheduler->jvm;
+    int size = (jvm->heap_limit - jvm->heap_ptr) / (2 * scheduler->thread_count);
+
+    if (size > TLAB_SIZE) {
+        size = TLAB_SIZE;
+    }
+    scheduler->tlab_size = size < 64 ? 64 : size & ~7;
+}
+
+/* Counters the threads keep for the JVM totals */
+typedef struct {
+    uint64_t ticks;
+    uint64_t calls;
+    uint64_t allocated;
+} Totals;
+
+static Totals thread_totals(const Scheduler* scheduler) {
+    Totals totals = {0, 0, 0};
+    for (int i = 0; i < scheduler->thread_count; i++) {
+        const GreenThread* t = &scheduler->threads[i];
+        totals.ticks += t->ticks;
+        totals.calls += t->calls;
+        totals.allocated += t->allocated;
+    }
+    return totals;
+}
+
+/* After a run: hand back the TLABs and add what ran since before to the
+ * JVM's counters */
+static void end_run(Scheduler* scheduler, Totals before) {
+    JVM* jvm = scheduler->jvm;
+    Totals after = thread_totals(scheduler);
+
+    for (int i = 0; i < scheduler->thread_count; i++) {
+        heap_retire_tlab(jvm, &scheduler->threads[i]);
+    }
+    jvm->scheduler = NULL;
+    jvm->instructions += after.ticks - before.ticks;
+    jvm->calls += after.calls - before.calls;
+    jvm->bytes_allocated += after.allocated - before.allocated;
+}
+
+static int unfinished_threads(const Scheduler* scheduler) {
+    int unfinished = 0;
+    for (int i = 0; i < scheduler->thread_count; i++) {
+        unfinished += scheduler->threads[i].state != THREAD_DONE;
+    }
+    return unfinished;
+}
+
+/* Wake t from a sleep */
+static void wake(GreenThread* t) {
+    t->state = THREAD_READY;
+    t->ready_at = t->wake_at;
+    t->ready_ns = now_ns();
+}
+
+/* Mark t running at the given clock, measuring how long it waited */
+static void begin_slice(GreenThread* t, uint64_t clock) {
+    uint64_t wait = clock - t->ready_at;
+    uint64_t wait_ns = now_ns() - t->ready_ns;
+
+    if (wait > t->max_wait) {
+        t->max_wait = wait;
+    }
+    if (wait_ns > t->max_wait_ns) {
+        t->max_wait_ns = wait_ns;
+    }
+    t->state = THREAD_RUNNING;
+    t->slices++;
+}
+
+/* Account for the slice t just ran, which ended at the given clock */
+static void end_slice(Scheduler* scheduler, GreenThread* t, int result, uint64_t clock) {
+    uint64_t slice = t->slice_ticks;
+
+    t->ticks += slice;
+    if (slice > t->max_slice) {
+        t->max_slice = slice;
+    }
+    /* Still running means it returned, or stopped on an error */
+    if (t->state == THREAD_RUNNING) {
+        t->state = THREAD_DONE;
+        t->result = result;
+        heap_release_monitors(scheduler->jvm, &t->monitors);
+    } else if (t->state == THREAD_SLEEPING) {
+        t->wake_at = clock + (uint64_t)t->sleep_ticks;
+    } else {
+        t->ready_at = clock;
+        t->ready_ns = now_ns();
+    }
+}
+
+/* The next thread to run, round-robin, waking sleepers whose time has
+ * come and skipping ahead if all are asleep. NULL once all are done. */
+static GreenThread* next_thread(Scheduler* scheduler) {
+    for (;;) {
+        uint64_t wake_at = UINT64_MAX;
+
+        for (int i = 0; i < scheduler->thread_count; i++) {
+            GreenThread* t = &scheduler->threads[i];
+            if (t->state == THREAD_SLEEPING && t->wake_at <= scheduler->clock) {
+                wake(t);
+            }
+        }
+        for (int i = 0; i < scheduler->thread_count; i++) {
+            int index = (scheduler->next + i) % scheduler->thread_count;
+            GreenThread* t = &scheduler->threads[index];
+            if (t->state == THREAD_READY) {
+                scheduler->next = (index + 1) % scheduler->thread_count;
+                return t;
+            }
+            if (t->state == THREAD_SLEEPING && t->wake_at < wake_at) {
+                wake_at = t->wake_at;
+            }
+        }
+        if (wake_at == UINT64_MAX) {
+            return NULL;
+        }
+        scheduler->idle += wake_at - scheduler->clock;
+        scheduler->clock = wake_at;
+    }
+}
+
+/* Resolve the threads' calls and optimize their code now: threads are
+ * not counted towards the tiers, and in parallel no call site or code
+ * may be written while they run */
+static int link_threads(Scheduler* scheduler) {
+    for (int i = 0; i < scheduler->thread_count; i++) {
+        if (method_link(scheduler->threads[i].method) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Run the threads on this OS thread until all are done, or until the
+ * clock reaches max_ticks if that is not 0. Returns the number of threads
+ * that have not finished, or -1 on error.
+ */
+int scheduler_run(Scheduler* scheduler, uint64_t max_ticks) {
+    JVM* jvm = scheduler->jvm;
+    GreenThread* last = NULL;
+    GreenThread* t;
+    Totals before = thread_totals(scheduler);
+
+    if (jvm->running) {
+        printf("Error: cannot schedule threads from inside a running method\n");
+        return -1;
+    }
+    if (link_threads(scheduler) != 0) {
+        return -1;
+    }
+    jvm->scheduler = scheduler;
+    size_tlabs(scheduler);
+    while ((t = next_thread(scheduler)) != NULL &&
+           (max_ticks == 0 || scheduler->clock < max_ticks)) {
+        int result;
+        if (t != last) {
+            scheduler->switches++;
+            last = t;
+        }
+        begin_slice(t, scheduler->clock);
+        result = jvm_execute_thread(jvm, t);
+        scheduler->clock += t->slice_ticks;
+        end_slice(scheduler, t, result, scheduler->clock);
+    }
+    end_run(scheduler, before);
+    return unfinished_threads(scheduler);
+}
+
+/* One worker's queue of ready threads. A thread is in at most one queue,
+ * so each has room for all of them. */
+typedef struct {
+    pthread_mutex_t lock;
+    GreenThread* threads[MAX_GREEN_THREADS];
+    int head;
+    int count;
+} RunQueue;
+
+typedef struct WorkerPool WorkerPool;
+
+typedef struct {
+    WorkerPool* pool;
+    int index;
+    pthread_t thread;
+} Worker;
+
+/*
+ * Shared state of a parallel run. lock guards heap_ptr, the collection
+ * and the sleeping threads; running, stop, queued, idle and sleeping are
+ * also read without it. A worker counts as running from taking a thread
+ * until its slice is accounted for, and must not be while the world is
+ * stopped.
+ */
+struct WorkerPool {
+    Scheduler* scheduler;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;     /* Work queued, or every thread done */
+    pthread_cond_t stopped;     /* A worker stopped running for the collection */
+    pthread_cond_t restarted;   /* The collection is over */
+    Worker workers[MAX_WORKERS];
+    RunQueue queues[MAX_WORKERS];
+    int worker_count;
+    int running;                /* Workers that are running */
+    int stop;                   /* A collection waits for running to be 0 */
+    int queued;                 /* Threads in all the queues */
+    int idle;                   /* Workers waiting for work */
+    GreenThread* sleepers[MAX_GREEN_THREADS];
+    int sleeping;               /* Threads asleep, in sleepers */
+    int done;                   /* Threads finished */
+};
+
+#define LOAD(p) __atomic_load_n(p, __ATOMIC_SEQ_CST)
+#define ADD(p, n) __atomic_add_fetch(p, n, __ATOMIC_SEQ_CST)
+
+/* Add t to the end of a worker's queue */
+static void queue_thread(WorkerPool* pool, int index, GreenThread* t) {
+    RunQueue* queue = &pool->queues[index];
+
+    pthread_mutex_lock(&queue->lock);
+    queue->threads[(queue->head + queue->count++) % MAX_GREEN_THREADS] = t;
+    pthread_mutex_unlock(&queue->lock);
+    ADD(&pool->queued, 1);
+}
+
+/* Queue t, and tell the workers waiting for work. A worker about to wait
+ * either sees it queued or is counted in idle first. */
+static void push_thread(WorkerPool* pool, int index, GreenThread* t) {
+    queue_thread(pool, index, t);
+    if (LOAD(&pool->idle) > 0) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_broadcast(&pool->changed);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+/* The thread at the front of the worker's own queue, or else one stolen
+ * from the end of another's; NULL if all are empty */
+static GreenThread* take_thread(WorkerPool* pool, int index) {
+    GreenThread* t = NULL;
+
+    for (int i = 0; i < pool->worker_count && !t; i++) {
+        RunQueue* queue = &pool->queues[(index + i) % pool->worker_count];
+        pthread_mutex_lock(&queue->lock);
+        if (queue->count > 0) {
+            if (i == 0) {
+                t = queue->threads[queue->head];
+                queue->head = (queue->head + 1) % MAX_GREEN_THREADS;
+            } else {
+                t = queue->threads[(queue->head + queue->count - 1) % MAX_GREEN_THREADS];
+                ADD(&pool->scheduler->steals, 1);
+            }
+            queue->count--;
+        }
+        pthread_mutex_unlock(&queue->lock);
+    }
+    if (t) {
+        ADD(&pool->queued, -1);
+    }
+    return t;
+}
+
+/* Start running, waiting out a collection first */
+static void start_running(WorkerPool* pool) {
+    for (;;) {
+        ADD(&pool->running, 1);
+        if (!LOAD(&pool->stop)) {
+            return;
+        }
+        ADD(&pool->running, -1);
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->stopped);
+        while (pool->stop) {
+            pthread_cond_wait(&pool->restarted, &pool->lock);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+static void stop_running(WorkerPool* pool) {
+    ADD(&pool->running, -1);
+    if (LOAD(&pool->stop)) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->stopped);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+/* Queue the sleepers whose time has come on a worker. Called with the
+ * pool locked; returns how many woke. */
+static int wake_sleepers(WorkerPool* pool, int index) {
+    uint64_t clock = LOAD(&pool->scheduler->clock);
+    int woken = 0;
+
+    for (int i = 0; i < pool->sleeping; ) {
+        GreenThread* t = pool->sleepers[i];
+        if (t->wake_at <= clock) {
+            wake(t);
+            pool->sleepers[i] = pool->sleepers[pool->sleeping - 1];
+            ADD(&pool->sleeping, -1);
+            queue_thread(pool, index, t);
+            woken++;
+        } else {
+            i++;
+        }
+    }
+    if (woken > 0 && LOAD(&pool->idle) > 0) {
+        pthread_cond_broadcast(&pool->changed);
+    }
+    return woken;
+}
+
+/*
+ * Wait for a thread to run, with the worker's queue empty. If no worker
+ * is running or collecting and none is queued, every thread left is
+ * asleep, so the clock skips to the first wake-up. Returns 0 once all
+ * are done.
+ */
+static int wait_for_work(WorkerPool* pool, int index) {
+    Scheduler* scheduler = pool->scheduler;
+    int more = 1;
+
+    pthread_mutex_lock(&pool->lock);
+    ADD(&pool->idle, 1);
+    if (pool->done == scheduler->thread_count) {
+        more = 0;
+    } else if (LOAD(&pool->queued) == 0 && wake_sleepers(pool, index) == 0) {
+        if (LOAD(&pool->running) == 0 && !pool->stop && pool->sleeping > 0) {
+            uint64_t clock = LOAD(&scheduler->clock);
+            uint64_t wake_at = UINT64_MAX;
+            for (int i = 0; i < pool->sleeping; i++) {
+                if (pool->sleepers[i]->wake_at < wake_at) {
+                    wake_at = pool->sleepers[i]->wake_at;
+                }
+            }
+            if (wake_at > clock) {
+                scheduler->idle += wake_at - clock;
+                ADD(&scheduler->clock, wake_at - clock);
+            }
+            wake_sleepers(pool, index);
+        } else {
+            pthread_cond_wait(&pool->changed, &pool->lock);
+        }
+    }
+    ADD(&pool->idle, -1);
+    pthread_mutex_unlock(&pool->lock);
+    return more;
+}
+
+static void* worker_main(void* arg) {
+    Worker* worker = (Worker*)arg;
+    WorkerPool* pool = worker->pool;
+    Scheduler* scheduler = pool->scheduler;
+    GreenThread* last = NULL;
+
+    for (;;) {
+        GreenThread* t;
+        ThreadState state;
+        uint64_t clock;
+        int result;
+
+        start_running(pool);
+        t = take_thread(pool, worker->index);
+        if (!t) {
+            stop_running(pool);
+            if (!wait_for_work(pool, worker->index)) {
+                return NULL;
+            }
+            continue;
+        }
+        if (t != last) {
+            ADD(&scheduler->switches, 1);
+            last = t;
+        }
+        begin_slice(t, LOAD(&scheduler->clock));
+        result = jvm_execute_thread(scheduler->jvm, t);
+        clock = ADD(&scheduler->clock, t->slice_ticks);
+        end_slice(scheduler, t, result, clock);
+
+        /* Once it is queued or asleep, another worker may take t */
+        state = t->state;
+        if (state == THREAD_READY) {
+            push_thread(pool, worker->index, t);
+        } else {
+            pthread_mutex_lock(&pool->lock);
+            if (state == THREAD_SLEEPING) {
+                pool->sleepers[pool->sleeping] = t;
+                ADD(&pool->sleeping, 1);
+            } else if (++pool->done == scheduler->thread_count) {
+                pthread_cond_broadcast(&pool->changed);
+            }
+            pthread_mutex_unlock(&pool->lock);
+        }
+        stop_running(pool);
+
+        if (LOAD(&pool->sleeping) > 0) {
+            pthread_mutex_lock(&pool->lock);
+            wake_sleepers(pool, worker->index);
+            pthread_mutex_unlock(&pool->lock);
+        }
+    }
+}
+
+/*
+ * Give a thread whose TLAB is used up a new one with room for bytes.
+ * Under a worker pool, a full heap stops the world for a collection: the
+ * thread waits, not running, until every other worker has stopped too or
+ * another collection is over. Returns 0, or -1 if the heap is still full.
+ */
+int scheduler_refill_tlab(Scheduler* scheduler, GreenThread* thread, uint32_t bytes) {
+    JVM* jvm = scheduler->jvm;
+    WorkerPool* pool = scheduler->pool;
+    uint32_t size = (uint32_t)scheduler->tlab_size;
+    int status;
+
+    if (!pool) {
+        if (heap_refill_tlab(jvm, thread, bytes, size) == 0) {
+            return 0;
+        }
+        jvm_gc(jvm);
+        return heap_refill_tlab(jvm, thread, bytes, size);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    status = heap_refill_tlab(jvm, thread, bytes, size);
+    if (status != 0) {
+        ADD(&pool->running, -1);
+        pthread_cond_signal(&pool->stopped);
+        while (pool->stop) {
+            pthread_cond_wait(&pool->restarted, &pool->lock);
+        }
+        status = heap_refill_tlab(jvm, thread, bytes, size);
+        if (status != 0) {
+            __atomic_store_n(&pool->stop, 1, __ATOMIC_SEQ_CST);
+            while (LOAD(&pool->running) > 0) {
+                pthread_cond_wait(&pool->stopped, &pool->lock);
+            }
+            jvm_gc(jvm);
+            __atomic_store_n(&pool->stop, 0, __ATOMIC_SEQ_CST);
+            pthread_cond_broadcast(&pool->restarted);
+            pthread_cond_broadcast(&pool->changed);
+            status = heap_refill_tlab(jvm, thread, bytes, size);
+        }
+        ADD(&pool->running, 1);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return status;
+}
+
+/*
+ * Run the threads M:N on workers OS threads until all are done. The
+ * threads start spread round-robin over the workers' queues. Returns the
+ * number of threads that have not finished, or -1 on error.
+ */
+int scheduler_run_parallel(Scheduler* scheduler, int workers) {
+    JVM* jvm = scheduler->jvm;
+    WorkerPool* pool;
+    Totals before = thread_totals(scheduler);
+    uint64_t start;
+    int started = 0;
+
+    if (workers < 1 || workers > MAX_WORKERS) {
+        printf("Error: worker count must be between 1 and %d\n", MAX_WORKERS);
+        return -1;
+    }
+    if (jvm->running) {
+        printf("Error: cannot schedule threads from inside a running method\n");
+        return -1;
+    }
+    if (jvm->profile) {
+        printf("Error: cannot profile threads running in parallel\n");
+        return -1;
+    }
+    if (link_threads(scheduler) != 0) {
+        return -1;
+    }
+    pool = (WorkerPool*)calloc(1, sizeof(WorkerPool));
+    if (!pool) {
+        printf("Error: out of memory\n");
+        return -1;
+    }
+    pool->scheduler = scheduler;
+    pool->worker_count = workers;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->changed, NULL);
+    pthread_cond_init(&pool->stopped, NULL);
+    pthread_cond_init(&pool->restarted, NULL);
+    for (int i = 0; i < workers; i++) {
+        pthread_mutex_init(&pool->queues[i].lock, NULL);
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+    }
+    for (int i = 0; i < scheduler->thread_count; i++) {
+        GreenThread* t = &scheduler->threads[i];
+        if (t->state == THREAD_READY) {
+            push_thread(pool, i % workers, t);
+        } else if (t->state == THREAD_SLEEPING) {
+            pool->sleepers[pool->sleeping++] = t;
+        } else {
+            pool->done++;
+        }
+    }
+
+    jvm->scheduler = scheduler;
+    scheduler->pool = pool;
+    scheduler->workers = workers;
+    scheduler->steals = 0;
+    size_tlabs(scheduler);
+    start = now_ns();
+    while (started < workers &&
+           pthread_create(&pool->workers[started].thread, NULL, worker_main,
+                          &pool->workers[started]) == 0) {
+        started++;
+    }
+    if (started == 0) {
+        /* Run on this thread rather than not at all */
+        worker_main(&pool->workers[0]);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+    scheduler->wall_ns = now_ns() - start;
+    scheduler->pool = NULL;
+    end_run(scheduler, before);
+
+    for (int i = 0; i < workers; i++) {
+        pthread_mutex_destroy(&pool->queues[i].lock);
+    }
+    pthread_cond_destroy(&pool->restarted);
+    pthread_cond_destroy(&pool->stopped);
+    pthread_cond_destroy(&pool->changed);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+    return unfinished_threads(scheduler);
+}
+
+void scheduler_print_stats(const Scheduler* scheduler) {
+    static const char* const states[] = {"ready", "running", "sleeping", "done"};
+
+    printf("Scheduler: %d threads, budget %d, clock %llu ticks (%llu idle), %llu switches\n",
+           scheduler->thread_count, scheduler->budget, (unsigned long long)scheduler->clock,
+           (unsigned long long)scheduler->idle, (unsigned long long)scheduler->switches);
+    if (scheduler->workers > 0) {
+        printf("Workers: %d, %llu steals, %.3f ms\n", scheduler->workers,
+               (unsigned long long)scheduler->steals, (double)scheduler->wall_ns / 1e6);
+    }
+    printf("  %-12s %-8s %10s %8s %10s %10s %12s %10s\n", "thread", "state", "ticks",
+           "slices", "max slice", "max wait", "max wait ns", "result");
+    for (int i = 0; i < scheduler->thread_count; i++) {
+        const GreenThread* t = &scheduler->threads[i];
+        printf("  %-12s %-8s %10llu %8llu %10llu %10llu %12llu ", t->name, states[t->state],
+               (unsigned long long)t->ticks, (unsigned long long)t->slices,
+               (unsigned long long)t->max_slice, (unsigned long long)t->max_wait,
+               (unsigned long long)t->max_wait_ns);
+        if (t->state == THREAD_DONE) {
+            printf("%10d\n", t->result);
+        } else {
+            printf("%10s\n", "-");
+        }
+    }
+}
+
+#endif
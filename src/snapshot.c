@@ -0,0 +1,1097 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "jvm.h"
+
+#ifndef JVM_NO_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Startup snapshots
+ *
+ * A snapshot is an image of a registry's classes as they are once loaded,
+ * linked and verified, with every call they make resolved and their code
+ * in the optimized tier. Loading one skips parsing, decoding, verification
+ * and linking: the image is mapped and the classes point into it.
+ *
+ * The image holds no pointers. Data is found by its offset from the start
+ * of the file and classes and methods by their index, so the image is
+ * position independent and nothing in it is patched when it is loaded.
+ * Bytecode, the pre-decoded instructions, the verifier's stack depths and
+ * slot types, switch tables, exception tables, names and the text of
+ * String constants are used where they lie, in a private mapping whose
+ * pages are read from disk when first touched and only copied if
+ * superinstruction fusion rewrites them. What the runtime keeps pointers
+ * in, the vtables, itables, call sites and decoded exception tables, is
+ * built at load from the indexes, without looking up any name except
+ * those of the built-in classes.
+ *
+ * The image is in the host's byte order and records the build options
+ * the decoded form depends on; one made by another build is rejected, not
+ * converted. It is a cache, and the class files or containers it was made
+ * from stay the portable form. Only its structure is checked when it is
+ * loaded: the code in it was verified when it was made.
+ *
+ *   SnapshotHeader
+ *   SnapClass[class_count]     In the registry's order
+ *   SnapMethod[method_count]   Each class's methods in its order, from
+ *                              its first_method on
+ *   and then the arrays and strings they refer to. Arrays start at a
+ *   multiple of 8 bytes.
+ *
+ * A reference to a class or method is a uint32_t: 0 for none, n for class
+ * or method n - 1 of the image, or SNAP_EXTERN | the offset of a
+ * SnapExtern naming a built-in class or one of its methods.
+ */
+
+#define SNAPSHOT_MAGIC 0x41534e50       /* "ASNP" */
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+#define SNAP_EXTERN 0x80000000u
+
+#ifdef JVM_FUSION
+#define SNAP_FUSION 1u
+#else
+#define SNAP_FUSION 0u
+#endif
+#ifdef JVM_FLOAT
+#define SNAP_FLOAT 1u
+#else
+#define SNAP_FLOAT 0u
+#endif
+#ifdef JVM_GREEN_THREADS
+#define SNAP_GREEN_THREADS 1u
+#else
+#define SNAP_GREEN_THREADS 0u
+#endif
+
+/* The build options an image depends on */
+#define SNAPSHOT_BUILD ((uint32_t)INSN_COUNT | (uint32_t)TOS_SCRATCH_LOCALS << 12 | \
+                        SNAP_FUSION << 16 | SNAP_FLOAT << 17 | SNAP_GREEN_THREADS << 18 | \
+                        (uint32_t)sizeof(Insn) << 24)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t byte_order;        /* SNAPSHOT_BYTE_ORDER as the host stores it */
+    uint32_t build;             /* SNAPSHOT_BUILD */
+    uint32_t file_size;
+    uint32_t class_count;
+    uint32_t classes;
+    uint32_t method_count;
+    uint32_t methods;
+    uint32_t reserved;
+} SnapshotHeader;
+
+typedef struct {
+    uint32_t class_name;
+    uint32_t name;              /* 0 for the class itself */
+    uint32_t descriptor;
+} SnapExtern;
+
+typedef struct {
+    uint32_t name;
+    uint32_t access_flags;
+    uint32_t super_name;
+    uint32_t super;
+    uint32_t interface_count;
+    uint32_t interface_names[MAX_INTERFACES];
+    uint32_t interfaces[MAX_INTERFACES];
+    uint32_t first_method;
+    uint32_t method_count;
+    uint32_t constants;         /* SnapConstant[constant_count - 1], from index 1 */
+    uint32_t constant_count;
+    uint32_t fields;            /* SnapField[field_count] */
+    uint32_t field_count;
+    uint32_t instance_fields;
+    uint32_t ref_map;
+    uint32_t vtable;            /* Method references */
+    uint32_t vtable_length;
+    uint32_t itable;            /* SnapITableEntry[itable_length] */
+    uint32_t itable_length;
+} SnapClass;
+
+typedef struct {
+    int64_t wide;
+    int32_t tag;
+    int32_t resolved;
+    uint32_t ref1, ref2;
+    int32_t value;
+    uint32_t utf8, utf8_length;
+    uint32_t name, class_name, descriptor;
+    uint32_t method;
+    uint32_t cls;
+    uint32_t chars, chars_length;
+    int32_t coder;
+    uint32_t reserved;
+} SnapConstant;
+
+typedef struct {
+    uint32_t name;
+    uint32_t descriptor;
+    int32_t slot;
+    uint32_t reserved;
+} SnapField;
+
+typedef struct {
+    uint32_t interface;
+    uint32_t methods;           /* Method references, one per interface method */
+} SnapITableEntry;
+
+typedef struct {
+    uint32_t name, descriptor;
+    int32_t access_flags;
+    int32_t vtable_index;
+    int32_t arg_slots, return_slots;
+    uint32_t code, code_length;
+    uint32_t handlers, handler_count;   /* ExceptionHandler[] */
+    int32_t locals_count, max_stack;
+    int32_t limits_declared;
+    int32_t tier;
+    uint32_t insns, insn_count;         /* 0 for an abstract method */
+    uint32_t bytecode_pc;
+    uint32_t stack_depth;
+    uint32_t slot_types;
+    int32_t frame_slots;
+    uint32_t call_sites, call_site_count;
+    uint32_t switches, switch_count;
+    uint32_t decoded_handlers, decoded_handler_count;
+} SnapMethod;
+
+typedef struct {
+    uint32_t target;
+    uint32_t cls;               /* Class of the inline cache's target */
+    int32_t arg_slots;
+} SnapCallSite;
+
+typedef struct {
+    int32_t low, count, default_target;
+    uint32_t targets;
+    uint32_t keys;              /* 0 for a jump table */
+    uint32_t hash;              /* 0 unless hashed */
+    int32_t hash_shift;
+    uint32_t reserved;
+} SnapSwitch;
+
+typedef struct {
+    int32_t start, end, target, catch_type;
+    uint32_t catch_class;
+} SnapHandler;
+
+/*
+ * Writing
+ */
+
+typedef struct {
+    ClassRegistry* registry;
+    uint8_t* data;
+    uint32_t size;
+    uint32_t capacity;
+    int failed;
+    uint32_t first_method[MAX_CLASSES];
+} Writer;
+
+/* Append size bytes of data, or zeros if data is NULL, at a multiple of
+ * align. Returns their offset, or 0 once out of memory; nothing but the
+ * header is at offset 0. */
+static uint32_t emit(Writer* w, const void* data, size_t size, uint32_t align) {
+    uint32_t offset = (w->size + align - 1) & ~(align - 1);
+
+    if (w->failed) {
+        return 0;
+    }
+    if (size > UINT32_MAX / 2 - offset) {
+        printf("Error: snapshot too large\n");
+        w->failed = 1;
+        return 0;
+    }
+    if (offset + size > w->capacity) {
+        uint32_t capacity = w->capacity ? w->capacity : 4096;
+        uint8_t* grown;
+        while (capacity < offset + size) {
+            capacity *= 2;
+        }
+        grown = (uint8_t*)realloc(w->data, capacity);
+        if (!grown) {
+            printf("Error: out of memory\n");
+            w->failed = 1;
+            return 0;
+        }
+        w->data = grown;
+        w->capacity = capacity;
+    }
+    memset(w->data + w->size, 0, offset - w->size);
+    if (data) {
+        memcpy(w->data + offset, data, size);
+    } else {
+        memset(w->data + offset, 0, size);
+    }
+    w->size = offset + (uint32_t)size;
+    return offset;
+}
+
+/* An array of count items, or 0 if there is none */
+static uint32_t emit_array(Writer* w, const void* data, int count, size_t size) {
+    return data ? emit(w, data, (size_t)count * size, 8) : 0;
+}
+
+static uint32_t emit_string(Writer* w, const char* s) {
+    return s ? emit(w, s, strlen(s) + 1, 1) : 0;
+}
+
+/* Bytes with a NUL after them, as String constant text is kept */
+static uint32_t emit_bytes(Writer* w, const uint8_t* bytes, int length) {
+    uint32_t offset;
+
+    if (!bytes) {
+        return 0;
+    }
+    offset = emit(w, NULL, (size_t)length + 1, 1);
+    if (offset) {
+        memcpy(w->data + offset, bytes, (size_t)length);
+    }
+    return offset;
+}
+
+static uint32_t extern_ref(Writer* w, const char* class_name, const char* name,
+                           const char* descriptor) {
+    SnapExtern entry;
+    uint32_t offset;
+
+    entry.class_name = emit_string(w, class_name);
+    entry.name = emit_string(w, name);
+    entry.descriptor = emit_string(w, descriptor);
+    offset = emit(w, &entry, sizeof(entry), 8);
+    return offset ? SNAP_EXTERN | offset : 0;
+}
+
+static uint32_t class_ref(Writer* w, const Class* cls) {
+    if (!cls) {
+        return 0;
+    }
+    for (int i = 0; i < w->registry->count; i++) {
+        if (w->registry->classes[i] == cls) {
+            return (uint32_t)i + 1;
+        }
+    }
+    if (class_system(cls->name) == cls) {
+        return extern_ref(w, cls->name, NULL, NULL);
+    }
+    printf("Error: class %s is not in the snapshot\n", cls->name);
+    w->failed = 1;
+    return 0;
+}
+
+static uint32_t method_ref(Writer* w, const Method* method) {
+    if (!method) {
+        return 0;
+    }
+    for (int i = 0; i < w->registry->count; i++) {
+        if (w->registry->classes[i] == method->owner) {
+            return w->first_method[i] + (uint32_t)(method - method->owner->methods) + 1;
+        }
+    }
+    if (method->owner && class_system(method->owner->name) == method->owner) {
+        return extern_ref(w, method->owner->name, method->name, method->descriptor);
+    }
+    printf("Error: method %s is not in the snapshot\n", method->name);
+    w->failed = 1;
+    return 0;
+}
+
+/* Array of count method references */
+static uint32_t emit_method_refs(Writer* w, Method** methods, int count) {
+    uint32_t offset = emit(w, NULL, sizeof(uint32_t) * (size_t)count, 8);
+
+    for (int i = 0; i < count && offset; i++) {
+        uint32_t ref = method_ref(w, methods[i]);
+        if (!w->failed) {
+            memcpy(w->data + offset + i * sizeof(uint32_t), &ref, sizeof(ref));
+        }
+    }
+    return w->failed ? 0 : offset;
+}
+
+static void emit_constants(Writer* w, const Class* cls, SnapClass* entry) {
+    uint32_t offset = emit(w, NULL, sizeof(SnapConstant) * (size_t)(cls->constant_count - 1), 8);
+
+    for (int i = 1; i < cls->constant_count && !w->failed; i++) {
+        const Constant* constant = &cls->constants[i];
+        SnapConstant out;
+
+        memset(&out, 0, sizeof(out));
+        out.wide = constant->wide;
+        out.tag = constant->tag;
+        out.resolved = constant->resolved;
+        out.ref1 = constant->ref1;
+        out.ref2 = constant->ref2;
+        out.value = constant->value;
+        out.utf8 = emit_bytes(w, constant->utf8, constant->utf8_length);
+        out.utf8_length = (uint32_t)constant->utf8_length;
+        out.name = emit_string(w, constant->name);
+        out.class_name = emit_string(w, constant->class_name);
+        out.descriptor = emit_string(w, constant->descriptor);
+        out.method = method_ref(w, constant->method);
+        out.cls = class_ref(w, constant->cls);
+        out.chars = emit_bytes(w, constant->chars, constant->chars_length << constant->coder);
+        out.chars_length = (uint32_t)constant->chars_length;
+        out.coder = constant->coder;
+        if (!w->failed) {
+            memcpy(w->data + offset + (i - 1) * sizeof(SnapConstant), &out, sizeof(out));
+        }
+    }
+    entry->constants = offset;
+    entry->constant_count = (uint32_t)cls->constant_count;
+}
+
+static void emit_decoded(Writer* w, const Method* method, SnapMethod* out) {
+    const DecodedCode* decoded = &method->decoded;
+    uint32_t offset;
+
+    out->insns = emit_array(w, decoded->insns, decoded->count, sizeof(Insn));
+    out->insn_count = (uint32_t)decoded->count;
+    out->bytecode_pc = emit_array(w, decoded->bytecode_pc, decoded->count, sizeof(int));
+    out->stack_depth = emit_array(w, decoded->stack_depth, decoded->count, sizeof(int));
+    out->slot_types = emit_array(w, decoded->slot_types, decoded->count * decoded->frame_slots, 1);
+    out->frame_slots = decoded->frame_slots;
+
+    offset = emit(w, NULL, sizeof(SnapCallSite) * (size_t)decoded->call_site_count, 8);
+    for (int i = 0; i < decoded->call_site_count && !w->failed; i++) {
+        const CallSite* site = &decoded->call_sites[i];
+        SnapCallSite entry;
+        entry.target = method_ref(w, site->target);
+        entry.cls = site->class_id ? class_ref(w, class_by_id(site->class_id)) : 0;
+        entry.arg_slots = site->arg_slots;
+        if (!w->failed) {
+            memcpy(w->data + offset + i * sizeof(entry), &entry, sizeof(entry));
+        }
+    }
+    out->call_sites = offset;
+    out->call_site_count = (uint32_t)decoded->call_site_count;
+
+    offset = emit(w, NULL, sizeof(SnapSwitch) * (size_t)decoded->switch_count, 8);
+    for (int i = 0; i < decoded->switch_count && !w->failed; i++) {
+        const SwitchTable* table = &decoded->switches[i];
+        SnapSwitch entry;
+        size_t hash_size;
+        memset(&entry, 0, sizeof(entry));
+        entry.low = table->low;
+        entry.count = table->count;
+        entry.default_target = table->default_target;
+        entry.targets = emit_array(w, table->targets, table->count, sizeof(int));
+        entry.keys = emit_array(w, table->keys, table->count, sizeof(int32_t));
+        /* Only hashed tables have a hash_shift; the others leave it 0 */
+        hash_size = table->hash ? (size_t)1 << (32 - table->hash_shift) : 0;
+        entry.hash = emit_array(w, table->hash, (int)hash_size, sizeof(uint32_t));
+        entry.hash_shift = table->hash_shift;
+        if (!w->failed) {
+            memcpy(w->data + offset + i * sizeof(entry), &entry, sizeof(entry));
+        }
+    }
+    out->switches = offset;
+    out->switch_count = (uint32_t)decoded->switch_count;
+
+    offset = emit(w, NULL, sizeof(SnapHandler) * (size_t)decoded->handler_count, 8);
+    for (int i = 0; i < decoded->handler_count && !w->failed; i++) {
+        const DecodedHandler* handler = &decoded->handlers[i];
+        SnapHandler entry;
+        entry.start = handler->start;
+        entry.end = handler->end;
+        entry.target = handler->target;
+        entry.catch_type = handler->catch_type;
+        entry.catch_class = class_ref(w, handler->catch_class);
+        if (!w->failed) {
+            memcpy(w->data + offset + i * sizeof(entry), &entry, sizeof(entry));
+        }
+    }
+    out->decoded_handlers = offset;
+    out->decoded_handler_count = (uint32_t)decoded->handler_count;
+}
+
+static void emit_method(Writer* w, const Method* method, uint32_t at) {
+    SnapMethod out;
+
+    memset(&out, 0, sizeof(out));
+    out.name = emit_string(w, method->name);
+    out.descriptor = emit_string(w, method->descriptor);
+    out.access_flags = method->access_flags;
+    out.vtable_index = method->vtable_index;
+    out.arg_slots = method->arg_slots;
+    out.return_slots = method->return_slots;
+    out.code = emit_bytes(w, method->code, method->code_length);
+    out.code_length = (uint32_t)method->code_length;
+    out.handlers = emit_array(w, method->handlers, method->handler_count, sizeof(ExceptionHandler));
+    out.handler_count = (uint32_t)method->handler_count;
+    out.locals_count = method->locals_count;
+    out.max_stack = method->max_stack;
+    out.limits_declared = method->limits_declared;
+    /* Native code is not kept; the method comes back optimized */
+    out.tier = method->tier > TIER_OPTIMIZED ? TIER_OPTIMIZED : method->tier;
+    if (method->prepared) {
+        emit_decoded(w, method, &out);
+    }
+    if (!w->failed) {
+        memcpy(w->data + at, &out, sizeof(out));
+    }
+}
+
+static void emit_class(Writer* w, int index, uint32_t at) {
+    const Class* cls = w->registry->classes[index];
+    SnapClass out;
+    uint32_t offset;
+
+    memset(&out, 0, sizeof(out));
+    out.name = emit_string(w, cls->name);
+    out.access_flags = (uint32_t)cls->access_flags;
+    out.super_name = emit_string(w, cls->super_name);
+    out.super = class_ref(w, cls->super);
+    out.interface_count = (uint32_t)cls->interface_count;
+    for (int i = 0; i < cls->interface_count; i++) {
+        out.interface_names[i] = emit_string(w, cls->interface_names[i]);
+        out.interfaces[i] = class_ref(w, cls->interfaces[i]);
+    }
+    out.first_method = w->first_method[index];
+    out.method_count = (uint32_t)cls->method_count;
+    emit_constants(w, cls, &out);
+
+    offset = emit(w, NULL, sizeof(SnapField) * (size_t)cls->field_count, 8);
+    for (int i = 0; i < cls->field_count && !w->failed; i++) {
+        SnapField field;
+        field.name = emit_string(w, cls->fields[i].name);
+        field.descriptor = emit_string(w, cls->fields[i].descriptor);
+        field.slot = cls->fields[i].slot;
+        field.reserved = 0;
+        if (!w->failed) {
+            memcpy(w->data + offset + i * sizeof(field), &field, sizeof(field));
+        }
+    }
+    out.fields = offset;
+    out.field_count = (uint32_t)cls->field_count;
+    out.instance_fields = (uint32_t)cls->instance_fields;
+    out.ref_map = cls->ref_map;
+    out.vtable = emit_method_refs(w, cls->vtable, cls->vtable_length);
+    out.vtable_length = (uint32_t)cls->vtable_length;
+
+    offset = emit(w, NULL, sizeof(SnapITableEntry) * (size_t)cls->itable_length, 8);
+    for (int i = 0; i < cls->itable_length && !w->failed; i++) {
+        const ITableEntry* entry = &cls->itable[i];
+        SnapITableEntry out_entry;
+        out_entry.interface = class_ref(w, entry->interface);
+        out_entry.methods = emit_method_refs(w, entry->methods, entry->interface->vtable_length);
+        if (!w->failed) {
+            memcpy(w->data + offset + i * sizeof(out_entry), &out_entry, sizeof(out_entry));
+        }
+    }
+    out.itable = offset;
+    out.itable_length = (uint32_t)cls->itable_length;
+
+    if (!w->failed) {
+        memcpy(w->data + at, &out, sizeof(out));
+    }
+}
+
+/* Link every class and method of the registry, so that what is written
+ * is what a program that has started running would have */
+static int prepare_registry(ClassRegistry* registry) {
+    for (int c = 0; c < registry->count; c++) {
+        Class* cls = registry->classes[c];
+        if (cls->container) {
+            printf("Error: class %s has methods left in its container\n", cls->name);
+            return -1;
+        }
+        if (class_link(cls) != 0) {
+            return -1;
+        }
+        /* Entries that don't resolve, such as NameAndType, stay raw */
+        for (int i = 1; i < cls->constant_count; i++) {
+            class_resolve_constant(cls, i);
+        }
+    }
+    for (int c = 0; c < registry->count; c++) {
+        Class* cls = registry->classes[c];
+        for (int i = 0; i < cls->method_count; i++) {
+            Method* method = &cls->methods[i];
+            if (method->access_flags & ACC_ABSTRACT) {
+                continue;
+            }
+            if (method->access_flags & ACC_NATIVE) {
+                printf("Error: cannot snapshot native method %s.%s\n", cls->name, method->name);
+                return -1;
+            }
+            if (method_link(method) != 0) {
+                printf("Error: cannot link %s.%s\n", cls->name, method->name);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+ * Write a snapshot of the classes of a registry. They are linked and
+ * every method is verified, optimized and has its calls resolved first,
+ * so the registry is left ready to run too. Returns 0, or -1 on error.
+ */
+int snapshot_write(const char* filename, ClassRegistry* registry) {
+    Writer w;
+    SnapshotHeader header;
+    uint32_t classes, methods, method_count = 0;
+    FILE* file;
+    int status = -1;
+
+    if (prepare_registry(registry) != 0) {
+        return -1;
+    }
+    memset(&w, 0, sizeof(w));
+    w.registry = registry;
+    for (int c = 0; c < registry->count; c++) {
+        w.first_method[c] = method_count;
+        method_count += (uint32_t)registry->classes[c]->method_count;
+    }
+
+    emit(&w, NULL, sizeof(SnapshotHeader), 8);
+    classes = emit(&w, NULL, sizeof(SnapClass) * (size_t)registry->count, 8);
+    methods = emit(&w, NULL, sizeof(SnapMethod) * (size_t)method_count, 8);
+    for (int c = 0; c < registry->count && !w.failed; c++) {
+        const Class* cls = registry->classes[c];
+        emit_class(&w, c, classes + (uint32_t)c * sizeof(SnapClass));
+        for (int i = 0; i < cls->method_count && !w.failed; i++) {
+            emit_method(&w, &cls->methods[i],
+                        methods + (w.first_method[c] + (uint32_t)i) * sizeof(SnapMethod));
+        }
+    }
+    if (w.failed) {
+        goto out;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = SNAPSHOT_MAGIC;
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.build = SNAPSHOT_BUILD;
+    header.file_size = w.size;
+    header.class_count = (uint32_t)registry->count;
+    header.classes = classes;
+    header.method_count = method_count;
+    header.methods = methods;
+    memcpy(w.data, &header, sizeof(header));
+
+    file = fopen(filename, "wb");
+    if (!file) {
+        printf("Error: Cannot create file %s\n", filename);
+        goto out;
+    }
+    if (fwrite(w.data, 1, w.size, file) != w.size) {
+        printf("Error: Cannot write snapshot data\n");
+        fclose(file);
+        goto out;
+    }
+    fclose(file);
+    status = 0;
+
+out:
+    free(w.data);
+    return status;
+}
+
+/*
+ * Loading
+ */
+
+typedef struct {
+    ClassRegistry* registry;
+    const SnapshotHeader* header;
+    Method** methods;           /* Every method of the image by index */
+} Loader;
+
+/* count items of size bytes at an 8-byte aligned offset, or NULL if the
+ * offset is 0 or they don't fit */
+static void* image_at(const Loader* l, uint32_t offset, uint32_t count, size_t size) {
+    size_t image_size = l->registry->image_size;
+
+    if (offset == 0 || (offset & 7) != 0 || offset > image_size ||
+        (uint64_t)count * size > (uint64_t)(image_size - offset)) {
+        return NULL;
+    }
+    return l->registry->image + offset;
+}
+
+/* length bytes anywhere in the image, or NULL */
+static uint8_t* image_bytes(const Loader* l, uint32_t offset, uint32_t length) {
+    size_t image_size = l->registry->image_size;
+
+    if (offset == 0 || offset > image_size || length > image_size - offset) {
+        return NULL;
+    }
+    return l->registry->image + offset;
+}
+
+/* NUL-terminated string, or NULL for offset 0 or one that runs off the end */
+static char* image_string(const Loader* l, uint32_t offset) {
+    size_t image_size = l->registry->image_size;
+
+    if (offset == 0 || offset >= image_size ||
+        !memchr(l->registry->image + offset, '\0', image_size - offset)) {
+        return NULL;
+    }
+    return (char*)(l->registry->image + offset);
+}
+
+/* Resolve a class reference. Returns 0, or -1 if it is bad. */
+static int class_at(const Loader* l, uint32_t ref, Class** cls) {
+    *cls = NULL;
+    if (ref == 0) {
+        return 0;
+    }
+    if (ref & SNAP_EXTERN) {
+        const SnapExtern* entry = (const SnapExtern*)image_at(l, ref & ~SNAP_EXTERN, 1,
+                                                              sizeof(SnapExtern));
+        const char* name = entry ? image_string(l, entry->class_name) : NULL;
+        *cls = name ? class_system(name) : NULL;
+    } else if (ref <= (uint32_t)l->registry->count) {
+        *cls = l->registry->classes[ref - 1];
+    }
+    return *cls ? 0 : -1;
+}
+
+/* Resolve a method reference. Returns 0, or -1 if it is bad. */
+static int method_at(const Loader* l, uint32_t ref, Method** method) {
+    *method = NULL;
+    if (ref == 0) {
+        return 0;
+    }
+    if (ref & SNAP_EXTERN) {
+        const SnapExtern* entry = (const SnapExtern*)image_at(l, ref & ~SNAP_EXTERN, 1,
+                                                              sizeof(SnapExtern));
+        const char* class_name = entry ? image_string(l, entry->class_name) : NULL;
+        const char* name = entry ? image_string(l, entry->name) : NULL;
+        const char* descriptor = entry ? image_string(l, entry->descriptor) : NULL;
+        Class* cls = class_name ? class_system(class_name) : NULL;
+        *method = cls && name && descriptor ? class_find_method(cls, name, descriptor) : NULL;
+    } else if (ref <= l->header->method_count) {
+        *method = l->methods[ref - 1];
+    }
+    return *method ? 0 : -1;
+}
+
+/* Array of count method references, as a malloc'd Method* array */
+static Method** load_method_refs(const Loader* l, uint32_t offset, uint32_t count) {
+    const uint32_t* refs = (const uint32_t*)image_at(l, offset, count, sizeof(uint32_t));
+    Method** methods = (Method**)malloc(sizeof(Method*) * ((size_t)count + 1));
+
+    if (!refs || !methods) {
+        free(methods);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (method_at(l, refs[i], &methods[i]) != 0) {
+            free(methods);
+            return NULL;
+        }
+    }
+    return methods;
+}
+
+static int load_decoded(const Loader* l, const SnapMethod* in, Method* method) {
+    DecodedCode* decoded = &method->decoded;
+    const SnapCallSite* sites;
+    const SnapSwitch* switches;
+    const SnapHandler* handlers;
+
+    /* The image's arrays are never freed, whatever fails below */
+    memset(decoded, 0, sizeof(DecodedCode));
+    decoded->in_image = 1;
+    method->prepared = 1;
+    method->tier = in->tier;
+
+    decoded->count = (int)in->insn_count;
+    decoded->frame_slots = in->frame_slots;
+    decoded->insns = (Insn*)image_at(l, in->insns, in->insn_count, sizeof(Insn));
+    decoded->bytecode_pc = (int*)image_at(l, in->bytecode_pc, in->insn_count, sizeof(int));
+    decoded->stack_depth = (int*)image_at(l, in->stack_depth, in->insn_count, sizeof(int));
+    decoded->slot_types = (uint8_t*)image_at(l, in->slot_types,
+                                             in->insn_count * (uint32_t)in->frame_slots, 1);
+    if (!decoded->insns || !decoded->bytecode_pc || !decoded->stack_depth ||
+        !decoded->slot_types || in->insn_count == 0 || in->frame_slots < 0 ||
+        (uint64_t)in->insn_count * (uint32_t)in->frame_slots > UINT32_MAX) {
+        return -1;
+    }
+
+    sites = (const SnapCallSite*)image_at(l, in->call_sites, in->call_site_count,
+                                          sizeof(SnapCallSite));
+    decoded->call_sites = (CallSite*)calloc((size_t)in->call_site_count + 1, sizeof(CallSite));
+    if (!sites || !decoded->call_sites) {
+        return -1;
+    }
+    decoded->call_site_count = (int)in->call_site_count;
+    for (uint32_t i = 0; i < in->call_site_count; i++) {
+        CallSite* site = &decoded->call_sites[i];
+        Class* cls;
+        if (method_at(l, sites[i].target, &site->target) != 0 ||
+            class_at(l, sites[i].cls, &cls) != 0) {
+            return -1;
+        }
+        site->class_id = cls ? cls->id : 0;
+        site->arg_slots = sites[i].arg_slots;
+    }
+
+    switches = (const SnapSwitch*)image_at(l, in->switches, in->switch_count, sizeof(SnapSwitch));
+    decoded->switches = (SwitchTable*)calloc((size_t)in->switch_count + 1, sizeof(SwitchTable));
+    if (!switches || !decoded->switches) {
+        return -1;
+    }
+    decoded->switch_count = (int)in->switch_count;
+    for (uint32_t i = 0; i < in->switch_count; i++) {
+        const SnapSwitch* entry = &switches[i];
+        SwitchTable* table = &decoded->switches[i];
+        table->low = entry->low;
+        table->count = entry->count;
+        table->default_target = entry->default_target;
+        table->targets = (int*)image_at(l, entry->targets, (uint32_t)entry->count, sizeof(int));
+        table->hash_shift = entry->hash_shift;
+        if (!table->targets || entry->count < 0 ||
+            (entry->hash && (entry->hash_shift <= 0 || entry->hash_shift >= 32))) {
+            return -1;
+        }
+        if (entry->keys) {
+            table->keys = (int32_t*)image_at(l, entry->keys, (uint32_t)entry->count,
+                                             sizeof(int32_t));
+            if (!table->keys) {
+                return -1;
+            }
+        }
+        if (entry->hash) {
+            table->hash = (uint32_t*)image_at(l, entry->hash, 1u << (32 - entry->hash_shift),
+                                              sizeof(uint32_t));
+            if (!table->hash) {
+                return -1;
+            }
+        }
+    }
+
+    handlers = (const SnapHandler*)image_at(l, in->decoded_handlers, in->decoded_handler_count,
+                                            sizeof(SnapHandler));
+    decoded->handlers = (DecodedHandler*)calloc((size_t)in->decoded_handler_count + 1,
+                                                sizeof(DecodedHandler));
+    if (!handlers || !decoded->handlers) {
+        return -1;
+    }
+    decoded->handler_count = (int)in->decoded_handler_count;
+    for (uint32_t i = 0; i < in->decoded_handler_count; i++) {
+        DecodedHandler* handler = &decoded->handlers[i];
+        handler->start = handlers[i].start;
+        handler->end = handlers[i].end;
+        handler->target = handlers[i].target;
+        handler->catch_type = handlers[i].catch_type;
+        if (class_at(l, handlers[i].catch_class, &handler->catch_class) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int load_method(const Loader* l, const SnapMethod* in, Method* method) {
+    method->name = image_string(l, in->name);
+    method->descriptor = image_string(l, in->descriptor);
+    method->access_flags = in->access_flags;
+    method->vtable_index = in->vtable_index;
+    method->arg_slots = in->arg_slots;
+    method->return_slots = in->return_slots;
+    method->code = in->code ? image_bytes(l, in->code, in->code_length) : NULL;
+    method->code_length = (int)in->code_length;
+    method->handlers = in->handler_count ? (ExceptionHandler*)image_at(
+        l, in->handlers, in->handler_count, sizeof(ExceptionHandler)) : NULL;
+    method->handler_count = (int)in->handler_count;
+    method->locals_count = in->locals_count;
+    method->max_stack = in->max_stack;
+    method->limits_declared = in->limits_declared;
+    if (!method->name || !method->descriptor || (in->code && !method->code) ||
+        (in->handler_count && !method->handlers)) {
+        return -1;
+    }
+    return in->insns ? load_decoded(l, in, method) : 0;
+}
+
+static int load_constants(const Loader* l, const SnapClass* in, Class* cls) {
+    const SnapConstant* constants;
+
+    if (in->constant_count < 1 || in->constant_count > MAX_CONSTANTS) {
+        return -1;
+    }
+    constants = (const SnapConstant*)image_at(l, in->constants, in->constant_count - 1,
+                                              sizeof(SnapConstant));
+    if (!constants && in->constant_count > 1) {
+        return -1;
+    }
+    cls->constant_count = (int)in->constant_count;
+    for (uint32_t i = 1; i < in->constant_count; i++) {
+        const SnapConstant* entry = &constants[i - 1];
+        Constant* constant = &cls->constants[i];
+
+        constant->tag = entry->tag;
+        constant->resolved = entry->resolved;
+        constant->ref1 = (uint16_t)entry->ref1;
+        constant->ref2 = (uint16_t)entry->ref2;
+        constant->value = entry->value;
+        constant->wide = entry->wide;
+        constant->utf8 = entry->utf8 ? image_bytes(l, entry->utf8, entry->utf8_length) : NULL;
+        constant->utf8_length = (int)entry->utf8_length;
+        constant->name = image_string(l, entry->name);
+        constant->class_name = image_string(l, entry->class_name);
+        constant->descriptor = image_string(l, entry->descriptor);
+        constant->chars = entry->chars ? image_bytes(l, entry->chars,
+                                                     entry->chars_length << (entry->coder & 1))
+                                       : NULL;
+        constant->chars_length = (int)entry->chars_length;
+        constant->coder = entry->coder;
+        if ((entry->utf8 && !constant->utf8) || (entry->name && !constant->name) ||
+            (entry->class_name && !constant->class_name) ||
+            (entry->descriptor && !constant->descriptor) || (entry->chars && !constant->chars) ||
+            method_at(l, entry->method, &constant->method) != 0 ||
+            class_at(l, entry->cls, &constant->cls) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Fill in a class of the image; snapshot_load() has checked its method
+ * range */
+static int load_class(const Loader* l, const SnapClass* in, Class* cls) {
+    const SnapMethod* methods = (const SnapMethod*)image_at(l, l->header->methods,
+                                                            l->header->method_count,
+                                                            sizeof(SnapMethod));
+    const SnapField* fields;
+    const SnapITableEntry* itable;
+
+    if (in->interface_count > MAX_INTERFACES || in->field_count > MAX_FIELDS ||
+        (!methods && in->method_count > 0)) {
+        return -1;
+    }
+    cls->access_flags = (int)in->access_flags;
+    cls->super_name = image_string(l, in->super_name);
+    if ((in->super_name && !cls->super_name) || class_at(l, in->super, &cls->super) != 0) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < in->interface_count; i++) {
+        cls->interface_names[i] = image_string(l, in->interface_names[i]);
+        if (!cls->interface_names[i]) {
+            return -1;
+        }
+        cls->interface_count++;
+        if (class_at(l, in->interfaces[i], &cls->interfaces[i]) != 0) {
+            return -1;
+        }
+    }
+
+    for (uint32_t i = 0; i < in->method_count; i++) {
+        cls->methods[i].owner = cls;
+        cls->method_count++;
+        if (load_method(l, &methods[in->first_method + i], &cls->methods[i]) != 0) {
+            return -1;
+        }
+    }
+    if (load_constants(l, in, cls) != 0) {
+        return -1;
+    }
+
+    fields = (const SnapField*)image_at(l, in->fields, in->field_count, sizeof(SnapField));
+    if (!fields && in->field_count > 0) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < in->field_count; i++) {
+        Field* field = &cls->fields[i];
+        field->name = image_string(l, fields[i].name);
+        field->descriptor = image_string(l, fields[i].descriptor);
+        field->owner = cls;
+        field->slot = fields[i].slot;
+        cls->field_count++;
+        if (!field->name || !field->descriptor) {
+            return -1;
+        }
+    }
+    cls->instance_fields = (int)in->instance_fields;
+    cls->ref_map = in->ref_map;
+
+    cls->vtable = load_method_refs(l, in->vtable, in->vtable_length);
+    if (!cls->vtable && in->vtable) {
+        return -1;
+    }
+    cls->vtable_length = (int)in->vtable_length;
+    itable = (const SnapITableEntry*)image_at(l, in->itable, in->itable_length,
+                                              sizeof(SnapITableEntry));
+    cls->itable = (ITableEntry*)calloc((size_t)in->itable_length + 1, sizeof(ITableEntry));
+    if ((!itable && in->itable) || !cls->itable) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < in->itable_length; i++) {
+        ITableEntry* entry = &cls->itable[i];
+        if (class_at(l, itable[i].interface, &entry->interface) != 0 || !entry->interface) {
+            return -1;
+        }
+        cls->itable_length++;
+        entry->methods = load_method_refs(l, itable[i].methods,
+                                          (uint32_t)entry->interface->vtable_length);
+        if (!entry->methods && itable[i].methods) {
+            return -1;
+        }
+    }
+    cls->linked = 1;
+    return 0;
+}
+
+/* Map the file into registry->image. Returns 0, or -1 on error. */
+static int map_image(const char* filename, ClassRegistry* registry) {
+#ifndef JVM_NO_MMAP
+    struct stat st;
+    void* data;
+    int fd = open(filename, O_RDONLY);
+
+    if (fd < 0) {
+        printf("Error: Cannot open file %s\n", filename);
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SnapshotHeader)) {
+        printf("Error: %s is not a snapshot\n", filename);
+        close(fd);
+        return -1;
+    }
+    /* Private and writable: fusion rewrites code in place, which copies
+     * only the pages it touches */
+    data = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        printf("Error: Cannot map file %s\n", filename);
+        return -1;
+    }
+    registry->image = (uint8_t*)data;
+    registry->image_size = (size_t)st.st_size;
+    registry->image_mapped = 1;
+#else
+    /* No mmap on this target: read the whole file instead */
+    FILE* file = fopen(filename, "rb");
+    long size;
+    uint8_t* data;
+
+    if (!file) {
+        printf("Error: Cannot open file %s\n", filename);
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    data = size >= (long)sizeof(SnapshotHeader) ? (uint8_t*)malloc((size_t)size) : NULL;
+    if (!data || fread(data, 1, (size_t)size, file) != (size_t)size) {
+        printf("Error: %s is not a snapshot\n", filename);
+        free(data);
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+    registry->image = data;
+    registry->image_size = (size_t)size;
+#endif
+    return 0;
+}
+
+/*
+ * Load the classes of a snapshot into a new registry, ready to run: no
+ * method is verified or linked again. The registry owns the image, which
+ * stays mapped until it is destroyed. Returns NULL on error.
+ */
+ClassRegistry* snapshot_load(const char* filename) {
+    ClassRegistry* registry = class_registry_create();
+    const SnapClass* classes;
+    Loader l;
+
+    if (!registry) {
+        return NULL;
+    }
+    if (map_image(filename, registry) != 0) {
+        free(registry);
+        return NULL;
+    }
+    l.registry = registry;
+    l.header = (const SnapshotHeader*)registry->image;
+    l.methods = NULL;
+    if (l.header->magic != SNAPSHOT_MAGIC) {
+        printf("Error: %s is not a snapshot\n", filename);
+        goto fail;
+    }
+    if (l.header->version != SNAPSHOT_VERSION || l.header->byte_order != SNAPSHOT_BYTE_ORDER ||
+        l.header->build != SNAPSHOT_BUILD) {
+        printf("Error: %s was made by another build of AruviJVM\n", filename);
+        goto fail;
+    }
+    classes = (const SnapClass*)image_at(&l, l.header->classes, l.header->class_count,
+                                         sizeof(SnapClass));
+    if (l.header->file_size != registry->image_size || !classes ||
+        l.header->class_count > MAX_CLASSES) {
+        goto corrupt;
+    }
+    l.methods = (Method**)malloc(sizeof(Method*) * ((size_t)l.header->method_count + 1));
+    if (!l.methods) {
+        printf("Error: out of memory\n");
+        goto fail;
+    }
+
+    /* Create every class first, for references to go to */
+    for (uint32_t c = 0; c < l.header->class_count; c++) {
+        const char* name = image_string(&l, classes[c].name);
+        Class* cls = name ? class_create(name) : NULL;
+        if (!cls || class_registry_add(registry, cls) != 0) {
+            class_destroy(cls);
+            goto corrupt;
+        }
+        if (classes[c].first_method > l.header->method_count ||
+            classes[c].method_count > MAX_METHODS ||
+            classes[c].method_count > l.header->method_count - classes[c].first_method) {
+            goto corrupt;
+        }
+        for (uint32_t i = 0; i < classes[c].method_count; i++) {
+            l.methods[classes[c].first_method + i] = &cls->methods[i];
+        }
+    }
+    for (uint32_t c = 0; c < l.header->class_count; c++) {
+        if (load_class(&l, &classes[c], registry->classes[c]) != 0) {
+            goto corrupt;
+        }
+    }
+    free(l.methods);
+    return registry;
+
+corrupt:
+    printf("Error: %s is truncated or corrupt\n", filename);
+fail:
+    free(l.methods);
+    class_registry_destroy(registry);
+    return NULL;
+}
+
+/* Release the image of a registry, once its classes are destroyed */
+void snapshot_unmap(ClassRegistry* registry) {
+    if (!registry->image) {
+        return;
+    }
+#ifndef JVM_NO_MMAP
+    if (registry->image_mapped) {
+        munmap(registry->image, registry->image_size);
+    }
+#else
+    free(registry->image);
+#endif
+    registry->image = NULL;
+    registry->image_size = 0;
+    registry->image_mapped = 0;
+}
+
+/* Does p point into the image of a registry? Its classes don't free it. */
+int snapshot_owns(const ClassRegistry* registry, const void* p) {
+    uintptr_t address = (uintptr_t)p;
+    uintptr_t start = (uintptr_t)registry->image;
+
+    return registry->image && address >= start && address - start < registry->image_size;
+}
@@ -0,0 +1,593 @@
+#include "jvm.h"
+
+/*
+ * Strings
+ *
+ * java/lang/String and java/lang/StringBuilder are built-in final classes
+ * whose methods are native: the verifier turns calls to them into
+ * INSN_INVOKENATIVE, which runs the C function here on the caller's
+ * operand stack without a frame. Being final, they need no dispatch.
+ *
+ * A String keeps its characters in a byte[] with one byte per character
+ * when every character is Latin-1, which is nearly always, and two bytes
+ * of UTF-16 otherwise; its coder says which. Two equal Strings always
+ * have the same coder, so equals() compares the bytes. hashCode() is
+ * computed the first time it is asked for and kept in the object. A
+ * StringBuilder holds the same kind of byte[] with room to grow, and
+ * turns it into UTF-16 only when a character needs it.
+ *
+ * ldc of a String constant returns the one String with that text in the
+ * JVM's intern table (StringTable): the text is decoded, and its hashCode
+ * computed, when the constant is resolved, so a repeated ldc is a probe
+ * of the table, a compare of the hashes and one memcmp. The table is
+ * open-addressed with linear probing from the slot the hashCode picks.
+ * Green threads on several workers look Strings up without a lock;
+ * adding one takes a spin lock, which is never held across an
+ * allocation, so a collection can't stop the world with it taken. The
+ * table doesn't keep its Strings alive, as nothing could tell an
+ * unreferenced String from a new copy of it: the collector drops them
+ * (see heap.c), and the next ldc of the text interns a new one.
+ */
+
+/* Fields of java/lang/StringBuilder */
+#define BUILDER_VALUE 0
+#define BUILDER_COUNT 1
+#define BUILDER_CODER 2
+
+#define STRING_FIELDS 3
+#define BUILDER_MIN_CAPACITY 16
+
+/* Set up with the built-in classes, before any String exists */
+static Class* string_class;
+
+/* Interned entries are published with release stores and looked up with
+ * acquire loads, and the hash field a racing hashCode() may fill in is
+ * accessed atomically. Other compilers than GCC and Clang only get
+ * single-threaded forms. */
+#ifdef __GNUC__
+#define LOAD_ACQUIRE(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define LOAD_RELAXED(p) __atomic_load_n(p, __ATOMIC_RELAXED)
+#define STORE_RELAXED(p, v) __atomic_store_n(p, v, __ATOMIC_RELAXED)
+#define TABLE_LOCK(table)                                               \
+    while (__atomic_exchange_n(&(table)->lock, 1u, __ATOMIC_ACQUIRE)) {  \
+    }
+#define TABLE_UNLOCK(table) __atomic_store_n(&(table)->lock, 0u, __ATOMIC_RELEASE)
+#else
+#define LOAD_ACQUIRE(p) (*(p))
+#define STORE_RELEASE(p, v) (*(p) = (v))
+#define LOAD_RELAXED(p) (*(p))
+#define STORE_RELAXED(p, v) (*(p) = (v))
+#define TABLE_LOCK(table) ((table)->lock = 1u)
+#define TABLE_UNLOCK(table) ((table)->lock = 0u)
+#endif
+
+#define FIELD(jvm, ref, slot) (HEAP_OBJECT(jvm, ref)[OBJECT_HEADER_WORDS + (slot)])
+#define HASH_FIELD(jvm, ref) LOAD_RELAXED(&FIELD(jvm, ref, STRING_HASH))
+
+/* Bytes of a byte[], or none for a String made without a value */
+static const uint8_t* array_bytes(const JVM* jvm, int32_t array) {
+    return (const uint8_t*)(HEAP_OBJECT(jvm, array) + OBJECT_HEADER_WORDS);
+}
+
+static int array_length(const JVM* jvm, int32_t array) {
+    return array ? (int)(HEAP_OBJECT(jvm, array)[1] & ~(ARRAY_FLAG | BYTE_ARRAY_FLAG)) : 0;
+}
+
+/* Character i of text in coder */
+static int char_at(const uint8_t* chars, int coder, int i) {
+    uint16_t c;
+    if (coder == STRING_LATIN1) {
+        return chars[i];
+    }
+    memcpy(&c, chars + 2 * i, 2);
+    return c;
+}
+
+/* Copy count characters, widening Latin-1 into UTF-16 */
+static void copy_chars(uint8_t* to, int to_coder, const uint8_t* from, int from_coder,
+                       int count) {
+    if (to_coder == from_coder) {
+        memcpy(to, from, (size_t)count << to_coder);
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        uint16_t c = from[i];
+        memcpy(to + 2 * i, &c, 2);
+    }
+}
+
+/* String.hashCode() of text: s[0]*31^(n-1) + ... + s[n-1] */
+static int32_t hash_chars(const uint8_t* chars, int length, int coder) {
+    uint32_t hash = 0;
+    for (int i = 0; i < length; i++) {
+        hash = 31 * hash + (uint32_t)char_at(chars, coder, i);
+    }
+    return (int32_t)hash;
+}
+
+static int string_length(const JVM* jvm, int32_t s) {
+    return array_length(jvm, (int32_t)FIELD(jvm, s, STRING_VALUE)) >> FIELD(jvm, s, STRING_CODER);
+}
+
+static int32_t string_hash(JVM* jvm, int32_t s) {
+    int32_t hash = (int32_t)HASH_FIELD(jvm, s);
+    if (hash == 0) {
+        hash = hash_chars(array_bytes(jvm, (int32_t)FIELD(jvm, s, STRING_VALUE)),
+                          string_length(jvm, s), (int)FIELD(jvm, s, STRING_CODER));
+        STORE_RELAXED(&FIELD(jvm, s, STRING_HASH), (uint32_t)hash);
+    }
+    return hash;
+}
+
+/* Does String s hold this text? */
+static int has_text(const JVM* jvm, int32_t s, const uint8_t* chars, int length, int coder) {
+    return (int)FIELD(jvm, s, STRING_CODER) == coder && string_length(jvm, s) == length &&
+           memcmp(array_bytes(jvm, (int32_t)FIELD(jvm, s, STRING_VALUE)), chars,
+                  (size_t)length << coder) == 0;
+}
+
+/* The interned String with this text and hashCode, or 0 */
+static int32_t table_find(JVM* jvm, const uint8_t* chars, int length, int coder, int32_t hash) {
+    StringTable* table = &jvm->strings;
+
+    for (int i = STRING_TABLE_INDEX(hash);; i = (i + 1) & (STRING_TABLE_SIZE - 1)) {
+        int32_t s = LOAD_ACQUIRE(&table->entries[i]);
+        if (s == 0) {
+            return 0;
+        }
+        if ((int32_t)HASH_FIELD(jvm, s) == hash && has_text(jvm, s, chars, length, coder)) {
+            return s;
+        }
+    }
+}
+
+/* Intern String s, whose hash field is filled in, unless another String
+ * with its text got there first. Returns the interned one, or 0 if the
+ * table is full. */
+static int32_t table_add(JVM* jvm, int32_t s) {
+    StringTable* table = &jvm->strings;
+    const uint8_t* chars = array_bytes(jvm, (int32_t)FIELD(jvm, s, STRING_VALUE));
+    int length = string_length(jvm, s);
+    int coder = (int)FIELD(jvm, s, STRING_CODER);
+    int32_t hash = (int32_t)HASH_FIELD(jvm, s);
+    int32_t found;
+
+    TABLE_LOCK(table);
+    found = table_find(jvm, chars, length, coder, hash);
+    if (!found && table->count < STRING_TABLE_MAX) {
+        int i = STRING_TABLE_INDEX(hash);
+        while (table->entries[i] != 0) {
+            i = (i + 1) & (STRING_TABLE_SIZE - 1);
+        }
+        STORE_RELEASE(&table->entries[i], s);
+        table->count++;
+        found = s;
+    }
+    TABLE_UNLOCK(table);
+    if (!found) {
+        printf("Error: string table is full\n");
+    }
+    return found;
+}
+
+static int32_t native_alloc(NativeCall* call, uint32_t words, uint32_t type) {
+#ifdef JVM_GREEN_THREADS
+    if (call->thread) {
+        return heap_alloc_tlab(call->jvm, call->thread, words, type);
+    }
+#endif
+    return heap_alloc(call->jvm, words, type);
+}
+
+static int32_t new_byte_array(NativeCall* call, int length) {
+    if (length < 0 || length > HEAP_SIZE) {
+        return 0;
+    }
+    return native_alloc(call, BYTE_ARRAY_WORDS(length),
+                        ARRAY_FLAG | BYTE_ARRAY_FLAG | (uint32_t)length);
+}
+
+/* Allocate a String of length characters in coder, whose value is zeroed
+ * for the caller to fill in. Returns 0 if the heap is full. */
+static int32_t new_string(NativeCall* call, int length, int coder) {
+    JVM* jvm = call->jvm;
+    int32_t array, s;
+
+    array = new_byte_array(call, length << coder);
+    if (array == 0) {
+        printf("Out of heap memory!\n");
+        return 0;
+    }
+    call->root->i = array;
+    s = native_alloc(call, OBJECT_HEADER_WORDS + STRING_FIELDS,
+                     OBJECT_TYPE(string_class->id, STRING_FIELDS));
+    array = call->root->i;
+    call->root->i = 0;
+    if (s == 0) {
+        printf("Out of heap memory!\n");
+        return 0;
+    }
+    FIELD(jvm, s, STRING_VALUE) = (uint32_t)array;
+    FIELD(jvm, s, STRING_CODER) = (uint32_t)coder;
+    return s;
+}
+
+/*
+ * Fill in a String constant's characters from its text, in the modified
+ * UTF-8 of class files, as a String's value holds them: one byte each if
+ * they are all Latin-1, else UTF-16. Its value becomes their hashCode.
+ * Returns 0, or -1 if the text is malformed or memory runs out.
+ */
+int string_decode_constant(Constant* constant, const char* text) {
+    const uint8_t* p = (const uint8_t*)text;
+    uint16_t* utf16 = (uint16_t*)malloc(strlen(text) * 2 + 2);
+    int length = 0;
+    int coder = STRING_LATIN1;
+
+    if (!utf16) {
+        return -1;
+    }
+    while (*p) {
+        uint16_t c;
+        if (p[0] < 0x80) {
+            c = p[0];
+            p++;
+        } else if ((p[0] & 0xe0) == 0xc0 && (p[1] & 0xc0) == 0x80) {
+            c = (uint16_t)((p[0] & 0x1f) << 6 | (p[1] & 0x3f));
+            p += 2;
+        } else if ((p[0] & 0xf0) == 0xe0 && (p[1] & 0xc0) == 0x80 && (p[2] & 0xc0) == 0x80) {
+            c = (uint16_t)((p[0] & 0x0f) << 12 | (p[1] & 0x3f) << 6 | (p[2] & 0x3f));
+            p += 3;
+        } else {
+            free(utf16);
+            return -1;
+        }
+        if (c > 0xff) {
+            coder = STRING_UTF16;
+        }
+        utf16[length++] = c;
+    }
+
+    constant->chars = (uint8_t*)malloc(((size_t)length << coder) + 1);
+    if (!constant->chars) {
+        free(utf16);
+        return -1;
+    }
+    for (int i = 0; i < length; i++) {
+        if (coder == STRING_LATIN1) {
+            constant->chars[i] = (uint8_t)utf16[i];
+        } else {
+            memcpy(constant->chars + 2 * i, &utf16[i], 2);
+        }
+    }
+    free(utf16);
+    constant->chars_length = length;
+    constant->coder = coder;
+    constant->value = hash_chars(constant->chars, length, coder);
+    return 0;
+}
+
+/* The interned String for a String constant, or 0 if there is none yet.
+ * Allocates nothing. */
+int32_t string_find(JVM* jvm, const Constant* constant) {
+    return table_find(jvm, constant->chars, constant->chars_length, constant->coder,
+                      constant->value);
+}
+
+/* Create and intern the String for a String constant. Returns it, or 0
+ * after reporting that the heap or the table is full. */
+int32_t string_intern_constant(NativeCall* call, const Constant* constant) {
+    JVM* jvm = call->jvm;
+    int32_t s = new_string(call, constant->chars_length, constant->coder);
+
+    if (s == 0) {
+        return 0;
+    }
+    memcpy((uint8_t*)array_bytes(jvm, (int32_t)FIELD(jvm, s, STRING_VALUE)), constant->chars,
+           (size_t)constant->chars_length << constant->coder);
+    FIELD(jvm, s, STRING_HASH) = (uint32_t)constant->value;
+    return table_add(jvm, s);
+}
+
+/*
+ * Copy the text of String ref into buffer as NUL-terminated UTF-8, for
+ * code outside the JVM to read a result. Returns its length in bytes, or
+ * -1 if ref is not a String or buffer is too small.
+ */
+int jvm_string_text(const JVM* jvm, int32_t ref, char* buffer, int size) {
+    const uint8_t* chars;
+    int length, coder, n = 0;
+
+    if (ref <= 0 || ref >= jvm->heap_ptr || !string_class ||
+        HEAP_OBJECT(jvm, ref)[1] != OBJECT_TYPE(string_class->id, STRING_FIELDS)) {
+        return -1;
+    }
+    chars = array_bytes(jvm, (int32_t)FIELD(jvm, ref, STRING_VALUE));
+    length = string_length(jvm, ref);
+    coder = (int)FIELD(jvm, ref, STRING_CODER);
+    for (int i = 0; i < length; i++) {
+        int c = char_at(chars, coder, i);
+        if (n + 3 >= size) {
+            return -1;
+        }
+        if (c < 0x80) {
+            buffer[n++] = (char)c;
+        } else if (c < 0x800) {
+            buffer[n++] = (char)(0xc0 | c >> 6);
+            buffer[n++] = (char)(0x80 | (c & 0x3f));
+        } else {
+            buffer[n++] = (char)(0xe0 | c >> 12);
+            buffer[n++] = (char)(0x80 | (c >> 6 & 0x3f));
+            buffer[n++] = (char)(0x80 | (c & 0x3f));
+        }
+    }
+    if (n >= size) {
+        return -1;
+    }
+    buffer[n] = '\0';
+    return n;
+}
+
+/* Native methods of java/lang/String. The receiver is never null. */
+
+static int string_length_native(NativeCall* call) {
+    call->result.i = string_length(call->jvm, call->args[0].i);
+    return 0;
+}
+
+static int string_char_at(NativeCall* call) {
+    JVM* jvm = call->jvm;
+    int32_t s = call->args[0].i;
+    int32_t index = call->args[1].i;
+
+    if ((uint32_t)index >= (uint32_t)string_length(jvm, s)) {
+        call->exception = STRING_INDEX_EXCEPTION;
+        return -1;
+    }
+    call->result.i = char_at(array_bytes(jvm, (int32_t)FIELD(jvm, s, STRING_VALUE)),
+                             (int)FIELD(jvm, s, STRING_CODER), index);
+    return 0;
+}
+
+/* Identical Strings are equal without a look at the text, and ones whose
+ * hashCodes are known and differ are not */
+static int string_equals(NativeCall* call) {
+    JVM* jvm = call->jvm;
+    int32_t s = call->args[0].i;
+    int32_t other = call->args[1].i;
+    int32_t hash, other_hash;
+
+    if (s == other) {
+        call->result.i = 1;
+        return 0;
+    }
+    call->result.i = 0;
+    if (other == 0 || HEAP_OBJECT(jvm, other)[1] != OBJECT_TYPE(string_class->id, STRING_FIELDS)) {
+        return 0;
+    }
+    hash = (int32_t)HASH_FIELD(jvm, s);
+    other_hash = (int32_t)HASH_FIELD(jvm, other);
+    if (hash != 0 && other_hash != 0 && hash != other_hash) {
+        return 0;
+    }
+    call->result.i = has_text(jvm, s, array_bytes(jvm, (int32_t)FIELD(jvm, other, STRING_VALUE)),
+                              string_length(jvm, other), (int)FIELD(jvm, other, STRING_CODER));
+    return 0;
+}
+
+static int string_hash_code(NativeCall* call) {
+    call->result.i = string_hash(call->jvm, call->args[0].i);
+    return 0;
+}
+
+static int string_intern(NativeCall* call) {
+    JVM* jvm = call->jvm;
+    int32_t s = call->args[0].i;
+    int32_t hash = string_hash(jvm, s);
+    int32_t found = table_find(jvm, array_bytes(jvm, (int32_t)FIELD(jvm, s, STRING_VALUE)),
+                               string_length(jvm, s), (int)FIELD(jvm, s, STRING_CODER), hash);
+
+    if (!found) {
+        found = table_add(jvm, s);
+        if (!found) {
+            return -1;
+        }
+    }
+    call->result.i = found;
+    return 0;
+}
+
+/* Native methods of java/lang/StringBuilder. The receiver is never null;
+ * a new one has no value and is Latin-1. */
+
+/*
+ * Make room in the receiver for extra more characters of coder, and turn
+ * its text into UTF-16 if they need it. The value grows to twice its
+ * size plus two, or if that doesn't fit the heap, to just what is
+ * needed. Returns 0, or -1 after reporting that the heap is full.
+ */
+static int ensure_capacity(NativeCall* call, int extra, int coder) {
+    JVM* jvm = call->jvm;
+    int32_t builder = call->args[0].i;
+    int count = (int)FIELD(jvm, builder, BUILDER_COUNT);
+    int old_coder = (int)FIELD(jvm, builder, BUILDER_CODER);
+    int new_coder = old_coder | coder;
+    int capacity = array_length(jvm, (int32_t)FIELD(jvm, builder, BUILDER_VALUE)) >> old_coder;
+    int needed = count + extra;
+    int32_t array;
+
+    if (needed <= capacity && new_coder == old_coder) {
+        return 0;
+    }
+    if (extra > HEAP_SIZE || needed > HEAP_SIZE) {
+        printf("Out of heap memory!\n");
+        return -1;
+    }
+    if (capacity < needed) {
+        capacity = capacity * 2 + 2;
+        if (capacity < needed) {
+            capacity = needed;
+        }
+        if (capacity < BUILDER_MIN_CAPACITY) {
+            capacity = BUILDER_MIN_CAPACITY;
+        }
+    }
+    array = new_byte_array(call, capacity << new_coder);
+    if (array == 0 && capacity > needed) {
+        array = new_byte_array(call, needed << new_coder);
+    }
+    if (array == 0) {
+        printf("Out of heap memory!\n");
+        return -1;
+    }
+    builder = call->args[0].i;
+    copy_chars((uint8_t*)array_bytes(jvm, array), new_coder,
+               array_bytes(jvm, (int32_t)FIELD(jvm, builder, BUILDER_VALUE)), old_coder, count);
+    FIELD(jvm, builder, BUILDER_VALUE) = (uint32_t)array;
+    FIELD(jvm, builder, BUILDER_CODER) = (uint32_t)new_coder;
+    return 0;
+}
+
+/* Append length characters of coder from outside the heap */
+static int append_chars(NativeCall* call, const uint8_t* chars, int length, int coder) {
+    JVM* jvm = call->jvm;
+    int32_t builder;
+    int count, to_coder;
+
+    if (ensure_capacity(call, length, coder) != 0) {
+        return -1;
+    }
+    builder = call->args[0].i;
+    count = (int)FIELD(jvm, builder, BUILDER_COUNT);
+    to_coder = (int)FIELD(jvm, builder, BUILDER_CODER);
+    copy_chars((uint8_t*)array_bytes(jvm, (int32_t)FIELD(jvm, builder, BUILDER_VALUE)) +
+               (count << to_coder), to_coder, chars, coder, length);
+    FIELD(jvm, builder, BUILDER_COUNT) = (uint32_t)(count + length);
+    call->result.i = builder;
+    return 0;
+}
+
+/* append(String): null appends "null" */
+static int builder_append_string(NativeCall* call) {
+    JVM* jvm = call->jvm;
+    int32_t s = call->args[1].i;
+    int32_t builder;
+    int length, coder, count, to_coder;
+
+    if (s == 0) {
+        return append_chars(call, (const uint8_t*)"null", 4, STRING_LATIN1);
+    }
+    length = string_length(jvm, s);
+    coder = (int)FIELD(jvm, s, STRING_CODER);
+    if (ensure_capacity(call, length, coder) != 0) {
+        return -1;
+    }
+    builder = call->args[0].i;
+    s = call->args[1].i;
+    count = (int)FIELD(jvm, builder, BUILDER_COUNT);
+    to_coder = (int)FIELD(jvm, builder, BUILDER_CODER);
+    copy_chars((uint8_t*)array_bytes(jvm, (int32_t)FIELD(jvm, builder, BUILDER_VALUE)) +
+               (count << to_coder), to_coder,
+               array_bytes(jvm, (int32_t)FIELD(jvm, s, STRING_VALUE)), coder, length);
+    FIELD(jvm, builder, BUILDER_COUNT) = (uint32_t)(count + length);
+    call->result.i = builder;
+    return 0;
+}
+
+static int builder_append_int(NativeCall* call) {
+    char digits[12];
+    int length = snprintf(digits, sizeof(digits), "%d", (int)call->args[1].i);
+    return append_chars(call, (const uint8_t*)digits, length, STRING_LATIN1);
+}
+
+static int builder_append_char(NativeCall* call) {
+    uint16_t c = (uint16_t)call->args[1].i;
+    uint8_t latin1 = (uint8_t)c;
+
+    if (c <= 0xff) {
+        return append_chars(call, &latin1, 1, STRING_LATIN1);
+    }
+    return append_chars(call, (const uint8_t*)&c, 1, STRING_UTF16);
+}
+
+static int builder_length(NativeCall* call) {
+    call->result.i = (int32_t)FIELD(call->jvm, call->args[0].i, BUILDER_COUNT);
+    return 0;
+}
+
+/* A new String with a copy of the text, in the builder's coder: one that
+ * had to turn UTF-16 holds a character that needs it */
+static int builder_to_string(NativeCall* call) {
+    JVM* jvm = call->jvm;
+    int32_t builder = call->args[0].i;
+    int count = (int)FIELD(jvm, builder, BUILDER_COUNT);
+    int coder = (int)FIELD(jvm, builder, BUILDER_CODER);
+    int32_t s = new_string(call, count, coder);
+
+    if (s == 0) {
+        return -1;
+    }
+    builder = call->args[0].i;
+    memcpy((uint8_t*)array_bytes(jvm, (int32_t)FIELD(jvm, s, STRING_VALUE)),
+           array_bytes(jvm, (int32_t)FIELD(jvm, builder, BUILDER_VALUE)), (size_t)count << coder);
+    call->result.i = s;
+    return 0;
+}
+
+typedef struct {
+    const char* name;
+    const char* descriptor;
+    NativeFunction native;
+} NativeMethod;
+
+static const NativeMethod string_methods[] = {
+    {"length", "()I", string_length_native},
+    {"charAt", "(I)C", string_char_at},
+    {"equals", "(Ljava/lang/Object;)Z", string_equals},
+    {"hashCode", "()I", string_hash_code},
+    {"intern", "()Ljava/lang/String;", string_intern}
+};
+
+static const NativeMethod builder_methods[] = {
+    {"append", "(Ljava/lang/String;)Ljava/lang/StringBuilder;", builder_append_string},
+    {"append", "(I)Ljava/lang/StringBuilder;", builder_append_int},
+    {"append", "(C)Ljava/lang/StringBuilder;", builder_append_char},
+    {"length", "()I", builder_length},
+    {"toString", "()Ljava/lang/String;", builder_to_string}
+};
+
+static int define_class(Class* cls, const char* const* fields, int field_count,
+                        const NativeMethod* methods, int method_count) {
+    if (!cls) {
+        return -1;
+    }
+    cls->access_flags |= ACC_FINAL;
+    for (int i = 0; i < field_count; i++) {
+        if (class_add_field(cls, fields[i * 2], fields[i * 2 + 1]) < 0) {
+            return -1;
+        }
+    }
+    for (int i = 0; i < method_count; i++) {
+        if (!class_add_native_method(cls, methods[i].name, methods[i].descriptor,
+                                     methods[i].native)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Give the built-in String classes of registry, created empty and not yet
+ * linked, their fields and native methods. Returns 0, or -1 on error. */
+int string_define_classes(ClassRegistry* registry) {
+    static const char* const string_fields[] = {"value", "[B", "coder", "I", "hash", "I"};
+    static const char* const builder_fields[] = {"value", "[B", "count", "I", "coder", "I"};
+
+    string_class = class_registry_find(registry, STRING_CLASS);
+    return define_class(string_class, string_fields, STRING_FIELDS, string_methods,
+                        (int)(sizeof(string_methods) / sizeof(string_methods[0]))) != 0 ||
+           define_class(class_registry_find(registry, STRING_BUILDER_CLASS), builder_fields, 3,
+                        builder_methods,
+                        (int)(sizeof(builder_methods) / sizeof(builder_methods[0]))) != 0
+           ? -1 : 0;
+}
@@ -0,0 +1,1871 @@
+#include "test_programs.h"
+
+/* Simple test programs written as bytecode arrays */
+
+/* Test 1: Simple arithmetic - compute 5 + 3 * 2 */
+uint8_t test_arithmetic[] = {
+    OP_ICONST_5,    /* Push 5 */
+    OP_ICONST_3,    /* Push 3 */
+    OP_ICONST_2,    /* Push 2 */
+    OP_IMUL,        /* 3 * 2 = 6 */
+    OP_IADD,        /* 5 + 6 = 11 */
+    OP_IRETURN      /* Return 11 */
+};
+
+/* Test 2: Local variables - store and load */
+uint8_t test_locals[] = {
+    OP_BIPUSH, 42,      /* Push 42 */
+    OP_ISTORE_0,        /* Store in local 0 */
+    OP_BIPUSH, 10,      /* Push 10 */
+    OP_ISTORE_1,        /* Store in local 1 */
+    OP_ILOAD_0,         /* Load local 0 (42) */
+    OP_ILOAD_1,         /* Load local 1 (10) */
+    OP_IADD,            /* 42 + 10 = 52 */
+    OP_IRETURN          /* Return 52 */
+};
+
+/* Test 3: Conditional branch - simple if statement */
+uint8_t test_branch[] = {
+    OP_BIPUSH, 10,      /* Push 10 */
+    OP_BIPUSH, 5,       /* Push 5 */
+    OP_IF_ICMPGT, 0, 7, /* If 10 > 5, jump +7 bytes */
+    OP_ICONST_0,        /* Push 0 (false case) */
+    OP_GOTO, 0, 4,      /* Jump over true case */
+    OP_ICONST_1,        /* Push 1 (true case) */
+    OP_IRETURN          /* Return result */
+};
+
+/* Test 4: Simple counting - just count to 3 and return */
+uint8_t test_loop[] = {
+    OP_ICONST_1,        /* counter = 1 */
+    OP_ISTORE_0,        /* store in local 0 */
+    OP_ILOAD_0,         /* load counter */
+    OP_ICONST_1,        /* add 1 */
+    OP_IADD,            
+    OP_ISTORE_0,        /* counter = 2 */
+    OP_ILOAD_0,         /* load counter */
+    OP_ICONST_1,        /* add 1 */
+    OP_IADD,            
+    OP_ISTORE_0,        /* counter = 3 */
+    OP_ILOAD_0,         /* load final value */
+    OP_IRETURN          /* return 3 */
+};
+
+/* Test 5: Rejected by the verifier - iadd with only one value on the stack */
+uint8_t test_verify_underflow[] = {
+    OP_ICONST_1,        /* Push 1 */
+    OP_IADD,            /* Needs two operands */
+    OP_IRETURN
+};
+
+/* Test 28: Uncaught exception - return 1 / 0, which throws an
+ * ArithmeticException nothing catches */
+uint8_t test_divide_by_zero[] = {
+    OP_ICONST_1,
+    OP_ICONST_0,
+    OP_IDIV,
+    OP_IRETURN
+};
+
+/* Test 27: Rejected by the decoder - getstatic is not implemented, and its
+ * operands must not be read as the nop and return that follow */
+uint8_t test_decode_unsupported[] = {
+    OP_ICONST_1,
+    OP_GETSTATIC, OP_NOP, OP_RETURN,    /* Field ref #177 */
+    OP_IRETURN
+};
+
+/* Test 6: Recursion - static int fib(int n), calls itself through #1 */
+uint8_t test_fib[] = {
+    OP_ILOAD_0,                 /* 0: if (n >= 2) goto 7 */
+    OP_ICONST_2,
+    OP_IF_ICMPGE, 0, 5,
+    OP_ILOAD_0,                 /* 5: return n */
+    OP_IRETURN,
+    OP_ILOAD_0,                 /* 7: fib(n - 1) */
+    OP_ICONST_1,
+    OP_ISUB,
+    OP_INVOKESTATIC, 0, 1,
+    OP_ILOAD_0,                 /* 13: fib(n - 2) */
+    OP_ICONST_2,
+    OP_ISUB,
+    OP_INVOKESTATIC, 0, 1,
+    OP_IADD,                    /* 19: return the sum */
+    OP_IRETURN
+};
+
+/* Test 7: Recursion - static int ack(int m, int n), calls itself through #2 */
+uint8_t test_ackermann[] = {
+    OP_ILOAD_0,                 /* 0: if (m != 0) goto 9 */
+    OP_ICONST_0,
+    OP_IF_ICMPNE, 0, 7,
+    OP_ILOAD_1,                 /* 5: return n + 1 */
+    OP_ICONST_1,
+    OP_IADD,
+    OP_IRETURN,
+    OP_ILOAD_1,                 /* 9: if (n != 0) goto 22 */
+    OP_ICONST_0,
+    OP_IF_ICMPNE, 0, 11,
+    OP_ILOAD_0,                 /* 14: return ack(m - 1, 1) */
+    OP_ICONST_1,
+    OP_ISUB,
+    OP_ICONST_1,
+    OP_INVOKESTATIC, 0, 2,
+    OP_IRETURN,
+    OP_ILOAD_0,                 /* 22: return ack(m - 1, ack(m, n - 1)) */
+    OP_ICONST_1,
+    OP_ISUB,
+    OP_ILOAD_0,
+    OP_ILOAD_1,
+    OP_ICONST_1,
+    OP_ISUB,
+    OP_INVOKESTATIC, 0, 2,
+    OP_INVOKESTATIC, 0, 2,
+    OP_IRETURN
+};
+
+/* Lengths of the programs above, for callers that only see the header */
+const int test_arithmetic_length = sizeof(test_arithmetic);
+const int test_locals_length = sizeof(test_locals);
+const int test_branch_length = sizeof(test_branch);
+const int test_loop_length = sizeof(test_loop);
+const int test_verify_underflow_length = sizeof(test_verify_underflow);
+const int test_decode_unsupported_length = sizeof(test_decode_unsupported);
+const int test_divide_by_zero_length = sizeof(test_divide_by_zero);
+const int test_fib_length = sizeof(test_fib);
+const int test_ackermann_length = sizeof(test_ackermann);
+
+/*
+ * Test 8: Class file - a class file laid out the way javac writes it, for
+ *
+ *     public class Fib {
+ *         static int calls;
+ *         public static int fib(int n) {
+ *             if (n < 2) return n;
+ *             return fib(n - 1) + fib(n - 2);
+ *         }
+ *         public static int big() { return 100000; }
+ *     }
+ *
+ * The constant pool also has a Fieldref, a String and a Long that the
+ * code never uses, and <init> calls Object.<init> through invokespecial,
+ * which nothing runs.
+ */
+uint8_t test_class_file[] = {
+    0xca, 0xfe, 0xba, 0xbe, 0x00, 0x00, 0x00, 0x34, 0x00, 0x1c, 0x0a, 0x00,
+    0x02, 0x00, 0x03, 0x07, 0x00, 0x04, 0x0c, 0x00, 0x05, 0x00, 0x06, 0x01,
+    0x00, 0x10, 0x6a, 0x61, 0x76, 0x61, 0x2f, 0x6c, 0x61, 0x6e, 0x67, 0x2f,
+    0x4f, 0x62, 0x6a, 0x65, 0x63, 0x74, 0x01, 0x00, 0x06, 0x3c, 0x69, 0x6e,
+    0x69, 0x74, 0x3e, 0x01, 0x00, 0x03, 0x28, 0x29, 0x56, 0x0a, 0x00, 0x08,
+    0x00, 0x09, 0x07, 0x00, 0x0a, 0x0c, 0x00, 0x0b, 0x00, 0x0c, 0x01, 0x00,
+    0x03, 0x46, 0x69, 0x62, 0x01, 0x00, 0x03, 0x66, 0x69, 0x62, 0x01, 0x00,
+    0x04, 0x28, 0x49, 0x29, 0x49, 0x09, 0x00, 0x08, 0x00, 0x0e, 0x0c, 0x00,
+    0x0f, 0x00, 0x10, 0x01, 0x00, 0x05, 0x63, 0x61, 0x6c, 0x6c, 0x73, 0x01,
+    0x00, 0x01, 0x49, 0x03, 0x00, 0x01, 0x86, 0xa0, 0x08, 0x00, 0x13, 0x01,
+    0x00, 0x06, 0x75, 0x6e, 0x75, 0x73, 0x65, 0x64, 0x01, 0x00, 0x04, 0x43,
+    0x6f, 0x64, 0x65, 0x01, 0x00, 0x0f, 0x4c, 0x69, 0x6e, 0x65, 0x4e, 0x75,
+    0x6d, 0x62, 0x65, 0x72, 0x54, 0x61, 0x62, 0x6c, 0x65, 0x01, 0x00, 0x03,
+    0x62, 0x69, 0x67, 0x01, 0x00, 0x03, 0x28, 0x29, 0x49, 0x01, 0x00, 0x0a,
+    0x53, 0x6f, 0x75, 0x72, 0x63, 0x65, 0x46, 0x69, 0x6c, 0x65, 0x01, 0x00,
+    0x08, 0x46, 0x69, 0x62, 0x2e, 0x6a, 0x61, 0x76, 0x61, 0x05, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x21, 0x00, 0x08, 0x00, 0x02,
+    0x00, 0x00, 0x00, 0x01, 0x00, 0x08, 0x00, 0x0f, 0x00, 0x10, 0x00, 0x00,
+    0x00, 0x03, 0x00, 0x01, 0x00, 0x05, 0x00, 0x06, 0x00, 0x01, 0x00, 0x14,
+    0x00, 0x00, 0x00, 0x1d, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x05,
+    0x2a, 0xb7, 0x00, 0x01, 0xb1, 0x00, 0x00, 0x00, 0x01, 0x00, 0x15, 0x00,
+    0x00, 0x00, 0x06, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00, 0x09, 0x00,
+    0x0b, 0x00, 0x0c, 0x00, 0x01, 0x00, 0x14, 0x00, 0x00, 0x00, 0x31, 0x00,
+    0x03, 0x00, 0x01, 0x00, 0x00, 0x00, 0x15, 0x1a, 0x05, 0xa2, 0x00, 0x05,
+    0x1a, 0xac, 0x1a, 0x04, 0x64, 0xb8, 0x00, 0x07, 0x1a, 0x05, 0x64, 0xb8,
+    0x00, 0x07, 0x60, 0xac, 0x00, 0x00, 0x00, 0x01, 0x00, 0x15, 0x00, 0x00,
+    0x00, 0x0a, 0x00, 0x02, 0x00, 0x00, 0x00, 0x03, 0x00, 0x07, 0x00, 0x04,
+    0x00, 0x09, 0x00, 0x16, 0x00, 0x17, 0x00, 0x01, 0x00, 0x14, 0x00, 0x00,
+    0x00, 0x1b, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x12, 0x11,
+    0xac, 0x00, 0x00, 0x00, 0x01, 0x00, 0x15, 0x00, 0x00, 0x00, 0x06, 0x00,
+    0x01, 0x00, 0x00, 0x00, 0x07, 0x00, 0x01, 0x00, 0x18, 0x00, 0x00, 0x00,
+    0x02, 0x00, 0x19
+};
+
+const int test_class_file_length = sizeof(test_class_file);
+const int test_class_file_big_flags = 324;   /* Offset of big()'s access flags */
+
+/* Test 9: Objects - static Node push(Node next, int value) */
+uint8_t test_node_push[] = {
+    OP_NEW, 0, 1,               /* 0: node = new Node() */
+    OP_DUP,                     /* 3: node.next = next */
+    OP_ALOAD_0,
+    OP_PUTFIELD, 0, 2,
+    OP_DUP,                     /* 8: node.value = value */
+    OP_ILOAD_1,
+    OP_PUTFIELD, 0, 3,
+    OP_ARETURN                  /* 13: return node */
+};
+
+/* static int sum(Node list) */
+uint8_t test_node_sum[] = {
+    OP_ICONST_0,                /* 0: total = 0 */
+    OP_ISTORE_1,
+    OP_ALOAD_0,                 /* 2: while (list != null) { */
+    OP_IFNULL, 0, 18,
+    OP_ILOAD_1,                 /* 6: total += list.value */
+    OP_ALOAD_0,
+    OP_GETFIELD, 0, 3,
+    OP_IADD,
+    OP_ISTORE_1,
+    OP_ALOAD_0,                 /* 13: list = list.next */
+    OP_GETFIELD, 0, 2,
+    OP_ASTORE_0,
+    OP_GOTO, 0xff, 0xf0,        /* 18: } */
+    OP_ILOAD_1,                 /* 21: return total */
+    OP_IRETURN
+};
+
+/* static Node build(int n): the list n-1, ..., 1, 0 */
+uint8_t test_node_build[] = {
+    OP_ACONST_NULL,             /* 0: list = null */
+    OP_ASTORE_1,
+    OP_ICONST_0,                /* 2: i = 0 */
+    OP_ISTORE_2,
+    OP_ILOAD_2,                 /* 4: while (i < n) { */
+    OP_ILOAD_0,
+    OP_IF_ICMPGE, 0, 16,
+    OP_ALOAD_1,                 /* 9: list = push(list, i) */
+    OP_ILOAD_2,
+    OP_INVOKESTATIC, 0, 4,
+    OP_ASTORE_1,
+    OP_ILOAD_2,                 /* 15: i++ */
+    OP_ICONST_1,
+    OP_IADD,
+    OP_ISTORE_2,
+    OP_GOTO, 0xff, 0xf1,        /* 19: } */
+    OP_ALOAD_1,                 /* 22: return list */
+    OP_ARETURN
+};
+
+/*
+ * static int churn(int n, int rounds): keeps a list of n nodes live while
+ * each round allocates a garbage array and replaces the head node, then
+ * returns sum(list), which is n * (n - 1) / 2 + rounds
+ */
+uint8_t test_node_churn[] = {
+    OP_ILOAD_0,                 /* 0: list = build(n) */
+    OP_INVOKESTATIC, 0, 6,
+    OP_ASTORE_2,
+    OP_ICONST_0,                /* 5: r = 0 */
+    OP_ISTORE_3,
+    OP_ILOAD_3,                 /* 7: while (r < rounds) { */
+    OP_ILOAD_1,
+    OP_IF_ICMPGE, 0, 47,
+    OP_BIPUSH, 8,               /* 12: junk = new int[8] */
+    OP_NEWARRAY, 10,
+    OP_ASTORE, 4,
+    OP_ALOAD, 4,                /* 18: junk[7] = r */
+    OP_BIPUSH, 7,
+    OP_ILOAD_3,
+    OP_IASTORE,
+    OP_ALOAD_2,                 /* 24: list = push(list.next, list.value + 1) */
+    OP_GETFIELD, 0, 2,
+    OP_ALOAD_2,
+    OP_GETFIELD, 0, 3,
+    OP_ICONST_1,
+    OP_IADD,
+    OP_INVOKESTATIC, 0, 4,
+    OP_ASTORE_2,
+    OP_ALOAD, 4,                /* 38: if (junk[7] != r) return -1 */
+    OP_BIPUSH, 7,
+    OP_IALOAD,
+    OP_ILOAD_3,
+    OP_IF_ICMPEQ, 0, 5,
+    OP_ICONST_M1,
+    OP_IRETURN,
+    OP_ILOAD_3,                 /* 49: r++ */
+    OP_ICONST_1,
+    OP_IADD,
+    OP_ISTORE_3,
+    OP_GOTO, 0xff, 0xd2,        /* 53: } */
+    OP_ALOAD_2,                 /* 56: return sum(list) */
+    OP_INVOKESTATIC, 0, 5,
+    OP_IRETURN
+};
+
+/* Test 10: Arrays - static int sieve(int n), the number of primes below n */
+uint8_t test_sieve[] = {
+    OP_ILOAD_0,                 /* 0: composite = new int[n] */
+    OP_NEWARRAY, 10,
+    OP_ASTORE_1,
+    OP_ICONST_0,                /* 4: count = 0 */
+    OP_ISTORE, 4,
+    OP_ICONST_2,                /* 7: i = 2 */
+    OP_ISTORE_2,
+    OP_ILOAD_2,                 /* 9: while (i < composite.length) { */
+    OP_ALOAD_1,
+    OP_ARRAYLENGTH,
+    OP_IF_ICMPGE, 0, 43,
+    OP_ALOAD_1,                 /* 15: if (composite[i] == 0) { */
+    OP_ILOAD_2,
+    OP_IALOAD,
+    OP_ICONST_0,
+    OP_IF_ICMPNE, 0, 29,
+    OP_ILOAD, 4,                /* 22: count++ */
+    OP_ICONST_1,
+    OP_IADD,
+    OP_ISTORE, 4,
+    OP_ILOAD_2,                 /* 28: j = i + i */
+    OP_ILOAD_2,
+    OP_IADD,
+    OP_ISTORE_3,
+    OP_ILOAD_3,                 /* 32: while (j < n) { */
+    OP_ILOAD_0,
+    OP_IF_ICMPGE, 0, 14,
+    OP_ALOAD_1,                 /* 37: composite[j] = 1 */
+    OP_ILOAD_3,
+    OP_ICONST_1,
+    OP_IASTORE,
+    OP_ILOAD_3,                 /* 41: j += i */
+    OP_ILOAD_2,
+    OP_IADD,
+    OP_ISTORE_3,
+    OP_GOTO, 0xff, 0xf3,        /* 45: } } */
+    OP_ILOAD_2,                 /* 48: i++ } */
+    OP_ICONST_1,
+    OP_IADD,
+    OP_ISTORE_2,
+    OP_GOTO, 0xff, 0xd5,
+    OP_ILOAD, 4,                /* 55: return count */
+    OP_IRETURN
+};
+
+/* Test 11: Superinstructions - sum 0..9 with iinc, then + 3 - 1 = 47. The
+ * loop is entered at its second load, in the middle of a fused compare. */
+uint8_t test_fused[] = {
+    OP_ICONST_0,                /* 0: sum = 0 */
+    OP_ISTORE_0,
+    OP_ICONST_0,                /* 2: i = 0 */
+    OP_ISTORE_1,
+    OP_BIPUSH, 10,              /* 4: n = 10 */
+    OP_ISTORE_2,
+    OP_ICONST_0,                /* 7: push i, enter the loop test at 19 */
+    OP_GOTO, 0, 11,
+    OP_ILOAD_0,                 /* 11: do { sum = sum + i */
+    OP_ILOAD_1,
+    OP_IADD,
+    OP_ISTORE_0,
+    OP_IINC, 1, 1,              /* 15: i++ */
+    OP_ILOAD_1,                 /* 18: } while (i < n) */
+    OP_ILOAD_2,
+    OP_IF_ICMPLT, 0xff, 0xf7,
+    OP_ILOAD_0,                 /* 23: sum = sum + 3 */
+    OP_ICONST_3,
+    OP_IADD,
+    OP_ISTORE_0,
+    OP_IINC, 0, 0xff,           /* 27: sum-- */
+    OP_ILOAD_0,                 /* 30: return sum */
+    OP_IRETURN
+};
+
+/* Test 12: Green thread tasks, as static methods of class Tasks.
+ * control(n, period) runs n periods, sleeping period ticks in each */
+uint8_t test_task_control[] = {
+    OP_ICONST_0,                /* 0: done = 0 */
+    OP_ISTORE_2,
+    OP_GOTO, 0, 10,             /* 2: enter the loop test at 12 */
+    OP_ILOAD_1,                 /* 5: do { Scheduler.sleep(period) */
+    OP_INVOKESTATIC, 0, 2,
+    OP_IINC, 2, 1,              /* 9: done++ */
+    OP_ILOAD_2,                 /* 12: } while (done < n) */
+    OP_ILOAD_0,
+    OP_IF_ICMPLT, 0xff, 0xf7,
+    OP_ILOAD_2,                 /* 17: return done */
+    OP_IRETURN
+};
+
+/* crunch(n) sums 0..n-1 without ever blocking */
+uint8_t test_task_crunch[] = {
+    OP_ICONST_0,                /* 0: sum = 0 */
+    OP_ISTORE_1,
+    OP_ICONST_0,                /* 2: i = 0 */
+    OP_ISTORE_2,
+    OP_GOTO, 0, 10,             /* 4: enter the loop test at 14 */
+    OP_ILOAD_1,                 /* 7: do { sum = sum + i */
+    OP_ILOAD_2,
+    OP_IADD,
+    OP_ISTORE_1,
+    OP_IINC, 2, 1,              /* 11: i++ */
+    OP_ILOAD_2,                 /* 14: } while (i < n) */
+    OP_ILOAD_0,
+    OP_IF_ICMPLT, 0xff, 0xf7,
+    OP_ILOAD_1,                 /* 19: return sum */
+    OP_IRETURN
+};
+
+/* logger(n) calls step n times, yielding after each: returns 3 * n */
+uint8_t test_task_logger[] = {
+    OP_ICONST_0,                /* 0: total = 0 */
+    OP_ISTORE_1,
+    OP_ICONST_0,                /* 2: i = 0 */
+    OP_ISTORE_2,
+    OP_GOTO, 0, 14,             /* 4: enter the loop test at 18 */
+    OP_ILOAD_1,                 /* 7: do { total = step(total) */
+    OP_INVOKESTATIC, 0, 3,
+    OP_ISTORE_1,
+    OP_INVOKESTATIC, 0, 1,      /* 12: Scheduler.yield() */
+    OP_IINC, 2, 1,              /* 15: i++ */
+    OP_ILOAD_2,                 /* 18: } while (i < n) */
+    OP_ILOAD_0,
+    OP_IF_ICMPLT, 0xff, 0xf3,
+    OP_ILOAD_1,                 /* 23: return total */
+    OP_IRETURN
+};
+
+/* step(x) returns x + 3 */
+uint8_t test_task_step[] = {
+    OP_ILOAD_0,
+    OP_ICONST_3,
+    OP_IADD,
+    OP_IRETURN
+};
+
+/* Test 13: Monitors, in class Counter { int count; }.
+ * static Counter make() returns a new counter */
+uint8_t test_counter_make[] = {
+    OP_NEW, 0, 1,
+    OP_ARETURN
+};
+
+/* static int add(Counter c, int n) adds 1 to c.count n times under c's
+ * monitor, making an int[6] of garbage each time while it holds it, and
+ * returns the count it saw last */
+uint8_t test_counter_add[] = {
+    OP_ICONST_0,                /* 0: i = 0 */
+    OP_ISTORE_2,
+    OP_GOTO, 0, 25,             /* 2: enter the loop test at 27 */
+    OP_ALOAD_0,                 /* 5: do { synchronized (c) { */
+    OP_MONITORENTER,
+    OP_ALOAD_0,                 /* 7: c.count = c.count + 1 */
+    OP_DUP,
+    OP_GETFIELD, 0, 2,
+    OP_ICONST_1,
+    OP_IADD,
+    OP_PUTFIELD, 0, 2,
+    OP_BIPUSH, 6,               /* 17: junk = new int[6] */
+    OP_NEWARRAY, 10,
+    OP_ASTORE_3,
+    OP_ALOAD_0,                 /* 22: } */
+    OP_MONITOREXIT,
+    OP_IINC, 2, 1,              /* 24: i++ */
+    OP_ILOAD_2,                 /* 27: } while (i < n) */
+    OP_ILOAD_1,
+    OP_IF_ICMPLT, 0xff, 0xe8,
+    OP_ALOAD_0,                 /* 32: synchronized (c) { return c.count } */
+    OP_MONITORENTER,
+    OP_ALOAD_0,
+    OP_GETFIELD, 0, 2,
+    OP_ALOAD_0,
+    OP_MONITOREXIT,
+    OP_IRETURN
+};
+
+/* Test 14: tableswitch - a state machine over states 1..4; any other
+ * state leaves it. Five rounds of acc = (acc + 1) * 3 - 2 give 121. The
+ * switch's operands are padded to a multiple of four bytes. */
+uint8_t test_switch_state[] = {
+    OP_BIPUSH, 1,               /* 0: state = 1 */
+    OP_ISTORE_0,
+    OP_ICONST_0,                /* 3: acc = 0 */
+    OP_ISTORE_1,
+    OP_ICONST_0,                /* 5: steps = 0 */
+    OP_ISTORE_2,
+    OP_ILOAD_0,                 /* 7: for (;;) switch (state) { */
+    OP_TABLESWITCH, 0, 0, 0,    /* 8: padded to 12 */
+    0, 0, 0, 76,                /* default */
+    0, 0, 0, 1,                 /* low */
+    0, 0, 0, 4,                 /* high */
+    0, 0, 0, 32,                /* case 1 */
+    0, 0, 0, 40,                /* case 2 */
+    0, 0, 0, 49,                /* case 3 */
+    0, 0, 0, 57,                /* case 4 */
+    OP_IINC, 1, 1,              /* 40: case 1: acc++; state = 2 */
+    OP_ICONST_2,
+    OP_ISTORE_0,
+    OP_GOTO, 0xff, 0xda,
+    OP_ILOAD_1,                 /* 48: case 2: acc *= 3; state = 3 */
+    OP_ICONST_3,
+    OP_IMUL,
+    OP_ISTORE_1,
+    OP_ICONST_3,
+    OP_ISTORE_0,
+    OP_GOTO, 0xff, 0xd1,
+    OP_IINC, 1, 0xfe,           /* 57: case 3: acc -= 2; state = 4 */
+    OP_ICONST_4,
+    OP_ISTORE_0,
+    OP_GOTO, 0xff, 0xc9,
+    OP_IINC, 2, 1,              /* 65: case 4: if (++steps >= 5) state = 9 */
+    OP_ILOAD_2,
+    OP_ICONST_5,
+    OP_IF_ICMPLT, 0, 9,
+    OP_BIPUSH, 9,
+    OP_ISTORE_0,
+    OP_GOTO, 0xff, 0xbb,
+    OP_ICONST_1,                /* 79: else state = 1 */
+    OP_ISTORE_0,
+    OP_GOTO, 0xff, 0xb6,
+    OP_ILOAD_1,                 /* 84: default: return acc } */
+    OP_IRETURN
+};
+
+/* Test 15: lookupswitch - sum three switches over x = -1100..2099. Keys
+ * 7i*i - 50 for i = 0..17 push i + 1 (171 in all), are too sparse for a
+ * jump table and enough to hash; keys -1000, -3, 7, 100 and 2000 push
+ * 1000..5000 (15000) through a binary search; keys 10, 11, 13 and 14 push
+ * 100..400 (1000) through a jump table. Returns 16171. */
+uint8_t test_switch_lookup[] = {
+    OP_SIPUSH, 0xfb, 0xb4,        /* 0: x = -1100 */
+    OP_ISTORE_0,
+    OP_ICONST_0,                /* 4: sum = 0 */
+    OP_ISTORE_1,
+    OP_GOTO, 1, 153,            /* 6: enter the loop test */
+    OP_ILOAD_0,                 /* 9: do { sum += switch (x): 7i*i - 50 -> i + 1 */
+    OP_LOOKUPSWITCH, 0,         /* 10: 18 sparse keys, hashed */
+    0, 0, 0, 244,               /* default */
+    0, 0, 0, 18,                /* pairs */
+    0xff, 0xff, 0xff, 0xce, 0, 0, 0, 154, /* case -50 */
+    0xff, 0xff, 0xff, 0xd5, 0, 0, 0, 159, /* case -43 */
+    0xff, 0xff, 0xff, 0xea, 0, 0, 0, 164, /* case -22 */
+    0, 0, 0, 13, 0, 0, 0, 169,  /* case 13 */
+    0, 0, 0, 62, 0, 0, 0, 174,  /* case 62 */
+    0, 0, 0, 125, 0, 0, 0, 179, /* case 125 */
+    0, 0, 0, 202, 0, 0, 0, 184, /* case 202 */
+    0, 0, 1, 37, 0, 0, 0, 189,  /* case 293 */
+    0, 0, 1, 142, 0, 0, 0, 194, /* case 398 */
+    0, 0, 2, 5, 0, 0, 0, 199,   /* case 517 */
+    0, 0, 2, 138, 0, 0, 0, 204, /* case 650 */
+    0, 0, 3, 29, 0, 0, 0, 209,  /* case 797 */
+    0, 0, 3, 190, 0, 0, 0, 214, /* case 958 */
+    0, 0, 4, 109, 0, 0, 0, 219, /* case 1133 */
+    0, 0, 5, 42, 0, 0, 0, 224,  /* case 1322 */
+    0, 0, 5, 245, 0, 0, 0, 229, /* case 1525 */
+    0, 0, 6, 206, 0, 0, 0, 234, /* case 1742 */
+    0, 0, 7, 181, 0, 0, 0, 239, /* case 1973 */
+    OP_BIPUSH, 1, OP_GOTO, 0, 89, /* 164: case: push 1 */
+    OP_BIPUSH, 2, OP_GOTO, 0, 84,
+    OP_BIPUSH, 3, OP_GOTO, 0, 79,
+    OP_BIPUSH, 4, OP_GOTO, 0, 74,
+    OP_BIPUSH, 5, OP_GOTO, 0, 69,
+    OP_BIPUSH, 6, OP_GOTO, 0, 64,
+    OP_BIPUSH, 7, OP_GOTO, 0, 59,
+    OP_BIPUSH, 8, OP_GOTO, 0, 54,
+    OP_BIPUSH, 9, OP_GOTO, 0, 49,
+    OP_BIPUSH, 10, OP_GOTO, 0, 44,
+    OP_BIPUSH, 11, OP_GOTO, 0, 39,
+    OP_BIPUSH, 12, OP_GOTO, 0, 34,
+    OP_BIPUSH, 13, OP_GOTO, 0, 29,
+    OP_BIPUSH, 14, OP_GOTO, 0, 24,
+    OP_BIPUSH, 15, OP_GOTO, 0, 19,
+    OP_BIPUSH, 16, OP_GOTO, 0, 14,
+    OP_BIPUSH, 17, OP_GOTO, 0, 9,
+    OP_BIPUSH, 18, OP_GOTO, 0, 4,
+    OP_ICONST_0, OP_ILOAD_1, OP_IADD, OP_ISTORE_1, /* 254: default: push 0; then add */
+    OP_ILOAD_0,                 /* 258: sum += switch (x): 5 sparse keys, searched */
+    OP_LOOKUPSWITCH,            /* 259: binary search */
+    0, 0, 0, 79,                /* default */
+    0, 0, 0, 5,                 /* pairs */
+    0xff, 0xff, 0xfc, 0x18, 0, 0, 0, 49, /* case -1000 */
+    0xff, 0xff, 0xff, 0xfd, 0, 0, 0, 55, /* case -3 */
+    0, 0, 0, 7, 0, 0, 0, 61,    /* case 7 */
+    0, 0, 0, 100, 0, 0, 0, 67,  /* case 100 */
+    0, 0, 7, 208, 0, 0, 0, 73,  /* case 2000 */
+    OP_SIPUSH, 3, 232, OP_GOTO, 0, 28, /* 308: case: push 1000 */
+    OP_SIPUSH, 7, 208, OP_GOTO, 0, 22,
+    OP_SIPUSH, 11, 184, OP_GOTO, 0, 16,
+    OP_SIPUSH, 15, 160, OP_GOTO, 0, 10,
+    OP_SIPUSH, 19, 136, OP_GOTO, 0, 4,
+    OP_ICONST_0, OP_ILOAD_1, OP_IADD, OP_ISTORE_1, /* 338: default: push 0; then add */
+    OP_ILOAD_0,                 /* 342: sum += switch (x): 4 close keys */
+    OP_LOOKUPSWITCH,            /* 343: made a jump table */
+    0, 0, 0, 65,                /* default */
+    0, 0, 0, 4,                 /* pairs */
+    0, 0, 0, 10, 0, 0, 0, 41,   /* case 10 */
+    0, 0, 0, 11, 0, 0, 0, 47,   /* case 11 */
+    0, 0, 0, 13, 0, 0, 0, 53,   /* case 13 */
+    0, 0, 0, 14, 0, 0, 0, 59,   /* case 14 */
+    OP_SIPUSH, 0, 100, OP_GOTO, 0, 22, /* 384: case: push 100 */
+    OP_SIPUSH, 0, 200, OP_GOTO, 0, 16,
+    OP_SIPUSH, 1, 44, OP_GOTO, 0, 10,
+    OP_SIPUSH, 1, 144, OP_GOTO, 0, 4,
+    OP_ICONST_0, OP_ILOAD_1, OP_IADD, OP_ISTORE_1, /* 408: default: push 0; then add */
+    OP_IINC, 0, 1,              /* 412: x++ */
+    OP_ILOAD_0,                 /* 415: } while (x < 2100) */
+    OP_SIPUSH, 8, 52,
+    OP_IF_ICMPLT, 0xfe, 0x66,
+    OP_ILOAD_1,                 /* 422: return sum */
+    OP_IRETURN
+};
+
+/* Test 16: long - static long mix(long h, int i), one step of a 64-bit
+ * LCG whose high bits are folded down: h = h * M + i; h ^ (h >>> 29) */
+uint8_t test_numeric_mix[] = {
+    OP_LLOAD_0,                 /* 0: h = h * M + i */
+    OP_LDC2_W, 0, 3,
+    OP_LMUL,
+    OP_ILOAD_2,
+    OP_I2L,
+    OP_LADD,
+    OP_LSTORE_0,
+    OP_LLOAD_0,                 /* 9: return h ^ (h >>> 29) */
+    OP_LLOAD_0,
+    OP_BIPUSH, 29,
+    OP_LUSHR,
+    OP_LXOR,
+    OP_LRETURN
+};
+
+/* Test 16: long - static int hash(int n), mixes n..1 into a seed, takes
+ * the absolute value and folds it to an int: -1584185376 for n = 1000 */
+uint8_t test_numeric_hash[] = {
+    OP_LDC2_W, 0, 5,            /* 0: h = SEED */
+    OP_LSTORE_1,
+    OP_ILOAD_0,                 /* 4: while (n > 0) */
+    OP_IFLE, 0, 15,
+    OP_LLOAD_1,                 /* 8: h = mix(h, n) */
+    OP_ILOAD_0,
+    OP_INVOKESTATIC, 0, 1,
+    OP_LSTORE_1,
+    OP_IINC, 0, 0xff,           /* 14: n-- */
+    OP_GOTO, 0xff, 0xf3,
+    OP_LLOAD_1,                 /* 20: if (h < 0) h = -h */
+    OP_LCONST_0,
+    OP_LCMP,
+    OP_IFGE, 0, 6,
+    OP_LLOAD_1,
+    OP_LNEG,
+    OP_LSTORE_1,
+    OP_LLOAD_1,                 /* 29: return (int)(h ^ (h >> 32)) */
+    OP_LLOAD_1,
+    OP_BIPUSH, 32,
+    OP_LSHR,
+    OP_LXOR,
+    OP_L2I,
+    OP_IRETURN
+};
+
+/* Test 17: double - static double root(double d), twenty Newton steps
+ * x = 0.5 * (x + d / x) from x = d towards the square root of d */
+uint8_t test_numeric_root[] = {
+    OP_DLOAD_0,                 /* 0: x = d */
+    OP_DSTORE_2,
+    OP_BIPUSH, 20,              /* 2: k = 20 */
+    OP_ISTORE, 4,
+    OP_ILOAD, 4,                /* 6: while (k != 0) */
+    OP_IFEQ, 0, 19,
+    OP_LDC2_W, 0, 7,            /* 11: x = 0.5 * (x + d / x) */
+    OP_DLOAD_2,
+    OP_DLOAD_0,
+    OP_DLOAD_2,
+    OP_DDIV,
+    OP_DADD,
+    OP_DMUL,
+    OP_DSTORE_2,
+    OP_IINC, 4, 0xff,           /* 21: k-- */
+    OP_GOTO, 0xff, 0xee,
+    OP_DLOAD_2,                 /* 27: return x */
+    OP_DRETURN
+};
+
+/* Test 17: double - static int roots(int n), the sum of
+ * (int)(root(i) * 1000) for i = 1..n: 671421 for n = 100 */
+uint8_t test_numeric_roots[] = {
+    OP_ICONST_0,                /* 0: sum = 0 */
+    OP_ISTORE_1,
+    OP_ILOAD_0,                 /* 2: while (n > 0) */
+    OP_IFLE, 0, 23,
+    OP_ILOAD_1,                 /* 6: sum += (int)(root(n) * 1000) */
+    OP_ILOAD_0,
+    OP_I2D,
+    OP_INVOKESTATIC, 0, 2,
+    OP_SIPUSH, 3, 232,
+    OP_I2D,
+    OP_DMUL,
+    OP_D2I,
+    OP_IADD,
+    OP_ISTORE_1,
+    OP_IINC, 0, 0xff,           /* 20: n-- */
+    OP_GOTO, 0xff, 0xeb,
+    OP_ILOAD_1,                 /* 26: return sum */
+    OP_IRETURN
+};
+
+/* Test 18: float - static int floats(int n), float arithmetic with
+ * f = n / 2 + 1, NaN compares, saturating and chained conversions:
+ * 42 - 1 + 1 + 0 + 127 + 1 + 11 - 6 = 175 for n = 11 */
+uint8_t test_numeric_floats[] = {
+    OP_ILOAD_0,                 /* 0: f = n / 2f + 1 */
+    OP_I2F,
+    OP_FCONST_2,
+    OP_FDIV,
+    OP_FCONST_1,
+    OP_FADD,
+    OP_FSTORE_1,
+    OP_FLOAD_1,                 /* 7: a = (int)(f * f) */
+    OP_FLOAD_1,
+    OP_FMUL,
+    OP_F2I,
+    OP_FCONST_0,                /* 11: nan = 0f / 0f */
+    OP_FCONST_0,
+    OP_FDIV,
+    OP_FSTORE_2,
+    OP_FLOAD_2,                 /* 15: a += fcmpl(nan, 0) */
+    OP_FCONST_0,
+    OP_FCMPL,
+    OP_IADD,
+    OP_FLOAD_2,                 /* 19: a += fcmpg(nan, 0) */
+    OP_FCONST_0,
+    OP_FCMPG,
+    OP_IADD,
+    OP_FLOAD_2,                 /* 23: a += (int)nan */
+    OP_F2I,
+    OP_IADD,
+    OP_LDC2_W, 0, 9,            /* 26: a += (int)1e30 >>> 24 */
+    OP_D2I,
+    OP_BIPUSH, 24,
+    OP_IUSHR,
+    OP_IADD,
+    OP_FLOAD_1,                 /* 34: a += (int)(f % 3f * 2) */
+    OP_LDC, 11,
+    OP_FREM,
+    OP_FCONST_2,
+    OP_FMUL,
+    OP_F2I,
+    OP_IADD,
+    OP_ILOAD_0,                 /* 42: a += (int)(long)(float)(double)(long)n */
+    OP_I2L,
+    OP_L2D,
+    OP_D2F,
+    OP_F2L,
+    OP_L2I,
+    OP_IADD,
+    OP_FLOAD_1,                 /* 49: a += (int)-f */
+    OP_FNEG,
+    OP_F2I,
+    OP_IADD,
+    OP_IRETURN                  /* 53: return a */
+};
+
+/* Test 19: dispatch - AbstractList.<init>()V, which only calls
+ * Object's constructor */
+uint8_t test_list_init[] = {
+    OP_ALOAD_0,                 /* 0: super() */
+    OP_INVOKESPECIAL, 0, 1,
+    OP_RETURN
+};
+
+/* Test 19: dispatch - AbstractList.sum()I, for (i = 0; i < size(); i++)
+ * s += get(i), with size() from interface List and get(I)I abstract */
+uint8_t test_list_sum[] = {
+    OP_ICONST_0,                /* 0: s = 0 */
+    OP_ISTORE_1,
+    OP_ICONST_0,                /* 2: i = 0 */
+    OP_ISTORE_2,
+    OP_ILOAD_2,                 /* 4: while (i < size()) */
+    OP_ALOAD_0,
+    OP_INVOKEVIRTUAL, 0, 2,
+    OP_IF_ICMPGE, 0, 17,
+    OP_ILOAD_1,                 /* 12: s += get(i) */
+    OP_ALOAD_0,
+    OP_ILOAD_2,
+    OP_INVOKEVIRTUAL, 0, 3,
+    OP_IADD,
+    OP_ISTORE_1,
+    OP_IINC, 2, 1,              /* 20: i++ */
+    OP_GOTO, 0xff, 0xed,
+    OP_ILOAD_1,                 /* 26: return s */
+    OP_IRETURN
+};
+
+/* Test 19: dispatch - ArrayList.<init>(I)V, data = new int[capacity] */
+uint8_t test_array_list_init[] = {
+    OP_ALOAD_0,                 /* 0: super() */
+    OP_INVOKESPECIAL, 0, 1,
+    OP_ALOAD_0,                 /* 4: data = new int[capacity] */
+    OP_ILOAD_1,
+    OP_NEWARRAY, 10,
+    OP_PUTFIELD, 0, 2,
+    OP_RETURN
+};
+
+/* Test 19: dispatch - ArrayList.add(I)V, data[size++] = value */
+uint8_t test_array_list_add[] = {
+    OP_ALOAD_0,                 /* 0: data[size] = value */
+    OP_GETFIELD, 0, 2,
+    OP_ALOAD_0,
+    OP_GETFIELD, 0, 3,
+    OP_ILOAD_1,
+    OP_IASTORE,
+    OP_ALOAD_0,                 /* 10: size++ */
+    OP_DUP,
+    OP_GETFIELD, 0, 3,
+    OP_ICONST_1,
+    OP_IADD,
+    OP_PUTFIELD, 0, 3,
+    OP_RETURN
+};
+
+/* Test 19: dispatch - ArrayList.size()I */
+uint8_t test_array_list_size[] = {
+    OP_ALOAD_0,
+    OP_GETFIELD, 0, 3,
+    OP_IRETURN
+};
+
+/* Test 19: dispatch - ArrayList.get(I)I, data[i] */
+uint8_t test_array_list_get[] = {
+    OP_ALOAD_0,
+    OP_GETFIELD, 0, 2,
+    OP_ILOAD_1,
+    OP_IALOAD,
+    OP_IRETURN
+};
+
+/* Test 19: dispatch - static LinkedList cons(List next, int value) */
+uint8_t test_linked_list_cons[] = {
+    OP_NEW, 0, 2,               /* 0: cell = new LinkedList() */
+    OP_DUP,
+    OP_INVOKESPECIAL, 0, 7,
+    OP_DUP,                     /* 7: cell.next = next */
+    OP_ALOAD_0,
+    OP_PUTFIELD, 0, 3,
+    OP_DUP,                     /* 12: cell.value = value */
+    OP_ILOAD_1,
+    OP_PUTFIELD, 0, 4,
+    OP_ARETURN
+};
+
+/* Test 19: dispatch - LinkedList.size()I, next == null ? 1 : 1 + next.size() */
+uint8_t test_linked_list_size[] = {
+    OP_ALOAD_0,                 /* 0: if (next == null) return 1 */
+    OP_GETFIELD, 0, 3,
+    OP_IFNONNULL, 0, 5,
+    OP_ICONST_1,
+    OP_IRETURN,
+    OP_ALOAD_0,                 /* 9: return next.size() + 1 */
+    OP_GETFIELD, 0, 3,
+    OP_INVOKEINTERFACE, 0, 5, 1, 0,
+    OP_ICONST_1,
+    OP_IADD,
+    OP_IRETURN
+};
+
+/* Test 19: dispatch - LinkedList.get(I)I, i == 0 ? value : next.get(i - 1) */
+uint8_t test_linked_list_get[] = {
+    OP_ILOAD_1,                 /* 0: if (i == 0) return value */
+    OP_IFNE, 0, 8,
+    OP_ALOAD_0,
+    OP_GETFIELD, 0, 4,
+    OP_IRETURN,
+    OP_ALOAD_0,                 /* 9: return next.get(i - 1) */
+    OP_GETFIELD, 0, 3,
+    OP_ILOAD_1,
+    OP_ICONST_1,
+    OP_ISUB,
+    OP_INVOKEINTERFACE, 0, 6, 2, 0,
+    OP_IRETURN
+};
+
+/* Test 19: dispatch - static int Lists.total(List list), the sum of
+ * list.get(i) through invokeinterface, which sees both lists */
+uint8_t test_lists_total[] = {
+    OP_ICONST_0,                /* 0: s = 0 */
+    OP_ISTORE_1,
+    OP_ICONST_0,                /* 2: i = 0 */
+    OP_ISTORE_2,
+    OP_ILOAD_2,                 /* 4: while (i < list.size()) */
+    OP_ALOAD_0,
+    OP_INVOKEINTERFACE, 0, 6, 1, 0,
+    OP_IF_ICMPGE, 0, 19,
+    OP_ILOAD_1,                 /* 14: s += list.get(i) */
+    OP_ALOAD_0,
+    OP_ILOAD_2,
+    OP_INVOKEINTERFACE, 0, 7, 2, 0,
+    OP_IADD,
+    OP_ISTORE_1,
+    OP_IINC, 2, 1,              /* 24: i++ */
+    OP_GOTO, 0xff, 0xe9,
+    OP_ILOAD_1,                 /* 30: return s */
+    OP_IRETURN
+};
+
+/* Test 19: dispatch - static int Lists.run(int n), puts 0..n-1 in an
+ * ArrayList and a LinkedList and adds up total() and sum() of each:
+ * 4 * 4950 = 19800 for n = 100 */
+uint8_t test_lists_run[] = {
+    OP_NEW, 0, 1,               /* 0: a = new ArrayList(n) */
+    OP_DUP,
+    OP_ILOAD_0,
+    OP_INVOKESPECIAL, 0, 2,
+    OP_ASTORE_1,
+    OP_ACONST_NULL,             /* 9: l = null */
+    OP_ASTORE_2,
+    OP_ICONST_0,                /* 11: i = 0 */
+    OP_ISTORE_3,
+    OP_ILOAD_3,                 /* 13: while (i < n) */
+    OP_ILOAD_0,
+    OP_IF_ICMPGE, 0, 20,
+    OP_ALOAD_1,                 /* 18: a.add(i) */
+    OP_ILOAD_3,
+    OP_INVOKEVIRTUAL, 0, 3,
+    OP_ALOAD_2,                 /* 23: l = LinkedList.cons(l, i) */
+    OP_ILOAD_3,
+    OP_INVOKESTATIC, 0, 4,
+    OP_ASTORE_2,
+    OP_IINC, 3, 1,              /* 29: i++ */
+    OP_GOTO, 0xff, 0xed,
+    OP_ALOAD_1,                 /* 35: return total(a) + total(l) + a.sum() + l.sum() */
+    OP_INVOKESTATIC, 0, 5,
+    OP_ALOAD_2,
+    OP_INVOKESTATIC, 0, 5,
+    OP_IADD,
+    OP_ALOAD_1,
+    OP_INVOKEVIRTUAL, 0, 8,
+    OP_IADD,
+    OP_ALOAD_2,
+    OP_INVOKEVIRTUAL, 0, 8,
+    OP_IADD,
+    OP_IRETURN
+};
+
+/* Test 20: exceptions - Exceptions.divide(II)I,
+ * try { return a / b; } catch (ArithmeticException e) { return -1; } */
+uint8_t test_exceptions_divide[] = {
+    OP_ILOAD_0,                 /* 0: try: return a / b */
+    OP_ILOAD_1,
+    OP_IDIV,
+    OP_IRETURN,
+    OP_ASTORE_2,                /* 4: catch: return -1 */
+    OP_ICONST_M1,
+    OP_IRETURN
+};
+
+/* Test 20: exceptions - Exceptions.element([II)I, try { return a[i]; }
+ * catch (IndexOutOfBoundsException e) { return -2; }, which catches the
+ * ArrayIndexOutOfBoundsException iaload raises */
+uint8_t test_exceptions_element[] = {
+    OP_ALOAD_0,                 /* 0: try: return a[i] */
+    OP_ILOAD_1,
+    OP_IALOAD,
+    OP_IRETURN,
+    OP_ASTORE_2,                /* 4: catch: return -2 */
+    OP_BIPUSH, 0xfe,
+    OP_IRETURN
+};
+
+/* Test 20: exceptions - Exceptions.validate(I)I,
+ * if (n < 0) throw new BadInput(); return n */
+uint8_t test_exceptions_validate[] = {
+    OP_ILOAD_0,                 /* 0: if (n < 0) */
+    OP_IFGE, 0, 11,
+    OP_NEW, 0, 3,               /* 4: throw new BadInput() */
+    OP_DUP,
+    OP_INVOKESPECIAL, 0, 4,
+    OP_ATHROW,
+    OP_ILOAD_0,                 /* 12: return n */
+    OP_IRETURN
+};
+
+/* Test 20: exceptions - Exceptions.guard(I)I, try { return validate(n); }
+ * with a handler for anything that rethrows it, as finally does */
+uint8_t test_exceptions_guard[] = {
+    OP_ILOAD_0,                 /* 0: try: return validate(n) */
+    OP_INVOKESTATIC, 0, 5,
+    OP_IRETURN,
+    OP_ASTORE_1,                /* 5: catch any: throw it again */
+    OP_ALOAD_1,
+    OP_ATHROW
+};
+
+/* Test 20: exceptions - Exceptions.parse(I)I,
+ * try { return guard(n) * 2; } catch (BadInput e) { return 0; } */
+uint8_t test_exceptions_parse[] = {
+    OP_ILOAD_0,                 /* 0: try: return guard(n) * 2 */
+    OP_INVOKESTATIC, 0, 6,
+    OP_ICONST_2,
+    OP_IMUL,
+    OP_IRETURN,
+    OP_POP,                     /* 7: catch: return 0 */
+    OP_ICONST_0,
+    OP_IRETURN
+};
+
+/* Test 20: exceptions - Exceptions.depth(I)I, return depth(n + 1), which
+ * recurses until the frames run out */
+uint8_t test_exceptions_depth[] = {
+    OP_ILOAD_0,
+    OP_ICONST_1,
+    OP_IADD,
+    OP_INVOKESTATIC, 0, 8,
+    OP_IRETURN
+};
+
+/* Test 20: exceptions - Exceptions.overflow()I,
+ * try { depth(0); return 0; } catch (StackOverflowError e) { return 1; } */
+uint8_t test_exceptions_overflow[] = {
+    OP_ICONST_0,                /* 0: try: depth(0); return 0 */
+    OP_INVOKESTATIC, 0, 8,
+    OP_POP,
+    OP_ICONST_0,
+    OP_IRETURN,
+    OP_POP,                     /* 7: catch: return 1 */
+    OP_ICONST_1,
+    OP_IRETURN
+};
+
+/* Test 20: exceptions - Exceptions.length([I)I,
+ * try { return a.length; } catch (NullPointerException e) { return -3; } */
+uint8_t test_exceptions_length[] = {
+    OP_ALOAD_0,                 /* 0: try: return a.length */
+    OP_ARRAYLENGTH,
+    OP_IRETURN,
+    OP_POP,                     /* 3: catch: return -3 */
+    OP_BIPUSH, 0xfd,
+    OP_IRETURN
+};
+
+/* Test 20: exceptions - Exceptions.run(I)I,
+ * for (i = 0; i < n; i++) s += divide(120, i % 4);
+ * return s + element(new int[4], n) + parse(-1) + parse(5) + overflow()
+ *        + length(null) */
+uint8_t test_exceptions_run[] = {
+    OP_ICONST_0,                /* 0: s = 0 */
+    OP_ISTORE_1,
+    OP_ICONST_0,                /* 2: i = 0 */
+    OP_ISTORE_2,
+    OP_ILOAD_2,                 /* 4: while (i < n) */
+    OP_ILOAD_0,
+    OP_IF_ICMPGE, 0, 20,
+    OP_ILOAD_1,                 /* 9: s += divide(120, i % 4) */
+    OP_BIPUSH, 120,
+    OP_ILOAD_2,
+    OP_ICONST_4,
+    OP_IREM,
+    OP_INVOKESTATIC, 0, 10,
+    OP_IADD,
+    OP_ISTORE_1,
+    OP_IINC, 2, 1,              /* 20: i++ */
+    OP_GOTO, 0xff, 0xed,
+    OP_ILOAD_1,                 /* 26: s + element(new int[4], n) */
+    OP_ICONST_4,
+    OP_NEWARRAY, 10,
+    OP_ILOAD_0,
+    OP_INVOKESTATIC, 0, 11,
+    OP_IADD,
+    OP_ICONST_M1,               /* 35: + parse(-1) + parse(5) */
+    OP_INVOKESTATIC, 0, 12,
+    OP_IADD,
+    OP_ICONST_5,
+    OP_INVOKESTATIC, 0, 12,
+    OP_IADD,
+    OP_INVOKESTATIC, 0, 13,     /* 45: + overflow() */
+    OP_IADD,
+    OP_ACONST_NULL,             /* 49: + length(null) */
+    OP_INVOKESTATIC, 0, 14,
+    OP_IADD,
+    OP_IRETURN
+};
+
+/* Test 21: strings - Strings.label(I)Ljava/lang/String;,
+ * return new StringBuilder().append("item-").append(i).toString() */
+uint8_t test_strings_label[] = {
+    OP_NEW, 0, 2,
+    OP_DUP,
+    OP_INVOKESPECIAL, 0, 3,
+    OP_LDC, 1,                  /* "item-" */
+    OP_INVOKEVIRTUAL, 0, 4,
+    OP_ILOAD_0,
+    OP_INVOKEVIRTUAL, 0, 5,
+    OP_INVOKEVIRTUAL, 0, 6,
+    OP_ARETURN
+};
+
+/* Test 21: strings - Strings.chars()I: t = "ab" + 'α', which makes
+ * a UTF-16 String; r = t.length() + t.charAt(2);
+ * try { return r + t.charAt(3); }
+ * catch (StringIndexOutOfBoundsException e) { return r + 10000; } */
+uint8_t test_strings_chars[] = {
+    OP_NEW, 0, 2,               /* 0: t = new StringBuilder() */
+    OP_DUP,
+    OP_INVOKESPECIAL, 0, 3,
+    OP_LDC, 15,                 /* 7: .append("ab") */
+    OP_INVOKEVIRTUAL, 0, 4,
+    OP_SIPUSH, 0x03, 0xb1,      /* 12: .append('α') */
+    OP_INVOKEVIRTUAL, 0, 13,
+    OP_INVOKEVIRTUAL, 0, 6,     /* 18: .toString() */
+    OP_ASTORE_0,
+    OP_ALOAD_0,                 /* 22: r = t.length() + t.charAt(2) */
+    OP_INVOKEVIRTUAL, 0, 9,
+    OP_ALOAD_0,
+    OP_ICONST_2,
+    OP_INVOKEVIRTUAL, 0, 10,
+    OP_IADD,
+    OP_ISTORE_1,
+    OP_ALOAD_0,                 /* 33: try: return r + t.charAt(3) */
+    OP_ICONST_3,
+    OP_INVOKEVIRTUAL, 0, 10,
+    OP_ILOAD_1,
+    OP_IADD,
+    OP_IRETURN,
+    OP_POP,                     /* 41: catch: return r + 10000 */
+    OP_ILOAD_1,
+    OP_SIPUSH, 0x27, 0x10,
+    OP_IADD,
+    OP_IRETURN
+};
+
+/* Test 21: strings - Strings.run(I)I,
+ * for (i = 0; i < n; i++) { l = label(i % 10);
+ *     if (l.equals("item-7")) s += 1000; s += l.length() + l.charAt(5); }
+ * if ("item-7" == Labels.seven()) s += 100;
+ * if (label(7).intern() == "item-7") s += 50;
+ * return s + "hello".hashCode() + chars() */
+uint8_t test_strings_run[] = {
+    OP_ICONST_0,                /* 0: s = 0 */
+    OP_ISTORE_1,
+    OP_ICONST_0,                /* 2: i = 0 */
+    OP_ISTORE_2,
+    OP_ILOAD_2,                 /* 4: while (i < n) */
+    OP_ILOAD_0,
+    OP_IF_ICMPGE, 0, 45,
+    OP_ILOAD_2,                 /* 9: l = label(i % 10) */
+    OP_BIPUSH, 10,
+    OP_IREM,
+    OP_INVOKESTATIC, 0, 7,
+    OP_ASTORE_3,
+    OP_ALOAD_3,                 /* 17: if (l.equals("item-7")) */
+    OP_LDC, 8,
+    OP_INVOKEVIRTUAL, 0, 11,
+    OP_IFEQ, 0, 9,
+    OP_ILOAD_1,                 /* 26: s += 1000 */
+    OP_SIPUSH, 0x03, 0xe8,
+    OP_IADD,
+    OP_ISTORE_1,
+    OP_ILOAD_1,                 /* 32: s += l.length() + l.charAt(5) */
+    OP_ALOAD_3,
+    OP_INVOKEVIRTUAL, 0, 9,
+    OP_IADD,
+    OP_ALOAD_3,
+    OP_ICONST_5,
+    OP_INVOKEVIRTUAL, 0, 10,
+    OP_IADD,
+    OP_ISTORE_1,
+    OP_IINC, 2, 1,              /* 45: i++ */
+    OP_GOTO, 0xff, 0xd4,
+    OP_LDC, 8,                  /* 51: if ("item-7" == Labels.seven()) */
+    OP_INVOKESTATIC, 0, 14,
+    OP_IF_ACMPNE, 0, 6,
+    OP_IINC, 1, 100,            /* 59: s += 100 */
+    OP_BIPUSH, 7,               /* 62: if (label(7).intern() == "item-7") */
+    OP_INVOKESTATIC, 0, 7,
+    OP_INVOKEVIRTUAL, 0, 12,
+    OP_LDC, 8,
+    OP_IF_ACMPNE, 0, 6,
+    OP_IINC, 1, 50,             /* 75: s += 50 */
+    OP_ILOAD_1,                 /* 78: return s + "hello".hashCode() + chars() */
+    OP_LDC, 16,
+    OP_INVOKEVIRTUAL, 0, 17,
+    OP_IADD,
+    OP_INVOKESTATIC, 0, 18,
+    OP_IADD,
+    OP_IRETURN
+};
+
+/* Test 21: strings - Labels.seven()Ljava/lang/String;, return "item-7"
+ * from another class's constant pool */
+uint8_t test_labels_seven[] = {
+    OP_LDC, 1,
+    OP_ARETURN
+};
+
+/* Test 23: Garbage.alloc(I)I, a virtual method that allocates,
+ * return new int[n].length */
+uint8_t test_garbage_alloc[] = {
+    OP_ILOAD_1,
+    OP_NEWARRAY, 10,
+    OP_ARRAYLENGTH,
+    OP_IRETURN
+};
+
+/* Test 23: Garbage.run(I)I, g = new Garbage(); s = 0;
+ * for (i = 0; i < n; i++) s += g.alloc(16); return s */
+uint8_t test_garbage_run[] = {
+    OP_NEW, 0, 1,               /* 0: g = new Garbage() */
+    OP_ASTORE_1,
+    OP_ICONST_0,                /* 4: s = 0 */
+    OP_ISTORE_2,
+    OP_ICONST_0,                /* 6: i = 0 */
+    OP_ISTORE_3,
+    OP_ILOAD_3,                 /* 8: while (i < n) */
+    OP_ILOAD_0,
+    OP_IF_ICMPGE, 0, 18,
+    OP_ILOAD_2,                 /* 13: s += g.alloc(16) */
+    OP_ALOAD_1,
+    OP_BIPUSH, 16,
+    OP_INVOKEVIRTUAL, 0, 2,
+    OP_IADD,
+    OP_ISTORE_2,
+    OP_IINC, 3, 1,              /* 22: i++ */
+    OP_GOTO, 0xff, 0xef,
+    OP_ILOAD_2,                 /* 28: return s */
+    OP_IRETURN
+};
+
+/* Test 24: division overflow - Integer.MIN_VALUE / -1 wraps to MIN_VALUE
+ * and MIN_VALUE % -1 is 0, so MIN_VALUE / -1 + MIN_VALUE % -1 is
+ * -2147483648. MIN_VALUE is made as -32768 * 256 * 256. */
+uint8_t test_divide_overflow[] = {
+    OP_SIPUSH, 0x80, 0x00,      /* 0: min = -32768 * 256 * 256 */
+    OP_SIPUSH, 0x01, 0x00,
+    OP_IMUL,
+    OP_SIPUSH, 0x01, 0x00,
+    OP_IMUL,
+    OP_ISTORE_0,
+    OP_ILOAD_0,                 /* 12: q = min / -1 */
+    OP_ICONST_M1,
+    OP_IDIV,
+    OP_ILOAD_0,                 /* 15: return q + min % -1 */
+    OP_ICONST_M1,
+    OP_IREM,
+    OP_IADD,
+    OP_IRETURN
+};
+
+/* Test 26: super calls - Base.scale(I)I, an instance method,
+ * return n * 3 */
+uint8_t test_base_scale[] = {
+    OP_ILOAD_1,
+    OP_ICONST_3,
+    OP_IMUL,
+    OP_IRETURN
+};
+
+/* Test 26: Base.twice(I)I, static, return n * 2 */
+uint8_t test_base_twice[] = {
+    OP_ILOAD_0,
+    OP_ICONST_2,
+    OP_IMUL,
+    OP_IRETURN
+};
+
+/* Test 26: Derived.scale(I)I, return super.scale(n) + 1 */
+uint8_t test_derived_scale[] = {
+    OP_ALOAD_0,
+    OP_ILOAD_1,
+    OP_INVOKESPECIAL, 0, 1,
+    OP_ICONST_1,
+    OP_IADD,
+    OP_IRETURN
+};
+
+/* Test 26: Derived.twice(I)I, static, return Base.twice(n) + 1, a call to
+ * the method of the same name and descriptor in another class */
+uint8_t test_derived_twice[] = {
+    OP_ILOAD_0,
+    OP_INVOKESTATIC, 0, 2,
+    OP_ICONST_1,
+    OP_IADD,
+    OP_IRETURN
+};
+
+/* Test 26: Supers.scale(I)I, return new Derived().scale(n) */
+uint8_t test_supers_scale[] = {
+    OP_NEW, 0, 1,
+    OP_ILOAD_0,
+    OP_INVOKEVIRTUAL, 0, 2,
+    OP_IRETURN
+};
+
+/* Test 25: Switches.run(I)I, return state() * n + lookup(), where state
+ * and lookup are tests 14 and 15 as methods of a class */
+uint8_t test_switches_run[] = {
+    OP_INVOKESTATIC, 0, 1,      /* 0: state() * n */
+    OP_ILOAD_0,
+    OP_IMUL,
+    OP_INVOKESTATIC, 0, 2,      /* 5: + lookup() */
+    OP_IADD,
+    OP_IRETURN
+};
+
+const int test_node_push_length = sizeof(test_node_push);
+const int test_node_sum_length = sizeof(test_node_sum);
+const int test_node_build_length = sizeof(test_node_build);
+const int test_node_churn_length = sizeof(test_node_churn);
+const int test_sieve_length = sizeof(test_sieve);
+const int test_fused_length = sizeof(test_fused);
+const int test_task_control_length = sizeof(test_task_control);
+const int test_task_crunch_length = sizeof(test_task_crunch);
+const int test_task_logger_length = sizeof(test_task_logger);
+const int test_task_step_length = sizeof(test_task_step);
+const int test_counter_make_length = sizeof(test_counter_make);
+const int test_counter_add_length = sizeof(test_counter_add);
+const int test_switch_state_length = sizeof(test_switch_state);
+const int test_switch_lookup_length = sizeof(test_switch_lookup);
+const int test_numeric_mix_length = sizeof(test_numeric_mix);
+const int test_numeric_hash_length = sizeof(test_numeric_hash);
+const int test_numeric_root_length = sizeof(test_numeric_root);
+const int test_numeric_roots_length = sizeof(test_numeric_roots);
+const int test_numeric_floats_length = sizeof(test_numeric_floats);
+const int test_list_init_length = sizeof(test_list_init);
+const int test_list_sum_length = sizeof(test_list_sum);
+const int test_array_list_init_length = sizeof(test_array_list_init);
+const int test_array_list_add_length = sizeof(test_array_list_add);
+const int test_array_list_size_length = sizeof(test_array_list_size);
+const int test_array_list_get_length = sizeof(test_array_list_get);
+const int test_linked_list_cons_length = sizeof(test_linked_list_cons);
+const int test_linked_list_size_length = sizeof(test_linked_list_size);
+const int test_linked_list_get_length = sizeof(test_linked_list_get);
+const int test_lists_total_length = sizeof(test_lists_total);
+const int test_lists_run_length = sizeof(test_lists_run);
+const int test_exceptions_divide_length = sizeof(test_exceptions_divide);
+const int test_exceptions_element_length = sizeof(test_exceptions_element);
+const int test_exceptions_validate_length = sizeof(test_exceptions_validate);
+const int test_exceptions_guard_length = sizeof(test_exceptions_guard);
+const int test_exceptions_parse_length = sizeof(test_exceptions_parse);
+const int test_exceptions_depth_length = sizeof(test_exceptions_depth);
+const int test_exceptions_overflow_length = sizeof(test_exceptions_overflow);
+const int test_exceptions_length_length = sizeof(test_exceptions_length);
+const int test_exceptions_run_length = sizeof(test_exceptions_run);
+const int test_strings_label_length = sizeof(test_strings_label);
+const int test_strings_chars_length = sizeof(test_strings_chars);
+const int test_strings_run_length = sizeof(test_strings_run);
+const int test_labels_seven_length = sizeof(test_labels_seven);
+const int test_garbage_alloc_length = sizeof(test_garbage_alloc);
+const int test_garbage_run_length = sizeof(test_garbage_run);
+const int test_divide_overflow_length = sizeof(test_divide_overflow);
+const int test_switches_run_length = sizeof(test_switches_run);
+const int test_base_scale_length = sizeof(test_base_scale);
+const int test_base_twice_length = sizeof(test_base_twice);
+const int test_derived_scale_length = sizeof(test_derived_scale);
+const int test_derived_twice_length = sizeof(test_derived_twice);
+const int test_supers_scale_length = sizeof(test_supers_scale);
+
+/* Build the class holding fib and ack, with the constant pool their
+ * invokestatic operands expect */
+Class* test_recursion_class(void) {
+    Class* cls = class_create("Recursion");
+    if (!cls) {
+        return NULL;
+    }
+    class_add_method_ref(cls, "fib", "(I)I");      /* #1 */
+    class_add_method_ref(cls, "ack", "(II)I");     /* #2 */
+    if (!class_add_method(cls, "fib", "(I)I", test_fib, test_fib_length) ||
+        !class_add_method(cls, "ack", "(II)I", test_ackermann, test_ackermann_length)) {
+        class_destroy(cls);
+        return NULL;
+    }
+    return cls;
+}
+
+/* Build class Node { Node next; int value; } with the object and array
+ * tests as its static methods and the constants their operands expect */
+Class* test_node_class(void) {
+    Class* cls = class_create("Node");
+    if (!cls) {
+        return NULL;
+    }
+    class_add_class_ref(cls, "Node");                       /* #1 */
+    class_add_field_ref(cls, "next", "LNode;");             /* #2 */
+    class_add_field_ref(cls, "value", "I");                 /* #3 */
+    class_add_method_ref(cls, "push", "(LNode;I)LNode;");   /* #4 */
+    class_add_method_ref(cls, "sum", "(LNode;)I");          /* #5 */
+    class_add_method_ref(cls, "build", "(I)LNode;");        /* #6 */
+    if (class_add_field(cls, "value", "I") < 0 ||
+        class_add_field(cls, "next", "LNode;") < 0 ||
+        !class_add_method(cls, "push", "(LNode;I)LNode;", test_node_push, test_node_push_length) ||
+        !class_add_method(cls, "sum", "(LNode;)I", test_node_sum, test_node_sum_length) ||
+        !class_add_method(cls, "build", "(I)LNode;", test_node_build, test_node_build_length) ||
+        !class_add_method(cls, "churn", "(II)I", test_node_churn, test_node_churn_length) ||
+        !class_add_method(cls, "sieve", "(I)I", test_sieve, test_sieve_length)) {
+        class_destroy(cls);
+        return NULL;
+    }
+    return cls;
+}
+
+/* Build class Tasks with the green thread tasks, calling the scheduler
+ * through aruvi/Scheduler */
+Class* test_tasks_class(void) {
+    Class* cls = class_create("Tasks");
+    if (!cls) {
+        return NULL;
+    }
+    class_add_external_method_ref(cls, SCHEDULER_CLASS, "yield", "()V");   /* #1 */
+    class_add_external_method_ref(cls, SCHEDULER_CLASS, "sleep", "(I)V");  /* #2 */
+    class_add_method_ref(cls, "step", "(I)I");                             /* #3 */
+    if (!class_add_method(cls, "control", "(II)I", test_task_control, test_task_control_length) ||
+        !class_add_method(cls, "crunch", "(I)I", test_task_crunch, test_task_crunch_length) ||
+        !class_add_method(cls, "logger", "(I)I", test_task_logger, test_task_logger_length) ||
+        !class_add_method(cls, "step", "(I)I", test_task_step, test_task_step_length)) {
+        class_destroy(cls);
+        return NULL;
+    }
+    return cls;
+}
+
+/* Build class Counter { int count; } with make and add */
+Class* test_counter_class(void) {
+    Class* cls = class_create("Counter");
+    if (!cls) {
+        return NULL;
+    }
+    class_add_class_ref(cls, "Counter");           /* #1 */
+    class_add_field_ref(cls, "count", "I");        /* #2 */
+    if (class_add_field(cls, "count", "I") < 0 ||
+        !class_add_method(cls, "make", "()LCounter;", test_counter_make,
+                          test_counter_make_length) ||
+        !class_add_method(cls, "add", "(LCounter;I)I", test_counter_add,
+                          test_counter_add_length)) {
+        class_destroy(cls);
+        return NULL;
+    }
+    return cls;
+}
+
+/* Build class Garbage with its virtual alloc and static run */
+Class* test_garbage_class(void) {
+    Class* cls = class_create("Garbage");
+    if (!cls) {
+        return NULL;
+    }
+    class_add_class_ref(cls, "Garbage");                /* #1 */
+    class_add_method_ref(cls, "alloc", "(I)I");         /* #2 */
+    if (!class_add_instance_method(cls, "alloc", "(I)I", test_garbage_alloc,
+                                   test_garbage_alloc_length) ||
+        !class_add_method(cls, "run", "(I)I", test_garbage_run, test_garbage_run_length)) {
+        class_destroy(cls);
+        return NULL;
+    }
+    return cls;
+}
+
+/* Build class Numeric with the long, double and float tests. Without
+ * JVM_FLOAT only mix and hash are added, at the same constant indices. */
+Class* test_numeric_class(void) {
+    Class* cls = class_create("Numeric");
+    if (!cls) {
+        return NULL;
+    }
+    class_add_method_ref(cls, "mix", "(JI)J");                /* #1 */
+    class_add_method_ref(cls, "root", "(D)D");                /* #2 */
+    class_add_long_constant(cls, INT64_C(6364136223846793005)); /* #3, M */
+    class_add_long_constant(cls, INT64_C(-7046029254386353131)); /* #5, SEED */
+#ifdef JVM_FLOAT
+    class_add_double_constant(cls, 0.5);                      /* #7 */
+    class_add_double_constant(cls, 1e30);                     /* #9 */
+    class_add_float_constant(cls, 3.0f);                      /* #11 */
+#endif
+    if (!class_add_method(cls, "mix", "(JI)J", test_numeric_mix, test_numeric_mix_length) ||
+        !class_add_method(cls, "hash", "(I)I", test_numeric_hash, test_numeric_hash_length)) {
+        class_destroy(cls);
+        return NULL;
+    }
+#ifdef JVM_FLOAT
+    if (!class_add_method(cls, "root", "(D)D", test_numeric_root, test_numeric_root_length) ||
+        !class_add_method(cls, "roots", "(I)I", test_numeric_roots, test_numeric_roots_length) ||
+        !class_add_method(cls, "floats", "(I)I", test_numeric_floats,
+                          test_numeric_floats_length)) {
+        class_destroy(cls);
+        return NULL;
+    }
+#endif
+    return cls;
+}
+
+/* Build interface List and classes AbstractList, ArrayList, LinkedList
+ * and Lists, in a registry so their names find each other */
+ClassRegistry* test_lists_registry(void) {
+    ClassRegistry* registry = class_registry_create();
+    Class* list = class_create("List");
+    Class* abstract_list = class_create("AbstractList");
+    Class* array_list = class_create("ArrayList");
+    Class* linked_list = class_create("LinkedList");
+    Class* lists = class_create("Lists");
+    Class* classes[] = {list, abstract_list, array_list, linked_list, lists};
+    int added = 0, ok;
+
+    ok = registry && list && abstract_list && array_list && linked_list && lists;
+    for (; ok && added < 5; added++) {
+        ok = class_registry_add(registry, classes[added]) == 0;
+    }
+    /* Classes the registry did not take are destroyed here */
+    if (!ok) {
+        for (int i = added; i < 5; i++) {
+            class_destroy(classes[i]);
+        }
+        class_registry_destroy(registry);
+        return NULL;
+    }
+
+    class_set_interface(list);
+    ok = class_add_abstract_method(list, "size", "()I") &&
+         class_add_abstract_method(list, "get", "(I)I");
+
+    class_add_external_method_ref(abstract_list, "java/lang/Object", "<init>", "()V"); /* #1 */
+    class_add_method_ref(abstract_list, "size", "()I");                               /* #2 */
+    class_add_method_ref(abstract_list, "get", "(I)I");                               /* #3 */
+    ok = ok && class_add_interface(abstract_list, "List") == 0 &&
+         class_add_instance_method(abstract_list, "<init>", "()V", test_list_init,
+                                   test_list_init_length) &&
+         class_add_abstract_method(abstract_list, "get", "(I)I") &&
+         class_add_instance_method(abstract_list, "sum", "()I", test_list_sum,
+                                   test_list_sum_length);
+
+    class_add_external_method_ref(array_list, "AbstractList", "<init>", "()V");      /* #1 */
+    class_add_field_ref(array_list, "data", "[I");                                   /* #2 */
+    class_add_field_ref(array_list, "size", "I");                                    /* #3 */
+    ok = ok && class_set_super(array_list, "AbstractList") == 0 &&
+         class_add_field(array_list, "data", "[I") >= 0 &&
+         class_add_field(array_list, "size", "I") >= 0 &&
+         class_add_instance_method(array_list, "<init>", "(I)V", test_array_list_init,
+                                   test_array_list_init_length) &&
+         class_add_instance_method(array_list, "add", "(I)V", test_array_list_add,
+                                   test_array_list_add_length) &&
+         class_add_instance_method(array_list, "size", "()I", test_array_list_size,
+                                   test_array_list_size_length) &&
+         class_add_instance_method(array_list, "get", "(I)I", test_array_list_get,
+                                   test_array_list_get_length);
+
+    class_add_external_method_ref(linked_list, "AbstractList", "<init>", "()V");     /* #1 */
+    class_add_class_ref(linked_list, "LinkedList");                                  /* #2 */
+    class_add_field_ref(linked_list, "next", "LList;");                              /* #3 */
+    class_add_field_ref(linked_list, "value", "I");                                  /* #4 */
+    class_add_interface_method_ref(linked_list, "List", "size", "()I");              /* #5 */
+    class_add_interface_method_ref(linked_list, "List", "get", "(I)I");              /* #6 */
+    class_add_method_ref(linked_list, "<init>", "()V");                              /* #7 */
+    ok = ok && class_set_super(linked_list, "AbstractList") == 0 &&
+         class_add_field(linked_list, "value", "I") >= 0 &&
+         class_add_field(linked_list, "next", "LList;") >= 0 &&
+         class_add_instance_method(linked_list, "<init>", "()V", test_list_init,
+                                   test_list_init_length) &&
+         class_add_method(linked_list, "cons", "(LList;I)LLinkedList;",
+                          test_linked_list_cons, test_linked_list_cons_length) &&
+         class_add_instance_method(linked_list, "size", "()I", test_linked_list_size,
+                                   test_linked_list_size_length) &&
+         class_add_instance_method(linked_list, "get", "(I)I", test_linked_list_get,
+                                   test_linked_list_get_length);
+
+    class_add_class_ref(lists, "ArrayList");                                         /* #1 */
+    class_add_external_method_ref(lists, "ArrayList", "<init>", "(I)V");             /* #2 */
+    class_add_external_method_ref(lists, "ArrayList", "add", "(I)V");                /* #3 */
+    class_add_external_method_ref(lists, "LinkedList", "cons", "(LList;I)LLinkedList;"); /* #4 */
+    class_add_method_ref(lists, "total", "(LList;)I");                               /* #5 */
+    class_add_interface_method_ref(lists, "List", "size", "()I");                    /* #6 */
+    class_add_interface_method_ref(lists, "List", "get", "(I)I");                    /* #7 */
+    class_add_external_method_ref(lists, "AbstractList", "sum", "()I");              /* #8 */
+    ok = ok &&
+         class_add_method(lists, "total", "(LList;)I", test_lists_total,
+                          test_lists_total_length) &&
+         class_add_method(lists, "run", "(I)I", test_lists_run, test_lists_run_length);
+
+    if (!ok) {
+        class_registry_destroy(registry);
+        return NULL;
+    }
+    return registry;
+}
+
+/* Build class BadInput, a RuntimeException, and class Exceptions, in a
+ * registry so their names find each other */
+ClassRegistry* test_exceptions_registry(void) {
+    ClassRegistry* registry = class_registry_create();
+    Class* bad_input = class_create("BadInput");
+    Class* exceptions = class_create("Exceptions");
+    Method* divide = NULL;
+    Method* element = NULL;
+    Method* guard = NULL;
+    Method* parse = NULL;
+    Method* overflow = NULL;
+    Method* length = NULL;
+    Class* classes[] = {bad_input, exceptions};
+    int added = 0, ok;
+
+    ok = registry && bad_input && exceptions;
+    for (; ok && added < 2; added++) {
+        ok = class_registry_add(registry, classes[added]) == 0;
+    }
+    /* Classes the registry did not take are destroyed here */
+    if (!ok) {
+        for (int i = added; i < 2; i++) {
+            class_destroy(classes[i]);
+        }
+        class_registry_destroy(registry);
+        return NULL;
+    }
+
+    class_add_external_method_ref(bad_input, "java/lang/RuntimeException", "<init>", "()V"); /* #1 */
+    ok = class_set_super(bad_input, "java/lang/RuntimeException") == 0 &&
+         class_add_instance_method(bad_input, "<init>", "()V", test_list_init,
+                                   test_list_init_length);
+
+    class_add_class_ref(exceptions, "java/lang/ArithmeticException");               /* #1 */
+    class_add_class_ref(exceptions, "java/lang/IndexOutOfBoundsException");         /* #2 */
+    class_add_class_ref(exceptions, "BadInput");                                    /* #3 */
+    class_add_external_method_ref(exceptions, "BadInput", "<init>", "()V");          /* #4 */
+    class_add_method_ref(exceptions, "validate", "(I)I");                           /* #5 */
+    class_add_method_ref(exceptions, "guard", "(I)I");                              /* #6 */
+    class_add_class_ref(exceptions, "java/lang/StackOverflowError");                /* #7 */
+    class_add_method_ref(exceptions, "depth", "(I)I");                              /* #8 */
+    class_add_class_ref(exceptions, "java/lang/NullPointerException");              /* #9 */
+    class_add_method_ref(exceptions, "divide", "(II)I");                            /* #10 */
+    class_add_method_ref(exceptions, "element", "([II)I");                          /* #11 */
+    class_add_method_ref(exceptions, "parse", "(I)I");                              /* #12 */
+    class_add_method_ref(exceptions, "overflow", "()I");                            /* #13 */
+    class_add_method_ref(exceptions, "length", "([I)I");                            /* #14 */
+    ok = ok &&
+         (divide = class_add_method(exceptions, "divide", "(II)I", test_exceptions_divide,
+                                    test_exceptions_divide_length)) &&
+         (element = class_add_method(exceptions, "element", "([II)I", test_exceptions_element,
+                                     test_exceptions_element_length)) &&
+         class_add_method(exceptions, "validate", "(I)I", test_exceptions_validate,
+                          test_exceptions_validate_length) &&
+         (guard = class_add_method(exceptions, "guard", "(I)I", test_exceptions_guard,
+                                   test_exceptions_guard_length)) &&
+         (parse = class_add_method(exceptions, "parse", "(I)I", test_exceptions_parse,
+                                   test_exceptions_parse_length)) &&
+         class_add_method(exceptions, "depth", "(I)I", test_exceptions_depth,
+                          test_exceptions_depth_length) &&
+         (overflow = class_add_method(exceptions, "overflow", "()I", test_exceptions_overflow,
+                                      test_exceptions_overflow_length)) &&
+         (length = class_add_method(exceptions, "length", "([I)I", test_exceptions_length,
+                                    test_exceptions_length_length)) &&
+         class_add_method(exceptions, "run", "(I)I", test_exceptions_run,
+                          test_exceptions_run_length);
+
+    /* start_pc, end_pc, handler_pc, catch type */
+    ok = ok &&
+         method_add_exception_handler(divide, 0, 4, 4, 1) == 0 &&
+         method_add_exception_handler(element, 0, 4, 4, 2) == 0 &&
+         method_add_exception_handler(guard, 0, 5, 5, 0) == 0 &&
+         method_add_exception_handler(parse, 0, 7, 7, 3) == 0 &&
+         method_add_exception_handler(overflow, 0, 7, 7, 7) == 0 &&
+         method_add_exception_handler(length, 0, 3, 3, 9) == 0;
+
+    if (!ok) {
+        class_registry_destroy(registry);
+        return NULL;
+    }
+    return registry;
+}
+
+/* Class Labels, and class Strings, which builds, compares and interns
+ * Strings from both classes' constants */
+ClassRegistry* test_strings_registry(void) {
+    ClassRegistry* registry = class_registry_create();
+    Class* labels = class_create("Labels");
+    Class* strings = class_create("Strings");
+    Class* classes[] = {labels, strings};
+    int added = 0, ok;
+    Method* chars = NULL;
+
+    ok = registry && labels && strings;
+    for (; ok && added < 2; added++) {
+        ok = class_registry_add(registry, classes[added]) == 0;
+    }
+    /* Classes the registry did not take are destroyed here */
+    if (!ok) {
+        for (int i = added; i < 2; i++) {
+            class_destroy(classes[i]);
+        }
+        class_registry_destroy(registry);
+        return NULL;
+    }
+
+    class_add_string_constant(labels, "item-7");                                    /* #1 */
+    ok = class_add_method(labels, "seven", "()Ljava/lang/String;", test_labels_seven,
+                          test_labels_seven_length) != NULL;
+
+    class_add_string_constant(strings, "item-");                                    /* #1 */
+    class_add_class_ref(strings, "java/lang/StringBuilder");                        /* #2 */
+    class_add_external_method_ref(strings, "java/lang/StringBuilder", "<init>", "()V"); /* #3 */
+    class_add_external_method_ref(strings, "java/lang/StringBuilder", "append",
+                                  "(Ljava/lang/String;)Ljava/lang/StringBuilder;"); /* #4 */
+    class_add_external_method_ref(strings, "java/lang/StringBuilder", "append",
+                                  "(I)Ljava/lang/StringBuilder;");                  /* #5 */
+    class_add_external_method_ref(strings, "java/lang/StringBuilder", "toString",
+                                  "()Ljava/lang/String;");                          /* #6 */
+    class_add_method_ref(strings, "label", "(I)Ljava/lang/String;");                /* #7 */
+    class_add_string_constant(strings, "item-7");                                   /* #8 */
+    class_add_external_method_ref(strings, "java/lang/String", "length", "()I");    /* #9 */
+    class_add_external_method_ref(strings, "java/lang/String", "charAt", "(I)C");   /* #10 */
+    class_add_external_method_ref(strings, "java/lang/String", "equals",
+                                  "(Ljava/lang/Object;)Z");                         /* #11 */
+    class_add_external_method_ref(strings, "java/lang/String", "intern",
+                                  "()Ljava/lang/String;");                          /* #12 */
+    class_add_external_method_ref(strings, "java/lang/StringBuilder", "append",
+                                  "(C)Ljava/lang/StringBuilder;");                  /* #13 */
+    class_add_external_method_ref(strings, "Labels", "seven", "()Ljava/lang/String;"); /* #14 */
+    class_add_string_constant(strings, "ab");                                       /* #15 */
+    class_add_string_constant(strings, "hello");                                    /* #16 */
+    class_add_external_method_ref(strings, "java/lang/String", "hashCode", "()I");  /* #17 */
+    class_add_method_ref(strings, "chars", "()I");                                  /* #18 */
+    class_add_class_ref(strings, "java/lang/StringIndexOutOfBoundsException");      /* #19 */
+    ok = ok &&
+         class_add_method(strings, "label", "(I)Ljava/lang/String;", test_strings_label,
+                          test_strings_label_length) &&
+         (chars = class_add_method(strings, "chars", "()I", test_strings_chars,
+                                   test_strings_chars_length)) &&
+         class_add_method(strings, "run", "(I)I", test_strings_run, test_strings_run_length) &&
+         method_add_exception_handler(chars, 33, 41, 41, 19) == 0;
+
+    if (!ok) {
+        class_registry_destroy(registry);
+        return NULL;
+    }
+    return registry;
+}
+
+/* Class Switches, whose state and lookup have a dense tableswitch and
+ * lookupswitches that are hashed, searched and made a jump table */
+ClassRegistry* test_switches_registry(void) {
+    ClassRegistry* registry = class_registry_create();
+    Class* cls = class_create("Switches");
+
+    if (!registry || !cls || class_registry_add(registry, cls) != 0) {
+        class_destroy(cls);
+        class_registry_destroy(registry);
+        return NULL;
+    }
+    class_add_method_ref(cls, "state", "()I");     /* #1 */
+    class_add_method_ref(cls, "lookup", "()I");    /* #2 */
+    if (!class_add_method(cls, "state", "()I", test_switch_state, test_switch_state_length) ||
+        !class_add_method(cls, "lookup", "()I", test_switch_lookup,
+                          test_switch_lookup_length) ||
+        !class_add_method(cls, "run", "(I)I", test_switches_run, test_switches_run_length)) {
+        class_registry_destroy(registry);
+        return NULL;
+    }
+    return registry;
+}
+
+/* Classes Base and Derived extends Base, whose methods call Base's
+ * of the same name, and Supers, which makes a Derived */
+ClassRegistry* test_supers_registry(void) {
+    ClassRegistry* registry = class_registry_create();
+    Class* base = class_create("Base");
+    Class* derived = class_create("Derived");
+    Class* supers = class_create("Supers");
+    Class* classes[] = {base, derived, supers};
+    int added = 0, ok;
+
+    ok = registry && base && derived && supers;
+    for (; ok && added < 3; added++) {
+        ok = class_registry_add(registry, classes[added]) == 0;
+    }
+    /* Classes the registry did not take are destroyed here */
+    if (!ok) {
+        for (int i = added; i < 3; i++) {
+            class_destroy(classes[i]);
+        }
+        class_registry_destroy(registry);
+        return NULL;
+    }
+
+    ok = class_add_instance_method(base, "scale", "(I)I", test_base_scale,
+                                   test_base_scale_length) &&
+         class_add_method(base, "twice", "(I)I", test_base_twice, test_base_twice_length);
+
+    class_add_external_method_ref(derived, "Base", "scale", "(I)I");    /* #1 */
+    class_add_external_method_ref(derived, "Base", "twice", "(I)I");    /* #2 */
+    ok = ok && class_set_super(derived, "Base") == 0 &&
+         class_add_instance_method(derived, "scale", "(I)I", test_derived_scale,
+                                   test_derived_scale_length) &&
+         class_add_method(derived, "twice", "(I)I", test_derived_twice,
+                          test_derived_twice_length);
+
+    class_add_class_ref(supers, "Derived");                             /* #1 */
+    class_add_external_method_ref(supers, "Derived", "scale", "(I)I");  /* #2 */
+    ok = ok && class_add_method(supers, "scale", "(I)I", test_supers_scale,
+                                test_supers_scale_length);
+
+    if (!ok) {
+        class_registry_destroy(registry);
+        return NULL;
+    }
+    return registry;
+}
+
+/* Test 22: startup - a program of many small methods, generated. Method
+ * m<i>(n) of class Startup<c>, with k = c * STARTUP_METHODS + i, is
+ *     s = 0; for (j = 0; j < n; j++) s += j ^ k; return s + m<i+1>(n);
+ * and the last method of each class returns s. */
+#define STARTUP_CODE_LENGTH 30
+
+static uint8_t startup_code[STARTUP_CLASSES][STARTUP_METHODS][STARTUP_CODE_LENGTH];
+
+/* Fill in the code of one method and return its length */
+static int startup_method(uint8_t* code, int k, int next) {
+    static const uint8_t loop[] = {
+        OP_ICONST_0,            /* 0: s = 0 */
+        OP_ISTORE_1,
+        OP_ICONST_0,            /* 2: j = 0 */
+        OP_ISTORE_2,
+        OP_ILOAD_2,             /* 4: while (j < n) { */
+        OP_ILOAD_0,
+        OP_IF_ICMPGE, 0, 17,
+        OP_ILOAD_1,             /* 9: s += j ^ k */
+        OP_ILOAD_2,
+        OP_SIPUSH, 0, 0,
+        OP_IXOR,
+        OP_IADD,
+        OP_ISTORE_1,
+        OP_IINC, 2, 1,          /* 17: j++ } */
+        OP_GOTO, 0xff, 0xf0,
+        OP_ILOAD_1              /* 23: s */
+    };
+    int length = (int)sizeof(loop);
+
+    memcpy(code, loop, sizeof(loop));
+    code[12] = (uint8_t)(k >> 8);
+    code[13] = (uint8_t)k;
+    if (next > 0) {
+        code[length++] = OP_ILOAD_0;        /* 24: + m<i+1>(n) */
+        code[length++] = OP_INVOKESTATIC;
+        code[length++] = 0;
+        code[length++] = (uint8_t)next;
+        code[length++] = OP_IADD;
+    }
+    code[length++] = OP_IRETURN;
+    return length;
+}
+
+/* STARTUP_CLASSES classes Startup<c> of STARTUP_METHODS methods m<i>(I)I
+ * each, which call the next one; m0 runs them all */
+ClassRegistry* test_startup_registry(void) {
+    ClassRegistry* registry = class_registry_create();
+    int ok = registry != NULL;
+
+    for (int c = 0; ok && c < STARTUP_CLASSES; c++) {
+        char name[32];
+        Class* cls;
+
+        snprintf(name, sizeof(name), "Startup%d", c);
+        cls = class_create(name);
+        ok = cls && class_registry_add(registry, cls) == 0;
+        if (!ok) {
+            class_destroy(cls);
+            break;
+        }
+        /* Constant #i names m<i> */
+        for (int i = 1; ok && i < STARTUP_METHODS; i++) {
+            snprintf(name, sizeof(name), "m%d", i);
+            ok = class_add_method_ref(cls, name, "(I)I") == i;
+        }
+        for (int i = 0; ok && i < STARTUP_METHODS; i++) {
+            uint8_t* code = startup_code[c][i];
+            int length = startup_method(code, c * STARTUP_METHODS + i,
+                                        i + 1 < STARTUP_METHODS ? i + 1 : 0);
+            snprintf(name, sizeof(name), "m%d", i);
+            ok = class_add_method(cls, name, "(I)I", code, length) != NULL;
+        }
+    }
+    if (!ok) {
+        class_registry_destroy(registry);
+        return NULL;
+    }
+    return registry;
+}
@@ -0,0 +1,183 @@
+#ifndef TEST_PROGRAMS_H
+#define TEST_PROGRAMS_H
+
+#include "jvm.h"
+
+/* Built-in bytecode test programs, shared by main.c and the benchmarks */
+extern uint8_t test_arithmetic[];
+extern uint8_t test_locals[];
+extern uint8_t test_branch[];
+extern uint8_t test_loop[];
+extern uint8_t test_verify_underflow[];
+extern uint8_t test_decode_unsupported[];
+extern uint8_t test_divide_by_zero[];
+extern uint8_t test_fib[];
+extern uint8_t test_ackermann[];
+extern uint8_t test_class_file[];
+extern uint8_t test_node_push[];
+extern uint8_t test_node_sum[];
+extern uint8_t test_node_build[];
+extern uint8_t test_node_churn[];
+extern uint8_t test_sieve[];
+extern uint8_t test_fused[];
+extern uint8_t test_task_control[];
+extern uint8_t test_task_crunch[];
+extern uint8_t test_task_logger[];
+extern uint8_t test_task_step[];
+extern uint8_t test_counter_make[];
+extern uint8_t test_counter_add[];
+extern uint8_t test_garbage_alloc[];
+extern uint8_t test_garbage_run[];
+extern uint8_t test_divide_overflow[];
+extern uint8_t test_switches_run[];
+extern uint8_t test_base_scale[];
+extern uint8_t test_base_twice[];
+extern uint8_t test_derived_scale[];
+extern uint8_t test_derived_twice[];
+extern uint8_t test_supers_scale[];
+extern uint8_t test_switch_state[];
+extern uint8_t test_switch_lookup[];
+extern uint8_t test_numeric_mix[];
+extern uint8_t test_numeric_hash[];
+extern uint8_t test_numeric_root[];
+extern uint8_t test_numeric_roots[];
+extern uint8_t test_numeric_floats[];
+extern uint8_t test_list_init[];
+extern uint8_t test_list_sum[];
+extern uint8_t test_array_list_init[];
+extern uint8_t test_array_list_add[];
+extern uint8_t test_array_list_size[];
+extern uint8_t test_array_list_get[];
+extern uint8_t test_linked_list_cons[];
+extern uint8_t test_linked_list_size[];
+extern uint8_t test_linked_list_get[];
+extern uint8_t test_lists_total[];
+extern uint8_t test_lists_run[];
+extern uint8_t test_exceptions_divide[];
+extern uint8_t test_exceptions_element[];
+extern uint8_t test_exceptions_validate[];
+extern uint8_t test_exceptions_guard[];
+extern uint8_t test_exceptions_parse[];
+extern uint8_t test_exceptions_depth[];
+extern uint8_t test_exceptions_overflow[];
+extern uint8_t test_exceptions_length[];
+extern uint8_t test_exceptions_run[];
+extern uint8_t test_strings_label[];
+extern uint8_t test_strings_chars[];
+extern uint8_t test_strings_run[];
+extern uint8_t test_labels_seven[];
+
+extern const int test_arithmetic_length;
+extern const int test_locals_length;
+extern const int test_branch_length;
+extern const int test_loop_length;
+extern const int test_verify_underflow_length;
+extern const int test_decode_unsupported_length;
+extern const int test_divide_by_zero_length;
+extern const int test_fib_length;
+extern const int test_ackermann_length;
+extern const int test_class_file_length;
+extern const int test_class_file_big_flags;
+extern const int test_node_push_length;
+extern const int test_node_sum_length;
+extern const int test_node_build_length;
+extern const int test_node_churn_length;
+extern const int test_sieve_length;
+extern const int test_fused_length;
+extern const int test_task_control_length;
+extern const int test_task_crunch_length;
+extern const int test_task_logger_length;
+extern const int test_task_step_length;
+extern const int test_counter_make_length;
+extern const int test_counter_add_length;
+extern const int test_garbage_alloc_length;
+extern const int test_garbage_run_length;
+extern const int test_divide_overflow_length;
+extern const int test_switches_run_length;
+extern const int test_base_scale_length;
+extern const int test_base_twice_length;
+extern const int test_derived_scale_length;
+extern const int test_derived_twice_length;
+extern const int test_supers_scale_length;
+extern const int test_switch_state_length;
+extern const int test_switch_lookup_length;
+extern const int test_numeric_mix_length;
+extern const int test_numeric_hash_length;
+extern const int test_numeric_root_length;
+extern const int test_numeric_roots_length;
+extern const int test_numeric_floats_length;
+extern const int test_list_init_length;
+extern const int test_list_sum_length;
+extern const int test_array_list_init_length;
+extern const int test_array_list_add_length;
+extern const int test_array_list_size_length;
+extern const int test_array_list_get_length;
+extern const int test_linked_list_cons_length;
+extern const int test_linked_list_size_length;
+extern const int test_linked_list_get_length;
+extern const int test_lists_total_length;
+extern const int test_lists_run_length;
+extern const int test_exceptions_divide_length;
+extern const int test_exceptions_element_length;
+extern const int test_exceptions_validate_length;
+extern const int test_exceptions_guard_length;
+extern const int test_exceptions_parse_length;
+extern const int test_exceptions_depth_length;
+extern const int test_exceptions_overflow_length;
+extern const int test_exceptions_length_length;
+extern const int test_exceptions_run_length;
+extern const int test_strings_label_length;
+extern const int test_strings_chars_length;
+extern const int test_strings_run_length;
+extern const int test_labels_seven_length;
+
+/* Class with static fib(I)I and ack(II)I built from the programs above */
+Class* test_recursion_class(void);
+
+/* Class Node { Node next; int value; } with push, sum, build, churn and sieve */
+Class* test_node_class(void);
+
+/* Class Tasks with control, crunch and logger, which use aruvi/Scheduler */
+Class* test_tasks_class(void);
+
+/* Class Counter { int count; } whose add works under the counter's monitor */
+Class* test_counter_class(void);
+
+/* Class Garbage whose run(I)I calls its virtual alloc(I)I, which makes
+ * an int[] each time */
+Class* test_garbage_class(void);
+
+/* Class Numeric with long mix and hash, and with float and double built
+ * in, root, roots and floats */
+Class* test_numeric_class(void);
+/* Interface List { size()I; get(I)I } with abstract class AbstractList
+ * and its ArrayList and LinkedList, and Lists with total and run */
+ClassRegistry* test_lists_registry(void);
+
+/* Class BadInput extends RuntimeException, and class Exceptions whose
+ * methods catch what divide, iaload, arraylength, athrow and a runaway
+ * recursion throw; run(I)I adds up their results */
+ClassRegistry* test_exceptions_registry(void);
+
+/* Class Labels, and class Strings whose run(I)I builds labels with a
+ * StringBuilder and checks equals, length, charAt, hashCode, UTF-16 text
+ * and the identity of interned Strings */
+ClassRegistry* test_strings_registry(void);
+
+/* Class Switches with the tableswitch and lookupswitch tests as state()I
+ * and lookup()I, and run(I)I, which returns state() * n + lookup() */
+ClassRegistry* test_switches_registry(void);
+
+/* Class Base with instance scale(I)I and static twice(I)I, class Derived
+ * extends Base whose scale and twice call Base's, and Supers, whose
+ * static scale(I)I calls scale on a new Derived */
+ClassRegistry* test_supers_registry(void);
+
+/* STARTUP_CLASSES classes Startup<c> of STARTUP_METHODS static methods
+ * m<i>(I)I each, a loop and a call of m<i+1>: a program whose start-up
+ * is mostly loading and preparing code */
+#define STARTUP_CLASSES 24
+#define STARTUP_METHODS 48
+ClassRegistry* test_startup_registry(void);
+
+#endif
@@ -0,0 +1,188 @@
+#include "jvm.h"
+
+/*
+ * Tiered execution
+ *
+ * A method starts in TIER_BASELINE: the pre-decoded instructions exactly
+ * as the decoder and verifier left them, which is the cheapest form to
+ * prepare. The interpreter counts the calls of every method and the
+ * backward branches it takes, and once either count reaches the JVM's
+ * threshold for the next tier, tier_promote() moves the method up: to
+ * TIER_OPTIMIZED, where superinstruction fusion has rewritten its common
+ * sequences to run as one dispatch, and with the JIT on to TIER_NATIVE.
+ * Code that runs once, such as a class's setup, is never optimized.
+ *
+ * Fusion rewrites the method in place and only changes the first opcode
+ * of each sequence; every instruction keeps its index. A promotion taken
+ * at a loop back-edge is therefore an on-stack replacement without any
+ * frame translation: the running frame goes on from the loop header in
+ * the optimized code, and so does any activation further down the stack
+ * when it is returned to. Native code is entered at the loop header the
+ * same way, from the interpreter's JIT_ENTER().
+ *
+ * Counts are kept in the Method and thresholds in the JVM. A method reads
+ * the thresholds of the JVM running it when it is first counted and at
+ * each promotion, and then only compares its counts with its own limits.
+ * Green threads are not counted, as the scheduler's workers could race on
+ * the counts and on the rewrite; method_link() optimizes their code before
+ * they start.
+ */
+
+/* Set the default thresholds and clear the promotion counts */
+void tier_init(TierStats* tiers) {
+    tiers->invocations[TIER_BASELINE] = 0;
+    tiers->backedges[TIER_BASELINE] = 0;
+    tiers->invocations[TIER_OPTIMIZED] = OPTIMIZE_INVOKE_THRESHOLD;
+    tiers->backedges[TIER_OPTIMIZED] = OPTIMIZE_BACKEDGE_THRESHOLD;
+    tiers->invocations[TIER_NATIVE] = JIT_INVOKE_THRESHOLD;
+    tiers->backedges[TIER_NATIVE] = JIT_BACKEDGE_THRESHOLD;
+    for (int tier = 0; tier < TIER_COUNT; tier++) {
+        tiers->promotions[tier] = 0;
+        tiers->on_stack[tier] = 0;
+    }
+    tiers->failed = 0;
+    tiers->event_count = 0;
+}
+
+const char* tier_name(int tier) {
+    static const char* const names[TIER_COUNT] = {"baseline", "optimized", "native"};
+    return tier >= 0 && tier < TIER_COUNT ? names[tier] : "?";
+}
+
+/* Bring a method to TIER_OPTIMIZED if it is below. Returns 0, or -1 if it
+ * cannot be prepared. */
+int method_optimize(Method* method) {
+    if (method_prepare(method) != 0) {
+        return -1;
+    }
+    if (method->tier == TIER_BASELINE) {
+#ifdef JVM_FUSION
+        fuse_superinstructions(&method->decoded);
+#endif
+        method->tier = TIER_OPTIMIZED;
+    }
+    return 0;
+}
+
+/* Move a method up one tier. Returns 0 on success, -1 if it can't be. */
+static int promote(Method* method, int tier) {
+    if (tier == TIER_OPTIMIZED) {
+        return method_optimize(method);
+    }
+#ifdef JVM_JIT
+    if (tier == TIER_NATIVE && !method->jit_attempted && jit_compile(method) == 0) {
+        method->tier = TIER_NATIVE;
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+/* Keep the promotion in the event list, dropping the oldest when full */
+static void record_event(TierStats* tiers, const Method* method, int from, int on_stack) {
+    TierEvent* event;
+
+    if (tiers->event_count == TIER_EVENTS) {
+        memmove(&tiers->events[0], &tiers->events[1], sizeof(TierEvent) * (TIER_EVENTS - 1));
+        tiers->event_count--;
+    }
+    event = &tiers->events[tiers->event_count++];
+    if (method->owner) {
+        snprintf(event->method, sizeof(event->method), "%s.%s", method->owner->name, method->name);
+    } else {
+        snprintf(event->method, sizeof(event->method), "%s", method->name);
+    }
+    event->from = from;
+    event->to = method->tier;
+    event->invocations = method->invocations;
+    event->backedges = method->backedges;
+    event->on_stack = on_stack;
+}
+
+/*
+ * Called by the interpreter when one of a method's counts reaches its
+ * limit. Promotes the method through every tier whose threshold it has
+ * reached, then sets its limits to the next tier's thresholds. on_stack
+ * is set when the count was a back-edge, so the promotion replaces the
+ * running frame's code at that loop header.
+ */
+void tier_promote(JVM* jvm, Method* method, int on_stack) {
+    TierStats* tiers = &jvm->tiers;
+
+    while (method->tier < TIER_TOP) {
+        int from = method->tier;
+        int next = from + 1;
+
+        if (method->invocations < tiers->invocations[next] &&
+            method->backedges < tiers->backedges[next]) {
+            break;
+        }
+        if (promote(method, next) != 0) {
+            /* Stay in this tier for good */
+            tiers->failed++;
+            method->invocation_limit = UINT32_MAX;
+            method->backedge_limit = UINT32_MAX;
+            return;
+        }
+        tiers->promotions[next]++;
+        if (on_stack) {
+            tiers->on_stack[next]++;
+        }
+        record_event(tiers, method, from, on_stack);
+    }
+
+    if (method->tier < TIER_TOP) {
+        method->invocation_limit = tiers->invocations[method->tier + 1];
+        method->backedge_limit = tiers->backedges[method->tier + 1];
+    } else {
+        method->invocation_limit = UINT32_MAX;
+        method->backedge_limit = UINT32_MAX;
+    }
+}
+
+/*
+ * Set the calls or backward branches, counted from a method's first call,
+ * that promote it to tier. Methods take up new thresholds at their next
+ * promotion; those not counted yet, at their first call. Returns 0, or -1
+ * if the tier is not built in or a threshold is 0.
+ */
+int jvm_set_tier_threshold(JVM* jvm, int tier, uint32_t invocations, uint32_t backedges) {
+    if (tier <= TIER_BASELINE || tier > TIER_TOP) {
+        printf("Error: no %s tier to set thresholds for\n", tier_name(tier));
+        return -1;
+    }
+    if (invocations == 0 || backedges == 0) {
+        printf("Error: tier thresholds must be at least 1\n");
+        return -1;
+    }
+    jvm->tiers.invocations[tier] = invocations;
+    jvm->tiers.backedges[tier] = backedges;
+    return 0;
+}
+
+/* Print the thresholds, the promotion totals and the latest promotions */
+void jvm_print_tier_stats(const JVM* jvm) {
+    const TierStats* tiers = &jvm->tiers;
+
+    printf("Tiers:");
+    for (int tier = TIER_OPTIMIZED; tier <= TIER_TOP; tier++) {
+        printf("%s %s after %u calls or %u back-edges", tier > TIER_OPTIMIZED ? "," : "",
+               tier_name(tier), tiers->invocations[tier], tiers->backedges[tier]);
+    }
+    printf("\nPromoted:");
+    for (int tier = TIER_OPTIMIZED; tier <= TIER_TOP; tier++) {
+        printf("%s %llu to %s (%llu on the stack)", tier > TIER_OPTIMIZED ? "," : "",
+               (unsigned long long)tiers->promotions[tier], tier_name(tier),
+               (unsigned long long)tiers->on_stack[tier]);
+    }
+    printf(", %llu failed\n", (unsigned long long)tiers->failed);
+    if (tiers->event_count > 0) {
+        printf("  %-20s %-10s %-10s %10s %10s\n", "method", "from", "to", "calls", "back-edges");
+    }
+    for (int i = 0; i < tiers->event_count; i++) {
+        const TierEvent* event = &tiers->events[i];
+        printf("  %-20s %-10s %-10s %10u %10u%s\n", event->method, tier_name(event->from),
+               tier_name(event->to), event->invocations, event->backedges,
+               event->on_stack ? "  on stack" : "");
+    }
+}
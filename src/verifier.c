@@ -0,0 +1,1339 @@
+#include "jvm.h"
+
+/*
+ * Bytecode verifier
+ *
+ * Walks every reachable instruction of a pre-decoded method, tracking the
+ * operand stack depth along each control-flow path. Code is accepted only
+ * if the stack never underflows and every instruction is reached with the
+ * same depth from all of its predecessors. The deepest stack seen and the
+ * highest local index used become the method's max_stack and max_locals,
+ * which is what lets the interpreter size frames exactly and skip the
+ * per-instruction stack checks. The depth on entry to each instruction is
+ * kept in decoded->stack_depth for code that needs to rebuild an
+ * interpreter frame mid-method, such as the JIT's exits.
+ *
+ * A second pass tracks what each local and stack slot holds (int, float,
+ * either half of a long or double, null, an object of the method's
+ * class, an int[] or another reference), so that values are only ever
+ * used as what they are and a long or double is never split. Its
+ * result, the slot types on entry to each instruction, is kept in
+ * decoded->slot_types: it is the stack map the garbage collector uses to
+ * find the references in a frame.
+ *
+ * Only fields of the method's own class, inherited ones included, can be
+ * accessed, and only on an object known to be of that class: a subclass
+ * object has the same fields at the same slots. Calls to other classes
+ * are resolved while verifying and their operands typed the way the
+ * declaring class's code types them, so an object passed as one of that
+ * class's own must be one. Virtual and interface calls, and constructor
+ * calls on objects of other classes, check the receiver's class when
+ * they run.
+ *
+ * An exception handler is a successor of every instruction it covers,
+ * entered with the exception alone on the stack and the locals as they
+ * were on entry to the instruction, so the stack maps hold for frames a
+ * throw unwinds to.
+ */
+
+/* Can ldc (slots 1) or ldc2_w (slots 2) push a constant with this tag? */
+static int loadable_constant(int tag, int slots) {
+#ifdef JVM_FLOAT
+    return slots == 1 ? tag == CONSTANT_Integer || tag == CONSTANT_Float || tag == CONSTANT_String
+                      : tag == CONSTANT_Long || tag == CONSTANT_Double;
+#else
+    return slots == 1 ? tag == CONSTANT_Integer || tag == CONSTANT_String
+                      : tag == CONSTANT_Long;
+#endif
+}
+
+/*
+ * Stack effect of one instruction: slots popped and pushed, two for each
+ * long or double. Constants an instruction refers to are resolved here,
+ * the first time the method is verified. Returns -1 if the instruction
+ * refers to a constant it can't use.
+ */
+static int stack_effect(const Method* method, const Insn* insn, int* pops, int* pushes) {
+    *pops = 0;
+    *pushes = 0;
+    switch (insn->op) {
+        case INSN_ICONST:
+        case INSN_FCONST:
+        case INSN_ACONST_NULL:
+        case INSN_ILOAD:
+        case INSN_FLOAD:
+        case INSN_ALOAD:
+            *pushes = 1;
+            break;
+        case INSN_LCONST:
+        case INSN_DCONST:
+        case INSN_LLOAD:
+        case INSN_DLOAD:
+            *pushes = 2;
+            break;
+        case INSN_LDC:
+        case INSN_LDC2_W:
+            *pushes = insn->op == INSN_LDC ? 1 : 2;
+            if (!method->owner || class_resolve_constant(method->owner, insn->k) != 0 ||
+                !loadable_constant(method->owner->constants[insn->k].tag, *pushes)) {
+                return -1;
+            }
+            break;
+        case INSN_ISTORE:
+        case INSN_FSTORE:
+        case INSN_ASTORE:
+        case INSN_IRETURN:
+        case INSN_FRETURN:
+        case INSN_ARETURN:
+        case INSN_POP:
+        case INSN_IFEQ:
+        case INSN_IFNE:
+        case INSN_IFLT:
+        case INSN_IFGE:
+        case INSN_IFGT:
+        case INSN_IFLE:
+        case INSN_IFNULL:
+        case INSN_IFNONNULL:
+        case INSN_TABLESWITCH:
+        case INSN_LOOKUPSWITCH:
+        case INSN_MONITORENTER:
+        case INSN_MONITOREXIT:
+        case INSN_ATHROW:
+            *pops = 1;
+            break;
+        case INSN_LSTORE:
+        case INSN_DSTORE:
+        case INSN_LRETURN:
+        case INSN_DRETURN:
+        case INSN_POP2:
+            *pops = 2;
+            break;
+        case INSN_DUP:
+            *pops = 1;
+            *pushes = 2;
+            break;
+        case INSN_DUP2:
+            *pops = 2;
+            *pushes = 4;
+            break;
+        case INSN_NEWARRAY:
+        case INSN_ARRAYLENGTH:
+        case INSN_INEG:
+        case INSN_FNEG:
+        case INSN_I2F:
+        case INSN_F2I:
+            *pops = 1;
+            *pushes = 1;
+            break;
+        case INSN_I2L:
+        case INSN_I2D:
+        case INSN_F2L:
+        case INSN_F2D:
+            *pops = 1;
+            *pushes = 2;
+            break;
+        case INSN_L2I:
+        case INSN_L2F:
+        case INSN_D2I:
+        case INSN_D2F:
+            *pops = 2;
+            *pushes = 1;
+            break;
+        case INSN_LNEG:
+        case INSN_DNEG:
+        case INSN_L2D:
+        case INSN_D2L:
+            *pops = 2;
+            *pushes = 2;
+            break;
+        case INSN_IALOAD:
+            *pops = 2;
+            *pushes = 1;
+            break;
+        case INSN_IASTORE:
+            *pops = 3;
+            break;
+        case INSN_NEW:
+            if (!method->owner || class_resolve_constant(method->owner, insn->k) != 0 ||
+                method->owner->constants[insn->k].tag != CONSTANT_Class) {
+                return -1;
+            }
+            *pushes = 1;
+            break;
+        case INSN_GETFIELD:
+        case INSN_PUTFIELD:
+            if (!method->owner || class_resolve_constant(method->owner, insn->k) != 0 ||
+                method->owner->constants[insn->k].tag != CONSTANT_Fieldref) {
+                return -1;
+            }
+            *pops = insn->op == INSN_GETFIELD ? 1 : 2;
+            *pushes = insn->op == INSN_GETFIELD ? 1 : 0;
+            break;
+        case INSN_IADD:
+        case INSN_ISUB:
+        case INSN_IMUL:
+        case INSN_IDIV:
+        case INSN_IREM:
+        case INSN_ISHL:
+        case INSN_ISHR:
+        case INSN_IUSHR:
+        case INSN_IAND:
+        case INSN_IOR:
+        case INSN_IXOR:
+        case INSN_FADD:
+        case INSN_FSUB:
+        case INSN_FMUL:
+        case INSN_FDIV:
+        case INSN_FREM:
+        case INSN_FCMPL:
+        case INSN_FCMPG:
+            *pops = 2;
+            *pushes = 1;
+            break;
+        case INSN_LADD:
+        case INSN_LSUB:
+        case INSN_LMUL:
+        case INSN_LDIV:
+        case INSN_LREM:
+        case INSN_LAND:
+        case INSN_LOR:
+        case INSN_LXOR:
+        case INSN_DADD:
+        case INSN_DSUB:
+        case INSN_DMUL:
+        case INSN_DDIV:
+        case INSN_DREM:
+            *pops = 4;
+            *pushes = 2;
+            break;
+        case INSN_LSHL:         /* long, then an int shift count */
+        case INSN_LSHR:
+        case INSN_LUSHR:
+            *pops = 3;
+            *pushes = 2;
+            break;
+        case INSN_LCMP:
+        case INSN_DCMPL:
+        case INSN_DCMPG:
+            *pops = 4;
+            *pushes = 1;
+            break;
+        case INSN_IF_ICMPEQ:
+        case INSN_IF_ICMPNE:
+        case INSN_IF_ICMPLT:
+        case INSN_IF_ICMPGE:
+        case INSN_IF_ICMPGT:
+        case INSN_IF_ICMPLE:
+        case INSN_IF_ACMPEQ:
+        case INSN_IF_ACMPNE:
+            *pops = 2;
+            break;
+        case INSN_INVOKESTATIC:
+        case INSN_INVOKESPECIAL:
+        case INSN_INVOKEVIRTUAL:
+        case INSN_INVOKEINTERFACE: {
+            const Constant* constant;
+            if (!method->owner || class_resolve_constant(method->owner, insn->k) != 0) {
+                return -1;
+            }
+            constant = &method->owner->constants[insn->k];
+            if (constant->tag != (insn->op == INSN_INVOKEINTERFACE ? CONSTANT_InterfaceMethodref
+                                                                   : CONSTANT_Methodref) ||
+                parse_descriptor(constant->descriptor, pops, pushes) != 0) {
+                return -1;
+            }
+            if (insn->op != INSN_INVOKESTATIC) {
+                (*pops)++;      /* The receiver */
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    return 0;
+}
+
+/* Room successors() needs: two, or one more than the largest switch */
+static int successor_room(const DecodedCode* decoded) {
+    int room = 2;
+    for (int i = 0; i < decoded->switch_count; i++) {
+        if (decoded->switches[i].count + 1 > room) {
+            room = decoded->switches[i].count + 1;
+        }
+    }
+    return room;
+}
+
+/* Instructions control can reach next: returns how many. A switch can
+ * name the same target more than once. */
+static int successors(const DecodedCode* decoded, const Insn* insn, int index, int* next) {
+    switch (insn->op) {
+        case INSN_GOTO:
+            next[0] = insn->k;
+            return 1;
+        case INSN_TABLESWITCH:
+        case INSN_LOOKUPSWITCH: {
+            const SwitchTable* table = &decoded->switches[insn->a];
+            memcpy(next, table->targets, sizeof(int) * (size_t)table->count);
+            next[table->count] = table->default_target;
+            return table->count + 1;
+        }
+        case INSN_IF_ICMPEQ:
+        case INSN_IF_ICMPNE:
+        case INSN_IF_ICMPLT:
+        case INSN_IF_ICMPGE:
+        case INSN_IF_ICMPGT:
+        case INSN_IF_ICMPLE:
+        case INSN_IF_ACMPEQ:
+        case INSN_IF_ACMPNE:
+        case INSN_IFEQ:
+        case INSN_IFNE:
+        case INSN_IFLT:
+        case INSN_IFGE:
+        case INSN_IFGT:
+        case INSN_IFLE:
+        case INSN_IFNULL:
+        case INSN_IFNONNULL:
+            next[0] = insn->k;
+            next[1] = index + 1;
+            return 2;
+        case INSN_IRETURN:
+        case INSN_LRETURN:
+        case INSN_FRETURN:
+        case INSN_DRETURN:
+        case INSN_ARETURN:
+        case INSN_RETURN:
+        case INSN_ATHROW:
+        case INSN_HALT:
+        case INSN_END:
+            return 0;
+        default:
+            next[0] = index + 1;
+            return 1;
+    }
+}
+
+/* Record that instruction target is reached with the given stack depth */
+static int merge_depth(int* depth, int* worklist, int* work_count,
+                       int target, int incoming, const DecodedCode* decoded) {
+    if (depth[target] < 0) {
+        depth[target] = incoming;
+        worklist[(*work_count)++] = target;
+        return 0;
+    }
+    if (depth[target] != incoming) {
+        printf("Verify error: stack depth %d vs %d at pc=%d\n",
+               depth[target], incoming, decoded->bytecode_pc[target]);
+        return -1;
+    }
+    return 0;
+}
+
+/* aruvi/Scheduler.yield()V or sleep(I)V, which only green threads use */
+static int is_scheduler_call(const Constant* constant) {
+    return constant->class_name && strcmp(constant->class_name, SCHEDULER_CLASS) == 0 &&
+           ((strcmp(constant->name, "yield") == 0 && strcmp(constant->descriptor, "()V") == 0) ||
+            (strcmp(constant->name, "sleep") == 0 && strcmp(constant->descriptor, "(I)V") == 0));
+}
+
+/*
+ * Slot type of the field type at *p, which is advanced past it; for a long
+ * or double, the type of its first slot. Returns the slots it takes, or -1
+ * if it is malformed.
+ */
+static int descriptor_type(const Class* owner, const char** p, uint8_t* type) {
+    const char* start = *p;
+    const char* q = start;
+    int slots = 1;
+
+    switch (*q) {
+        case 'B': case 'C': case 'I': case 'S': case 'Z':
+            *type = SLOT_INT;
+            break;
+        case 'F':
+            *type = SLOT_FLOAT;
+            break;
+        case 'J':
+            *type = SLOT_LONG;
+            slots = 2;
+            break;
+        case 'D':
+            *type = SLOT_DOUBLE;
+            slots = 2;
+            break;
+        case 'L':
+            while (*q && *q != ';') {
+                q++;
+            }
+            if (*q != ';') {
+                return -1;
+            }
+            *type = (owner && strlen(owner->name) == (size_t)(q - start - 1) &&
+                     memcmp(owner->name, start + 1, q - start - 1) == 0) ? SLOT_OBJECT : SLOT_REF;
+            break;
+        case '[':
+            while (*q == '[') {
+                q++;
+            }
+            if (*q == 'L') {
+                while (*q && *q != ';') {
+                    q++;
+                }
+            }
+            if (*q == '\0') {
+                return -1;
+            }
+            *type = (q == start + 1 && *q == 'I') ? SLOT_INT_ARRAY : SLOT_REF;
+            break;
+        default:
+            return -1;
+    }
+    *p = q + 1;
+    return slots;
+}
+
+/*
+ * Slot type, in code of owner, of a value typed by the field type at *p in
+ * a member of cls, which is advanced past it. cls's own code takes an
+ * object of its class to be one, so owner can only pass one in (result 0)
+ * if its own objects are cls's, and only gets one back (result 1) as an
+ * object of its own class from itself. Returns the slots it takes.
+ */
+static int member_type(const Class* owner, const Class* cls, const char** p, uint8_t* type,
+                       int result) {
+    int slots = descriptor_type(cls, p, type);
+    if (*type == SLOT_OBJECT && cls != owner) {
+        if (result) {
+            *type = SLOT_REF;
+        } else if (!class_is_subtype(owner, cls)) {
+            *type = SLOT_NULL;
+        }
+    }
+    return slots;
+}
+
+/* java/lang/Object.<init>, or the no-argument constructor of a built-in
+ * class, which do nothing but consume the receiver */
+static int is_object_init(const Class* owner, const Constant* constant) {
+    Class* cls;
+
+    if (!constant->class_name || strcmp(constant->name, "<init>") != 0) {
+        return 0;
+    }
+    if (strcmp(constant->class_name, "java/lang/Object") == 0) {
+        return 1;
+    }
+    cls = class_system(constant->class_name);
+    return cls && strcmp(constant->descriptor, "()V") == 0 &&
+           class_find(owner, constant->class_name) == cls;
+}
+
+/*
+ * Resolve the method that constant index of owner names while verifying,
+ * so a call's operands can be typed by the class declaring it. Other
+ * classes are looked up in owner's registry. Returns NULL after an error.
+ */
+static Method* resolve_method_ref(Class* owner, int index, int pc) {
+    Constant* constant = &owner->constants[index];
+    Class* cls = owner;
+    Method* target;
+
+    if (constant->method) {
+        return constant->method;
+    }
+    if (class_link(owner) != 0) {
+        return NULL;
+    }
+    if (constant->class_name) {
+        cls = class_find(owner, constant->class_name);
+        if (!cls) {
+            printf("Verify error: class %s is not loaded at pc=%d\n", constant->class_name, pc);
+            return NULL;
+        }
+        if (class_link(cls) != 0) {
+            return NULL;
+        }
+    }
+    target = class_resolve_method(cls, constant->name, constant->descriptor);
+    if (!target) {
+        printf("Verify error: no method %s.%s%s at pc=%d\n", cls->name, constant->name,
+               constant->descriptor, pc);
+        return NULL;
+    }
+    constant->method = target;
+    return target;
+}
+
+/* Can a value of type actual be used where expected is required? */
+static int assignable(int actual, int expected) {
+    if (expected == SLOT_TOP) {
+        return 1;
+    }
+    if (expected == SLOT_REF) {
+        return SLOT_IS_REF(actual);
+    }
+    if (SLOT_IS_REF(expected) && actual == SLOT_NULL) {
+        return 1;
+    }
+    return actual == expected;
+}
+
+/* Type of a slot reached with type a on one path and b on another */
+static int merge_type(int a, int b) {
+    if (a == b) {
+        return a;
+    }
+    if (a == SLOT_NULL && SLOT_IS_REF(b)) {
+        return b;
+    }
+    if (b == SLOT_NULL && SLOT_IS_REF(a)) {
+        return a;
+    }
+    if (SLOT_IS_REF(a) && SLOT_IS_REF(b)) {
+        return SLOT_REF;
+    }
+    return SLOT_TOP;
+}
+
+/* A long or double is its type in the first slot and the next type, the
+ * matching _HIGH, in the second */
+#define SLOT_HIGH(t)        ((t) + 1)
+#define SLOT_IS_WIDE(t)     ((t) >= SLOT_LONG && (t) <= SLOT_DOUBLE_HIGH)
+#define SLOT_STARTS_WIDE(t) ((t) == SLOT_LONG || (t) == SLOT_DOUBLE)
+
+/* Value types converted from and to, indexed by op - INSN_I2L */
+static const uint8_t conversions[][2] = {
+    {SLOT_INT, SLOT_LONG}, {SLOT_INT, SLOT_FLOAT}, {SLOT_INT, SLOT_DOUBLE},
+    {SLOT_LONG, SLOT_INT}, {SLOT_LONG, SLOT_FLOAT}, {SLOT_LONG, SLOT_DOUBLE},
+    {SLOT_FLOAT, SLOT_INT}, {SLOT_FLOAT, SLOT_LONG}, {SLOT_FLOAT, SLOT_DOUBLE},
+    {SLOT_DOUBLE, SLOT_INT}, {SLOT_DOUBLE, SLOT_LONG}, {SLOT_DOUBLE, SLOT_FLOAT}
+};
+
+#define POP_TYPE()          (slots[--*sp])
+#define PUSH_TYPE(t)        (slots[(*sp)++] = (uint8_t)(t))
+#define EXPECT(t, want)     do { if (!assignable((t), (want))) goto mismatch; } while (0)
+
+/* Pop or push a value of type t, in two slots if it is a long or double */
+#define POP_VALUE(t)                                            \
+    do {                                                        \
+        b = POP_TYPE();                                         \
+        if (SLOT_STARTS_WIDE(t)) {                              \
+            a = POP_TYPE();                                     \
+            if (a != (t) || b != SLOT_HIGH(t)) goto mismatch;   \
+        } else {                                                \
+            EXPECT(b, (t));                                     \
+        }                                                       \
+    } while (0)
+#define PUSH_VALUE(t)                                           \
+    do {                                                        \
+        PUSH_TYPE(t);                                           \
+        if (SLOT_STARTS_WIDE(t)) PUSH_TYPE(SLOT_HIGH(t));       \
+    } while (0)
+
+/*
+ * Apply one instruction to the slot types in slots, whose operand stack
+ * top is *sp. Field instructions get their field's slot in insn->a.
+ * Returns 0, or -1 if the operands have the wrong types.
+ */
+static int check_types(Method* method, Insn* insn, uint8_t* slots, int* sp,
+                       int return_type, int pc) {
+    Class* owner = method->owner;
+    int a, b, c;
+
+    switch (insn->op) {
+        case INSN_ICONST:
+            PUSH_TYPE(SLOT_INT);
+            break;
+        case INSN_FCONST:
+            PUSH_TYPE(SLOT_FLOAT);
+            break;
+        case INSN_LCONST:
+            PUSH_VALUE(SLOT_LONG);
+            break;
+        case INSN_DCONST:
+            PUSH_VALUE(SLOT_DOUBLE);
+            break;
+        case INSN_LDC:
+            c = owner->constants[insn->k].tag;
+            PUSH_TYPE(c == CONSTANT_String ? SLOT_REF : c == CONSTANT_Float ? SLOT_FLOAT : SLOT_INT);
+            break;
+        case INSN_LDC2_W:
+            PUSH_VALUE(owner->constants[insn->k].tag == CONSTANT_Double ? SLOT_DOUBLE : SLOT_LONG);
+            break;
+        case INSN_ACONST_NULL:
+            PUSH_TYPE(SLOT_NULL);
+            break;
+        case INSN_ILOAD:
+        case INSN_FLOAD:
+            c = insn->op == INSN_ILOAD ? SLOT_INT : SLOT_FLOAT;
+            EXPECT(slots[insn->a], c);
+            PUSH_TYPE(c);
+            break;
+        case INSN_LLOAD:
+        case INSN_DLOAD:
+            c = insn->op == INSN_LLOAD ? SLOT_LONG : SLOT_DOUBLE;
+            if (slots[insn->a] != c || slots[insn->a + 1] != SLOT_HIGH(c)) {
+                goto mismatch;
+            }
+            PUSH_VALUE(c);
+            break;
+        case INSN_ALOAD:
+            EXPECT(slots[insn->a], SLOT_REF);
+            PUSH_TYPE(slots[insn->a]);
+            break;
+        case INSN_ISTORE:
+        case INSN_FSTORE:
+        case INSN_LSTORE:
+        case INSN_DSTORE:
+            c = insn->op == INSN_ISTORE ? SLOT_INT : insn->op == INSN_FSTORE ? SLOT_FLOAT
+              : insn->op == INSN_LSTORE ? SLOT_LONG : SLOT_DOUBLE;
+            POP_VALUE(c);
+            slots[insn->a] = (uint8_t)c;
+            if (SLOT_STARTS_WIDE(c)) {
+                slots[insn->a + 1] = (uint8_t)SLOT_HIGH(c);
+            }
+            break;
+        case INSN_IINC:
+            EXPECT(slots[insn->a], SLOT_INT);
+            break;
+        case INSN_ASTORE:
+            a = POP_TYPE();
+            EXPECT(a, SLOT_REF);
+            slots[insn->a] = (uint8_t)a;
+            break;
+        case INSN_IADD:
+        case INSN_ISUB:
+        case INSN_IMUL:
+        case INSN_IDIV:
+        case INSN_IREM:
+        case INSN_ISHL:
+        case INSN_ISHR:
+        case INSN_IUSHR:
+        case INSN_IAND:
+        case INSN_IOR:
+        case INSN_IXOR:
+            b = POP_TYPE();
+            a = POP_TYPE();
+            EXPECT(a, SLOT_INT);
+            EXPECT(b, SLOT_INT);
+            PUSH_TYPE(SLOT_INT);
+            break;
+        case INSN_INEG:
+            a = POP_TYPE();
+            EXPECT(a, SLOT_INT);
+            PUSH_TYPE(SLOT_INT);
+            break;
+        case INSN_LADD:
+        case INSN_LSUB:
+        case INSN_LMUL:
+        case INSN_LDIV:
+        case INSN_LREM:
+        case INSN_LAND:
+        case INSN_LOR:
+        case INSN_LXOR:
+        case INSN_LCMP:
+        case INSN_FADD:
+        case INSN_FSUB:
+        case INSN_FMUL:
+        case INSN_FDIV:
+        case INSN_FREM:
+        case INSN_FCMPL:
+        case INSN_FCMPG:
+        case INSN_DADD:
+        case INSN_DSUB:
+        case INSN_DMUL:
+        case INSN_DDIV:
+        case INSN_DREM:
+        case INSN_DCMPL:
+        case INSN_DCMPG:
+            c = insn->op <= INSN_LCMP ? SLOT_LONG : insn->op <= INSN_FCMPG ? SLOT_FLOAT : SLOT_DOUBLE;
+            POP_VALUE(c);
+            POP_VALUE(c);
+            if (insn->op == INSN_LCMP || insn->op == INSN_FCMPL || insn->op == INSN_FCMPG ||
+                insn->op == INSN_DCMPL || insn->op == INSN_DCMPG) {
+                PUSH_TYPE(SLOT_INT);
+            } else {
+                PUSH_VALUE(c);
+            }
+            break;
+        case INSN_LNEG:
+        case INSN_FNEG:
+        case INSN_DNEG:
+            c = insn->op == INSN_LNEG ? SLOT_LONG : insn->op == INSN_FNEG ? SLOT_FLOAT : SLOT_DOUBLE;
+            POP_VALUE(c);
+            PUSH_VALUE(c);
+            break;
+        case INSN_LSHL:
+        case INSN_LSHR:
+        case INSN_LUSHR:
+            POP_VALUE(SLOT_INT);
+            POP_VALUE(SLOT_LONG);
+            PUSH_VALUE(SLOT_LONG);
+            break;
+        case INSN_I2L:
+        case INSN_I2F:
+        case INSN_I2D:
+        case INSN_L2I:
+        case INSN_L2F:
+        case INSN_L2D:
+        case INSN_F2I:
+        case INSN_F2L:
+        case INSN_F2D:
+        case INSN_D2I:
+        case INSN_D2L:
+        case INSN_D2F:
+            POP_VALUE(conversions[insn->op - INSN_I2L][0]);
+            PUSH_VALUE(conversions[insn->op - INSN_I2L][1]);
+            break;
+        case INSN_IF_ICMPEQ:
+        case INSN_IF_ICMPNE:
+        case INSN_IF_ICMPLT:
+        case INSN_IF_ICMPGE:
+        case INSN_IF_ICMPGT:
+        case INSN_IF_ICMPLE:
+            b = POP_TYPE();
+            a = POP_TYPE();
+            EXPECT(a, SLOT_INT);
+            EXPECT(b, SLOT_INT);
+            break;
+        case INSN_IFEQ:
+        case INSN_IFNE:
+        case INSN_IFLT:
+        case INSN_IFGE:
+        case INSN_IFGT:
+        case INSN_IFLE:
+            POP_VALUE(SLOT_INT);
+            break;
+        case INSN_IF_ACMPEQ:
+        case INSN_IF_ACMPNE:
+            b = POP_TYPE();
+            a = POP_TYPE();
+            EXPECT(a, SLOT_REF);
+            EXPECT(b, SLOT_REF);
+            break;
+        case INSN_IFNULL:
+        case INSN_IFNONNULL:
+        case INSN_MONITORENTER:
+        case INSN_MONITOREXIT:
+            a = POP_TYPE();
+            EXPECT(a, SLOT_REF);
+            break;
+        case INSN_ATHROW:
+            /* Whether the object is a Throwable is checked when it runs */
+            a = POP_TYPE();
+            if (a == SLOT_INT_ARRAY) {
+                goto mismatch;
+            }
+            EXPECT(a, SLOT_REF);
+            break;
+        case INSN_POP:
+            /* Never half of a long or double */
+            a = POP_TYPE();
+            if (SLOT_IS_WIDE(a)) {
+                goto mismatch;
+            }
+            break;
+        case INSN_POP2:
+        case INSN_DUP2:
+            /* One long or double, or two values that are neither */
+            b = slots[*sp - 1];
+            a = slots[*sp - 2];
+            if ((SLOT_IS_WIDE(a) || SLOT_IS_WIDE(b)) &&
+                !(SLOT_STARTS_WIDE(a) && b == SLOT_HIGH(a))) {
+                goto mismatch;
+            }
+            if (insn->op == INSN_POP2) {
+                *sp -= 2;
+            } else {
+                PUSH_TYPE(a);
+                PUSH_TYPE(b);
+            }
+            break;
+        case INSN_TABLESWITCH:
+        case INSN_LOOKUPSWITCH:
+            a = POP_TYPE();
+            EXPECT(a, SLOT_INT);
+            break;
+        case INSN_DUP:
+            a = slots[*sp - 1];
+            if (SLOT_IS_WIDE(a)) {
+                goto mismatch;
+            }
+            PUSH_TYPE(a);
+            break;
+        case INSN_IRETURN:
+        case INSN_FRETURN:
+        case INSN_LRETURN:
+        case INSN_DRETURN:
+            c = insn->op == INSN_IRETURN ? SLOT_INT : insn->op == INSN_FRETURN ? SLOT_FLOAT
+              : insn->op == INSN_LRETURN ? SLOT_LONG : SLOT_DOUBLE;
+            POP_VALUE(c);
+            if (return_type != c) {
+                goto bad_return;
+            }
+            break;
+        case INSN_ARETURN:
+            a = POP_TYPE();
+            if (!SLOT_IS_REF(return_type)) {
+                goto bad_return;
+            }
+            EXPECT(a, return_type);
+            break;
+        case INSN_INVOKESTATIC:
+        case INSN_INVOKESPECIAL:
+        case INSN_INVOKESPECIAL_CHECKED:
+        case INSN_INVOKEVIRTUAL:
+        case INSN_INVOKEINTERFACE: {
+            const Constant* constant = &owner->constants[insn->k];
+            const char* p = constant->descriptor + 1;
+            int receiver = insn->op != INSN_INVOKESTATIC;
+            int dispatched = insn->op == INSN_INVOKEVIRTUAL || insn->op == INSN_INVOKEINTERFACE;
+            Method* target = NULL;
+            const Class* cls = owner;
+            int args, returns, base, slot;
+            uint8_t type;
+
+            parse_descriptor(constant->descriptor, &args, &returns);
+            if (constant->class_name && strcmp(constant->class_name, SCHEDULER_CLASS) == 0 &&
+                !is_scheduler_call(constant)) {
+                printf("Verify error: no method %s.%s%s at pc=%d\n", SCHEDULER_CLASS,
+                       constant->name, constant->descriptor, pc);
+                return -1;
+            }
+            /* Calls to this class's own methods are resolved when they first
+             * run; the others now, to type the operands by their class */
+            if (dispatched ||
+                (constant->class_name && !is_object_init(owner, constant) && !is_scheduler_call(constant) &&
+                 (owner->registry || insn->op != INSN_INVOKESTATIC))) {
+                target = resolve_method_ref(owner, insn->k, pc);
+                if (!target) {
+                    return -1;
+                }
+                if (((target->access_flags & ACC_STATIC) == 0) != receiver ||
+                    (dispatched && target->name[0] == '<') ||
+                    (!dispatched && (target->access_flags & ACC_ABSTRACT)) ||
+                    (insn->op == INSN_INVOKEINTERFACE &&
+                     !(target->owner->access_flags & ACC_INTERFACE))) {
+                    printf("Verify error: %s %s.%s%s is not allowed at pc=%d\n",
+                           insn_name(insn->op), target->owner->name, target->name,
+                           target->descriptor, pc);
+                    return -1;
+                }
+                cls = target->owner;
+            }
+            base = *sp - args - receiver;
+            slot = base;
+            if (receiver) {
+                if (dispatched || is_object_init(owner, constant)) {
+                    EXPECT(slots[slot], SLOT_REF);
+                } else if (!target) {
+                    EXPECT(slots[slot], SLOT_OBJECT);
+                } else if (insn->op == INSN_INVOKESPECIAL && slots[slot] == SLOT_OBJECT &&
+                           class_is_subtype(owner, cls)) {
+                    /* A superclass method called on an object of this class */
+                } else {
+                    /* The receiver's class is checked when it runs */
+                    EXPECT(slots[slot], SLOT_REF);
+                    insn->op = INSN_INVOKESPECIAL_CHECKED;
+                }
+                slot++;
+            }
+            while (*p != ')') {
+                int n = member_type(owner, cls, &p, &type, 0);
+                EXPECT(slots[slot], type);
+                if (n == 2 && slots[slot + 1] != SLOT_HIGH(type)) {
+                    goto mismatch;
+                }
+                slot += n;
+            }
+            *sp = base;
+            p++;
+            if (*p != 'V') {
+                /* An override may return any object of the declared type */
+                if (dispatched) {
+                    descriptor_type(NULL, &p, &type);
+                } else {
+                    member_type(owner, cls, &p, &type, 1);
+                }
+                PUSH_VALUE(type);
+            }
+            method->decoded.call_sites[insn->a].arg_slots = args + receiver;
+            break;
+        }
+        case INSN_NEW: {
+            Constant* constant = &owner->constants[insn->k];
+            Class* cls = owner;
+            if (strcmp(constant->name, owner->name) != 0) {
+                cls = class_find(owner, constant->name);
+                if (!cls) {
+                    printf("Verify error: new %s: class is not loaded at pc=%d\n",
+                           constant->name, pc);
+                    return -1;
+                }
+            }
+            if (class_link(cls) != 0) {
+                return -1;
+            }
+            if (cls->access_flags & ACC_ABSTRACT) {
+                printf("Verify error: new %s: class is abstract at pc=%d\n", cls->name, pc);
+                return -1;
+            }
+            constant->cls = cls;
+            PUSH_TYPE(cls == owner ? SLOT_OBJECT : SLOT_REF);
+            break;
+        }
+        case INSN_NEWARRAY:
+            if (insn->a != 10) {            /* T_INT */
+                printf("Verify error: newarray type %d is not supported at pc=%d\n", insn->a, pc);
+                return -1;
+            }
+            a = POP_TYPE();
+            EXPECT(a, SLOT_INT);
+            PUSH_TYPE(SLOT_INT_ARRAY);
+            break;
+        case INSN_ARRAYLENGTH:
+            a = POP_TYPE();
+            EXPECT(a, SLOT_INT_ARRAY);
+            PUSH_TYPE(SLOT_INT);
+            break;
+        case INSN_IALOAD:
+            b = POP_TYPE();
+            a = POP_TYPE();
+            EXPECT(a, SLOT_INT_ARRAY);
+            EXPECT(b, SLOT_INT);
+            PUSH_TYPE(SLOT_INT);
+            break;
+        case INSN_IASTORE:
+            c = POP_TYPE();
+            b = POP_TYPE();
+            a = POP_TYPE();
+            EXPECT(a, SLOT_INT_ARRAY);
+            EXPECT(b, SLOT_INT);
+            EXPECT(c, SLOT_INT);
+            break;
+        case INSN_GETFIELD:
+        case INSN_PUTFIELD: {
+            const Constant* constant = &owner->constants[insn->k];
+            const char* p;
+            Field* field;
+            uint8_t type;
+
+            if (constant->class_name) {
+                printf("Verify error: field %s.%s is not in class %s at pc=%d\n",
+                       constant->class_name, constant->name, owner->name, pc);
+                return -1;
+            }
+            field = class_find_field(owner, constant->name, constant->descriptor);
+            if (!field) {
+                printf("Verify error: no field %s %s in class %s at pc=%d\n",
+                       constant->descriptor, constant->name, owner->name, pc);
+                return -1;
+            }
+            p = field->descriptor;
+            member_type(owner, field->owner, &p, &type, insn->op == INSN_GETFIELD);
+            if (insn->op == INSN_PUTFIELD) {
+                a = POP_TYPE();
+                EXPECT(a, type);
+            }
+            b = POP_TYPE();
+            EXPECT(b, SLOT_OBJECT);
+            if (insn->op == INSN_GETFIELD) {
+                PUSH_TYPE(type);
+            }
+            insn->a = (uint16_t)field->slot;
+            break;
+        }
+        default:
+            break;
+    }
+    return 0;
+
+mismatch:
+    printf("Verify error: wrong operand types at pc=%d\n", pc);
+    return -1;
+
+bad_return:
+    printf("Verify error: return does not match %s at pc=%d\n", method->descriptor, pc);
+    return -1;
+}
+
+#undef POP_TYPE
+#undef PUSH_TYPE
+#undef EXPECT
+#undef POP_VALUE
+#undef PUSH_VALUE
+
+/* Merge the first live slot types of a frame into the entry state of
+ * instruction target, and queue target if that changed it */
+static void merge_types(uint8_t* types, int width, char* reached, char* queued, int* worklist,
+                        int* work_count, int target, const uint8_t* frame, int live) {
+    uint8_t* entry = types + (size_t)target * width;
+    int changed = !reached[target];
+
+    for (int slot = 0; slot < live; slot++) {
+        int merged = reached[target] ? merge_type(entry[slot], frame[slot]) : frame[slot];
+        if (merged != entry[slot]) {
+            entry[slot] = (uint8_t)merged;
+            changed = 1;
+        }
+    }
+    reached[target] = 1;
+    if (changed && !queued[target]) {
+        queued[target] = 1;
+        worklist[(*work_count)++] = target;
+    }
+}
+
+/*
+ * Second pass: compute the slot types on entry to every reachable
+ * instruction, iterating to a fixed point since a loop can weaken the
+ * types its header was first reached with. The frame is width slots
+ * wide: the locals, then an operand stack of the given depth.
+ */
+static uint8_t* verify_types(Method* method, const int* depth, int locals, int width) {
+    DecodedCode* decoded = &method->decoded;
+    int count = decoded->count;
+    uint8_t* types = (uint8_t*)calloc((size_t)count * width + 1, 1);
+    uint8_t* current = (uint8_t*)malloc(width + 1);
+    char* reached = (char*)calloc(count, 1);
+    char* queued = (char*)calloc(count, 1);
+    int* worklist = (int*)malloc(sizeof(int) * count);
+    int* next = (int*)malloc(sizeof(int) * successor_room(decoded));
+    int work_count = 0;
+    int return_type = SLOT_INT;     /* Top-level code returns an int */
+    int status = 0;
+
+    if (!types || !current || !reached || !queued || !worklist || !next) {
+        printf("Verify error: out of memory\n");
+        status = -1;
+        goto out;
+    }
+
+    /* Entry: the arguments, after the receiver of an instance method */
+    if (method->descriptor) {
+        const char* p = method->descriptor + 1;
+        int args, returns, slot = 0;
+        uint8_t type;
+
+        parse_descriptor(method->descriptor, &args, &returns);
+        if (method->arg_slots > args) {
+            types[slot++] = SLOT_OBJECT;
+        }
+        while (*p != ')') {
+            int n = descriptor_type(method->owner, &p, &type);
+            types[slot] = type;
+            if (n == 2) {
+                types[slot + 1] = (uint8_t)SLOT_HIGH(type);
+            }
+            slot += n;
+        }
+        p++;
+        return_type = SLOT_TOP;
+        if (*p != 'V') {
+            descriptor_type(method->owner, &p, &type);
+            return_type = type;
+        }
+    }
+    reached[0] = 1;
+    queued[0] = 1;
+    worklist[work_count++] = 0;
+
+    while (work_count > 0) {
+        int index = worklist[--work_count];
+        Insn* insn = &decoded->insns[index];
+        int sp = locals + depth[index];
+        int n;
+
+        queued[index] = 0;
+        memcpy(current, types + (size_t)index * width, width);
+
+        /* A handler gets the locals of any instruction it covers, as none
+         * changes them before it throws, and the exception */
+        for (int i = 0; i < decoded->handler_count; i++) {
+            const DecodedHandler* handler = &decoded->handlers[i];
+            if (index >= handler->start && index < handler->end) {
+                uint8_t top = current[locals];
+                current[locals] = SLOT_REF;
+                merge_types(types, width, reached, queued, worklist, &work_count,
+                            handler->target, current, locals + 1);
+                current[locals] = top;
+            }
+        }
+
+        if (check_types(method, insn, current, &sp, return_type,
+                        decoded->bytecode_pc[index]) != 0) {
+            status = -1;
+            break;
+        }
+
+        n = successors(decoded, insn, index, next);
+        for (int i = 0; i < n; i++) {
+            merge_types(types, width, reached, queued, worklist, &work_count,
+                        next[i], current, locals + depth[next[i]]);
+        }
+    }
+
+out:
+    free(current);
+    free(reached);
+    free(queued);
+    free(worklist);
+    free(next);
+    if (status != 0) {
+        free(types);
+        return NULL;
+    }
+    return types;
+}
+
+/*
+ * Rewrite checked instructions into the forms the interpreter runs. A
+ * reference is a heap offset in an int-sized slot, so once the types are
+ * known the reference loads, stores, compares and returns are their int
+ * twins. Slots don't care what their bits mean either, so the float ones
+ * become int moves too and the double ones long moves. ldc of an int or
+ * float is a constant, and Object's constructor does nothing but consume
+ * the receiver. Calls to the scheduler become the instructions that yield,
+ * and calls to native methods, whose classes are final, run them directly.
+ */
+static void quicken(Method* method, const int* depth) {
+    DecodedCode* decoded = &method->decoded;
+
+    for (int i = 0; i < decoded->count; i++) {
+        Insn* insn = &decoded->insns[i];
+        if (depth[i] < 0) {
+            continue;
+        }
+        switch (insn->op) {
+            case INSN_LDC:
+                if (method->owner->constants[insn->k].tag != CONSTANT_String) {
+                    insn->op = INSN_ICONST;
+                    insn->k = method->owner->constants[insn->k].value;
+                }
+                break;
+            case INSN_ACONST_NULL:
+                insn->op = INSN_ICONST;
+                insn->k = 0;
+                break;
+            case INSN_FCONST: insn->op = INSN_ICONST; break;    /* k is the bits */
+            case INSN_ALOAD:
+            case INSN_FLOAD: insn->op = INSN_ILOAD; break;
+            case INSN_ASTORE:
+            case INSN_FSTORE: insn->op = INSN_ISTORE; break;
+            case INSN_ARETURN:
+            case INSN_FRETURN: insn->op = INSN_IRETURN; break;
+            case INSN_DLOAD: insn->op = INSN_LLOAD; break;
+            case INSN_DSTORE: insn->op = INSN_LSTORE; break;
+            case INSN_DRETURN: insn->op = INSN_LRETURN; break;
+            case INSN_IF_ACMPEQ: insn->op = INSN_IF_ICMPEQ; break;
+            case INSN_IF_ACMPNE: insn->op = INSN_IF_ICMPNE; break;
+            case INSN_INVOKESPECIAL:
+                if (is_object_init(method->owner, &method->owner->constants[insn->k])) {
+                    insn->op = INSN_POP;
+                    break;
+                }
+                /* fall through */
+            case INSN_INVOKESTATIC:
+            case INSN_INVOKESPECIAL_CHECKED:
+            case INSN_INVOKEVIRTUAL:
+            case INSN_INVOKEINTERFACE: {
+                Method* target = method->owner->constants[insn->k].method;
+                if (insn->op == INSN_INVOKESTATIC &&
+                    is_scheduler_call(&method->owner->constants[insn->k])) {
+                    insn->op = strcmp(method->owner->constants[insn->k].name, "yield") == 0
+                               ? INSN_YIELD : INSN_SLEEP;
+                } else if (target && (target->access_flags & ACC_NATIVE)) {
+                    insn->op = INSN_INVOKENATIVE;
+                    decoded->call_sites[insn->a].target = target;
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+/* Resolve the classes the handlers of a method catch, which must be
+ * Throwable. Returns 0, or -1 after an error. */
+static int resolve_handlers(Method* method) {
+    DecodedCode* decoded = &method->decoded;
+    Class* throwable = class_system(THROWABLE_CLASS);
+
+    for (int i = 0; i < decoded->handler_count; i++) {
+        DecodedHandler* handler = &decoded->handlers[i];
+        int pc = decoded->bytecode_pc[handler->target];
+        Constant* constant;
+        Class* cls;
+
+        if (handler->catch_type == 0) {
+            continue;
+        }
+        if (!method->owner || class_resolve_constant(method->owner, handler->catch_type) != 0 ||
+            method->owner->constants[handler->catch_type].tag != CONSTANT_Class) {
+            printf("Verify error: bad catch type #%d at pc=%d\n", handler->catch_type, pc);
+            return -1;
+        }
+        constant = &method->owner->constants[handler->catch_type];
+        cls = class_find(method->owner, constant->name);
+        if (!cls) {
+            printf("Verify error: catch %s: class is not loaded at pc=%d\n", constant->name, pc);
+            return -1;
+        }
+        if (class_link(cls) != 0) {
+            return -1;
+        }
+        if (!throwable || !class_is_subtype(cls, throwable)) {
+            printf("Verify error: catch %s: class is not Throwable at pc=%d\n", cls->name, pc);
+            return -1;
+        }
+        constant->cls = cls;
+        handler->catch_class = cls;
+    }
+    return 0;
+}
+
+/* Verify a decoded method and fill in max_stack and locals_count. Limits
+ * declared by a container file must not be exceeded. */
+int verify_method(Method* method) {
+    DecodedCode* decoded = &method->decoded;
+    int* depth;         /* Stack depth on entry, -1 if not reached yet */
+    int* worklist;
+    int* next;
+    uint8_t* types = NULL;
+    int work_count = 0;
+    int max_stack = 0;
+    int max_locals = method->locals_count;
+    int status = 0;
+
+    /* Nothing would enter and exit the monitor around the call */
+    if (method->access_flags & ACC_SYNCHRONIZED) {
+        printf("Verify error: synchronized method %s is not supported\n", method->name);
+        return -1;
+    }
+
+    depth = (int*)malloc(sizeof(int) * decoded->count);
+    worklist = (int*)malloc(sizeof(int) * decoded->count);
+    next = (int*)malloc(sizeof(int) * successor_room(decoded));
+    if (!depth || !worklist || !next) {
+        printf("Verify error: out of memory\n");
+        free(depth);
+        free(worklist);
+        free(next);
+        return -1;
+    }
+    for (int i = 0; i < decoded->count; i++) {
+        depth[i] = -1;
+    }
+    if (resolve_handlers(method) != 0) {
+        free(depth);
+        free(worklist);
+        free(next);
+        return -1;
+    }
+
+    depth[0] = 0;
+    worklist[work_count++] = 0;
+
+    /* Each instruction enters the worklist once, the first time it is
+     * reached; later arrivals only have to agree on the depth. */
+    while (work_count > 0 && status == 0) {
+        int index = worklist[--work_count];
+        const Insn* insn = &decoded->insns[index];
+        int pc = decoded->bytecode_pc[index];
+        int pops, pushes, after;
+        int n;
+
+        if (stack_effect(method, insn, &pops, &pushes) != 0) {
+            printf("Verify error: bad constant #%d at pc=%d\n", insn->k, pc);
+            status = -1;
+            break;
+        }
+        if (depth[index] < pops) {
+            printf("Verify error: stack underflow at pc=%d\n", pc);
+            status = -1;
+            break;
+        }
+        after = depth[index] - pops + pushes;
+        if (after > max_stack) {
+            max_stack = after;
+        }
+        if (after > STACK_SIZE) {
+            printf("Verify error: operand stack too deep at pc=%d\n", pc);
+            status = -1;
+            break;
+        }
+
+        if ((insn->op == INSN_ILOAD || insn->op == INSN_ISTORE ||
+             insn->op == INSN_FLOAD || insn->op == INSN_FSTORE ||
+             insn->op == INSN_ALOAD || insn->op == INSN_ASTORE ||
+             insn->op == INSN_IINC) && insn->a + 1 > max_locals) {
+            max_locals = insn->a + 1;
+        }
+        if ((insn->op == INSN_LLOAD || insn->op == INSN_LSTORE ||
+             insn->op == INSN_DLOAD || insn->op == INSN_DSTORE) && insn->a + 2 > max_locals) {
+            max_locals = insn->a + 2;
+        }
+
+        /* Return instructions must match the descriptor, if there is one;
+         * falling off the end counts as a void return */
+        if (method->descriptor &&
+            (((insn->op == INSN_IRETURN || insn->op == INSN_FRETURN ||
+               insn->op == INSN_ARETURN) && method->return_slots != 1) ||
+             ((insn->op == INSN_LRETURN || insn->op == INSN_DRETURN) && method->return_slots != 2) ||
+             ((insn->op == INSN_RETURN || insn->op == INSN_END) && method->return_slots != 0))) {
+            printf("Verify error: return does not match %s at pc=%d\n",
+                   method->descriptor, pc);
+            status = -1;
+            break;
+        }
+
+        /* A handler starts with only the exception on the stack */
+        for (int i = 0; i < decoded->handler_count && status == 0; i++) {
+            const DecodedHandler* handler = &decoded->handlers[i];
+            if (index >= handler->start && index < handler->end) {
+                status = merge_depth(depth, worklist, &work_count, handler->target, 1, decoded);
+                if (max_stack < 1) {
+                    max_stack = 1;
+                }
+            }
+        }
+
+        n = successors(decoded, insn, index, next);
+        for (int i = 0; i < n && status == 0; i++) {
+            status = merge_depth(depth, worklist, &work_count, next[i], after, decoded);
+        }
+    }
+
+    if (status == 0 && method->limits_declared &&
+        (max_stack > method->max_stack || max_locals > method->locals_count)) {
+        printf("Verify error: %s needs max_stack %d, max_locals %d; declares %d, %d\n",
+               method->name, max_stack, max_locals, method->max_stack, method->locals_count);
+        status = -1;
+    }
+
+    if (status == 0) {
+        max_locals += TOS_SCRATCH_LOCALS;
+        types = verify_types(method, depth, max_locals, max_locals + max_stack);
+        if (!types) {
+            status = -1;
+        }
+    }
+
+    if (status == 0) {
+        quicken(method, depth);
+        method->max_stack = max_stack;
+        method->locals_count = max_locals;
+        free(decoded->stack_depth);
+        free(decoded->slot_types);
+        decoded->stack_depth = depth;
+        decoded->slot_types = types;
+        decoded->frame_slots = max_locals + max_stack;
+    } else {
+        free(depth);
+    }
+
+    free(worklist);
+    free(next);
+    return status;
+}
@@ -42,6 +42,8 @@ OPCODE_MAP = {
     'if_icmpgt': 0xa3,
     'if_icmple': 0xa4,
     'goto': 0xa7,
+    'tableswitch': 0xaa,
+    'lookupswitch': 0xab,
     'ireturn': 0xac,
     'return': 0xb1,
     'invokestatic': 0xb8,
@@ -51,10 +53,24 @@ OPCODE_MAP = {
 def parse_javap_output(lines):
     """Parse javap -c output and extract bytecode instructions"""
     instructions = []
+    switch = None
     
     for line in lines:
         line = line.strip()
         
+        # Inside a switch: "1: 28" or "default: 43" lines up to "}"
+        if switch is not None:
+            if line.startswith('}'):
+                switch = None
+                continue
+            match = re.match(r'(-?\d+|default)\s*:\s*(\d+)', line)
+            if match:
+                if match.group(1) == 'default':
+                    switch['default'] = int(match.group(2))
+                else:
+                    switch['cases'].append((int(match.group(1)), int(match.group(2))))
+            continue
+        
         # Skip empty lines and non-instruction lines
         if not line or not re.match(r'\s*\d+:', line):
             continue
@@ -71,9 +87,37 @@ def parse_javap_output(lines):
                 'mnemonic': mnemonic,
                 'operand': operand
             })
+            if mnemonic in ['tableswitch', 'lookupswitch']:
+                switch = instructions[-1]
+                switch['cases'] = []
+                switch['default'] = pc
     
     return instructions
 
+def append_int32(bytecode, value):
+    """Append a 32-bit value, big endian"""
+    for shift in (24, 16, 8, 0):
+        bytecode.append((value >> shift) & 0xFF)
+
+def convert_switch(bytecode, instr):
+    """Append a switch's padding and operands. javap prints absolute
+    targets; the operands are offsets from the switch itself."""
+    pc = instr['pc']
+    cases = sorted(instr['cases'])
+    while len(bytecode) % 4 != 0:
+        bytecode.append(0)
+    append_int32(bytecode, instr['default'] - pc)
+    if instr['mnemonic'] == 'tableswitch':
+        append_int32(bytecode, cases[0][0])
+        append_int32(bytecode, cases[-1][0])
+        for key, target in cases:
+            append_int32(bytecode, target - pc)
+    else:
+        append_int32(bytecode, len(cases))
+        for key, target in cases:
+            append_int32(bytecode, key)
+            append_int32(bytecode, target - pc)
+
 def convert_to_bytecode(instructions):
     """Convert parsed instructions to AruviJVM bytecode array"""
     bytecode = []
@@ -86,7 +130,9 @@ def convert_to_bytecode(instructions):
             bytecode.append(OPCODE_MAP[mnemonic])
             
             # Handle operands
-            if operand is not None:
+            if mnemonic in ['tableswitch', 'lookupswitch']:
+                convert_switch(bytecode, instr)
+            elif operand is not None:
                 if mnemonic in ['bipush']:
                     # Single byte operand
                     value = int(operand)